@@ -0,0 +1,23 @@
+// Writes a fixture of the dots_delaunay harness: reads "x y" lines from the
+// stdin, triangulates them with the reference Delaunator and prints the
+// counts of the triangles and of the hull followed by the same points.
+//
+//   dots_delaunay --points grid 1024 | node fixture.mjs > fixtures/delaunay/grid.txt
+//
+// Needs robust-predicates next to reference.js: npm install robust-predicates
+
+import {readFileSync} from 'fs';
+import Delaunator from './reference.js';
+
+const values = readFileSync(0, 'utf8').trim().split(/\s+/).map(Number);
+// Harness works with single precision
+const coords = Float64Array.from(values, Math.fround);
+const points = coords.length >> 1;
+if (points < 3) throw new Error('Expected at least three points.');
+
+const delaunay = new Delaunator(coords);
+const lines = [`triangles ${delaunay.triangles.length / 3} hull ${delaunay.hull.length}`];
+for (let i = 0; i < points; i++) {
+    lines.push(`${values[2 * i]} ${values[2 * i + 1]}`);
+}
+process.stdout.write(lines.join('\n') + '\n');
@@ -0,0 +1,215 @@
+#include "animation.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// FRAME CELLS
+////////////////////////////////////////////////////////////////////////////////
+
+#define HASH_SEED  0xcbf29ce484222325ull
+#define HASH_PRIME 0x100000001b3ull
+
+local i32 frameCellsOffset(const FrameCells* cells, i32 row) {
+  i32 step = cells->params.step;
+  i32 y    = row * step;
+  return cellOffset(cells->params, y);
+}
+
+local Rect frameCellsRect(const FrameCells* cells, i32 row, i32 column) {
+  i32 step = cells->params.step;
+  Rect cell = {
+    .x      = frameCellsOffset(cells, row) + column * step,
+    .y      = row * step,
+    .width  = step,
+    .height = step,
+  };
+  return cell;
+}
+
+// hashCell is FNV-1a over the pixel rows of the cell, eight bytes at a time
+local u64 hashCell(Bitmap bitmap, Rect cell) {
+  i32 xend = min_value(CAST(i32, cell.x + cell.width), bitmap.width);
+  i32 yend = min_value(CAST(i32, cell.y + cell.height), bitmap.height);
+  usize size = CAST(usize, xend - cell.x) * bitmap.channels;
+
+  u64 hash = HASH_SEED;
+  for (i32 y = cell.y; y < yend; y++) {
+    const u8* pixel = bitmapPixel(bitmap, cell.x, y);
+
+    usize i = 0;
+    for (; i + 8 <= size; i += 8) {
+      u64 word;
+      memcpy(&word, pixel + i, 8);
+      hash = (hash ^ word) * HASH_PRIME;
+    }
+    for (; i < size; i++) {
+      hash = (hash ^ pixel[i]) * HASH_PRIME;
+    }
+  }
+  return hash;
+}
+
+void frameCellsInit(FrameCells* cells, i32 width, i32 height, RenderParams params) {
+  i32 step = params.step;
+  *cells = (FrameCells){
+    .width   = width,
+    .height  = height,
+    .columns = (width + step - 1) / step,
+    .rows    = (height + step - 1) / step,
+    .params  = params,
+  };
+
+  usize count = CAST(usize, cells->columns) * cells->rows;
+  cells->hashes = CAST(u64*, calloc(count, sizeof(u64)));
+  cells->colors = CAST(Rgba*, calloc(count, sizeof(Rgba)));
+  cells->dirty  = CAST(u8*, calloc(count, sizeof(u8)));
+}
+
+void frameCellsFree(FrameCells* cells) {
+  free(cells->hashes);
+  free(cells->colors);
+  free(cells->dirty);
+  *cells = (FrameCells){ 0 };
+}
+
+// markNeighbours marks dirty the cells whose figures overlap the area that
+// gets covered around the changed cell, they have to be drawn again on top
+// of the cover.
+local void markNeighbours(FrameCells* cells, i32 row, i32 column) {
+  i32 step   = cells->params.step;
+  f32 radius = cells->params.radius;
+  f32 half   = max_value(radius, step / 2.0f);
+  f32 reach  = radius + half;
+  i32 span   = CAST(i32, ceilf(reach / step));
+
+  Rect cell = frameCellsRect(cells, row, column);
+  f32 cx = cell.x + step / 2.0f;
+  f32 cy = cell.y + step / 2.0f;
+
+  i32 row_first = max_value(0, row - span);
+  i32 row_last  = min_value(cells->rows - 1, row + span);
+  for (i32 r = row_first; r <= row_last; r++) {
+    // Shifted rows are half of the step off, one more column covers them
+    i32 column_first = max_value(0, column - span - 1);
+    i32 column_last  = min_value(cells->columns - 1, column + span + 1);
+
+    for (i32 c = column_first; c <= column_last; c++) {
+      Rect other = frameCellsRect(cells, r, c);
+      f32 dx = fabsf(other.x + step / 2.0f - cx);
+      f32 dy = fabsf(other.y + step / 2.0f - cy);
+      if (other.x < cells->width && dx < reach && dy < reach) {
+        cells->dirty[r * cells->columns + c] |= FRAME_CELL_REDRAW;
+      }
+    }
+  }
+}
+
+i32 frameCellsUpdate(FrameCells* cells, Bitmap frame) {
+  bool first = cells->frames == 0;
+  usize count = CAST(usize, cells->columns) * cells->rows;
+
+  TRACE_BEGIN("frame_cells");
+  memset(cells->dirty, 0, count * sizeof(u8));
+
+  i32 changed = 0;
+  for (i32 row = 0; row < cells->rows; row++) {
+    for (i32 column = 0; column < cells->columns; column++) {
+      Rect cell = frameCellsRect(cells, row, column);
+      if (cell.x >= cells->width) {
+        continue;
+      }
+
+      i32 i = row * cells->columns + column;
+      u64 hash = hashCell(frame, cell);
+      if (!first && hash == cells->hashes[i]) {
+        continue;
+      }
+
+      cells->hashes[i] = hash;
+      cells->colors[i] = cellAverage(frame, cell, cells->params);
+      changed++;
+
+      cells->dirty[i] |= FRAME_CELL_CHANGED | FRAME_CELL_REDRAW;
+      if (!first) {
+        markNeighbours(cells, row, column);
+      }
+    }
+  }
+  TRACE_END();
+
+  cells->changed = changed;
+  cells->frames++;
+  return changed;
+}
+
+// renderCover fills the square the figure of the cell may occupy
+local void renderCover(Renderer render, Rect cell, f32 radius, Rgba background) {
+  f32 half = max_value(radius, cell.width / 2.0f);
+  f32 cx = cell.x + cell.width / 2.0f;
+  f32 cy = cell.y + cell.width / 2.0f;
+
+  Vec2 strip[5] = {
+    { cx - half, cy - half },
+    { cx + half, cy - half },
+    { cx + half, cy + half },
+    { cx - half, cy + half },
+    { cx - half, cy - half },
+  };
+  render.draw_triangle_strip(render.ctx, strip, 5, background);
+}
+
+void renderFrameCells(Renderer render, const FrameCells* cells, Rgba background, bool all) {
+  TRACE_BEGIN("frame_render");
+
+  // Covers go first so the figures of the neighbours are not erased
+  if (background.a != 0) {
+    for (i32 row = 0; row < cells->rows; row++) {
+      for (i32 column = 0; column < cells->columns; column++) {
+        Rect cell = frameCellsRect(cells, row, column);
+        i32 i = row * cells->columns + column;
+        if (cell.x < cells->width && (all || (cells->dirty[i] & FRAME_CELL_CHANGED))) {
+          renderCover(render, cell, cells->params.radius, background);
+        }
+      }
+    }
+  }
+
+  for (i32 row = 0; row < cells->rows; row++) {
+    for (i32 column = 0; column < cells->columns; column++) {
+      Rect cell = frameCellsRect(cells, row, column);
+      i32 i = row * cells->columns + column;
+      if (cell.x < cells->width && (all || cells->dirty[i])) {
+        renderCell(render, cell, cells->colors[i], cells->params);
+      }
+    }
+  }
+
+  TRACE_END();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// ANIMATED SVG
+////////////////////////////////////////////////////////////////////////////////
+
+void svgFrameBegin(FILE* svg, i32 index, i32 count, f32 fps) {
+  if (index == 0) {
+    fprintf(svg, "<g>\n");
+    return;
+  }
+
+  // Discrete animation of the visibility that restarts with the loop
+  fprintf(svg, "<g visibility=\"hidden\">\n");
+  fprintf(svg,
+    "<animate attributeName=\"visibility\" values=\"hidden;visible\" "
+    "keyTimes=\"0;%f\" dur=\"%fs\" calcMode=\"discrete\" repeatCount=\"indefinite\"/>\n",
+    CAST(f32, index) / count, count / fps);
+}
+
+void svgFrameEnd(FILE* svg) {
+  fprintf(svg, "</g>\n");
+}
@@ -0,0 +1,83 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_CELL_REDRAW  1
+#define FRAME_CELL_CHANGED 2
+
+// FrameCells is the grid of the cells of an animation that remembers the
+// previous frame. Every frame the pixels of each cell are hashed and only
+// the cells whose hash changed are averaged and drawn again, so mostly
+// static clips cost a fraction of halftoning every frame from scratch.
+typedef struct {
+  i32 width;
+  i32 height;
+  i32 columns;
+  i32 rows;
+  RenderParams params;
+
+  u64* hashes;
+  Rgba* colors;
+  // Cells to draw for the last frame: changed cells are covered with the
+  // background and drawn again, their neighbours whose figures may reach
+  // into the cover are only drawn again
+  u8* dirty;
+  i32 changed;
+  i32 frames;
+} FrameCells;
+
+void frameCellsInit(FrameCells* cells, i32 width, i32 height, RenderParams params);
+void frameCellsFree(FrameCells* cells);
+
+// frameCellsUpdate hashes cells of the next frame and averages the ones
+// that changed. Returns number of the changed cells, all cells of the first
+// frame are changed.
+i32 frameCellsUpdate(FrameCells* cells, Bitmap frame);
+
+// renderFrameCells renders figures of the dirty cells of the last frame or
+// of all cells. Changed cells are covered with the background first, so the
+// result can be drawn over the previous frame. Zero alpha of the background
+// skips the covers.
+void renderFrameCells(Renderer render, const FrameCells* cells, Rgba background, bool all);
+
+// svgFrameBegin starts the group of the frame index out of count in the
+// animated SVG. Group appears at its time and stays until the loop restarts,
+// so every frame only has to contain the cells that changed.
+void svgFrameBegin(FILE* svg, i32 index, i32 count, f32 fps);
+void svgFrameEnd(FILE* svg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ANIMATION_H
@@ -0,0 +1,8 @@
+#include "types.h"
+
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#ifdef ARENA_STATS
+DynamicArrayStats da_stats = { 0 };
+#endif // ARENA_STATS
@@ -40,6 +40,7 @@
 #define ARENA_BACKEND_LINUX_MMAP 1
 #define ARENA_BACKEND_WIN32_VIRTUALALLOC 2
 #define ARENA_BACKEND_WASM_HEAPBASE 3
+#define ARENA_BACKEND_LINUX_VMEM 4
 
 #ifndef ARENA_BACKEND
 #define ARENA_BACKEND ARENA_BACKEND_LIBC_MALLOC
@@ -51,11 +52,55 @@ struct Region {
     Region *next;
     size_t count;
     size_t capacity;
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+    size_t committed; // Bytes of the reservation backed by memory
+#endif
     uintptr_t data[];
 };
 
+#ifdef ARENA_STATS
+// Statistics collected per arena when ARENA_STATS is defined. With the switch
+// off the counters are not part of the Arena and every ARENA_STAT() compiles
+// to nothing.
+typedef struct {
+    size_t new_region_calls;   // How many times new_region was called
+    size_t regions_recycled;   // Regions taken from the pool instead
+    size_t regions_skipped;    // How many times existing region was skipped
+    size_t oversized_allocs;   // Allocations exceeding REGION_DEFAULT_CAPACITY
+    size_t allocs;             // Calls to arena_alloc
+    size_t reallocs;           // Calls to arena_realloc that had to grow
+    size_t reallocs_in_place;  // Grows that extended the last allocation
+    size_t bytes_requested;    // Sum of sizes passed to arena_alloc
+    size_t bytes_reserved;     // Sum of capacities of all regions
+    size_t bytes_committed;    // Part of bytes_reserved backed by memory
+    size_t bytes_used;         // Bytes handed out since the last reset
+    size_t bytes_copied;       // Bytes moved by arena_realloc
+    size_t alignment_waste;    // Bytes lost rounding allocations up to uintptr_t
+    size_t high_water;         // Maximum of bytes_used ever observed
+} ArenaStats;
+
+#define ARENA_STAT(a, field, n) ((a)->stats.field += (n))
+#else
+#define ARENA_STAT(a, field, n) ((void)0)
+#endif // ARENA_STATS
+
+// RegionPool is a lock-free stack of free regions that can be shared between
+// arenas owned by different threads. Head is a pointer tagged in the upper 16
+// bits with a counter that is bumped on every update, so a pop racing with
+// pop/push of the same region (ABA) fails its compare-and-swap.
+// NOTE: assumes user space addresses fit into 48 bits, which holds for
+// x86_64 and aarch64 unless the process opts into larger address spaces.
+typedef struct {
+    uint64_t head;
+} RegionPool;
+
 typedef struct {
     Region *begin, *end;
+    // Optional pool the arena takes regions from instead of new_region
+    RegionPool *pool;
+#ifdef ARENA_STATS
+    ArenaStats stats;
+#endif // ARENA_STATS
 } Arena;
 
 #define REGION_DEFAULT_CAPACITY (8*1024)
@@ -78,6 +123,24 @@ char *arena_sprintf(Arena *a, const char *format, ...);
 void arena_reset(Arena *a);
 void arena_free(Arena *a);
 
+// Pops a region with at least given capacity from the pool, returns NULL if
+// there is no such region on the top of the pool. Regions that came from the
+// pool must not be unmapped while other threads may still take from it.
+Region *region_pool_take(RegionPool *p, size_t capacity);
+// Pushes the list of regions from first to last (inclusive) to the pool.
+void region_pool_give(RegionPool *p, Region *first, Region *last);
+// Frees all the regions of the pool. Must not race with take or give.
+void region_pool_free(RegionPool *p);
+// Returns all regions of the arena to the pool, arena becomes empty.
+void arena_release(Arena *a, RegionPool *p);
+
+#ifdef ARENA_STATS
+// Returns snapshot of the statistics collected for the arena.
+ArenaStats arena_stats(const Arena *a);
+// Adds counters of src to dst, high_water is the maximum of the two.
+void arena_stats_merge(ArenaStats *dst, ArenaStats src);
+#endif // ARENA_STATS
+
 #define ARENA_DA_INIT_CAP 256
 
 #ifdef __cplusplus
@@ -146,6 +209,102 @@ void free_region(Region *r)
     size_t size_bytes = sizeof(Region) + sizeof(uintptr_t) * r->capacity;
     int ret = munmap(r, size_bytes);
     ARENA_ASSERT(ret == 0);
+    (void)ret;
+}
+
+#elif ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Every region reserves ARENA_VMEM_RESERVE bytes of address space up front and
+// commits them in ARENA_VMEM_COMMIT steps as the region fills up. In practice
+// an arena never needs a second region, so pointers into it stay valid and
+// the last allocation can always grow in place.
+#ifndef ARENA_VMEM_RESERVE
+#define ARENA_VMEM_RESERVE (sizeof(void*) == 8 ? ((size_t)64 << 30) : ((size_t)256 << 20))
+#endif // ARENA_VMEM_RESERVE
+
+// Commit granularity, matches the size of the transparent huge page on x86_64
+// and aarch64 with 4K pages.
+#ifndef ARENA_VMEM_COMMIT
+#define ARENA_VMEM_COMMIT ((size_t)2 << 20)
+#endif // ARENA_VMEM_COMMIT
+
+// High-water mark of the region kept committed when the arena is reset or
+// released, a single large frame does not pin its memory forever.
+#ifndef ARENA_VMEM_RETAIN
+#define ARENA_VMEM_RETAIN ((size_t)64 << 20)
+#endif // ARENA_VMEM_RETAIN
+
+static size_t region_vmem_round(size_t size_bytes)
+{
+    return (size_bytes + ARENA_VMEM_COMMIT - 1)/ARENA_VMEM_COMMIT*ARENA_VMEM_COMMIT;
+}
+
+// Commits the region up to count words, returns number of bytes committed
+static size_t region_commit(Region *r, size_t count)
+{
+    size_t size_bytes = sizeof(Region) + sizeof(uintptr_t)*count;
+    if (size_bytes <= r->committed) return 0;
+
+    size_t committed = region_vmem_round(size_bytes);
+    int ret = mprotect((char*)r + r->committed, committed - r->committed, PROT_READ | PROT_WRITE);
+    ARENA_ASSERT(ret == 0);
+    (void)ret;
+
+    size_t grown = committed - r->committed;
+    r->committed = committed;
+    return grown;
+}
+
+// Returns the pages of the region above ARENA_VMEM_RETAIN to the system and
+// protects them again, returns number of bytes decommitted
+static size_t region_decommit(Region *r)
+{
+    if (r->committed <= ARENA_VMEM_RETAIN) return 0;
+
+    char *start = (char*)r + ARENA_VMEM_RETAIN;
+    size_t size = r->committed - ARENA_VMEM_RETAIN;
+    int ret = madvise(start, size, MADV_DONTNEED);
+    ARENA_ASSERT(ret == 0);
+    ret = mprotect(start, size, PROT_NONE);
+    ARENA_ASSERT(ret == 0);
+    (void)ret;
+
+    r->committed = ARENA_VMEM_RETAIN;
+    return size;
+}
+
+Region *new_region(size_t capacity)
+{
+    size_t size_bytes = sizeof(Region) + sizeof(uintptr_t)*capacity;
+    if (size_bytes < ARENA_VMEM_RESERVE) size_bytes = ARENA_VMEM_RESERVE;
+    size_bytes = region_vmem_round(size_bytes);
+
+    Region *r = (Region*)mmap(NULL, size_bytes, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    ARENA_ASSERT(r != MAP_FAILED);
+#ifdef ARENA_VMEM_HUGEPAGES
+    // Best effort: kernel may have transparent huge pages disabled
+    madvise(r, size_bytes, MADV_HUGEPAGE);
+#endif // ARENA_VMEM_HUGEPAGES
+
+    int ret = mprotect(r, ARENA_VMEM_COMMIT, PROT_READ | PROT_WRITE);
+    ARENA_ASSERT(ret == 0);
+    (void)ret;
+
+    r->next = NULL;
+    r->count = 0;
+    r->capacity = (size_bytes - sizeof(Region))/sizeof(uintptr_t);
+    r->committed = ARENA_VMEM_COMMIT;
+    return r;
+}
+
+void free_region(Region *r)
+{
+    size_t size_bytes = sizeof(Region) + sizeof(uintptr_t)*r->capacity;
+    int ret = munmap(r, size_bytes);
+    ARENA_ASSERT(ret == 0);
+    (void)ret;
 }
 
 #elif ARENA_BACKEND == ARENA_BACKEND_WIN32_VIRTUALALLOC
@@ -200,50 +359,111 @@ void free_region(Region *r)
 #  error "Unknown Arena backend"
 #endif
 
-// TODO: add debug statistic collection mode for arena
-// Should collect things like:
-// - How many times new_region was called
-// - How many times existing region was skipped
-// - How many times allocation exceeded REGION_DEFAULT_CAPACITY
+static Region *arena_new_region(Arena *a, size_t capacity)
+{
+    Region *r = NULL;
+    if (a->pool != NULL) {
+        r = region_pool_take(a->pool, capacity);
+        ARENA_STAT(a, regions_recycled, r != NULL);
+    }
+    if (r == NULL) {
+        r = new_region(capacity);
+        ARENA_STAT(a, new_region_calls, 1);
+    }
+    ARENA_STAT(a, bytes_reserved, r->capacity*sizeof(uintptr_t));
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+    ARENA_STAT(a, bytes_committed, r->committed);
+#else
+    ARENA_STAT(a, bytes_committed, r->capacity*sizeof(uintptr_t));
+#endif
+    return r;
+}
 
 void *arena_alloc(Arena *a, size_t size_bytes)
 {
     size_t size = (size_bytes + sizeof(uintptr_t) - 1)/sizeof(uintptr_t);
 
+    ARENA_STAT(a, allocs, 1);
+    ARENA_STAT(a, bytes_requested, size_bytes);
+    ARENA_STAT(a, alignment_waste, size*sizeof(uintptr_t) - size_bytes);
+    ARENA_STAT(a, oversized_allocs, size > REGION_DEFAULT_CAPACITY);
+
     if (a->end == NULL) {
         ARENA_ASSERT(a->begin == NULL);
         size_t capacity = REGION_DEFAULT_CAPACITY;
         if (capacity < size) capacity = size;
-        a->end = new_region(capacity);
+        a->end = arena_new_region(a, capacity);
         a->begin = a->end;
     }
 
     while (a->end->count + size > a->end->capacity && a->end->next != NULL) {
         a->end = a->end->next;
+        ARENA_STAT(a, regions_skipped, 1);
     }
 
     if (a->end->count + size > a->end->capacity) {
         ARENA_ASSERT(a->end->next == NULL);
         size_t capacity = REGION_DEFAULT_CAPACITY;
         if (capacity < size) capacity = size;
-        a->end->next = new_region(capacity);
-        a->end = a->end->next;
+        Region *r = arena_new_region(a, capacity);
+        // Stale readers of the pool may still look at next of this region
+        __atomic_store_n(&a->end->next, r, __ATOMIC_RELAXED);
+        a->end = r;
     }
 
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+    size_t grown = region_commit(a->end, a->end->count + size);
+    ARENA_STAT(a, bytes_committed, grown);
+    (void)grown;
+#endif
+
     void *result = &a->end->data[a->end->count];
     a->end->count += size;
+
+#ifdef ARENA_STATS
+    a->stats.bytes_used += size*sizeof(uintptr_t);
+    if (a->stats.high_water < a->stats.bytes_used) {
+        a->stats.high_water = a->stats.bytes_used;
+    }
+#endif // ARENA_STATS
+
     return result;
 }
 
 void *arena_realloc(Arena *a, void *oldptr, size_t oldsz, size_t newsz)
 {
     if (newsz <= oldsz) return oldptr;
-    void *newptr = arena_alloc(a, newsz);
-    char *newptr_char = (char*)newptr;
-    char *oldptr_char = (char*)oldptr;
-    for (size_t i = 0; i < oldsz; ++i) {
-        newptr_char[i] = oldptr_char[i];
+    ARENA_STAT(a, reallocs, 1);
+
+    // The last allocation of the current region can grow without copying
+    // as long as the region still has room for it.
+    size_t oldsize = (oldsz + sizeof(uintptr_t) - 1)/sizeof(uintptr_t);
+    size_t newsize = (newsz + sizeof(uintptr_t) - 1)/sizeof(uintptr_t);
+    Region *r = a->end;
+    if (r != NULL && oldptr != NULL && oldsize <= r->count &&
+        (uintptr_t*)oldptr == &r->data[r->count - oldsize] &&
+        r->count - oldsize + newsize <= r->capacity) {
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+        size_t grown = region_commit(r, r->count - oldsize + newsize);
+        ARENA_STAT(a, bytes_committed, grown);
+        (void)grown;
+#endif
+        r->count += newsize - oldsize;
+
+        ARENA_STAT(a, reallocs_in_place, 1);
+        ARENA_STAT(a, bytes_requested, newsz - oldsz);
+#ifdef ARENA_STATS
+        a->stats.bytes_used += (newsize - oldsize)*sizeof(uintptr_t);
+        if (a->stats.high_water < a->stats.bytes_used) {
+            a->stats.high_water = a->stats.bytes_used;
+        }
+#endif // ARENA_STATS
+        return oldptr;
     }
+
+    ARENA_STAT(a, bytes_copied, oldsz);
+    void *newptr = arena_alloc(a, newsz);
+    if (oldsz > 0) memcpy(newptr, oldptr, oldsz);
     return newptr;
 }
 
@@ -283,9 +503,19 @@ void arena_reset(Arena *a)
 {
     for (Region *r = a->begin; r != NULL; r = r->next) {
         r->count = 0;
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+        size_t released = region_decommit(r);
+#ifdef ARENA_STATS
+        a->stats.bytes_committed -= released;
+#endif // ARENA_STATS
+        (void)released;
+#endif
     }
 
     a->end = a->begin;
+#ifdef ARENA_STATS
+    a->stats.bytes_used = 0;
+#endif // ARENA_STATS
 }
 
 void arena_free(Arena *a)
@@ -298,6 +528,129 @@ void arena_free(Arena *a)
     }
     a->begin = NULL;
     a->end = NULL;
+#ifdef ARENA_STATS
+    a->stats.bytes_used = 0;
+    a->stats.bytes_reserved = 0;
+    a->stats.bytes_committed = 0;
+#endif // ARENA_STATS
+}
+
+#define REGION_POOL_PTR_MASK ((((uint64_t)1) << 48) - 1)
+#define REGION_POOL_TAG_ONE  (((uint64_t)1) << 48)
+
+static Region *region_pool_ptr(uint64_t head)
+{
+    return (Region*)(uintptr_t)(head & REGION_POOL_PTR_MASK);
+}
+
+static uint64_t region_pool_head(uint64_t prev, Region *r)
+{
+    ARENA_ASSERT(((uint64_t)(uintptr_t)r & ~REGION_POOL_PTR_MASK) == 0);
+    return ((prev & ~REGION_POOL_PTR_MASK) + REGION_POOL_TAG_ONE) | (uint64_t)(uintptr_t)r;
+}
+
+Region *region_pool_take(RegionPool *p, size_t capacity)
+{
+    uint64_t head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        Region *r = region_pool_ptr(head);
+        if (r == NULL) return NULL;
+        // By the time of this read r may already be popped by another thread
+        // and be in use by its arena. That is safe only because a region
+        // that has ever been in the pool is never unmapped while the pool is
+        // shared: arenas go back with arena_release, arena_free and
+        // region_pool_free run once no thread can take from the pool, and
+        // the header of the region is never decommitted. The value read may
+        // be garbage then, but the tag of the head has changed since and
+        // the exchange below fails.
+        Region *next = __atomic_load_n(&r->next, __ATOMIC_RELAXED);
+        uint64_t desired = region_pool_head(head, next);
+        // Succeeds only if nobody popped or pushed since head was read, so
+        // next is the value r held while it was on the top
+        if (__atomic_compare_exchange_n(&p->head, &head, desired, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (r->capacity < capacity) {
+                region_pool_give(p, r, r);
+                return NULL;
+            }
+            __atomic_store_n(&r->next, NULL, __ATOMIC_RELAXED);
+            r->count = 0;
+            return r;
+        }
+    }
+}
+
+void region_pool_give(RegionPool *p, Region *first, Region *last)
+{
+    uint64_t head = __atomic_load_n(&p->head, __ATOMIC_RELAXED);
+    for (;;) {
+        __atomic_store_n(&last->next, region_pool_ptr(head), __ATOMIC_RELAXED);
+        uint64_t desired = region_pool_head(head, first);
+        if (__atomic_compare_exchange_n(&p->head, &head, desired, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+
+void region_pool_free(RegionPool *p)
+{
+    Region *r = region_pool_ptr(p->head);
+    while (r) {
+        Region *r0 = r;
+        r = r->next;
+        free_region(r0);
+    }
+    p->head = 0;
+}
+
+void arena_release(Arena *a, RegionPool *p)
+{
+    if (a->begin != NULL) {
+        Region *last = a->begin;
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+        region_decommit(last);
+#endif
+        while (last->next != NULL) {
+            last = last->next;
+#if ARENA_BACKEND == ARENA_BACKEND_LINUX_VMEM
+            region_decommit(last);
+#endif
+        }
+        region_pool_give(p, a->begin, last);
+    }
+    a->begin = NULL;
+    a->end = NULL;
+#ifdef ARENA_STATS
+    a->stats.bytes_used = 0;
+    a->stats.bytes_reserved = 0;
+    a->stats.bytes_committed = 0;
+#endif // ARENA_STATS
+}
+
+#ifdef ARENA_STATS
+ArenaStats arena_stats(const Arena *a)
+{
+    return a->stats;
+}
+
+void arena_stats_merge(ArenaStats *dst, ArenaStats src)
+{
+    dst->new_region_calls += src.new_region_calls;
+    dst->regions_recycled += src.regions_recycled;
+    dst->regions_skipped  += src.regions_skipped;
+    dst->oversized_allocs += src.oversized_allocs;
+    dst->allocs           += src.allocs;
+    dst->reallocs         += src.reallocs;
+    dst->reallocs_in_place += src.reallocs_in_place;
+    dst->bytes_requested  += src.bytes_requested;
+    dst->bytes_reserved   += src.bytes_reserved;
+    dst->bytes_committed  += src.bytes_committed;
+    dst->bytes_used       += src.bytes_used;
+    dst->bytes_copied     += src.bytes_copied;
+    dst->alignment_waste  += src.alignment_waste;
+    if (dst->high_water < src.high_water) dst->high_water = src.high_water;
 }
+#endif // ARENA_STATS
 
 #endif // ARENA_IMPLEMENTATION
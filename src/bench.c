@@ -0,0 +1,785 @@
+// Benchmarks of the halftone and triangulation hot paths.
+//
+// Every input is generated from the seed, so two runs with the same seed
+// measure exactly the same work. Results are printed to stdout as JSON:
+//
+//   { "seed": 1, "benchmarks": [ { "name": ..., "params": { ... },
+//     "ops": ..., "repetitions": ..., "min_ns": ..., "median_ns": ...,
+//     "ns_per_op": ... }, ... ] }
+//
+// ns_per_op is the median time of the repetition divided by the number of
+// operations it performs.
+//
+// With --check the correctness checks of the parallel and geometric paths
+// run instead, printed as { "seed": 1, "checks": [ { "name": ...,
+// "errors": [ ... ] }, ... ] }. Exit status is non-zero if any fails.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "halftone.h"
+#include "delaunay.h"
+#include "dither.h"
+#include "quadtree.h"
+#include "raster.h"
+#include "stipple.h"
+#include "workers.h"
+
+// Minimal number of repetitions of every benchmark
+#define BENCH_MIN_REPETITIONS 5
+// Maximal number of repetitions of every benchmark
+#define BENCH_MAX_REPETITIONS 100
+// Benchmark is repeated until it runs at least this long in total
+#define BENCH_MIN_TIME_NS 250000000ull
+// Errors of a single check printed before the rest are only counted
+#define CHECK_MAX_ERRORS 8
+
+////////////////////////////////////////////////////////////////////////////////
+/// RANDOM
+////////////////////////////////////////////////////////////////////////////////
+
+// randomState turns the seed into the nonzero state of nextRandom
+local u64 randomState(u64 seed) {
+  return (seed * 0x9e3779b97f4a7c15ull) | 1;
+}
+
+local i32 randomRange(u64* state, i32 max) {
+  return CAST(i32, nextRandom(state) % CAST(u64, max));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// INPUTS
+////////////////////////////////////////////////////////////////////////////////
+
+// generateImage produces photo-like RGBA image: smooth gradients with some
+// noise and a few flat discs, so cells are neither uniform nor random.
+local u8* generateImage(u64 seed, i32 width, i32 height) {
+  u64 random = randomState(seed);
+
+  u8* pixels = CAST(u8*, malloc(CAST(usize, width) * height * 4));
+  for (i32 y = 0; y < height; y++) {
+    for (i32 x = 0; x < width; x++) {
+      u8* px = pixels + (CAST(usize, y) * width + x) * 4;
+      i32 noise = randomRange(&random, 32);
+      px[0] = CAST(u8, (x * 223 / width + noise) % 256);
+      px[1] = CAST(u8, (y * 223 / height + noise) % 256);
+      px[2] = CAST(u8, ((x + y) * 111 / (width + height) + noise) % 256);
+      px[3] = 255;
+    }
+  }
+
+  for (i32 i = 0; i < 16; i++) {
+    i32 cx = randomRange(&random, width);
+    i32 cy = randomRange(&random, height);
+    i32 r  = 1 + randomRange(&random, min_value(width, height) / 4);
+    u8 value = CAST(u8, randomRange(&random, 256));
+
+    for (i32 y = max_value(0, cy - r); y < min_value(height, cy + r); y++) {
+      for (i32 x = max_value(0, cx - r); x < min_value(width, cx + r); x++) {
+        if ((x - cx) * (x - cx) + (y - cy) * (y - cy) > r * r) continue;
+        u8* px = pixels + (CAST(usize, y) * width + x) * 4;
+        px[0] = value;
+        px[1] = value / 2;
+        px[2] = 255 - value;
+      }
+    }
+  }
+
+  return pixels;
+}
+
+local Vec2* generatePoints(u64 seed, i32 count) {
+  u64 random = randomState(seed);
+  Vec2* points = CAST(Vec2*, malloc(sizeof(Vec2) * count));
+  for (i32 i = 0; i < count; i++) {
+    points[i].x = randomUnit(&random) * 1000.0f;
+    points[i].y = randomUnit(&random) * 1000.0f;
+  }
+  return points;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RENDERERS
+////////////////////////////////////////////////////////////////////////////////
+
+// Counters of the null renderer, they keep the compiler from throwing away
+// the geometry.
+local u64 null_primitives = 0;
+local f64 null_checksum   = 0;
+
+local void nullDrawCircle(void* UNUSED(ctx), Vec2 center, f32 radius, Rgba color) {
+  null_primitives++;
+  null_checksum += center.x + center.y + radius + color.r;
+}
+
+local void nullDrawTriangle(void* UNUSED(ctx), Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  null_primitives++;
+  null_checksum += v1.x + v2.y + v3.x + color.g;
+}
+
+local void nullDrawPoints(void* UNUSED(ctx), const Vec2 *points, i32 pointCount, Rgba color) {
+  null_primitives++;
+  null_checksum += points[pointCount - 1].x + color.b;
+}
+
+local const Renderer null_renderer = {
+  .draw_circle          = nullDrawCircle,
+  .draw_triangle        = nullDrawTriangle,
+  .draw_triangle_fan    = nullDrawPoints,
+  .draw_triangle_strip  = nullDrawPoints,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// HARNESS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef void BenchFn(void* ctx);
+
+typedef struct {
+  u64 seed;
+  const char* filter;
+  bool quick;
+  i32 count;
+} Bench;
+
+local u64 nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return CAST(u64, ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+local i32 compareU64(const void* lhs, const void* rhs) {
+  u64 a = *CAST(const u64*, lhs);
+  u64 b = *CAST(const u64*, rhs);
+  return (a > b) - (a < b);
+}
+
+// benchRun measures fn and prints the result. Params must be the body of the
+// JSON object describing the inputs.
+local void benchRun(Bench* bench, const char* name, const char* params,
+    u64 ops, BenchFn* fn, void* ctx) {
+  if (bench->filter != NULL && strstr(name, bench->filter) == NULL) {
+    return;
+  }
+
+  u64 times[BENCH_MAX_REPETITIONS];
+  i32 repetitions = 0;
+  u64 total       = 0;
+  i32 min_reps    = bench->quick ? 1 : BENCH_MIN_REPETITIONS;
+  u64 min_time    = bench->quick ? 0 : BENCH_MIN_TIME_NS;
+
+  // Warm up caches and the branch predictor
+  fn(ctx);
+
+  while (repetitions < BENCH_MAX_REPETITIONS && (repetitions < min_reps || total < min_time)) {
+    u64 start = nowNs();
+    fn(ctx);
+    times[repetitions] = nowNs() - start;
+    total += times[repetitions];
+    repetitions++;
+  }
+
+  qsort(times, repetitions, sizeof(u64), compareU64);
+  u64 median = times[repetitions / 2];
+
+  printf("%s\n    { \"name\": \"%s\", \"params\": { %s }, \"ops\": %" PRIu64 ", "
+      "\"repetitions\": %d, \"min_ns\": %" PRIu64 ", \"median_ns\": %" PRIu64 ", "
+      "\"ns_per_op\": %.3f }",
+      bench->count > 0 ? "," : "", name, params, ops,
+      repetitions, times[0], median, CAST(f64, median) / max_value(ops, 1));
+  fflush(stdout);
+  bench->count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// BENCHMARKS
+////////////////////////////////////////////////////////////////////////////////
+
+/// averageColor ///////////////////////////////////////////////////////////////
+
+#define AVERAGE_COLOR_CELLS 4096
+
+typedef struct {
+  Bitmap image;
+  Rect cells[AVERAGE_COLOR_CELLS];
+} AverageColorCtx;
+
+local void benchAverageColor(void* ctx) {
+  AverageColorCtx* c = CAST(AverageColorCtx*, ctx);
+  u32 sum = 0;
+  for (i32 i = 0; i < AVERAGE_COLOR_CELLS; i++) {
+    Rgba color = averageColor(c->image, c->cells[i]);
+    sum += color.r + color.g + color.b;
+  }
+  null_checksum += sum;
+}
+
+local void benchAverageColorLinear(void* ctx) {
+  AverageColorCtx* c = CAST(AverageColorCtx*, ctx);
+  u32 sum = 0;
+  for (i32 i = 0; i < AVERAGE_COLOR_CELLS; i++) {
+    Rgba color = averageColorLinear(c->image, c->cells[i]);
+    sum += color.r + color.g + color.b;
+  }
+  null_checksum += sum;
+}
+
+/// renderImage ////////////////////////////////////////////////////////////////
+
+typedef struct {
+  Bitmap image;
+  RenderParams params;
+} RenderImageCtx;
+
+local void benchRenderImage(void* ctx) {
+  RenderImageCtx* c = CAST(RenderImageCtx*, ctx);
+  renderImage(null_renderer, c->image, c->params);
+}
+
+/// displayList ////////////////////////////////////////////////////////////////
+
+typedef struct {
+  RenderImageCtx* render;
+  DisplayList list;
+} DisplayListCtx;
+
+local void benchDisplayListImage(void* ctx) {
+  DisplayListCtx* c = CAST(DisplayListCtx*, ctx);
+  displayListImage(&c->list, c->render->image, c->render->params);
+}
+
+local void benchDisplayListRender(void* ctx) {
+  DisplayListCtx* c = CAST(DisplayListCtx*, ctx);
+  displayListRender(&c->list, null_renderer, 0, c->list.count);
+}
+
+/// cellPyramid ////////////////////////////////////////////////////////////////
+
+// Pyramid is rebuilt in place the way the preview does on every resample
+typedef struct {
+  RenderImageCtx* render;
+  CellStore store;
+  CellPyramid pyramid;
+  Workers* workers;
+} CellPyramidCtx;
+
+local void benchCellPyramid(void* ctx) {
+  CellPyramidCtx* c = CAST(CellPyramidCtx*, ctx);
+  cellPyramidBuild(&c->pyramid, c->render->image, c->render->params.step,
+      c->render->params.shift, c->workers);
+  null_checksum += c->pyramid.count;
+}
+
+local void benchCellPyramidStore(void* ctx) {
+  CellPyramidCtx* c = CAST(CellPyramidCtx*, ctx);
+  cellPyramidBuildStore(&c->pyramid, &c->store, c->render->params.step,
+      c->render->params.shift, c->workers);
+  null_checksum += c->pyramid.count;
+}
+
+/// stipple ////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  Bitmap image;
+  RenderParams params;
+  Workers* workers;
+} StippleCtx;
+
+local void benchStipple(void* ctx) {
+  StippleCtx* c = CAST(StippleCtx*, ctx);
+  StippleLayout layout;
+  stippleLayout(&layout, c->image, c->params, (StippleParams){ .spread = 4 }, c->workers);
+  null_checksum += layout.dots.len;
+  stippleLayoutFree(&layout);
+}
+
+/// SVG ////////////////////////////////////////////////////////////////////////
+
+#define SVG_PRIMITIVES 20000
+
+typedef struct {
+  FILE* file;
+  Vec2 points[SVG_PRIMITIVES][5];
+  Rgba colors[SVG_PRIMITIVES];
+  f32 radii[SVG_PRIMITIVES];
+} SvgCtx;
+
+local void benchSvgCircle(void* ctx) {
+  SvgCtx* c = CAST(SvgCtx*, ctx);
+  for (i32 i = 0; i < SVG_PRIMITIVES; i++) {
+    svgDrawCircle(c->file, c->points[i][0], c->radii[i], c->colors[i]);
+  }
+}
+
+local void benchSvgTriangle(void* ctx) {
+  SvgCtx* c = CAST(SvgCtx*, ctx);
+  for (i32 i = 0; i < SVG_PRIMITIVES; i++) {
+    svgDrawTriangle(c->file, c->points[i][0], c->points[i][1], c->points[i][2], c->colors[i]);
+  }
+}
+
+local void benchSvgTriangleFan(void* ctx) {
+  SvgCtx* c = CAST(SvgCtx*, ctx);
+  for (i32 i = 0; i < SVG_PRIMITIVES; i++) {
+    svgDrawTriangleFan(c->file, c->points[i], 5, c->colors[i]);
+  }
+}
+
+local void benchSvgTriangleStrip(void* ctx) {
+  SvgCtx* c = CAST(SvgCtx*, ctx);
+  for (i32 i = 0; i < SVG_PRIMITIVES; i++) {
+    svgDrawTriangleStrip(c->file, c->points[i], 5, c->colors[i]);
+  }
+}
+
+/// delaunay ///////////////////////////////////////////////////////////////////
+
+typedef struct {
+  Vec2* points;
+  i32 count;
+} DelaunayCtx;
+
+local void benchDelaunay(void* ctx) {
+  DelaunayCtx* c = CAST(DelaunayCtx*, ctx);
+  Triangulation triangulation;
+  delaunay(&triangulation, c->points, c->count);
+  null_checksum += triangulation.count;
+  triangulationFree(&triangulation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// CHECKS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  i32 count;
+  i32 errors;
+  bool first;
+} Check;
+
+local void checkBegin(Check* check, const char* name) {
+  printf("%s\n    { \"name\": \"%s\", \"errors\": [", check->count > 0 ? "," : "", name);
+  check->count++;
+  check->first = true;
+}
+
+local void checkFail(Check* check, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+local void checkFail(Check* check, const char* format, ...) {
+  if (check->errors++ >= CHECK_MAX_ERRORS) {
+    return;
+  }
+  printf("%s\"", check->first ? "" : ", ");
+  check->first = false;
+
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\"");
+}
+
+local void checkEnd(void) {
+  printf("] }");
+  fflush(stdout);
+}
+
+/// ditherGrid /////////////////////////////////////////////////////////////////
+
+#define CHECK_DITHER_COLUMNS 8192
+#define CHECK_DITHER_ROWS    256
+
+// checkDither diffuses the same grid on a single worker and on the pool: the
+// values must be the same bit for bit and the rows must have overlapped,
+// the row below starting while the row above is still running. A single
+// processor may run the rows one after another, overlap is not required.
+local void checkDither(Check* check, u64 seed) {
+  bool concurrent = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+  usize count = CAST(usize, CHECK_DITHER_COLUMNS) * CHECK_DITHER_ROWS;
+  f32* serial   = CAST(f32*, malloc(count * sizeof(f32)));
+  f32* parallel = CAST(f32*, malloc(count * sizeof(f32)));
+  Workers* single = workersCreate(1);
+  Workers* pool   = workersCreate(4);
+
+  for (i32 kernel = 0; kernel < _DITHER_MAX; kernel++) {
+    u64 random = randomState(seed + kernel);
+    for (usize i = 0; i < count; i++) {
+      serial[i] = randomUnit(&random);
+    }
+    memcpy(parallel, serial, count * sizeof(f32));
+
+    i32 overlapped = 0;
+    ditherGrid(serial, CHECK_DITHER_COLUMNS, CHECK_DITHER_ROWS, kernel, 3, single, NULL);
+    ditherGrid(parallel, CHECK_DITHER_COLUMNS, CHECK_DITHER_ROWS, kernel, 3, pool, &overlapped);
+
+    if (memcmp(serial, parallel, count * sizeof(f32)) != 0) {
+      checkFail(check, "kernel %d differs between one and four workers", kernel);
+    }
+    if (concurrent && overlapped == 0) {
+      checkFail(check, "kernel %d ran the rows one after another", kernel);
+    }
+  }
+
+  workersDestroy(pool);
+  workersDestroy(single);
+  free(parallel);
+  free(serial);
+}
+
+/// raster /////////////////////////////////////////////////////////////////////
+
+#define CHECK_RASTER_SIZE 64
+
+// checkInk returns the area covered by the black figures on the white band
+local f32 checkInk(const u8* pixels, i32 x0, i32 y0, i32 x1, i32 y1) {
+  f32 ink = 0.0f;
+  for (i32 y = y0; y < y1; y++) {
+    for (i32 x = x0; x < x1; x++) {
+      ink += (255 - pixels[(y * CHECK_RASTER_SIZE + x) * 4]) / 255.0f;
+    }
+  }
+  return ink;
+}
+
+// checkRaster draws every figure alone and compares the ink with the area of
+// its outline, then draws the square on the half of the pixel: the pixels of
+// the left and right edges are half covered and the inside is covered once.
+local void checkRaster(Check* check) {
+  Raster* raster = rasterCreate(CHECK_RASTER_SIZE, CHECK_RASTER_SIZE, 1.0f,
+      (Rgba){ 255, 255, 255, 255 });
+  Renderer render = rasterRenderer(raster);
+  u8* pixels = CAST(u8*, malloc(CHECK_RASTER_SIZE * CHECK_RASTER_SIZE * 4));
+  Rgba black  = { 0, 0, 0, 255 };
+  Vec2 center = { 32.5f, 32.0f };
+  Workers* workers = workersCreate(1);
+
+  for (i32 figure = 0; figure < _FIGURE_MAX; figure++) {
+    if (figure == FIGURE_CIRCLE) continue;
+
+    Vec2 points[FIGURE_MAX_POINTS];
+    i32 count = figurePoints(figure, center, 14.0f, points);
+    rasterClear(raster);
+    if (figure == FIGURE_TRIANGLE) {
+      render.draw_triangle(render.ctx, points[0], points[1], points[2], black);
+    } else if (figure == FIGURE_STAR) {
+      render.draw_triangle_fan(render.ctx, points, count, black);
+    } else {
+      render.draw_triangle_strip(render.ctx, points, count, black);
+    }
+    rasterRenderBand(raster, workers, 0, pixels, CHECK_RASTER_SIZE * 4);
+
+    // Center of the star fan is not a part of the outline
+    i32 first = figure == FIGURE_STAR ? 1 : 0;
+    f32 expected = 0.0f;
+    for (i32 i = first; i < count; i++) {
+      Vec2 a = points[i];
+      Vec2 b = points[i + 1 < count ? i + 1 : first];
+      expected += a.x * b.y - b.x * a.y;
+    }
+    expected = fabsf(expected) / 2.0f;
+
+    f32 ink = checkInk(pixels, 0, 0, CHECK_RASTER_SIZE, CHECK_RASTER_SIZE);
+    if (fabsf(ink - expected) > 0.5f) {
+      checkFail(check, "%s covers %.2f pixels instead of %.2f",
+          figure_names[figure], ink, expected);
+    }
+  }
+
+  // Corners of the square are on the diagonals, half of its side is
+  // size * cos(45)
+  Vec2 points[FIGURE_MAX_POINTS];
+  i32 count = figurePoints(FIGURE_SQUARE, center, 10.0f * sqrtf(2.0f), points);
+  rasterClear(raster);
+  render.draw_triangle_strip(render.ctx, points, count, black);
+  rasterRenderBand(raster, workers, 0, pixels, CHECK_RASTER_SIZE * 4);
+
+  f32 ink = checkInk(pixels, 0, 0, CHECK_RASTER_SIZE, CHECK_RASTER_SIZE);
+  if (fabsf(ink - 400.0f) > 0.5f) {
+    checkFail(check, "square covers %.2f pixels instead of 400", ink);
+  }
+  f32 left  = checkInk(pixels, 22, 22, 23, 42);
+  f32 right = checkInk(pixels, 42, 22, 43, 42);
+  f32 top   = checkInk(pixels, 23, 22, 42, 23);
+  if (fabsf(left - 10.0f) > 0.2f || fabsf(right - 10.0f) > 0.2f) {
+    checkFail(check, "square edges cover %.2f and %.2f pixels instead of 10", left, right);
+  }
+  if (fabsf(top - 19.0f) > 0.2f) {
+    checkFail(check, "square top covers %.2f pixels instead of 19", top);
+  }
+
+  workersDestroy(workers);
+  free(pixels);
+  rasterDestroy(raster);
+}
+
+/// quadtreeCells //////////////////////////////////////////////////////////////
+
+typedef struct {
+  i32 width;
+  i32 height;
+  // Number of the leaves over every pixel of the image
+  u8* covered;
+} QuadtreeCheck;
+
+local void checkQuadtreeCell(void* ctx, Rect cell, Rgba UNUSED(color)) {
+  QuadtreeCheck* c = CAST(QuadtreeCheck*, ctx);
+  i32 x1 = min_value(CAST(i32, cell.x + cell.width), c->width);
+  i32 y1 = min_value(CAST(i32, cell.y + cell.height), c->height);
+  for (i32 y = CAST(i32, cell.y); y < y1; y++) {
+    for (i32 x = CAST(i32, cell.x); x < x1; x++) {
+      c->covered[y * c->width + x]++;
+    }
+  }
+}
+
+// checkQuadtree splits the images whose blocks have odd sizes on every
+// level, every pixel must be covered by exactly one leaf.
+local void checkQuadtree(Check* check, u64 seed) {
+  static const i32 sizes[][2] = { { 200, 200 }, { 203, 197 } };
+  static const i32 steps[] = { 5, 7, 11 };
+  static const f32 thresholds[] = { 0.0f, 8.0f };
+  Workers* workers = workersCreate(4);
+
+  for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    i32 width  = sizes[i][0];
+    i32 height = sizes[i][1];
+    u8* pixels = generateImage(seed + i, width, height);
+    Bitmap bitmap = bitmapView(pixels, width, height, 0);
+    QuadtreeCheck c = {
+      .width   = width,
+      .height  = height,
+      .covered = CAST(u8*, malloc(CAST(usize, width) * height)),
+    };
+
+    for (u32 j = 0; j < sizeof(steps) / sizeof(steps[0]); j++) {
+      for (u32 k = 0; k < sizeof(thresholds) / sizeof(thresholds[0]); k++) {
+        RenderParams params = { .step = steps[j], .radius = steps[j] / 2.0f };
+        QuadtreeParams quadtree = { .threshold = thresholds[k] };
+        memset(c.covered, 0, CAST(usize, width) * height);
+        quadtreeCells(bitmap, params, quadtree, workers, checkQuadtreeCell, &c);
+
+        i32 wrong = 0;
+        for (i32 p = 0; p < width * height; p++) {
+          wrong += c.covered[p] != 1;
+        }
+        if (wrong > 0) {
+          checkFail(check, "%dx%d step %d threshold %.0f covers %d pixels not once",
+              width, height, steps[j], thresholds[k], wrong);
+        }
+      }
+    }
+
+    free(c.covered);
+    free(pixels);
+  }
+
+  workersDestroy(workers);
+}
+
+// runChecks runs every check and prints the results, returns false if any
+// of them failed
+local bool runChecks(u64 seed) {
+  Check check = { 0 };
+  printf("{\n  \"seed\": %" PRIu64 ",\n  \"checks\": [", seed);
+
+  checkBegin(&check, "dither_wavefront");
+  checkDither(&check, seed);
+  checkEnd();
+
+  checkBegin(&check, "raster_coverage");
+  checkRaster(&check);
+  checkEnd();
+
+  checkBegin(&check, "quadtree_tiling");
+  checkQuadtree(&check, seed);
+  checkEnd();
+
+  printf("\n  ]\n}\n");
+  return check.errors == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// MAIN
+////////////////////////////////////////////////////////////////////////////////
+
+local void usage(const char* program) {
+  fprintf(stderr,
+    "Usage: %s [--seed N] [--filter NAME] [--quick] [--check]\n"
+    "\n"
+    "  --seed N       seed of the generated inputs (default 1)\n"
+    "  --filter NAME  run only benchmarks whose name contains NAME\n"
+    "  --quick        single repetition and the smallest inputs only\n"
+    "  --check        run the correctness checks instead of the benchmarks\n",
+    program);
+}
+
+i32 main(i32 argc, char** argv) {
+  Bench bench = { .seed = 1 };
+  bool check = false;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      bench.quick = true;
+    } else if (strcmp(argv[i], "--check") == 0) {
+      check = true;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      bench.seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      bench.filter = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (check) {
+    return runChecks(bench.seed) ? 0 : 1;
+  }
+
+  static const i32 sizes[] = { 512, 2048, 4096 };
+  static const i32 steps[] = { 5, 11, 51 };
+  static const i32 point_counts[] = { 1000, 10000, 100000, 1000000 };
+
+  i32 nsizes  = bench.quick ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+  i32 npoints = bench.quick ? 1 : sizeof(point_counts) / sizeof(point_counts[0]);
+  char params[256];
+
+  printf("{\n  \"seed\": %" PRIu64 ",\n  \"benchmarks\": [", bench.seed);
+
+  for (i32 s = 0; s < nsizes; s++) {
+    i32 size = sizes[s];
+    u8* pixels   = generateImage(bench.seed, size, size);
+    Bitmap image = bitmapView(pixels, size, size, 0);
+
+    for (u32 t = 0; t < sizeof(steps) / sizeof(steps[0]); t++) {
+      i32 step = steps[t];
+
+      AverageColorCtx* average = CAST(AverageColorCtx*, malloc(sizeof(AverageColorCtx)));
+      u64 random = randomState(bench.seed + step);
+      average->image = image;
+      for (i32 i = 0; i < AVERAGE_COLOR_CELLS; i++) {
+        average->cells[i] = (Rect){
+          .x      = randomRange(&random, size),
+          .y      = randomRange(&random, size),
+          .width  = step,
+          .height = step,
+        };
+      }
+      snprintf(params, sizeof(params), "\"size\": %d, \"step\": %d", size, step);
+      benchRun(&bench, "average_color", params, AVERAGE_COLOR_CELLS, benchAverageColor, average);
+      benchRun(&bench, "average_color_linear", params, AVERAGE_COLOR_CELLS,
+          benchAverageColorLinear, average);
+      free(average);
+
+      for (i32 figure = 0; figure < _FIGURE_MAX; figure++) {
+        RenderImageCtx render = {
+          .image  = image,
+          .params = {
+            .figure   = figure,
+            .step     = step,
+            .radius   = step / 2.0f,
+            .shift    = true,
+            .size_lum = true,
+          },
+        };
+        u64 cells = CAST(u64, (size + step - 1) / step) * ((size + step - 1) / step);
+
+        snprintf(params, sizeof(params), "\"size\": %d, \"step\": %d, \"figure\": \"%s\"",
+            size, step, figure_names[figure]);
+        benchRun(&bench, "render_image", params, cells, benchRenderImage, &render);
+
+        // Sampling once and drawing from the list splits render_image in two
+        DisplayListCtx list = { .render = &render };
+        benchRun(&bench, "display_list_image", params, cells, benchDisplayListImage, &list);
+        benchRun(&bench, "display_list_render", params, cells, benchDisplayListRender, &list);
+        displayListFree(&list.list);
+
+        if (figure == FIGURE_CIRCLE) {
+          snprintf(params, sizeof(params), "\"size\": %d, \"step\": %d", size, step);
+          CellPyramidCtx pyramid = { .render = &render, .workers = workersCreate(0) };
+          if (!cellStoreBuild(&pyramid.store, image)) {
+            return 1;
+          }
+          benchRun(&bench, "cell_pyramid", params, cells, benchCellPyramid, &pyramid);
+          benchRun(&bench, "cell_pyramid_store", params, cells, benchCellPyramidStore, &pyramid);
+          cellStoreFree(&pyramid.store);
+          cellPyramidFree(&pyramid.pyramid);
+          workersDestroy(pyramid.workers);
+        }
+      }
+    }
+
+    free(pixels);
+  }
+
+  {
+    // Generated image has mostly mid tones, step 3 lays out about a million
+    // dots over 4096 x 4096 pixels
+    i32 size = bench.quick ? 1024 : 4096;
+    u8* pixels = generateImage(bench.seed, size, size);
+    StippleCtx ctx = {
+      .image   = bitmapView(pixels, size, size, 0),
+      .params  = { .figure = FIGURE_CIRCLE, .step = 3, .radius = 1.5f },
+      .workers = workersCreate(0),
+    };
+
+    StippleLayout layout;
+    stippleLayout(&layout, ctx.image, ctx.params, (StippleParams){ .spread = 4 }, ctx.workers);
+    snprintf(params, sizeof(params), "\"size\": %d, \"step\": 3, \"spread\": 4, \"dots\": %d",
+        size, layout.dots.len);
+    benchRun(&bench, "stipple_layout", params, layout.dots.len, benchStipple, &ctx);
+    stippleLayoutFree(&layout);
+
+    workersDestroy(ctx.workers);
+    free(pixels);
+  }
+
+  {
+    SvgCtx* ctx = CAST(SvgCtx*, malloc(sizeof(SvgCtx)));
+    u64 random = randomState(bench.seed);
+    for (i32 i = 0; i < SVG_PRIMITIVES; i++) {
+      for (i32 j = 0; j < 5; j++) {
+        ctx->points[i][j].x = randomUnit(&random) * 4096.0f;
+        ctx->points[i][j].y = randomUnit(&random) * 4096.0f;
+      }
+      ctx->radii[i]  = randomUnit(&random) * 25.0f;
+      ctx->colors[i] = (Rgba){ randomRange(&random, 256), randomRange(&random, 256), randomRange(&random, 256), 255 };
+    }
+
+    ctx->file = fopen("/dev/null", "w");
+    if (ctx->file == NULL) {
+      perror("/dev/null");
+      return 1;
+    }
+    snprintf(params, sizeof(params), "\"primitives\": %d", SVG_PRIMITIVES);
+    benchRun(&bench, "svg_draw_circle", params, SVG_PRIMITIVES, benchSvgCircle, ctx);
+    benchRun(&bench, "svg_draw_triangle", params, SVG_PRIMITIVES, benchSvgTriangle, ctx);
+    benchRun(&bench, "svg_draw_triangle_fan", params, SVG_PRIMITIVES, benchSvgTriangleFan, ctx);
+    benchRun(&bench, "svg_draw_triangle_strip", params, SVG_PRIMITIVES, benchSvgTriangleStrip, ctx);
+    fclose(ctx->file);
+    free(ctx);
+  }
+
+  for (i32 i = 0; i < npoints; i++) {
+    DelaunayCtx ctx = {
+      .points = generatePoints(bench.seed, point_counts[i]),
+      .count  = point_counts[i],
+    };
+
+    snprintf(params, sizeof(params), "\"points\": %d, \"distribution\": \"uniform\"", ctx.count);
+    benchRun(&bench, "delaunay", params, ctx.count, benchDelaunay, &ctx);
+
+    free(ctx.points);
+  }
+
+  printf("\n  ],\n  \"checksum\": %.0f,\n  \"primitives\": %" PRIu64 "\n}\n",
+      null_checksum, null_primitives);
+
+  return 0;
+}
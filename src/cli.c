@@ -0,0 +1,1207 @@
+#include "cli.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <signal.h>
+
+#include "animation.h"
+#include "cmyk.h"
+#include "gif.h"
+#include "raster.h"
+#include "strip.h"
+#include "trace.h"
+#include "watch.h"
+
+// Paper of the raster outputs
+local const Rgba white = { 255, 255, 255, 255 };
+
+
+local const char* dither_names[_DITHER_MAX] = {
+  [DITHER_FLOYD_STEINBERG] = "floyd-steinberg",
+  [DITHER_ATKINSON]        = "atkinson",
+  [DITHER_JARVIS]          = "jarvis",
+};
+
+void cliUsage(const char* program, bool window) {
+  if (window) {
+    fprintf(stderr, "Usage: %s [OPTIONS]\n       ", program);
+  } else {
+    fprintf(stderr, "Usage: ");
+  }
+  fprintf(stderr,
+    "%s --strips INPUT --output OUTPUT [OPTIONS]\n"
+    "       %s --anim INPUT --output OUTPUT [OPTIONS]\n"
+    "       %s --stream [--output OUTPUT] [OPTIONS] < INPUT.y4m\n"
+    "       %s --sweep INPUT --output OUTPUT [OPTIONS]\n"
+    "       %s --watch DIR --output DIR [OPTIONS]\n"
+    "\n", program, program, program, program, program);
+  if (window) {
+    fprintf(stderr, "Without arguments opens the window to drop the images to.\n\n");
+  }
+  fprintf(stderr,
+    "Modes:\n"
+    "  --strips INPUT     stream the image in strips of one cell row straight\n"
+    "                     to the output, INPUT is binary PPM/PGM or QOI, - is stdin\n"
+    "  --anim INPUT       halftone every frame of the animated GIF, only the cells\n"
+    "                     that changed since the previous frame are processed,\n"
+    "                     OUTPUT with %%d or %%04d is a sequence of the frames,\n"
+    "                     anything else is animated SVG\n"
+    "  --stream           halftone y4m video from stdin frame by frame, OUTPUT is\n"
+    "                     stdout unless given\n"
+    "  --sweep INPUT      contact sheet of the image halftoned with every\n"
+    "                     combination of the swept values below\n"
+    "  --watch DIR        halftone every PPM/PGM or QOI image written or moved to\n"
+    "                     DIR into the output directory until interrupted, the\n"
+    "                     options of NAME.ppm are followed by the ones listed in\n"
+    "                     NAME.dots next to it, which must be written first\n"
+    "\n"
+    "Options:\n"
+    "  --output FILE      output file, - is stdout, .png and .qoi files are\n"
+    "                     rasterized, anything else is SVG, --strips may have\n"
+    "                     several outputs sharing a single pass over the image\n"
+    "  --dpi N            resolution of the raster output (default 300)\n"
+    "  --print-width MM   physical width of the raster output\n"
+    "  --fps N            frame rate of the animated SVG (default 10)\n"
+    "  --format NAME      frames of the stream mode: y4m (default) or rgba\n"
+    "  --step N           size of the cell in pixels (default 51)\n"
+    "  --radius N         radius of the figure (default 25)\n"
+    "  --figure NAME      circle, square, triangle, star or rhombus\n"
+    "  --shift            shift every other row by half of the cell\n"
+    "  --bw               black and white\n"
+    "  --lum              scale figures by luminance\n"
+    "  --linear           average colors and take luminance in linear light\n"
+    "  --palette LIST     paint figures with the nearest of the comma separated\n"
+    "                     hex colors, e.g. #00ffff,#ff00ff,#ffff00,#000000\n"
+    "  --dither NAME      pick sizes of the figures by the error diffusion with\n"
+    "                     floyd-steinberg, atkinson or jarvis, only with --strips\n"
+    "  --levels N         number of the figure sizes including none (default 2)\n"
+    "  --dither-pixels    diffuse the error between the pixels, not the cells\n"
+    "  --adaptive N       split cells whose colors deviate by more than N, only\n"
+    "                     with --strips\n"
+    "  --stipple N        place dots by blue noise, the spacing growing from the\n"
+    "                     step in black up to N steps in light, only with --strips\n"
+    "  --cmyk             separate into cyan, magenta, yellow and black screens\n"
+    "                     at 15, 75, 0 and 45 degrees, only with --strips to SVG\n"
+    "  --inks N           cluster colors of the cells into N inks, only with\n"
+    "                     --strips reading a file\n"
+    "  --steps LIST       comma separated steps of the sweep\n"
+    "  --radii LIST       radii of the sweep as parts of the step, e.g. 0.3,0.5\n"
+    "  --figures LIST     comma separated figures of the sweep\n"
+    "  --sweep-shift      sweep both with and without --shift\n"
+    "  --sweep-bw         sweep both in colors and black and white\n"
+    "  --tile N           width of every tile of the raster sheet (default 512)\n"
+    "  --extension EXT    extension of the files written by --watch: svg\n"
+    "                     (default), png or qoi\n"
+    "  --compact          keep only the average colors of 5x5 pixel cells of the\n"
+    "                     dropped image instead of its pixels, for huge images\n"
+    "  --trace FILE       write Chrome trace of the hot paths on exit, requires\n"
+    "                     build with TRACE\n");
+}
+
+// parseNumbers parses the comma separated list of positive numbers, returns
+// their count or -1 if the list is invalid
+local i32 parseNumbers(const char* list, f32* values, i32 max) {
+  i32 count = 0;
+  const char* c = list;
+  while (*c != '\0') {
+    char* end;
+    f32 value = strtof(c, &end);
+    if (end == c || value <= 0 || (*end != ',' && *end != '\0') || count == max) {
+      fprintf(stderr, "Invalid list of at most %d positive numbers: %s\n", max, list);
+      return -1;
+    }
+    values[count++] = value;
+    c = *end == ',' ? end + 1 : end;
+  }
+  return count;
+}
+
+// parseFigures parses the comma separated list of the figure names
+local bool parseFigures(const char* list, SweepParams* sweep) {
+  sweep->figure_count = 0;
+  const char* c = list;
+  while (*c != '\0') {
+    usize length = strcspn(c, ",");
+    i32 figure = 0;
+    while (figure < _FIGURE_MAX && (strlen(figure_names[figure]) != length
+        || strncmp(figure_names[figure], c, length) != 0)) figure++;
+    if (figure == _FIGURE_MAX || sweep->figure_count == _FIGURE_MAX) {
+      fprintf(stderr, "Invalid list of figures: %s\n", list);
+      return false;
+    }
+    sweep->figures[sweep->figure_count++] = figure;
+    c += length;
+    if (*c == ',') c++;
+  }
+  return true;
+}
+
+bool cliParse(Options* options, i32 argc, char** argv) {
+  options->mode   = MODE_WINDOW;
+  options->params = (RenderParams){
+    .figure = FIGURE_CIRCLE,
+    .step   = 51,
+    .radius = 25,
+  };
+  options->dpi = 300;
+  options->fps = 10;
+  options->dither.levels = 2;
+  options->tile = 512;
+
+  for (i32 i = 1; i < argc; i++) {
+    const char* arg   = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--shift") == 0) {
+      options->params.shift = true;
+    } else if (strcmp(arg, "--bw") == 0) {
+      options->params.bw = true;
+    } else if (strcmp(arg, "--lum") == 0) {
+      options->params.size_lum = true;
+    } else if (strcmp(arg, "--linear") == 0) {
+      options->params.linear = true;
+    } else if (strcmp(arg, "--cmyk") == 0) {
+      options->cmyk = true;
+    } else if (strcmp(arg, "--compact") == 0) {
+      options->compact = true;
+    } else if (strcmp(arg, "--dither-pixels") == 0) {
+      options->dither.pixels = true;
+    } else if (strcmp(arg, "--sweep-shift") == 0) {
+      options->sweep_shift = true;
+    } else if (strcmp(arg, "--sweep-bw") == 0) {
+      options->sweep_bw = true;
+    } else if (strcmp(arg, "--stream") == 0) {
+      options->mode = MODE_STREAM;
+    } else if (value == NULL) {
+      fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+      return false;
+    } else if (strcmp(arg, "--strips") == 0) {
+      options->mode  = MODE_STRIPS;
+      options->input = value;
+      i++;
+    } else if (strcmp(arg, "--anim") == 0) {
+      options->mode  = MODE_ANIM;
+      options->input = value;
+      i++;
+    } else if (strcmp(arg, "--watch") == 0) {
+      options->mode  = MODE_WATCH;
+      options->input = value;
+      options->argc  = argc;
+      options->argv  = argv;
+      i++;
+    } else if (strcmp(arg, "--extension") == 0) {
+      options->extension = value;
+      i++;
+    } else if (strcmp(arg, "--sweep") == 0) {
+      options->mode  = MODE_SWEEP;
+      options->input = value;
+      i++;
+    } else if (strcmp(arg, "--steps") == 0) {
+      f32 steps[SWEEP_MAX_VALUES];
+      i32 count = parseNumbers(value, steps, SWEEP_MAX_VALUES);
+      if (count < 0) {
+        return false;
+      }
+      for (i32 k = 0; k < count; k++) {
+        if (steps[k] != floorf(steps[k]) || steps[k] >= INT32_MAX) {
+          fprintf(stderr, "Invalid list of whole steps: %s\n", value);
+          return false;
+        }
+        options->sweep.steps[k] = steps[k];
+      }
+      options->sweep.step_count = count;
+      i++;
+    } else if (strcmp(arg, "--radii") == 0) {
+      options->sweep.radius_count = parseNumbers(value, options->sweep.radii, SWEEP_MAX_VALUES);
+      if (options->sweep.radius_count < 0) {
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--figures") == 0) {
+      if (!parseFigures(value, &options->sweep)) {
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--tile") == 0) {
+      options->tile = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--format") == 0) {
+      if (strcmp(value, "y4m") == 0) {
+        options->stream_format = STREAM_Y4M;
+      } else if (strcmp(value, "rgba") == 0) {
+        options->stream_format = STREAM_RGBA;
+      } else {
+        fprintf(stderr, "Unknown format: %s\n", value);
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--palette") == 0) {
+      if (!paletteParse(&options->palette, value)) {
+        return false;
+      }
+      options->params.palette = &options->palette;
+      i++;
+    } else if (strcmp(arg, "--dither") == 0) {
+      i32 kernel = 0;
+      while (kernel < _DITHER_MAX && strcmp(dither_names[kernel], value) != 0) kernel++;
+      if (kernel == _DITHER_MAX) {
+        fprintf(stderr, "Unknown error diffusion: %s\n", value);
+        return false;
+      }
+      options->dithering     = true;
+      options->dither.kernel = kernel;
+      i++;
+    } else if (strcmp(arg, "--adaptive") == 0) {
+      options->adaptive = true;
+      options->quadtree.threshold = atof(value);
+      i++;
+    } else if (strcmp(arg, "--stipple") == 0) {
+      options->stippling = true;
+      options->stipple.spread = atof(value);
+      i++;
+    } else if (strcmp(arg, "--levels") == 0) {
+      options->dither.levels = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--inks") == 0) {
+      options->inks = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--fps") == 0) {
+      options->fps = atof(value);
+      i++;
+    } else if (strcmp(arg, "--trace") == 0) {
+#ifndef TRACE
+      fprintf(stderr, "Tracing is not compiled in, rebuild with TRACE\n");
+      return false;
+#endif // TRACE
+      options->trace = value;
+      i++;
+    } else if (strcmp(arg, "--output") == 0) {
+      if (options->output_count == MAX_OUTPUTS) {
+        fprintf(stderr, "No more than %d outputs are supported\n", MAX_OUTPUTS);
+        return false;
+      }
+      options->outputs[options->output_count++] = value;
+      options->output = options->outputs[0];
+      i++;
+    } else if (strcmp(arg, "--step") == 0) {
+      options->params.step = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--dpi") == 0) {
+      options->dpi = atof(value);
+      i++;
+    } else if (strcmp(arg, "--print-width") == 0) {
+      options->print_width = atof(value);
+      i++;
+    } else if (strcmp(arg, "--radius") == 0) {
+      options->params.radius = atof(value);
+      i++;
+    } else if (strcmp(arg, "--figure") == 0) {
+      i32 figure = 0;
+      while (figure < _FIGURE_MAX && strcmp(figure_names[figure], value) != 0) figure++;
+      if (figure == _FIGURE_MAX) {
+        fprintf(stderr, "Unknown figure: %s\n", value);
+        return false;
+      }
+      options->params.figure = figure;
+      i++;
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      return false;
+    }
+  }
+
+  if (options->dpi <= 0 || options->print_width < 0) {
+    fprintf(stderr, "DPI and print width must be positive\n");
+    return false;
+  }
+  if (options->fps <= 0) {
+    fprintf(stderr, "Frame rate must be positive\n");
+    return false;
+  }
+  if (options->params.step < 1) {
+    fprintf(stderr, "Step must be positive\n");
+    return false;
+  }
+  if (options->dithering && options->mode != MODE_STRIPS) {
+    fprintf(stderr, "Error diffusion is supported with --strips only\n");
+    return false;
+  }
+  if (options->adaptive) {
+    if (options->mode != MODE_STRIPS) {
+      fprintf(stderr, "Adaptive cells are supported with --strips only\n");
+      return false;
+    }
+    if (options->dithering) {
+      fprintf(stderr, "Adaptive cells and error diffusion are exclusive\n");
+      return false;
+    }
+    if (options->quadtree.threshold < 0) {
+      fprintf(stderr, "Threshold of the adaptive cells must not be negative\n");
+      return false;
+    }
+  }
+  if (options->stippling) {
+    if (options->mode != MODE_STRIPS) {
+      fprintf(stderr, "Stipple layout is supported with --strips only\n");
+      return false;
+    }
+    if (options->dithering || options->adaptive) {
+      fprintf(stderr, "Stipple layout, adaptive cells and error diffusion are exclusive\n");
+      return false;
+    }
+    if (!(options->stipple.spread >= 1)) {
+      fprintf(stderr, "Spread of the stipple must be at least 1\n");
+      return false;
+    }
+  }
+  if (options->cmyk) {
+    RasterFormat format;
+    if (options->mode != MODE_STRIPS
+        || (options->output != NULL && rasterFormat(options->output, &format))) {
+      fprintf(stderr, "CMYK screens are supported with --strips to SVG only\n");
+      return false;
+    }
+    if (options->dithering || options->adaptive || options->stippling
+        || options->params.palette != NULL || options->inks != 0) {
+      fprintf(stderr, "CMYK screens pick the inks and the cells on their own\n");
+      return false;
+    }
+  }
+  if (options->dither.levels < 2) {
+    fprintf(stderr, "Number of the levels must be at least 2\n");
+    return false;
+  }
+  if (options->inks != 0) {
+    if (options->inks < 1 || options->inks > PALETTE_MAX_INKS) {
+      fprintf(stderr, "Number of inks must be between 1 and %d\n", PALETTE_MAX_INKS);
+      return false;
+    }
+    // Colors are collected by the first pass over the input
+    if (options->mode != MODE_STRIPS || strcmp(options->input, "-") == 0) {
+      fprintf(stderr, "Clustering the inks needs --strips reading a file\n");
+      return false;
+    }
+    if (options->params.palette != NULL) {
+      fprintf(stderr, "Palette and number of the inks are exclusive\n");
+      return false;
+    }
+  }
+  if (options->params.palette != NULL && options->mode == MODE_WINDOW) {
+    fprintf(stderr, "Palette is supported by the command line modes only\n");
+    return false;
+  }
+  // Preview samples the cell pyramid and the stream averages YCbCr planes,
+  // both in the encoded values
+  if (options->params.linear && (options->mode == MODE_WINDOW || options->mode == MODE_STREAM)) {
+    fprintf(stderr, "Linear light is supported with --strips and --anim only\n");
+    return false;
+  }
+  // Screens of the inks are sampled from the tables of the encoded values
+  if (options->params.linear && options->cmyk) {
+    fprintf(stderr, "Linear light is not supported by the CMYK screens\n");
+    return false;
+  }
+  if (options->mode == MODE_SWEEP) {
+    if (options->dithering || options->adaptive || options->stippling || options->cmyk
+        || options->inks != 0) {
+      fprintf(stderr, "Contact sheet supports the plain halftone only\n");
+      return false;
+    }
+    // Tables of the sheet sum the encoded values
+    if (options->params.linear) {
+      fprintf(stderr, "Linear light is not supported by the contact sheet\n");
+      return false;
+    }
+    if (options->tile < 1) {
+      fprintf(stderr, "Tile width must be positive\n");
+      return false;
+    }
+  } else if (options->sweep.step_count > 0 || options->sweep.radius_count > 0
+      || options->sweep.figure_count > 0 || options->sweep_shift || options->sweep_bw) {
+    fprintf(stderr, "Swept values are supported with --sweep only\n");
+    return false;
+  }
+  if (options->mode == MODE_WATCH) {
+    if (options->output != NULL && strcmp(options->input, options->output) == 0) {
+      fprintf(stderr, "Service must write to another directory\n");
+      return false;
+    }
+    if (options->extension == NULL) {
+      options->extension = "svg";
+    }
+  } else if (options->extension != NULL) {
+    fprintf(stderr, "Extension is supported with --watch only\n");
+    return false;
+  }
+  if (options->compact && options->mode != MODE_WINDOW) {
+    fprintf(stderr, "Compact cell store is supported by the window only\n");
+    return false;
+  }
+  if (options->mode == MODE_STREAM && options->output == NULL) {
+    options->output = "-";
+  }
+  if (options->output_count > 1 && (options->mode != MODE_STRIPS
+      || options->dithering || options->adaptive || options->stippling || options->cmyk)) {
+    fprintf(stderr, "Several outputs are supported by the plain --strips halftone only\n");
+    return false;
+  }
+  if (options->mode != MODE_WINDOW && options->output == NULL) {
+    fprintf(stderr, "Output file is required\n");
+    return false;
+  }
+
+  return true;
+}
+
+local FILE* openOutput(const char* path) {
+  FILE* file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+  }
+  return file;
+}
+
+local void closeOutput(FILE* file) {
+  if (file != stdout) {
+    fclose(file);
+  } else {
+    fflush(file);
+  }
+}
+
+// svgOutput starts the SVG file and returns renderer of its figures. With
+// the palette figures refer to the classes of the inks instead of repeating
+// their colors.
+local Renderer svgOutput(SvgPalette* svg, FILE* file, RenderParams params,
+    i32 width, i32 height) {
+  svgBegin(file, width, height, params.radius);
+  if (params.palette == NULL) {
+    return svgRenderer(file);
+  }
+
+  *svg = (SvgPalette){
+    .file    = file,
+    .palette = params.palette,
+  };
+  svgPaletteStyle(file, params.palette);
+  return svgPaletteRenderer(svg);
+}
+
+// clusterInks builds the palette of the options from the colors of the
+// cells of the input, reading it once more.
+local bool clusterInks(Options* options, Workers* workers) {
+  StripReader* reader = stripOpen(options->input);
+  if (reader == NULL) {
+    return false;
+  }
+
+  Colors colors = { 0 };
+  bool ok = paletteCollectStrips(&colors, reader, options->params);
+  stripClose(reader);
+
+  if (ok) {
+    ok = paletteKMeans(&options->palette, options->inks, colors.arr, colors.len, workers);
+  }
+  da_free(&colors);
+
+  if (ok) {
+    options->params.palette = &options->palette;
+    fprintf(stderr, "Inks:");
+    for (i32 i = 0; i < options->palette.count; i++) {
+      Rgba ink = options->palette.inks[i];
+      fprintf(stderr, " #%02x%02x%02x", ink.r, ink.g, ink.b);
+    }
+    fprintf(stderr, "\n");
+  }
+  return ok;
+}
+
+// rasterScale returns number of the raster pixels per pixel of the input
+local f32 rasterScale(const Options* options, i32 width) {
+  return options->print_width > 0
+    ? options->print_width / 25.4f * options->dpi / width
+    : options->dpi / 96.0f;
+}
+
+// renderInput renders the halftone of the image read in strips
+local bool renderInput(Renderer render, StripReader* reader, Options* options,
+    Workers* workers) {
+  if (options->dithering) {
+    return renderDitherStrips(render, reader, options->params, options->dither, workers);
+  }
+  if (options->adaptive) {
+    return renderQuadtreeStrips(render, reader, options->params, options->quadtree, workers);
+  }
+  if (options->stippling) {
+    return renderStippleStrips(render, reader, options->params, options->stipple, workers);
+  }
+  return renderStrips(render, reader, options->params);
+}
+
+// renderCmyk writes the screen of every ink to the group of its own
+local bool renderCmyk(StripReader* reader, FILE* output, const Options* options,
+    Workers* workers) {
+  CmykSeparation separation;
+  if (!cmykSeparate(&separation, reader, options->params, CMYK_DEFAULT_PARAMS, workers)) {
+    return false;
+  }
+
+  svgBegin(output, stripWidth(reader), stripHeight(reader), options->params.radius);
+  Renderer render = svgRenderer(output);
+  for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+    svgCmykBegin(output, ink);
+    renderCmykInk(render, &separation, ink, options->params);
+    svgCmykEnd(output);
+  }
+  svgEnd(output);
+
+  cmykSeparationFree(&separation);
+  return !ferror(output);
+}
+
+// writeInput renders the halftone of the image read in strips straight to
+// the output
+local bool writeInput(Options* options, StripReader* reader, Workers* workers) {
+  FILE* output = openOutput(options->output);
+  if (output == NULL) {
+    return false;
+  }
+
+  bool ok = false;
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+
+  RasterFormat format;
+  if (rasterFormat(options->output, &format)) {
+    f32 scale = rasterScale(options, width);
+    Raster* raster = rasterCreate(ceilf(width * scale), ceilf(height * scale), scale, white);
+    if (raster != NULL) {
+      TRACE_BEGIN("strips");
+      ok = renderInput(rasterRenderer(raster), reader, options, workers);
+      TRACE_END();
+
+      if (ok) {
+        ok = rasterWrite(raster, workers, output, format);
+      }
+      rasterDestroy(raster);
+    }
+  } else if (options->cmyk) {
+    TRACE_BEGIN("strips");
+    ok = renderCmyk(reader, output, options, workers);
+    TRACE_END();
+  } else {
+    TRACE_BEGIN("strips");
+    SvgPalette svg;
+    Renderer render = svgOutput(&svg, output, options->params, width, height);
+    ok = renderInput(render, reader, options, workers);
+    svgEnd(output);
+    TRACE_END();
+  }
+
+  closeOutput(output);
+  return ok;
+}
+
+// BandOutput is one of the outputs the plain halftone is written to row by
+// row: SVG figures go straight to the file, raster ones are drawn onto the
+// canvas that is encoded at the end.
+typedef struct {
+  FILE* file;
+  Raster* raster;
+  RasterFormat format;
+  SvgPalette svg;
+} BandOutput;
+
+typedef struct {
+  BandOutput outputs[MAX_OUTPUTS];
+  i32 count;
+  const Palette* palette;
+} BandOutputs;
+
+local bool writeBand(void* ctx, const DisplayList* band) {
+  BandOutputs* outputs = CAST(BandOutputs*, ctx);
+  bool ok = true;
+  for (i32 i = 0; i < outputs->count; i++) {
+    BandOutput* output = outputs->outputs + i;
+    if (output->raster != NULL) {
+      displayListRender(band, rasterRenderer(output->raster), 0, band->count);
+    } else {
+      svgDisplayList(output->file, band, outputs->palette);
+      ok = ok && !ferror(output->file);
+    }
+  }
+  return ok;
+}
+
+// writeBands samples the image once and writes the figures of every row of
+// the cells to all outputs before the next row is sampled, in place from the
+// mapped file when it can be or from the strips decoded out of the mapping
+local bool writeBands(Options* options, StripReader* reader, Workers* workers) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+
+  BandOutputs outputs = { .palette = options->params.palette };
+  bool ok = true;
+  while (ok && outputs.count < options->output_count) {
+    const char* path = options->outputs[outputs.count];
+    BandOutput* output = outputs.outputs + outputs.count;
+    output->file = openOutput(path);
+    if (output->file == NULL) {
+      ok = false;
+      break;
+    }
+    outputs.count++;
+
+    if (rasterFormat(path, &output->format)) {
+      f32 scale = rasterScale(options, width);
+      output->raster = rasterCreate(ceilf(width * scale), ceilf(height * scale), scale, white);
+      ok = output->raster != NULL;
+    } else {
+      svgOutput(&output->svg, output->file, options->params, width, height);
+    }
+  }
+
+  if (ok) {
+    MappedImage mapped;
+    TRACE_BEGIN("strips");
+    bool in_place = stripMap(reader, &mapped) && mapped.bitmap.pixels != NULL;
+    ok = displayListBands(reader, in_place ? &mapped.bitmap : NULL, options->params,
+        workers, writeBand, &outputs);
+    stripUnmap(&mapped);
+    TRACE_END();
+  }
+
+  for (i32 i = 0; i < outputs.count; i++) {
+    BandOutput* output = outputs.outputs + i;
+    if (output->raster != NULL) {
+      ok = ok && rasterWrite(output->raster, workers, output->file, output->format);
+      rasterDestroy(output->raster);
+    } else {
+      svgEnd(output->file);
+      ok = ok && !ferror(output->file);
+    }
+    closeOutput(output->file);
+  }
+  return ok;
+}
+
+// halftoneFile maps the input or reads it in strips
+local bool halftoneFile(Options* options, Workers* workers) {
+  if (options->inks > 0 && !clusterInks(options, workers)) {
+    return false;
+  }
+
+  StripReader* reader = stripOpen(options->input);
+  if (reader == NULL) {
+    return false;
+  }
+
+  bool ok = false;
+  if (options->dithering || options->adaptive || options->stippling || options->cmyk) {
+    ok = writeInput(options, reader, workers);
+  } else {
+    ok = writeBands(options, reader, workers);
+  }
+
+  stripClose(reader);
+  return ok;
+}
+
+local i32 runStrips(Options* options) {
+  Workers* workers = workersCreate(0);
+  bool ok = halftoneFile(options, workers);
+  workersDestroy(workers);
+
+  return ok ? 0 : 1;
+}
+
+// sweepParams fills the values left empty with the single ones of the params
+local SweepParams sweepParams(const Options* options) {
+  SweepParams sweep = options->sweep;
+  RenderParams params = options->params;
+
+  if (sweep.step_count == 0) {
+    sweep.steps[sweep.step_count++] = params.step;
+  }
+  if (sweep.radius_count == 0) {
+    sweep.radii[sweep.radius_count++] = params.radius / params.step;
+  }
+  if (sweep.figure_count == 0) {
+    sweep.figures[sweep.figure_count++] = params.figure;
+  }
+  sweep.shifts[sweep.shift_count++] = params.shift;
+  if (options->sweep_shift) {
+    sweep.shifts[sweep.shift_count++] = !params.shift;
+  }
+  sweep.bws[sweep.bw_count++] = params.bw;
+  if (options->sweep_bw) {
+    sweep.bws[sweep.bw_count++] = !params.bw;
+  }
+  return sweep;
+}
+
+// writeSweepSheet writes the sheet to the file, raster with every tile
+// scaled to the width of the tile or SVG
+local bool writeSweepSheet(const Options* options, const SweepSheet* sheet, Workers* workers) {
+  FILE* output = openOutput(options->output);
+  if (output == NULL) {
+    return false;
+  }
+
+  bool ok = false;
+  RasterFormat format;
+  if (rasterFormat(options->output, &format)) {
+    f32 scale = CAST(f32, options->tile) / sheet->image_width;
+    Raster* raster = rasterCreate(ceilf(sheet->width * scale), ceilf(sheet->height * scale),
+        scale, white);
+    if (raster != NULL) {
+      renderSweepSheet(rasterRenderer(raster), sheet);
+      ok = rasterWrite(raster, workers, output, format);
+      rasterDestroy(raster);
+    }
+  } else {
+    // Tiles have room for their figures, the sheet needs no margin
+    RenderParams params = options->params;
+    params.radius = 0;
+
+    SvgPalette svg;
+    svgOutput(&svg, output, params, ceilf(sheet->width), ceilf(sheet->height));
+    svgSweepSheet(output, sheet, params.palette);
+    svgEnd(output);
+    ok = !ferror(output);
+  }
+
+  closeOutput(output);
+  return ok;
+}
+
+local i32 runSweep(Options* options) {
+  StripReader* reader = stripOpen(options->input);
+  if (reader == NULL) {
+    return 1;
+  }
+
+  // Every combination samples the whole image, so it is read at once
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+  u8* pixels = CAST(u8*, malloc(CAST(usize, width) * height * 4));
+  if (pixels == NULL) {
+    fprintf(stderr, "Out of memory for the image of %dx%d\n", width, height);
+    stripClose(reader);
+    return 1;
+  }
+  i32 rows = stripRead(reader, pixels, height);
+  stripClose(reader);
+  if (rows != height) {
+    fprintf(stderr, "Failed to read %s\n", options->input);
+    free(pixels);
+    return 1;
+  }
+
+  Workers* workers = workersCreate(0);
+  SweepParams sweep = sweepParams(options);
+
+  SweepSheet sheet;
+  TRACE_BEGIN("sweep");
+  bool ok = sweepSheetBuild(&sheet, bitmapView(pixels, width, height, 0),
+      options->params, &sweep, workers);
+  TRACE_END();
+  free(pixels);
+
+  if (ok) {
+    char label[128];
+    for (i32 i = 0; i < sheet.count; i++) {
+      sweepLabel(label, sizeof(label), sheet.tiles[i].params);
+      fprintf(stderr, "%d, %d: %s\n", i / sheet.columns, i % sheet.columns, label);
+    }
+    ok = writeSweepSheet(options, &sheet, workers);
+    sweepSheetFree(&sheet);
+  }
+
+  workersDestroy(workers);
+  return ok ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SERVICE
+////////////////////////////////////////////////////////////////////////////////
+
+// Largest number of the files processed at once
+#define WATCH_BATCH 256
+// Largest number of the arguments of the file, sidecar included
+#define WATCH_MAX_ARGS 256
+#define WATCH_MAX_SIDECAR 4096
+#define WATCH_MAX_PATH 4096
+
+local volatile sig_atomic_t watch_stop = 0;
+
+local void watchSignal(int UNUSED(signal)) {
+  watch_stop = 1;
+}
+
+// watchImage returns true if the file is the image the service halftones,
+// hidden files are the ones still being written
+local bool watchImage(const char* name) {
+  const char* extension = strrchr(name, '.');
+  return name[0] != '.' && extension != NULL && (strcmp(extension, ".ppm") == 0
+      || strcmp(extension, ".pgm") == 0 || strcmp(extension, ".qoi") == 0);
+}
+
+// watchSidecar reads options of the file from the sidecar, missing sidecar
+// has no options
+local bool watchSidecar(const char* path, char* sidecar) {
+  sidecar[0] = '\0';
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    if (errno == ENOENT) {
+      return true;
+    }
+    fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  usize length = fread(sidecar, 1, WATCH_MAX_SIDECAR, file);
+  bool ok = !ferror(file) && length < WATCH_MAX_SIDECAR;
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "Failed to read %s or it is longer than %d bytes\n", path, WATCH_MAX_SIDECAR - 1);
+    return false;
+  }
+  sidecar[length] = '\0';
+  return true;
+}
+
+// watchOptions parses options of the file: command line of the service
+// without the arguments of the service itself followed by the sidecar.
+// Sidecar is split into the arguments in place.
+local bool watchOptions(Options* options, const Options* service, char* sidecar,
+    const char* input, const char* output) {
+  char* argv[WATCH_MAX_ARGS];
+  i32 argc = 0;
+
+  argv[argc++] = service->argv[0];
+  for (i32 i = 1; i < service->argc && argc < WATCH_MAX_ARGS - 4; i++) {
+    const char* arg = service->argv[i];
+    if (strcmp(arg, "--watch") == 0 || strcmp(arg, "--output") == 0
+        || strcmp(arg, "--extension") == 0) {
+      i++;
+      continue;
+    }
+    argv[argc++] = service->argv[i];
+  }
+
+  char* state;
+  for (char* arg = strtok_r(sidecar, " \t\r\n", &state); arg != NULL;
+      arg = strtok_r(NULL, " \t\r\n", &state)) {
+    if (argc == WATCH_MAX_ARGS - 4) {
+      fprintf(stderr, "More than %d arguments for %s\n", WATCH_MAX_ARGS - 5, input);
+      return false;
+    }
+    argv[argc++] = arg;
+  }
+
+  argv[argc++] = "--strips";
+  argv[argc++] = CAST(char*, input);
+  argv[argc++] = "--output";
+  argv[argc++] = CAST(char*, output);
+
+  *options = (Options){ 0 };
+  if (!cliParse(options, argc, argv)) {
+    return false;
+  }
+  if (options->output_count > 1) {
+    fprintf(stderr, "Outputs of %s are picked by the service\n", input);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  const Options* service;
+  char* names[WATCH_BATCH];
+  bool results[WATCH_BATCH];
+  // Single thread pool of every worker, the files are processed in
+  // parallel instead of the stages of every file
+  Workers** pools;
+} WatchJob;
+
+local void watchFile(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  WatchJob* job = CAST(WatchJob*, ctx);
+  const Options* service = job->service;
+  const char* name = job->names[index];
+  i32 stem = strrchr(name, '.') - name;
+
+  char input[WATCH_MAX_PATH];
+  char sidecar_path[WATCH_MAX_PATH];
+  char output[WATCH_MAX_PATH];
+  char temporary[WATCH_MAX_PATH];
+  snprintf(input, sizeof(input), "%s/%s", service->input, name);
+  snprintf(sidecar_path, sizeof(sidecar_path), "%s/%.*s.dots", service->input, stem, name);
+  snprintf(output, sizeof(output), "%s/%.*s.%s", service->output, stem, name, service->extension);
+  // Readers of the output directory see only complete files. Images that
+  // differ only in the extension share the output, index of the batch keeps
+  // their temporary files apart.
+  snprintf(temporary, sizeof(temporary), "%s/.%.*s.%d.%s", service->output, stem, name,
+      index, service->extension);
+
+  Workers* pool = job->pools[workerIndex()];
+  char sidecar[WATCH_MAX_SIDECAR];
+  Options options;
+  bool ok = watchSidecar(sidecar_path, sidecar)
+    && watchOptions(&options, service, sidecar, input, temporary)
+    && halftoneFile(&options, pool);
+  workersReset(pool);
+
+  if (ok && rename(temporary, output) != 0) {
+    fprintf(stderr, "Failed to rename %s: %s\n", temporary, strerror(errno));
+    ok = false;
+  }
+  if (!ok) {
+    remove(temporary);
+    fprintf(stderr, "Failed to halftone %s\n", input);
+  }
+  job->results[index] = ok;
+}
+
+// watchBatched returns true if the file is already in the batch
+local bool watchBatched(const WatchJob* job, i32 count, const char* name) {
+  for (i32 i = 0; i < count; i++) {
+    if (strcmp(job->names[i], name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+local i32 runWatch(Options* options) {
+  // Command line of the service is checked once before any file comes
+  Options check;
+  char sidecar[] = "";
+  if (!watchOptions(&check, options, sidecar, "image.ppm", "image.svg")) {
+    return 1;
+  }
+
+  Watch* watch = watchOpen(options->input);
+  if (watch == NULL) {
+    return 1;
+  }
+  signal(SIGINT, watchSignal);
+  signal(SIGTERM, watchSignal);
+
+  Workers* workers = workersCreate(0);
+  WatchJob job = {
+    .service = options,
+    .pools   = CAST(Workers**, malloc(workersCount(workers) * sizeof(Workers*))),
+  };
+  for (i32 i = 0; i < workersCount(workers); i++) {
+    job.pools[i] = workersCreate(1);
+  }
+
+  fprintf(stderr, "Watching %s\n", options->input);
+  bool ok = true;
+  i64 done   = 0;
+  i64 failed = 0;
+  while (!watch_stop) {
+    const char* name = watchNext(watch, true);
+    if (name == NULL) {
+      ok = watch_stop;
+      break;
+    }
+
+    // Everything that arrived while the previous batch was processed goes
+    // to the next one. The same file comes several times when it is closed
+    // more than once or shows up both in the listing and in the events, it
+    // is halftoned once.
+    i32 count = 0;
+    while (name != NULL) {
+      if (watchImage(name) && !watchBatched(&job, count, name)) {
+        job.names[count++] = strdup(name);
+      }
+      name = count < WATCH_BATCH ? watchNext(watch, false) : NULL;
+    }
+
+    TRACE_BEGIN("watch_batch");
+    workersRun(workers, count, watchFile, &job);
+    TRACE_END();
+
+    for (i32 i = 0; i < count; i++) {
+      done   += job.results[i];
+      failed += !job.results[i];
+      free(job.names[i]);
+    }
+  }
+  fprintf(stderr, "Halftoned %lld files, %lld failed\n", CAST(long long, done), CAST(long long, failed));
+
+  for (i32 i = 0; i < workersCount(workers); i++) {
+    workersDestroy(job.pools[i]);
+  }
+  free(job.pools);
+  workersDestroy(workers);
+  watchClose(watch);
+
+  return ok ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// ANIMATION
+////////////////////////////////////////////////////////////////////////////////
+
+// framePath substitutes index of the frame for the only %d or %0Nd of the
+// pattern, returns false if the pattern has any other conversions.
+local bool framePath(char* path, usize size, const char* pattern, i32 index) {
+  const char* spec = strchr(pattern, '%') + 1;
+  while (*spec >= '0' && *spec <= '9') spec++;
+  if (*spec != 'd' || strchr(spec, '%') != NULL) {
+    fprintf(stderr, "Frame sequence must have a single %%d: %s\n", pattern);
+    return false;
+  }
+
+  i32 length = snprintf(path, size, pattern, index);
+  return length > 0 && CAST(usize, length) < size;
+}
+
+// writeFrame writes all cells of the last frame to the file of its own
+local bool writeFrame(const Options* options, const FrameCells* cells,
+    Workers* workers, const char* path) {
+  FILE* output = openOutput(path);
+  if (output == NULL) {
+    return false;
+  }
+
+  bool ok = false;
+  RasterFormat format;
+  if (rasterFormat(path, &format)) {
+    f32 scale = rasterScale(options, cells->width);
+    Raster* raster = rasterCreate(ceilf(cells->width * scale),
+        ceilf(cells->height * scale), scale, white);
+    if (raster != NULL) {
+      renderFrameCells(rasterRenderer(raster), cells, (Rgba){ 0 }, true);
+      ok = rasterWrite(raster, workers, output, format);
+      rasterDestroy(raster);
+    }
+  } else {
+    SvgPalette svg;
+    Renderer render = svgOutput(&svg, output, options->params, cells->width, cells->height);
+    renderFrameCells(render, cells, (Rgba){ 0 }, true);
+    svgEnd(output);
+    ok = !ferror(output);
+  }
+
+  closeOutput(output);
+  return ok;
+}
+
+local i32 runAnimation(Options* options) {
+  GifAnimation anim;
+  TRACE_BEGIN("load_image");
+  bool loaded = gifLoad(&anim, options->input);
+  TRACE_END();
+  if (!loaded) {
+    fprintf(stderr, "Failed to load animation %s\n", options->input);
+    return 1;
+  }
+  i32 frames = anim.count;
+
+  bool sequence = strchr(options->output, '%') != NULL;
+
+  RasterFormat format;
+  if (!sequence && rasterFormat(options->output, &format)) {
+    fprintf(stderr, "Raster animation is written as a sequence of the frames, "
+        "e.g. frame%%04d.png\n");
+    gifFree(&anim);
+    return 1;
+  }
+
+  FILE* output = NULL;
+  Workers* workers = NULL;
+  SvgPalette svg;
+  Renderer render = { 0 };
+  if (sequence) {
+    workers = workersCreate(0);
+  } else {
+    output = openOutput(options->output);
+    if (output == NULL) {
+      gifFree(&anim);
+      return 1;
+    }
+    render = svgOutput(&svg, output, options->params, anim.width, anim.height);
+    // Changed cells of the later frames are covered with the same color
+    svgBackground(output, anim.width, anim.height, options->params.radius, white);
+  }
+
+  FrameCells cells;
+  frameCellsInit(&cells, anim.width, anim.height, options->params);
+
+  bool ok = true;
+  u64 changed = 0;
+  usize frame_size = CAST(usize, anim.width) * anim.height * 4;
+  for (i32 i = 0; i < frames && ok; i++) {
+    TRACE_BEGIN("frame");
+    const u8* pixels = anim.pixels + i * frame_size;
+    changed += frameCellsUpdate(&cells, bitmapView(pixels, anim.width, anim.height, 0));
+
+    if (sequence) {
+      char path[MAX_FILENAME_SIZE];
+      ok = framePath(path, sizeof(path), options->output, i)
+        && writeFrame(options, &cells, workers, path);
+    } else {
+      // Changed cells are drawn over the previous frames, the first frame
+      // is drawn over the background
+      Rgba background = i == 0 ? (Rgba){ 0 } : white;
+      svgFrameBegin(output, i, frames, options->fps);
+      renderFrameCells(render, &cells, background, false);
+      svgFrameEnd(output);
+    }
+    TRACE_END();
+  }
+
+  u64 total = CAST(u64, frames) * cells.columns * cells.rows;
+  fprintf(stderr, "%d frames, %.1f%% of the cells changed\n",
+      frames, 100.0 * changed / max_value(total, 1));
+
+  if (output != NULL) {
+    svgEnd(output);
+    ok = ok && !ferror(output);
+    closeOutput(output);
+  }
+  workersDestroy(workers);
+  frameCellsFree(&cells);
+  gifFree(&anim);
+
+  return ok ? 0 : 1;
+}
+
+local i32 runStream(Options* options) {
+  FILE* output = openOutput(options->output);
+  if (output == NULL) {
+    return 1;
+  }
+
+  Workers* workers = workersCreate(0);
+  bool ok = streamVideo(stdin, output, options->stream_format, options->params, workers);
+  workersDestroy(workers);
+  closeOutput(output);
+
+  return ok ? 0 : 1;
+}
+
+i32 cliRun(Options* options) {
+  switch (options->mode) {
+  case MODE_STRIPS:
+    return runStrips(options);
+  case MODE_ANIM:
+    return runAnimation(options);
+  case MODE_STREAM:
+    return runStream(options);
+  case MODE_SWEEP:
+    return runSweep(options);
+  case MODE_WATCH:
+    return runWatch(options);
+  default:
+    fprintf(stderr, "Mode is not supported by the command line\n");
+    return 1;
+  }
+}
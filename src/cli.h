@@ -0,0 +1,124 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CLI_H
+#define CLI_H
+
+#include "types.h"
+#include "dither.h"
+#include "halftone.h"
+#include "palette.h"
+#include "quadtree.h"
+#include "stipple.h"
+#include "sweep.h"
+#include "video.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Command line modes of dots. Everything but the window is here and needs
+// nothing but the imagine library, so the same modes run in the dots window
+// binary and in the headless dots_cli.
+
+#define MAX_FILENAME_SIZE 1024
+
+typedef enum {
+  MODE_WINDOW = 0,
+  MODE_STRIPS = 1,
+  MODE_ANIM   = 2,
+  MODE_STREAM = 3,
+  MODE_SWEEP  = 4,
+  MODE_WATCH  = 5,
+} Mode;
+
+// Largest number of the outputs of the strips mode
+#define MAX_OUTPUTS 8
+
+typedef struct {
+  Mode mode;
+  const char* input;
+  // First of the outputs, the only one outside of the strips mode
+  const char* output;
+  // Outputs of the strips mode are drawn from a single sampling pass
+  const char* outputs[MAX_OUTPUTS];
+  i32 output_count;
+  // Chrome trace of the run, only in builds with TRACE
+  const char* trace;
+  RenderParams params;
+  // Resolution of PNG and QOI output
+  f32 dpi;
+  // Width of the print in millimeters, zero keeps one pixel of the input
+  // per CSS pixel (1/96 inch) like in SVG
+  f32 print_width;
+  // Frame rate of the animated SVG, delays of the GIF frames are ignored
+  f32 fps;
+  // Frames of the stream mode
+  StreamFormat stream_format;
+  // Fixed palette or number of the inks to cluster the colors of the cells
+  // into, palette of the params points here
+  Palette palette;
+  i32 inks;
+  // Sizes of the figures come from the error diffusion
+  bool dithering;
+  DitherParams dither;
+  // Cells are split where the color varies
+  bool adaptive;
+  QuadtreeParams quadtree;
+  // Dots are placed by the Poisson-disk sampling instead of the grid
+  bool stippling;
+  StippleParams stipple;
+  // Separate the image into four inks on rotated screens
+  bool cmyk;
+  // Values of the parameters of the contact sheet, the ones left empty take
+  // the single value of the params
+  SweepParams sweep;
+  bool sweep_shift;
+  bool sweep_bw;
+  // Width of every tile of the raster contact sheet in pixels
+  i32 tile;
+  // Extension of the files written by the service
+  const char* extension;
+  // Window keeps only the cell store of the dropped image
+  bool compact;
+  // Command line of the service, every file is halftoned with it followed
+  // by the sidecar of the file
+  i32 argc;
+  char** argv;
+} Options;
+
+// cliParse parses the command line, prints the reason and returns false if
+// it is invalid.
+bool cliParse(Options* options, i32 argc, char** argv);
+// cliUsage prints the modes and the options, the window is mentioned only
+// by the binary that has one.
+void cliUsage(const char* program, bool window);
+
+// cliRun runs any mode of the options but the window, returns the exit
+// status of the process.
+i32 cliRun(Options* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLI_H
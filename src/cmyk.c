@@ -0,0 +1,342 @@
+#include "cmyk.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+local const char* ink_names[_CMYK_MAX] = {
+  [CMYK_CYAN]    = "cyan",
+  [CMYK_MAGENTA] = "magenta",
+  [CMYK_YELLOW]  = "yellow",
+  [CMYK_BLACK]   = "black",
+};
+
+local const Rgba ink_colors[_CMYK_MAX] = {
+  [CMYK_CYAN]    = {   0, 255, 255, 255 },
+  [CMYK_MAGENTA] = { 255,   0, 255, 255 },
+  [CMYK_YELLOW]  = { 255, 255,   0, 255 },
+  [CMYK_BLACK]   = {   0,   0,   0, 255 },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// SUMMED-AREA TABLES
+////////////////////////////////////////////////////////////////////////////////
+
+// CmykTables is a ring of the rows of the summed-area tables of every ink,
+// the row r sums the pixels above the row r of the image.
+typedef struct {
+  StripReader* reader;
+  i32 width;
+  i32 height;
+  i32 stride;
+  // Number of the rows in the ring
+  i32 rows;
+  u32* tables[_CMYK_MAX];
+  // Rows of the tables built so far
+  i32 built;
+
+  // Pixels read ahead of the tables
+  u8* pixels;
+  i32 buffered;
+  i32 consumed;
+  i32 buffer_rows;
+} CmykTables;
+
+local u32* tableRow(const CmykTables* tables, CmykInk ink, i32 row) {
+  return tables->tables[ink] + CAST(usize, row % tables->rows) * tables->stride;
+}
+
+local void cmykTablesInit(CmykTables* tables, StripReader* reader, i32 step) {
+  *tables = (CmykTables){
+    .reader      = reader,
+    .width       = stripWidth(reader),
+    .height      = stripHeight(reader),
+    .stride      = stripWidth(reader) + 1,
+    .rows        = 2 * step + 8,
+    .built       = 1,
+    .buffer_rows = step,
+  };
+
+  for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+    tables->tables[ink] = CAST(u32*, calloc(CAST(usize, tables->rows) * tables->stride, sizeof(u32)));
+  }
+  tables->pixels = CAST(u8*, malloc(CAST(usize, tables->width) * tables->buffer_rows * 4));
+}
+
+local void cmykTablesFree(CmykTables* tables) {
+  for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+    free(tables->tables[ink]);
+  }
+  free(tables->pixels);
+}
+
+// cmykTablesAdvance builds the rows of the tables up to the row, or up to
+// the bottom of the image
+local bool cmykTablesAdvance(CmykTables* tables, i32 row) {
+  row = min_value(row, tables->height);
+
+  while (tables->built <= row) {
+    if (tables->consumed == tables->buffered) {
+      TRACE_BEGIN("strip_read");
+      tables->buffered = stripRead(tables->reader, tables->pixels, tables->buffer_rows);
+      TRACE_END();
+      tables->consumed = 0;
+      if (tables->buffered <= 0) {
+        return false;
+      }
+    }
+
+    const u8* pixel = tables->pixels + CAST(usize, tables->consumed++) * tables->width * 4;
+    i32 y = tables->built++;
+
+    u32* above[_CMYK_MAX];
+    u32* rows[_CMYK_MAX];
+    u32 sums[_CMYK_MAX] = { 0 };
+    for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+      above[ink] = tableRow(tables, ink, y - 1);
+      rows[ink]  = tableRow(tables, ink, y);
+      rows[ink][0] = 0;
+    }
+
+    for (i32 x = 0; x < tables->width; x++, pixel += 4) {
+      // Black replaces the common part of the inks entirely
+      i32 light = max_value(pixel[0], max_value(pixel[1], pixel[2]));
+      if (light > 0) {
+        sums[CMYK_CYAN]    += (light - pixel[0]) * 255 / light;
+        sums[CMYK_MAGENTA] += (light - pixel[1]) * 255 / light;
+        sums[CMYK_YELLOW]  += (light - pixel[2]) * 255 / light;
+      }
+      sums[CMYK_BLACK] += 255 - light;
+
+      for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+        rows[ink][x + 1] = above[ink][x + 1] + sums[ink];
+      }
+    }
+  }
+  return true;
+}
+
+// tableBox returns sum of the ink over the box clipped to the image and
+// the area it covers
+local f32 tableBox(const CmykTables* tables, CmykInk ink, i32 x0, i32 y0, i32 size,
+    f32* area) {
+  i32 x1 = min_value(x0 + size, tables->width);
+  i32 y1 = min_value(y0 + size, tables->height);
+  x0 = max_value(x0, 0);
+  y0 = max_value(y0, 0);
+  if (x0 >= x1 || y0 >= y1) {
+    *area = 0;
+    return 0;
+  }
+
+  const u32* top    = tableRow(tables, ink, y0);
+  const u32* bottom = tableRow(tables, ink, y1);
+  *area = CAST(f32, x1 - x0) * (y1 - y0);
+  return SAT_BOX(top, bottom, x0, x1, );
+}
+
+// sampleInk returns coverage of the ink averaged over the box of the size
+// around the center, which is interpolated between the four boxes on the
+// pixel grid around it
+local f32 sampleInk(const CmykTables* tables, CmykInk ink, Vec2 center, i32 size) {
+  f32 left = center.x - size / 2.0f;
+  f32 top  = center.y - size / 2.0f;
+  i32 ix = CAST(i32, floorf(left));
+  i32 iy = CAST(i32, floorf(top));
+  f32 fx = left - ix;
+  f32 fy = top - iy;
+
+  f32 weights[4] = {
+    (1 - fx) * (1 - fy),
+    fx * (1 - fy),
+    (1 - fx) * fy,
+    fx * fy,
+  };
+
+  f32 sum  = 0;
+  f32 area = 0;
+  for (i32 i = 0; i < 4; i++) {
+    f32 box_area;
+    f32 box = tableBox(tables, ink, ix + i % 2, iy + i / 2, size, &box_area);
+    sum  += weights[i] * box;
+    area += weights[i] * box_area;
+  }
+  return area > 0 ? sum / area / 255.0f : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SCREENS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const CmykTables* tables;
+  CmykSeparation* separation;
+  i32 step;
+  // Axes of the screen of every ink, one step long
+  Vec2 u[_CMYK_MAX];
+  Vec2 v[_CMYK_MAX];
+  // Centers of the dots of the band are inside of these bounds
+  f32 left;
+  f32 right;
+  f32 top;
+  f32 bottom;
+} CmykJob;
+
+// indexRange narrows the range of the indexes i for which start + i * k is
+// inside of [a, b)
+local void indexRange(f32 start, f32 k, f32 a, f32 b, f32* lo, f32* hi) {
+  if (fabsf(k) < 1e-6f) {
+    if (start < a || start >= b) {
+      *lo = 1;
+      *hi = 0;
+    }
+    return;
+  }
+
+  f32 t0 = (a - start) / k;
+  f32 t1 = (b - start) / k;
+  *lo = max_value(*lo, min_value(t0, t1));
+  *hi = min_value(*hi, max_value(t0, t1));
+}
+
+local void sampleBand(void* ctx, i32 ink, Arena* UNUSED(scratch)) {
+  CmykJob* job = CAST(CmykJob*, ctx);
+  Vec2 u = job->u[ink];
+  Vec2 v = job->v[ink];
+  f32 half = job->step / 2.0f;
+  CmykDots* dots = &job->separation->inks[ink];
+
+  // Rows of the screen that cross the band, from the corners of the band
+  // in the coordinates of the screen
+  Vec2 corners[4] = {
+    { job->left,  job->top    },
+    { job->right, job->top    },
+    { job->left,  job->bottom },
+    { job->right, job->bottom },
+  };
+  f32 step2 = square(CAST(f32, job->step));
+  f32 jmin  = INFINITY;
+  f32 jmax  = -INFINITY;
+  for (i32 i = 0; i < 4; i++) {
+    f32 j = ((corners[i].x - half) * v.x + (corners[i].y - half) * v.y) / step2;
+    jmin = min_value(jmin, j);
+    jmax = max_value(jmax, j);
+  }
+
+  for (i32 j = CAST(i32, floorf(jmin)) - 1; j <= CAST(i32, ceilf(jmax)) + 1; j++) {
+    Vec2 start = { half + j * v.x, half + j * v.y };
+
+    f32 lo = -INFINITY;
+    f32 hi = INFINITY;
+    indexRange(start.x, u.x, job->left, job->right, &lo, &hi);
+    indexRange(start.y, u.y, job->top, job->bottom, &lo, &hi);
+    if (lo > hi) continue;
+
+    // Bounds are widened by one, the exact test keeps every dot in a
+    // single band
+    for (i32 i = CAST(i32, ceilf(lo)) - 1; i <= CAST(i32, floorf(hi)) + 1; i++) {
+      Vec2 center = { start.x + i * u.x, start.y + i * u.y };
+      if (center.x < job->left || center.x >= job->right
+          || center.y < job->top || center.y >= job->bottom) {
+        continue;
+      }
+
+      f32 coverage = sampleInk(job->tables, ink, center, job->step);
+      if (coverage > 0) {
+        da_append(dots, ((CmykDot){ center, min_value(coverage, 1.0f) }));
+      }
+    }
+  }
+}
+
+bool cmykSeparate(CmykSeparation* separation, StripReader* reader, RenderParams params,
+    CmykParams cmyk, Workers* workers) {
+  i32 step = params.step;
+  if (step > SAT_MAX_STEP) {
+    fprintf(stderr, "Step of the CMYK screens must not exceed %d\n", SAT_MAX_STEP);
+    return false;
+  }
+
+  *separation = (CmykSeparation){ 0 };
+
+  CmykTables tables;
+  cmykTablesInit(&tables, reader, step);
+
+  CmykJob job = {
+    .tables     = &tables,
+    .separation = separation,
+    .step       = step,
+    .left       = -step / 2.0f,
+    .right      = tables.width + step / 2.0f,
+  };
+  for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+    f32 angle = CAST(f32, cmyk.angles[ink] * M_PI_180);
+    job.u[ink] = (Vec2){  cosf(angle) * step, sinf(angle) * step };
+    job.v[ink] = (Vec2){ -sinf(angle) * step, cosf(angle) * step };
+  }
+
+  // Dots whose centers are up to half of the step off the image still
+  // cover it
+  bool ok = true;
+  for (f32 top = -step / 2.0f; top < tables.height + step / 2.0f; top += step) {
+    job.top    = top;
+    job.bottom = top + step;
+
+    // Boxes of the band reach half of the step below it and the bilinear
+    // lookup one more row
+    TRACE_BEGIN("cmyk_tables");
+    ok = cmykTablesAdvance(&tables, CAST(i32, ceilf(job.bottom + step / 2.0f)) + 2);
+    TRACE_END();
+    if (!ok) break;
+
+    TRACE_BEGIN("cmyk_sample");
+    workersRun(workers, _CMYK_MAX, sampleBand, &job);
+    TRACE_END();
+  }
+
+  cmykTablesFree(&tables);
+  if (!ok) {
+    cmykSeparationFree(separation);
+  }
+  return ok;
+}
+
+void cmykSeparationFree(CmykSeparation* separation) {
+  for (i32 ink = 0; ink < _CMYK_MAX; ink++) {
+    da_free(&separation->inks[ink]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RENDERING
+////////////////////////////////////////////////////////////////////////////////
+
+void renderCmykInk(Renderer render, const CmykSeparation* separation, CmykInk ink,
+    RenderParams params) {
+  const CmykDots* dots = &separation->inks[ink];
+  f32 half = params.step / 2.0f;
+
+  TRACE_BEGIN("cmyk_render");
+  for (i32 i = 0; i < dots->len; i++) {
+    CmykDot dot = dots->arr[i];
+    Rect area = {
+      .x      = dot.center.x - half,
+      .y      = dot.center.y - half,
+      .width  = params.step,
+      .height = params.step,
+    };
+    renderFigure(render, area, ink_colors[ink], sqrtf(dot.coverage), params.radius, params.figure);
+  }
+  TRACE_END();
+}
+
+void svgCmykBegin(FILE* svg, CmykInk ink) {
+  fprintf(svg, "<g id=\"%s\" style=\"mix-blend-mode:multiply\">\n", ink_names[ink]);
+}
+
+void svgCmykEnd(FILE* svg) {
+  fprintf(svg, "</g>\n");
+}
@@ -0,0 +1,90 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CMYK_H
+#define CMYK_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  CMYK_CYAN,
+  CMYK_MAGENTA,
+  CMYK_YELLOW,
+  CMYK_BLACK,
+  _CMYK_MAX,
+} CmykInk;
+
+// Screen angles of the inks in degrees, the classic ones keep the moire of
+// any two screens fine
+typedef struct {
+  f32 angles[_CMYK_MAX];
+} CmykParams;
+
+#define CMYK_DEFAULT_PARAMS ((CmykParams){ .angles = { 15, 75, 0, 45 } })
+
+typedef struct {
+  Vec2 center;
+  // Part of the cell covered by the ink in [0, 1]
+  f32 coverage;
+} CmykDot;
+
+da_define(CmykDots, CmykDot);
+
+// CmykSeparation holds the dots of every ink, each on the grid of step
+// rotated by the angle of its screen
+typedef struct {
+  CmykDots inks[_CMYK_MAX];
+} CmykSeparation;
+
+// cmykSeparate separates the image read in strips into the inks with full
+// black replacement. Every dot averages the ink under the step by step box
+// around its center with bilinear lookups into the summed-area tables, only
+// the rows of the tables the current band of dots reaches are kept. Inks of
+// every band are sampled in parallel on the workers.
+bool cmykSeparate(CmykSeparation* separation, StripReader* reader, RenderParams params,
+    CmykParams cmyk, Workers* workers);
+
+void cmykSeparationFree(CmykSeparation* separation);
+
+// renderCmykInk renders the dots of the ink, area of the figure follows the
+// coverage.
+void renderCmykInk(Renderer render, const CmykSeparation* separation, CmykInk ink,
+    RenderParams params);
+
+// svgCmykBegin opens the group of the ink, groups multiply like inks on paper.
+void svgCmykBegin(FILE* svg, CmykInk ink);
+void svgCmykEnd(FILE* svg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMYK_H
@@ -1,197 +1,539 @@
 #include "delaunay.h"
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Points closer than this along both axes are considered duplicates
+#define DELAUNAY_EPSILON 2.220446049250313e-16
+// Depth of the stack of the edges waiting to be legalized, only extremely
+// degenerate inputs may run out of it
+#define DELAUNAY_EDGE_STACK 512
+
+////////////////////////////////////////////////////////////////////////////////
+/// PREDICATES
+////////////////////////////////////////////////////////////////////////////////
+
+// Coordinates are single precision, so their differences and the products of
+// the differences are exact in doubles as long as the points are within
+// 2^29 of each other in magnitude, which keeps the exact fallback of orient
+// short.
+
+// Error bound of the orientation computed in doubles, see Shewchuk's
+// "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric
+// Predicates".
+#define ORIENT_ERROR_BOUND ((3.0 + 16.0 * 1.1102230246251565e-16) * 1.1102230246251565e-16)
+
+local void twoSum(f64 a, f64 b, f64* x, f64* y) {
+  *x = a + b;
+  f64 bv = *x - a;
+  f64 av = *x - bv;
+  *y = (a - av) + (b - bv);
+}
 
-#include <raylib.h>
-#include <raymath.h>
+local void twoDiff(f64 a, f64 b, f64* x, f64* y) {
+  *x = a - b;
+  f64 bv = a - *x;
+  f64 av = *x + bv;
+  *y = (a - av) + (bv - b);
+}
 
-#include "stb_ds.h"
+// orientExact returns the sign of a1 + a0 - (b1 + b0) computed without
+// rounding, the expansion is ordered from the smallest component
+local f64 orientExact(f64 a1, f64 a0, f64 b1, f64 b0) {
+  f64 x[4];
+  f64 i, j, k;
+  twoDiff(a0, b0, &i, &x[0]);
+  twoSum(a1, i, &j, &k);
+  twoDiff(k, b1, &i, &x[1]);
+  twoSum(j, i, &x[3], &x[2]);
+
+  for (i32 n = 3; n >= 0; n--) {
+    if (x[n] != 0) return x[n];
+  }
+  return 0;
+}
 
-typedef struct {
-  Vector2 min;
-  Vector2 max;
+// orient returns negative value if the points go counter-clockwise in the
+// coordinates with y going down, zero if they are collinear. Sign is exact.
+local f64 orient(Vec2 a, Vec2 b, Vec2 c) {
+  f64 acx = CAST(f64, a.x) - c.x;
+  f64 bcx = CAST(f64, b.x) - c.x;
+  f64 acy = CAST(f64, a.y) - c.y;
+  f64 bcy = CAST(f64, b.y) - c.y;
+
+  f64 left  = acy * bcx;
+  f64 right = acx * bcy;
+  f64 det   = left - right;
+
+  f64 sum;
+  if (left > 0) {
+    if (right <= 0) return det;
+    sum = left + right;
+  } else if (left < 0) {
+    if (right >= 0) return det;
+    sum = -left - right;
+  } else {
+    return det;
+  }
+  if (fabs(det) >= ORIENT_ERROR_BOUND * sum) {
+    return det;
+  }
 
-} BBox;
+  return orientExact(left, fma(acy, bcx, -left), right, fma(acx, bcy, -right));
+}
 
-local Vector2 bboxCenter(BBox box) {
-  Vector2 center = {
-    .x = (box.min.x + box.max.x) / 2.0f,
-    .y = (box.min.y + box.max.y) / 2.0f,
-  };
-  return center;
+// inCircle returns true if p is inside of the circumcircle of a, b, c
+local bool inCircle(Vec2 a, Vec2 b, Vec2 c, Vec2 p) {
+  f64 dx = CAST(f64, a.x) - p.x;
+  f64 dy = CAST(f64, a.y) - p.y;
+  f64 ex = CAST(f64, b.x) - p.x;
+  f64 ey = CAST(f64, b.y) - p.y;
+  f64 fx = CAST(f64, c.x) - p.x;
+  f64 fy = CAST(f64, c.y) - p.y;
+
+  f64 ap = dx * dx + dy * dy;
+  f64 bp = ex * ex + ey * ey;
+  f64 cp = fx * fx + fy * fy;
+
+  return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0;
 }
 
-local BBox bounds(Vector2* points, i32 length) {
-  BBox box = { 0 };
-  if (length == 0) {
-    return box;
-  }
+local f64 distanceSqr(f64 ax, f64 ay, Vec2 b) {
+  f64 dx = b.x - ax;
+  f64 dy = b.y - ay;
+  return dx * dx + dy * dy;
+}
 
-  box.min = points[0];
-  box.max = points[0];
+// triangleCircumcircle returns the center of the circumcircle relative to
+// the point a, infinite or NaN if the points are collinear
+local void triangleCircumcircle(Vec2 a, Vec2 b, Vec2 c, f64* x, f64* y) {
+  f64 dx = CAST(f64, b.x) - a.x;
+  f64 dy = CAST(f64, b.y) - a.y;
+  f64 ex = CAST(f64, c.x) - a.x;
+  f64 ey = CAST(f64, c.y) - a.y;
 
-  Vector2* point;
-  for (i32 i = 1; i < length; i++) {
-    point = points + i;
+  f64 bl = dx * dx + dy * dy;
+  f64 cl = ex * ex + ey * ey;
+  f64 d  = 0.5 / (dx * ey - dy * ex);
 
-    if (point->x > box.max.x) {
-      box.max.x = point->x;
-    } else if (point->x < box.min.x) {
-      box.max.x = point->x;
-    }
+  *x = (ey * bl - dy * cl) * d;
+  *y = (dx * cl - ex * bl) * d;
+}
 
-    if (point->y > box.max.y) {
-      box.max.y = point->y;
-    } else if (point->y < box.min.y) {
-      box.max.y = point->y;
-    }
-  }
+local f64 triangleCircumcircleRadius(Vec2 a, Vec2 b, Vec2 c) {
+  f64 x, y;
+  triangleCircumcircle(a, b, c, &x, &y);
+  return x * x + y * y;
+}
 
-  return box;
+// pseudoAngle grows monotonically with the angle of the vector, [0, 1]
+local f64 pseudoAngle(f64 dx, f64 dy) {
+  f64 p = dx / (fabs(dx) + fabs(dy));
+  return (dy > 0 ? 3 - p : 1 + p) / 4;
 }
 
-local f32 triangleArea(Vector2 a, Vector2 b, Vector2 c) {
-  return (b.y - a.y) * (c.x - b.x) - (b.x - a.x) * (c.y - b.y);
+////////////////////////////////////////////////////////////////////////////////
+/// SORTING
+////////////////////////////////////////////////////////////////////////////////
+
+local void swapIds(u32* ids, i32 i, i32 j) {
+  u32 tmp = ids[i];
+  ids[i] = ids[j];
+  ids[j] = tmp;
 }
 
-local Vector2 triangleCircumcircleCenter(Vector2 a, Vector2 b, Vector2 c) {
-  f32 dx = b.x - a.x;
-  f32 dy = b.y - a.y;
-  f32 ex = c.x - a.x;
-  f32 ey = c.y - a.y;
+// sortIds sorts the ids of the points by their distances
+local void sortIds(u32* ids, const f64* dists, i32 left, i32 right) {
+  while (right - left > 20) {
+    i32 median = (left + right) >> 1;
+    i32 i = left + 1;
+    i32 j = right;
+    swapIds(ids, median, i);
+    if (dists[ids[left]] > dists[ids[right]]) swapIds(ids, left, right);
+    if (dists[ids[i]] > dists[ids[right]]) swapIds(ids, i, right);
+    if (dists[ids[left]] > dists[ids[i]]) swapIds(ids, left, i);
+
+    u32 temp = ids[i];
+    f64 temp_dist = dists[temp];
+    for (;;) {
+      do i++; while (dists[ids[i]] < temp_dist);
+      do j--; while (dists[ids[j]] > temp_dist);
+      if (j < i) break;
+      swapIds(ids, i, j);
+    }
+    ids[left + 1] = ids[j];
+    ids[j] = temp;
+
+    // Recursion goes to the smaller half, so the stack stays logarithmic
+    if (right - i + 1 >= j - left) {
+      sortIds(ids, dists, left, j - 1);
+      left = i;
+    } else {
+      sortIds(ids, dists, i, right);
+      right = j - 1;
+    }
+  }
 
-  f32 bl = dx * dx + dy * dy;
-  f32 cl = ex * ex + ey * ey;
-  f32 d  = 0.5 / (dx * ey - dy * ex);
+  for (i32 i = left + 1; i <= right; i++) {
+    u32 temp = ids[i];
+    f64 temp_dist = dists[temp];
+    i32 j = i - 1;
+    while (j >= left && dists[ids[j]] > temp_dist) {
+      ids[j + 1] = ids[j];
+      j--;
+    }
+    ids[j + 1] = temp;
+  }
+}
 
-  Vector2 center = {
-    .x = a.x + (ey * bl - dy * cl) * d,
-    .y = a.y + (dx * cl - ex * bl) * d,
-  };
+////////////////////////////////////////////////////////////////////////////////
+/// TRIANGULATION
+////////////////////////////////////////////////////////////////////////////////
 
-  return center;
+// Delaunator keeps the advancing convex hull and the triangles built so far
+typedef struct {
+  const Vec2* points;
+  u32* triangles;
+  i32* halfedges;
+  i32 count;
+
+  // Hull is a linked list of the points, every point knows the triangle
+  // adjacent to its edge
+  u32* hull_prev;
+  u32* hull_next;
+  u32* hull_tri;
+  u32 hull_start;
+  // Hull points by the angle around the center
+  i32* hull_hash;
+  i32 hash_size;
+  f64 cx;
+  f64 cy;
+} Delaunator;
+
+local i32 hashKey(const Delaunator* d, Vec2 point) {
+  f64 angle = pseudoAngle(point.x - d->cx, point.y - d->cy);
+  return CAST(i32, floor(angle * d->hash_size)) % d->hash_size;
+}
+
+local void linkEdges(Delaunator* d, i32 a, i32 b) {
+  d->halfedges[a] = b;
+  if (b != -1) d->halfedges[b] = a;
 }
 
-local f32 triangleCircumcircleRadius(Vector2 a, Vector2 b, Vector2 c) {
-  f32 dx = b.x - a.x;
-  f32 dy = b.y - a.y;
-  f32 ex = c.x - a.x;
-  f32 ey = c.y - a.y;
+// addTriangle adds the triangle with the adjacent half-edges, returns its
+// first half-edge
+local i32 addTriangle(Delaunator* d, u32 i0, u32 i1, u32 i2, i32 a, i32 b, i32 c) {
+  i32 t = d->count;
 
-  f32 bl = dx * dx + dy * dy;
-  f32 cl = ex * ex + ey * ey;
-  f32 d  = 0.5 / (dx * ey - dy * ex);
+  d->triangles[t]     = i0;
+  d->triangles[t + 1] = i1;
+  d->triangles[t + 2] = i2;
 
-  f32 x = (ey * bl - dy * cl) * d;
-  f32 y = (dx * cl - ex * bl) * d;
+  linkEdges(d, t, a);
+  linkEdges(d, t + 1, b);
+  linkEdges(d, t + 2, c);
 
-  return x * x + y * y;
+  d->count += 3;
+  return t;
 }
 
-local i32 closestPoint(Vector2 to, Vector2* points, i32 length, i32 exclude) {
-  f32 distance;
-  f32 cur_distance;
+// legalize flips the triangles around the half-edge until all of them
+// satisfy the Delaunay condition
+local i32 legalize(Delaunator* d, i32 a) {
+  i32 stack[DELAUNAY_EDGE_STACK];
+  i32 i  = 0;
+  i32 ar = 0;
+
+  for (;;) {
+    i32 b  = d->halfedges[a];
+    i32 a0 = a - a % 3;
+    ar = a0 + (a + 2) % 3;
+
+    // Edge of the hull
+    if (b == -1) {
+      if (i == 0) break;
+      a = stack[--i];
+      continue;
+    }
 
-  i32 first    = 0;
-  i32 closest  = -1;
-  for (; first < length; first++) {
-    if (first != exclude) {
-      distance = Vector2DistanceSqr(to, points[0]);
-      closest  = first;
-      break;
+    i32 b0 = b - b % 3;
+    i32 al = a0 + (a + 1) % 3;
+    i32 bl = b0 + (b + 2) % 3;
+
+    u32 p0 = d->triangles[ar];
+    u32 pr = d->triangles[a];
+    u32 pl = d->triangles[al];
+    u32 p1 = d->triangles[bl];
+
+    if (inCircle(d->points[p0], d->points[pr], d->points[pl], d->points[p1])) {
+      d->triangles[a] = p1;
+      d->triangles[b] = p0;
+
+      i32 hbl = d->halfedges[bl];
+
+      // Edge swapped on the other side of the hull, which is rare
+      if (hbl == -1) {
+        u32 e = d->hull_start;
+        do {
+          if (d->hull_tri[e] == CAST(u32, bl)) {
+            d->hull_tri[e] = a;
+            break;
+          }
+          e = d->hull_prev[e];
+        } while (e != d->hull_start);
+      }
+      linkEdges(d, a, hbl);
+      linkEdges(d, b, d->halfedges[ar]);
+      linkEdges(d, ar, bl);
+
+      i32 br = b0 + (b + 1) % 3;
+      if (i < DELAUNAY_EDGE_STACK) {
+        stack[i++] = br;
+      }
+    } else {
+      if (i == 0) break;
+      a = stack[--i];
     }
   }
 
+  return ar;
+}
+
+// collinearHull orders the collinear points along the line and keeps the
+// distinct ones as the hull
+local void collinearHull(Triangulation* result, const Vec2* points, i32 length,
+    u32* ids, f64* dists) {
   for (i32 i = 0; i < length; i++) {
-    if (i == closest || i == exclude) continue;
-    cur_distance = Vector2DistanceSqr(to, points[i]);
-    if (cur_distance < distance) {
-      closest  = i;
-      distance = cur_distance;
-    }
+    f64 dx = CAST(f64, points[i].x) - points[0].x;
+    dists[i] = dx != 0 ? dx : CAST(f64, points[i].y) - points[0].y;
   }
+  sortIds(ids, dists, 0, length - 1);
 
-  return closest;
+  result->hull = CAST(u32*, malloc(length * sizeof(u32)));
+  f64 last = -INFINITY;
+  for (i32 i = 0; i < length; i++) {
+    if (dists[ids[i]] > last) {
+      result->hull[result->hull_count++] = ids[i];
+      last = dists[ids[i]];
+    }
+  }
 }
 
-local i32 formsSmallestCircle(i32 ai, i32 bi, Vector2* points, i32 length) {
+bool delaunay(Triangulation* result, const Vec2* points, i32 length) {
+  memset(result, 0, sizeof(Triangulation));
+  if (length < 3) {
+    return false;
+  }
 
-  f32 radius;
-  f32 cur_radius;
+  u32* ids   = CAST(u32*, malloc(length * sizeof(u32)));
+  f64* dists = CAST(f64*, malloc(length * sizeof(f64)));
 
-  i32 first    = 0;
-  i32 closest  = -1;
-  for (; first < length; first++) {
-    if (first != ai && first != bi) {
-      radius  = triangleCircumcircleRadius(points[ai], points[bi], points[first]);
-      closest = first;
-      break;
+  f64 min_x = INFINITY, min_y = INFINITY;
+  f64 max_x = -INFINITY, max_y = -INFINITY;
+  for (i32 i = 0; i < length; i++) {
+    min_x = min_value(min_x, points[i].x);
+    min_y = min_value(min_y, points[i].y);
+    max_x = max_value(max_x, points[i].x);
+    max_y = max_value(max_y, points[i].y);
+    ids[i] = i;
+  }
+  f64 cx = (min_x + max_x) / 2;
+  f64 cy = (min_y + max_y) / 2;
+
+  // Seed point close to the center, the closest one to it and the one that
+  // forms the smallest circumcircle with both
+  i32 i0 = 0;
+  f64 min_dist = INFINITY;
+  for (i32 i = 0; i < length; i++) {
+    f64 distance = distanceSqr(cx, cy, points[i]);
+    if (distance < min_dist) {
+      i0 = i;
+      min_dist = distance;
     }
   }
 
+  i32 i1 = -1;
+  min_dist = INFINITY;
   for (i32 i = 0; i < length; i++) {
-    if (i == ai || i == bi || i == first) continue;
+    if (i == i0) continue;
+    f64 distance = distanceSqr(points[i0].x, points[i0].y, points[i]);
+    if (distance < min_dist && distance > 0) {
+      i1 = i;
+      min_dist = distance;
+    }
+  }
 
-    cur_radius = triangleCircumcircleRadius(points[ai], points[bi], points[closest]);
-    if (cur_radius < radius) {
-      closest = i;
-      radius  = cur_radius;
+  i32 i2 = -1;
+  f64 min_radius = INFINITY;
+  for (i32 i = 0; i1 >= 0 && i < length; i++) {
+    if (i == i0 || i == i1) continue;
+    f64 radius = triangleCircumcircleRadius(points[i0], points[i1], points[i]);
+    if (radius < min_radius) {
+      i2 = i;
+      min_radius = radius;
     }
   }
 
-  return closest;
-}
+  if (i2 < 0) {
+    collinearHull(result, points, length, ids, dists);
+    free(ids);
+    free(dists);
+    return true;
+  }
 
-// @todo: Original implementations precomputes all of the distances before
-// the sort, which may be a faster way but at the time of writing this comment
-// I was too lazy and stupid to think of the similar implementation.
-// Instead of points this function should operate with ids (indices).
-local i32 compareDistances(void* ctx, const void* lhs, const void* rhs) {
-  Vector2* center = CAST(Vector2*, ctx);
-  Vector2* a      = CAST(Vector2*, lhs);
-  Vector2* b      = CAST(Vector2*, rhs);
+  // Orient the seed triangle counter-clockwise
+  if (orient(points[i0], points[i1], points[i2]) < 0) {
+    i32 tmp = i1;
+    i1 = i2;
+    i2 = tmp;
+  }
 
-  f32 center_a = Vector2DistanceSqr(*center, *a);
-  f32 center_b = Vector2DistanceSqr(*center, *b);
+  f64 center_x, center_y;
+  triangleCircumcircle(points[i0], points[i1], points[i2], &center_x, &center_y);
+  center_x += points[i0].x;
+  center_y += points[i0].y;
 
-  return (center_a > center_b) ? 1 : -1;
-}
+  result->seed[0] = points[i0];
+  result->seed[1] = points[i1];
+  result->seed[2] = points[i2];
+  result->center  = (Vec2){ center_x, center_y };
+  result->radius  = sqrt(distanceSqr(center_x, center_y, points[i0]));
 
-local void sortByDistance(Vector2 from, Vector2* points, i32 length) {
-  qsort_r(points, length, sizeof(Vector2), &from, compareDistances);
-}
+  // Points are added in the order of the distance to the seed circumcenter
+  for (i32 i = 0; i < length; i++) {
+    dists[i] = distanceSqr(center_x, center_y, points[i]);
+  }
+  sortIds(ids, dists, 0, length - 1);
+  free(dists);
+
+  i32 max_triangles = max_value(2 * length - 5, 0);
+  Delaunator d = {
+    .points    = points,
+    .triangles = CAST(u32*, malloc(max_triangles * 3 * sizeof(u32))),
+    .halfedges = CAST(i32*, malloc(max_triangles * 3 * sizeof(i32))),
+    .hull_prev = CAST(u32*, malloc(length * sizeof(u32))),
+    .hull_next = CAST(u32*, malloc(length * sizeof(u32))),
+    .hull_tri  = CAST(u32*, malloc(length * sizeof(u32))),
+    .hash_size = CAST(i32, ceil(sqrt(length))),
+    .cx        = center_x,
+    .cy        = center_y,
+  };
+  d.hull_hash = CAST(i32*, malloc(d.hash_size * sizeof(i32)));
+  for (i32 i = 0; i < d.hash_size; i++) {
+    d.hull_hash[i] = -1;
+  }
 
+  // Seed triangle is the starting hull
+  d.hull_start = i0;
+  i32 hull_size = 3;
 
-void delaunay(Vector2* points, i32 length) {
-  if (length < 3) {
-    return;
-  }
+  d.hull_next[i0] = d.hull_prev[i2] = i1;
+  d.hull_next[i1] = d.hull_prev[i0] = i2;
+  d.hull_next[i2] = d.hull_prev[i1] = i0;
 
-  BBox box           = bounds(points, length);
-  Vector2 box_center = bboxCenter(box);
+  d.hull_tri[i0] = 0;
+  d.hull_tri[i1] = 1;
+  d.hull_tri[i2] = 2;
 
-  // pick a seed point close to the center
-  i32 ai = closestPoint(box_center, points, length, -1);
-  i32 bi = closestPoint(points[ai], points, length, ai);
-  i32 ci = formsSmallestCircle(ai, bi, points, length);
+  d.hull_hash[hashKey(&d, points[i0])] = i0;
+  d.hull_hash[hashKey(&d, points[i1])] = i1;
+  d.hull_hash[hashKey(&d, points[i2])] = i2;
 
+  addTriangle(&d, i0, i1, i2, -1, -1, -1);
 
-  // Orient triangle counter-clocwise
-  if (triangleArea(points[ai], points[bi], points[ci]) < 0) {
-    i32 tmp = bi;
-    bi = ci;
-    ci = tmp;
-  }
+  Vec2 previous = { 0 };
+  for (i32 k = 0; k < length; k++) {
+    u32 i = ids[k];
+    Vec2 point = points[i];
 
-  Vector2 center = triangleCircumcircleCenter(points[ai], points[bi], points[ci]);
+    if (k > 0 && fabs(CAST(f64, point.x) - previous.x) <= DELAUNAY_EPSILON
+        && fabs(CAST(f64, point.y) - previous.y) <= DELAUNAY_EPSILON) continue;
+    previous = point;
 
-  DrawLineEx(points[ai], points[bi], 2, RED);
-  DrawLineEx(points[bi], points[ci], 2, GREEN);
-  DrawLineEx(points[ci], points[ai], 2, BLUE);
+    if (i == CAST(u32, i0) || i == CAST(u32, i1) || i == CAST(u32, i2)) continue;
 
-  f32 radius_sqr = Vector2Distance(center, points[bi]);
+    // Visible edge of the hull found through the angular hash
+    i32 start = 0;
+    i32 key   = hashKey(&d, point);
+    for (i32 j = 0; j < d.hash_size; j++) {
+      start = d.hull_hash[(key + j) % d.hash_size];
+      if (start != -1 && CAST(u32, start) != d.hull_next[start]) break;
+    }
 
-  DrawCircleLinesV(center, radius_sqr, BLACK);
+    start = d.hull_prev[start];
+    i32 e = start;
+    u32 q;
+    while (q = d.hull_next[e], orient(point, points[e], points[q]) >= 0) {
+      e = q;
+      if (e == start) {
+        e = -1;
+        break;
+      }
+    }
+    // Likely a near duplicate
+    if (e == -1) continue;
+
+    // First triangle from the point
+    i32 t = addTriangle(&d, e, i, d.hull_next[e], -1, -1, d.hull_tri[e]);
+
+    // Flip the triangles until they satisfy the Delaunay condition
+    d.hull_tri[i] = legalize(&d, t + 2);
+    d.hull_tri[e] = t;
+    hull_size++;
+
+    // Walk forward through the hull adding more triangles
+    u32 n = d.hull_next[e];
+    while (q = d.hull_next[n], orient(point, points[n], points[q]) < 0) {
+      t = addTriangle(&d, n, i, q, d.hull_tri[i], -1, d.hull_tri[n]);
+      d.hull_tri[i] = legalize(&d, t + 2);
+      // Removed from the hull
+      d.hull_next[n] = n;
+      hull_size--;
+      n = q;
+    }
+
+    // Walk backward from the other side
+    if (e == start) {
+      while (q = d.hull_prev[e], orient(point, points[q], points[e]) < 0) {
+        t = addTriangle(&d, q, i, e, -1, d.hull_tri[e], d.hull_tri[q]);
+        legalize(&d, t + 2);
+        d.hull_tri[q] = t;
+        d.hull_next[e] = e;
+        hull_size--;
+        e = q;
+      }
+    }
+
+    d.hull_start = d.hull_prev[i] = e;
+    d.hull_next[e] = d.hull_prev[n] = i;
+    d.hull_next[i] = n;
+
+    d.hull_hash[hashKey(&d, point)] = i;
+    d.hull_hash[hashKey(&d, points[e])] = e;
+  }
+
+  result->hull       = CAST(u32*, malloc(hull_size * sizeof(u32)));
+  result->hull_count = hull_size;
+  for (i32 i = 0, e = d.hull_start; i < hull_size; i++) {
+    result->hull[i] = e;
+    e = d.hull_next[e];
+  }
+  result->triangles = d.triangles;
+  result->halfedges = d.halfedges;
+  result->count     = d.count;
+
+  free(ids);
+  free(d.hull_prev);
+  free(d.hull_next);
+  free(d.hull_tri);
+  free(d.hull_hash);
+  return true;
+}
 
-  sortByDistance(center, points, length);
+void triangulationFree(Triangulation* triangulation) {
+  free(triangulation->triangles);
+  free(triangulation->halfedges);
+  free(triangulation->hull);
+  memset(triangulation, 0, sizeof(Triangulation));
 }
@@ -2,14 +2,38 @@
 #define DELAYNAY_H
 
 #include "types.h"
-
-#include <raylib.h>
+#include "imagine.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void delaunay(Vector2* points, i32 length);
+// Triangulation is the result of the delaunay, port of the Delaunator.
+// Every three consecutive indices of the triangles are a triangle oriented
+// the same way as the seed one, halfedges[e] is the half-edge of the
+// neighbouring triangle opposite to the half-edge e or -1 on the hull.
+typedef struct {
+  // Seed triangle oriented counter-clockwise
+  Vec2 seed[3];
+  // Center and radius of the circumcircle of the seed triangle
+  Vec2 center;
+  f32 radius;
+
+  u32* triangles;
+  i32* halfedges;
+  // Number of the indices in the triangles and the halfedges
+  i32 count;
+  // Indices of the points of the convex hull in the order of the triangles
+  u32* hull;
+  i32 hull_count;
+} Triangulation;
+
+// delaunay triangulates the points, returns false if there are less than
+// three points. Points that are all collinear produce no triangles, only the
+// hull going along the line. Duplicate points are skipped.
+bool delaunay(Triangulation* result, const Vec2* points, i32 length);
+
+void triangulationFree(Triangulation* triangulation);
 
 #ifdef __cplusplus
 }
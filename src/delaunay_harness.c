@@ -0,0 +1,577 @@
+// Correctness and throughput harness of the delaunay, the port of the
+// Delaunator in reference.js.
+//
+// Every generated set of points is triangulated and checked: half-edges are
+// reciprocal, triangles are oriented the same way, every edge is locally
+// Delaunay, hull is convex, matches the boundary of the triangles and holds
+// every point, and the number of triangles is 2n - h - 2 for n unique points.
+// Fixtures written by fixture.mjs carry the counts of the reference
+// implementation, they are compared exactly. Results are printed to stdout
+// as JSON:
+//
+//   { "seed": 1, "checks": [ { "generator": ..., "points": ...,
+//     "triangles": ..., "hull": ..., "errors": [ ... ] }, ... ],
+//   "fixtures": [ ... ], "scaling": [ { "generator": ..., "points": ...,
+//     "ns": ..., "points_per_sec": ... }, ... ] }
+//
+// Exit status is non-zero if any check fails.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "types.h"
+#include "delaunay.h"
+
+// Sets larger than this skip the quadratic check of the points inside of
+// the hull
+#define HARNESS_MAX_BRUTE 20000
+// Errors reported per set, the rest are only counted
+#define HARNESS_MAX_ERRORS 8
+// Relative tolerance of the in-circle check, the port uses plain doubles there
+#define HARNESS_IN_CIRCLE_TOLERANCE 1e-9
+
+////////////////////////////////////////////////////////////////////////////////
+/// RANDOM
+////////////////////////////////////////////////////////////////////////////////
+
+// randomState turns the seed into the nonzero state of nextRandom
+local u64 randomState(u64 seed) {
+  return (seed * 0x9e3779b97f4a7c15ull) | 1;
+}
+
+local i32 randomRange(u64* random, i32 max) {
+  return CAST(i32, nextRandom(random) % CAST(u64, max));
+}
+
+// randomGaussian returns normally distributed value, Box-Muller transform
+local f32 randomGaussian(u64* random) {
+  f64 u = (randomUnit(random) + 1.0 / (1 << 25));
+  f64 v = randomUnit(random);
+  return CAST(f32, sqrt(-2.0 * log(u)) * cos(M_PI_180 * 360.0 * v));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// GENERATORS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef void Generator(u64* random, Vec2* points, i32 count);
+
+local void generateUniform(u64* random, Vec2* points, i32 count) {
+  for (i32 i = 0; i < count; i++) {
+    points[i].x = randomUnit(random) * 1000.0f;
+    points[i].y = randomUnit(random) * 1000.0f;
+  }
+}
+
+// Gaussian clusters of different sizes around eight centers
+local void generateClusters(u64* random, Vec2* points, i32 count) {
+  Vec2 centers[8];
+  f32 sigmas[8];
+  for (i32 i = 0; i < 8; i++) {
+    centers[i] = (Vec2){ randomUnit(random) * 1000.0f, randomUnit(random) * 1000.0f };
+    sigmas[i]  = 1.0f + randomUnit(random) * 50.0f;
+  }
+  for (i32 i = 0; i < count; i++) {
+    i32 c = randomRange(random, 8);
+    points[i].x = centers[c].x + randomGaussian(random) * sigmas[c];
+    points[i].y = centers[c].y + randomGaussian(random) * sigmas[c];
+  }
+}
+
+// Exact integer lattice, every cell has four cocircular corners
+local void generateGrid(u64* UNUSED(random), Vec2* points, i32 count) {
+  i32 side = CAST(i32, ceil(sqrt(count)));
+  for (i32 i = 0; i < count; i++) {
+    points[i] = (Vec2){ CAST(f32, i % side), CAST(f32, i / side) };
+  }
+}
+
+// Points on a single line, shuffled and with repeats. The first two differ,
+// so even the smallest set is a line and not a single point.
+local void generateCollinear(u64* random, Vec2* points, i32 count) {
+  for (i32 i = 0; i < count; i++) {
+    f32 t = CAST(f32, i < 2 ? i : randomRange(random, count));
+    points[i] = (Vec2){ t, 0.5f * t + 3.0f };
+  }
+}
+
+// Every point is one of the few distinct ones
+local void generateDuplicates(u64* random, Vec2* points, i32 count) {
+  i32 unique = max_value(count / 10, 3);
+  generateUniform(random, points, unique);
+  for (i32 i = unique; i < count; i++) {
+    points[i] = points[randomRange(random, unique)];
+  }
+}
+
+// Points are dense where the synthetic image is dark, the way halftone
+// places the dots: gradient with a few discs, rejection sampled
+local void generateImage(u64* random, Vec2* points, i32 count) {
+  Vec2 discs[6];
+  f32 radii[6];
+  for (i32 i = 0; i < 6; i++) {
+    discs[i] = (Vec2){ randomUnit(random) * 1000.0f, randomUnit(random) * 1000.0f };
+    radii[i] = 20.0f + randomUnit(random) * 150.0f;
+  }
+
+  for (i32 i = 0; i < count;) {
+    // Pixel and the position inside of it
+    f32 x = randomRange(random, 1000) + randomUnit(random);
+    f32 y = randomRange(random, 1000) + randomUnit(random);
+
+    f32 darkness = (x + y) / 2000.0f;
+    for (i32 j = 0; j < 6; j++) {
+      if (square(x - discs[j].x) + square(y - discs[j].y) < square(radii[j])) {
+        darkness = 1.0f - darkness;
+      }
+    }
+    if (randomUnit(random) < darkness) {
+      points[i++] = (Vec2){ x, y };
+    }
+  }
+}
+
+typedef struct {
+  const char* name;
+  Generator* generate;
+} GeneratorEntry;
+
+local const GeneratorEntry generators[] = {
+  { "uniform",    generateUniform    },
+  { "clusters",   generateClusters   },
+  { "grid",       generateGrid       },
+  { "collinear",  generateCollinear  },
+  { "duplicates", generateDuplicates },
+  { "image",      generateImage      },
+};
+
+#define GENERATORS_COUNT CAST(i32, sizeof(generators) / sizeof(generators[0]))
+
+local const GeneratorEntry* findGenerator(const char* name) {
+  for (i32 i = 0; i < GENERATORS_COUNT; i++) {
+    if (strcmp(generators[i].name, name) == 0) {
+      return &generators[i];
+    }
+  }
+  return NULL;
+}
+
+local Vec2* generatePoints(const GeneratorEntry* generator, u64 seed, i32 count) {
+  u64 random = randomState(seed);
+  Vec2* points = CAST(Vec2*, malloc(sizeof(Vec2) * count));
+  generator->generate(&random, points, count);
+  return points;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// CHECKS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  i32 errors;
+  // Separates the errors in the JSON array
+  bool first;
+} Check;
+
+local void checkFail(Check* check, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+local void checkFail(Check* check, const char* format, ...) {
+  if (check->errors++ >= HARNESS_MAX_ERRORS) {
+    return;
+  }
+  printf("%s\"", check->first ? "" : ", ");
+  check->first = false;
+
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\"");
+}
+
+// orient is the sign of the orientation computed in long doubles, the
+// coordinates are single precision so the result is exact
+local i32 orient(Vec2 a, Vec2 b, Vec2 c) {
+  long double det = (CAST(long double, a.y) - c.y) * (CAST(long double, b.x) - c.x)
+    - (CAST(long double, a.x) - c.x) * (CAST(long double, b.y) - c.y);
+  return (det > 0) - (det < 0);
+}
+
+// strictlyInCircle returns true if p is inside of the circumcircle of the
+// triangle a, b, c beyond the rounding of the in-circle test
+local bool strictlyInCircle(Vec2 a, Vec2 b, Vec2 c, Vec2 p) {
+  f64 dx = CAST(f64, a.x) - p.x, dy = CAST(f64, a.y) - p.y;
+  f64 ex = CAST(f64, b.x) - p.x, ey = CAST(f64, b.y) - p.y;
+  f64 fx = CAST(f64, c.x) - p.x, fy = CAST(f64, c.y) - p.y;
+
+  f64 ap = dx * dx + dy * dy;
+  f64 bp = ex * ex + ey * ey;
+  f64 cp = fx * fx + fy * fy;
+
+  f64 det = dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx);
+  f64 permanent = fabs(dx) * (fabs(ey * cp) + fabs(bp * fy))
+    + fabs(dy) * (fabs(ex * cp) + fabs(bp * fx))
+    + ap * (fabs(ex * fy) + fabs(ey * fx));
+  return det < -HARNESS_IN_CIRCLE_TOLERANCE * permanent;
+}
+
+local i32 compareVec2(const void* a, const void* b) {
+  const Vec2* p = CAST(const Vec2*, a);
+  const Vec2* q = CAST(const Vec2*, b);
+  if (p->x != q->x) return p->x < q->x ? -1 : 1;
+  if (p->y != q->y) return p->y < q->y ? -1 : 1;
+  return 0;
+}
+
+// uniqueCount returns the number of the distinct points
+local i32 uniqueCount(const Vec2* points, i32 count) {
+  Vec2* sorted = CAST(Vec2*, malloc(sizeof(Vec2) * count));
+  memcpy(sorted, points, sizeof(Vec2) * count);
+  qsort(sorted, count, sizeof(Vec2), compareVec2);
+
+  i32 unique = count > 0;
+  for (i32 i = 1; i < count; i++) {
+    unique += compareVec2(&sorted[i - 1], &sorted[i]) != 0;
+  }
+  free(sorted);
+  return unique;
+}
+
+local i32 nextHalfedge(i32 e) {
+  return e % 3 == 2 ? e - 2 : e + 1;
+}
+
+local void checkTriangles(Check* check, const Triangulation* t, const Vec2* points) {
+  i32 sign = 0;
+  for (i32 e = 0; e < t->count; e++) {
+    i32 opposite = t->halfedges[e];
+    if (opposite >= t->count || (opposite >= 0 && t->halfedges[opposite] != e)) {
+      checkFail(check, "halfedge %d is not reciprocal", e);
+      continue;
+    }
+    if (opposite >= 0 && (t->triangles[e] != t->triangles[nextHalfedge(opposite)]
+          || t->triangles[nextHalfedge(e)] != t->triangles[opposite])) {
+      checkFail(check, "halfedge %d and %d do not share the points", e, opposite);
+    }
+
+    if (e % 3 != 0) continue;
+    Vec2 a = points[t->triangles[e]];
+    Vec2 b = points[t->triangles[e + 1]];
+    Vec2 c = points[t->triangles[e + 2]];
+    i32 o = orient(a, b, c);
+    if (o == 0) {
+      checkFail(check, "triangle %d is degenerate", e / 3);
+    } else if (sign == 0) {
+      sign = o;
+    } else if (o != sign) {
+      checkFail(check, "triangle %d is flipped", e / 3);
+    }
+  }
+
+  // Local Delaunay condition on every edge implies the global one
+  for (i32 e = 0; e < t->count; e++) {
+    i32 opposite = t->halfedges[e];
+    if (opposite < e) continue;
+
+    i32 t0 = e - e % 3;
+    Vec2 p = points[t->triangles[nextHalfedge(nextHalfedge(opposite))]];
+    if (strictlyInCircle(points[t->triangles[t0]], points[t->triangles[t0 + 1]],
+          points[t->triangles[t0 + 2]], p)) {
+      checkFail(check, "edge %d is not Delaunay", e);
+    }
+  }
+}
+
+local void checkHull(Check* check, const Triangulation* t, const Vec2* points, i32 count) {
+  if (t->hull_count < 2) {
+    checkFail(check, "hull has %d points", t->hull_count);
+    return;
+  }
+
+  // Boundary half-edges, next point of the hull after every point
+  u32* following = CAST(u32*, malloc(sizeof(u32) * count));
+  memset(following, 0xff, sizeof(u32) * count);
+  i32 boundary = 0;
+  for (i32 e = 0; e < t->count; e++) {
+    if (t->halfedges[e] == -1) {
+      following[t->triangles[e]] = t->triangles[nextHalfedge(e)];
+      boundary++;
+    }
+  }
+  if (t->count > 0 && boundary != t->hull_count) {
+    checkFail(check, "%d boundary edges, %d hull points", boundary, t->hull_count);
+  }
+
+  // Hull goes along the boundary edges of the triangles
+  i32 sign = 0;
+  for (i32 i = 0; i < t->hull_count; i++) {
+    u32 a = t->hull[i];
+    u32 b = t->hull[(i + 1) % t->hull_count];
+    u32 c = t->hull[(i + 2) % t->hull_count];
+    if (t->count > 0 && following[a] != b) {
+      checkFail(check, "hull edge %u-%u is not on the boundary", a, b);
+    }
+
+    i32 o = orient(points[a], points[b], points[c]);
+    if (o != 0 && sign == 0) {
+      sign = o;
+    } else if (o != 0 && o != sign) {
+      checkFail(check, "hull is not convex at %u", b);
+    }
+  }
+  free(following);
+
+  if (count > HARNESS_MAX_BRUTE || sign == 0) {
+    return;
+  }
+  for (i32 i = 0; i < count; i++) {
+    for (i32 j = 0; j < t->hull_count; j++) {
+      Vec2 a = points[t->hull[j]];
+      Vec2 b = points[t->hull[(j + 1) % t->hull_count]];
+      if (orient(a, b, points[i]) == -sign) {
+        checkFail(check, "point %d is outside of the hull", i);
+        break;
+      }
+    }
+  }
+}
+
+// checkCounts compares the number of triangles with the one given by Euler's
+// formula, the collinear points have no triangles and all of them are on the
+// hull
+local void checkCounts(Check* check, const Triangulation* t, const Vec2* points, i32 count) {
+  i32 unique = uniqueCount(points, count);
+  i32 triangles = t->count / 3;
+  if (triangles == 0) {
+    if (t->hull_count != unique) {
+      checkFail(check, "collinear hull has %d of %d points", t->hull_count, unique);
+    }
+  } else if (triangles != 2 * unique - t->hull_count - 2) {
+    checkFail(check, "%d triangles, expected %d", triangles, 2 * unique - t->hull_count - 2);
+  }
+}
+
+// checkSet triangulates the points and prints the result of the checks as
+// the body of the JSON object, returns the number of the errors
+local i32 checkSet(const Vec2* points, i32 count) {
+  Triangulation t;
+  if (!delaunay(&t, points, count)) {
+    printf("\"triangles\": 0, \"hull\": 0, \"errors\": [\"not triangulated\"]");
+    return 1;
+  }
+
+  printf("\"triangles\": %d, \"hull\": %d, \"errors\": [", t.count / 3, t.hull_count);
+  Check check = { .first = true };
+  checkTriangles(&check, &t, points);
+  checkHull(&check, &t, points, count);
+  checkCounts(&check, &t, points, count);
+  if (check.errors > HARNESS_MAX_ERRORS) {
+    printf(", \"%d more\"", check.errors - HARNESS_MAX_ERRORS);
+  }
+  printf("]");
+
+  triangulationFree(&t);
+  return check.errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// FIXTURES
+////////////////////////////////////////////////////////////////////////////////
+
+// checkFixture compares the triangulation of the points of the file with the
+// counts of the reference implementation in its header:
+//
+//   triangles T hull H
+//   x y
+//   ...
+local i32 checkFixture(const char* path, bool first) {
+  printf("%s\n    { \"fixture\": \"%s\", ", first ? "" : ",", path);
+
+  FILE* file = fopen(path, "r");
+  i32 expected_triangles, expected_hull;
+  if (file == NULL || fscanf(file, " triangles %d hull %d", &expected_triangles, &expected_hull) != 2) {
+    printf("\"errors\": [\"failed to read\"] }");
+    if (file != NULL) fclose(file);
+    return 1;
+  }
+
+  da_define(Points, Vec2);
+  Points points = { 0 };
+  Vec2 point;
+  while (fscanf(file, "%f %f", &point.x, &point.y) == 2) {
+    da_append(&points, point);
+  }
+  fclose(file);
+
+  Triangulation t;
+  if (!delaunay(&t, points.arr, points.len)) {
+    printf("\"points\": %d, \"errors\": [\"not triangulated\"] }", CAST(i32, points.len));
+    da_free(&points);
+    return 1;
+  }
+
+  i32 errors = (t.count / 3 != expected_triangles) + (t.hull_count != expected_hull);
+  printf("\"points\": %d, \"triangles\": %d, \"expected_triangles\": %d, "
+      "\"hull\": %d, \"expected_hull\": %d, \"errors\": [",
+      CAST(i32, points.len), t.count / 3, expected_triangles, t.hull_count, expected_hull);
+  if (errors > 0) {
+    printf("\"counts differ from the reference\"");
+  }
+
+  // Whatever the reference says, the result must be valid on its own
+  Check check = { .first = errors == 0 };
+  checkTriangles(&check, &t, points.arr);
+  checkHull(&check, &t, points.arr, points.len);
+  printf("] }");
+  errors += check.errors;
+
+  triangulationFree(&t);
+
+  da_free(&points);
+  return errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SCALING
+////////////////////////////////////////////////////////////////////////////////
+
+local u64 nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return CAST(u64, ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// measure triangulates the points once, huge sets make the repetitions
+// pointless and the small ones are repeated for at least a quarter second
+local void measure(const char* generator, const Vec2* points, i32 count, bool first) {
+  u64 best = UINT64_MAX;
+  u64 total = 0;
+  i32 triangles = 0;
+  for (i32 repetition = 0; repetition < 100 && (repetition < 3 || total < 250000000ull)
+      && (repetition == 0 || count < 1000000); repetition++) {
+    u64 start = nowNs();
+    Triangulation t;
+    delaunay(&t, points, count);
+    u64 time = nowNs() - start;
+    triangles = t.count / 3;
+    triangulationFree(&t);
+
+    best = min_value(best, time);
+    total += time;
+  }
+
+  printf("%s\n    { \"generator\": \"%s\", \"points\": %d, \"triangles\": %d, "
+      "\"ns\": %" PRIu64 ", \"points_per_sec\": %.0f }",
+      first ? "" : ",", generator, count, triangles, best, count * 1e9 / best);
+  fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// MAIN
+////////////////////////////////////////////////////////////////////////////////
+
+local void usage(const char* program) {
+  fprintf(stderr,
+    "Usage: %s [--seed N] [--quick] [--max-points N] [--fixture FILE]...\n"
+    "       %s --points GENERATOR N [--seed N]\n"
+    "\n"
+    "  --seed N              seed of the generated points (default 1)\n"
+    "  --quick               small sets only\n"
+    "  --max-points N        largest set of the scaling (default 50000000)\n"
+    "  --fixture FILE        compare with the counts of the reference\n"
+    "  --points GENERATOR N  print the generated points for fixture.mjs\n"
+    "\n"
+    "Generators: uniform, clusters, grid, collinear, duplicates, image\n",
+    program, program);
+}
+
+i32 main(i32 argc, char** argv) {
+  u64 seed = 1;
+  bool quick = false;
+  i64 max_points = 50000000;
+  const GeneratorEntry* dump = NULL;
+  i32 dump_count = 0;
+  da_define(Paths, const char*);
+  Paths fixtures = { 0 };
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--max-points") == 0 && i + 1 < argc) {
+      max_points = strtoll(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--fixture") == 0 && i + 1 < argc) {
+      da_append(&fixtures, argv[++i]);
+    } else if (strcmp(argv[i], "--points") == 0 && i + 2 < argc) {
+      dump = findGenerator(argv[++i]);
+      dump_count = atoi(argv[++i]);
+      if (dump == NULL || dump_count <= 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (dump != NULL) {
+    Vec2* points = generatePoints(dump, seed, dump_count);
+    for (i32 i = 0; i < dump_count; i++) {
+      printf("%.9g %.9g\n", points[i].x, points[i].y);
+    }
+    free(points);
+    return 0;
+  }
+
+  static const i32 check_counts[] = { 3, 10, 100, 1000, 10000, 100000 };
+  static const i64 scaling_counts[] = {
+    1000, 10000, 100000, 1000000, 10000000, 50000000,
+  };
+  i32 nchecks = quick ? 4 : sizeof(check_counts) / sizeof(check_counts[0]);
+  i32 errors = 0;
+
+  printf("{\n  \"seed\": %" PRIu64 ",\n  \"checks\": [", seed);
+  for (i32 g = 0; g < GENERATORS_COUNT; g++) {
+    for (i32 c = 0; c < nchecks; c++) {
+      i32 count = check_counts[c];
+      Vec2* points = generatePoints(&generators[g], seed, count);
+      printf("%s\n    { \"generator\": \"%s\", \"points\": %d, ",
+          g + c > 0 ? "," : "", generators[g].name, count);
+      errors += checkSet(points, count);
+      printf(" }");
+      fflush(stdout);
+      free(points);
+    }
+  }
+
+  printf("\n  ],\n  \"fixtures\": [");
+  for (i32 i = 0; i < fixtures.len; i++) {
+    errors += checkFixture(fixtures.arr[i], i == 0);
+  }
+  da_free(&fixtures);
+
+  printf("\n  ],\n  \"scaling\": [");
+  i32 nscaling = quick ? 2 : sizeof(scaling_counts) / sizeof(scaling_counts[0]);
+  for (i32 g = 0, first = true; g < GENERATORS_COUNT; g++) {
+    // Large sets of every distribution are too slow, the rest is measured
+    // up to a million points
+    bool full = strcmp(generators[g].name, "uniform") == 0;
+    for (i32 s = 0; s < nscaling && scaling_counts[s] <= max_points; s++) {
+      if (!full && scaling_counts[s] > 1000000) break;
+      i32 count = CAST(i32, scaling_counts[s]);
+      Vec2* points = generatePoints(&generators[g], seed, count);
+      measure(generators[g].name, points, count, first);
+      free(points);
+      first = false;
+    }
+  }
+  printf("\n  ],\n  \"errors\": %d\n}\n", errors);
+
+  return errors > 0;
+}
@@ -0,0 +1,368 @@
+#include "dither.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// KERNELS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  i32 dx;
+  i32 dy;
+  f32 weight;
+} DitherTap;
+
+typedef struct {
+  const DitherTap* taps;
+  i32 count;
+  // Largest horizontal distance the error travels
+  i32 reach;
+} DitherKernelDef;
+
+local const DitherTap floyd_steinberg[] = {
+  {  1, 0, 7.0f / 16.0f },
+  { -1, 1, 3.0f / 16.0f },
+  {  0, 1, 5.0f / 16.0f },
+  {  1, 1, 1.0f / 16.0f },
+};
+
+// Atkinson diffuses only 3/4 of the error, highlights and shadows clip
+local const DitherTap atkinson[] = {
+  {  1, 0, 1.0f / 8.0f },
+  {  2, 0, 1.0f / 8.0f },
+  { -1, 1, 1.0f / 8.0f },
+  {  0, 1, 1.0f / 8.0f },
+  {  1, 1, 1.0f / 8.0f },
+  {  0, 2, 1.0f / 8.0f },
+};
+
+local const DitherTap jarvis[] = {
+  {  1, 0, 7.0f / 48.0f },
+  {  2, 0, 5.0f / 48.0f },
+  { -2, 1, 3.0f / 48.0f },
+  { -1, 1, 5.0f / 48.0f },
+  {  0, 1, 7.0f / 48.0f },
+  {  1, 1, 5.0f / 48.0f },
+  {  2, 1, 3.0f / 48.0f },
+  { -2, 2, 1.0f / 48.0f },
+  { -1, 2, 3.0f / 48.0f },
+  {  0, 2, 5.0f / 48.0f },
+  {  1, 2, 3.0f / 48.0f },
+  {  2, 2, 1.0f / 48.0f },
+};
+
+#define KERNEL(taps, reach) { taps, sizeof(taps) / sizeof(DitherTap), reach }
+
+local const DitherKernelDef kernels[_DITHER_MAX] = {
+  [DITHER_FLOYD_STEINBERG] = KERNEL(floyd_steinberg, 1),
+  [DITHER_ATKINSON]        = KERNEL(atkinson, 2),
+  [DITHER_JARVIS]          = KERNEL(jarvis, 2),
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// WAVEFRONT
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  f32* values;
+  i32 columns;
+  i32 rows;
+  const DitherKernelDef* kernel;
+  i32 levels;
+  // Number of the values of every row that are final
+  atomic_int* progress;
+  // Rows that started before the row above was done
+  atomic_int overlapped;
+} DitherJob;
+
+local void ditherValue(DitherJob* job, i32 row, i32 column) {
+  f32* value = job->values + CAST(usize, row) * job->columns + column;
+  f32 steps  = job->levels - 1;
+
+  f32 quantized = roundf(min_value(max_value(*value, 0.0f), 1.0f) * steps) / steps;
+  f32 error = *value - quantized;
+  *value = quantized;
+
+  const DitherKernelDef* kernel = job->kernel;
+  for (i32 i = 0; i < kernel->count; i++) {
+    i32 x = column + kernel->taps[i].dx;
+    i32 y = row + kernel->taps[i].dy;
+    if (x < 0 || x >= job->columns || y >= job->rows) continue;
+    job->values[CAST(usize, y) * job->columns + x] += error * kernel->taps[i].weight;
+  }
+}
+
+// ditherRow processes the row as far as the row above allows. While the row
+// above works on the column a it writes to the columns a - reach .. a + reach
+// of this row, this row writes up to reach columns ahead of its own, so it
+// has to stay more than twice the reach behind. Progress is published every
+// chunk of the columns, so the row below starts long before this one ends.
+local void ditherRow(void* ctx, i32 row, Arena* UNUSED(scratch)) {
+  DitherJob* job = CAST(DitherJob*, ctx);
+  i32 columns = job->columns;
+  i32 lag     = 2 * job->kernel->reach;
+
+  i32 column = 0;
+  while (column < columns) {
+    i32 allowed = min_value(column + DITHER_CHUNK, columns);
+    if (row > 0) {
+      i32 above;
+      for (;;) {
+        above = atomic_load_explicit(&job->progress[row - 1], memory_order_acquire);
+        if (above == columns || above - lag > column) break;
+        sched_yield();
+      }
+      if (above < columns) {
+        allowed = min_value(allowed, above - lag);
+        if (column == 0) {
+          atomic_fetch_add_explicit(&job->overlapped, 1, memory_order_relaxed);
+        }
+      }
+    }
+
+    for (; column < allowed; column++) {
+      ditherValue(job, row, column);
+    }
+    atomic_store_explicit(&job->progress[row], column, memory_order_release);
+  }
+}
+
+bool ditherGrid(f32* values, i32 columns, i32 rows, DitherKernel kernel,
+    i32 levels, Workers* workers, i32* overlapped) {
+  DitherJob job = {
+    .values   = values,
+    .columns  = columns,
+    .rows     = rows,
+    .kernel   = &kernels[kernel],
+    .levels   = max_value(levels, 2),
+    .progress = CAST(atomic_int*, calloc(max_value(rows, 1), sizeof(atomic_int))),
+  };
+  if (job.progress == NULL) {
+    fprintf(stderr, "Out of memory for the progress of %d rows\n", rows);
+    return false;
+  }
+  atomic_init(&job.overlapped, 0);
+
+  // Workers take the rows in order, so the row above is always taken by the
+  // time a row waits for it
+  TRACE_BEGIN("dither");
+  workersRun(workers, rows, ditherRow, &job);
+  TRACE_END();
+
+  if (overlapped != NULL) {
+    *overlapped = atomic_load_explicit(&job.overlapped, memory_order_relaxed);
+  }
+  free(job.progress);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RENDERING
+////////////////////////////////////////////////////////////////////////////////
+
+// DitherImage collects the cells of the image strip by strip
+typedef struct {
+  RenderParams params;
+  DitherParams dither;
+  i32 width;
+  i32 height;
+  i32 columns;
+  i32 rows;
+  // Average colors of the cells, zero alpha outside of the image
+  Rgba* colors;
+  // Luminance of the cells or of the pixels
+  f32* values;
+} DitherImage;
+
+local i32 ditherOffset(const DitherImage* image, i32 row) {
+  i32 step = image->params.step;
+  i32 y    = row * step;
+  return cellOffset(image->params, y);
+}
+
+local bool ditherImageInit(DitherImage* image, i32 width, i32 height,
+    RenderParams params, DitherParams dither) {
+  i32 step = params.step;
+  *image = (DitherImage){
+    .params  = params,
+    .dither  = dither,
+    .width   = width,
+    .height  = height,
+    .columns = (width + step - 1) / step,
+    .rows    = (height + step - 1) / step,
+  };
+
+  usize cells  = CAST(usize, image->columns) * image->rows;
+  usize values = dither.pixels ? CAST(usize, width) * height : cells;
+  image->colors = CAST(Rgba*, calloc(cells, sizeof(Rgba)));
+  image->values = CAST(f32*, calloc(values, sizeof(f32)));
+  if (image->colors == NULL || image->values == NULL) {
+    fprintf(stderr, "Out of memory for %zu dithered values\n", values);
+    free(image->colors);
+    free(image->values);
+    return false;
+  }
+  return true;
+}
+
+local void ditherImageFree(DitherImage* image) {
+  free(image->colors);
+  free(image->values);
+}
+
+// ditherImageStrip takes the cells of the row from the strip of pixels that
+// starts at the top of the row.
+local void ditherImageStrip(DitherImage* image, i32 row, Bitmap strip) {
+  i32 step = image->params.step;
+  i32 x    = ditherOffset(image, row);
+
+  for (i32 column = 0; x < image->width; column++, x += step) {
+    Rect cell = {
+      .x      = x,
+      .y      = 0,
+      .width  = step,
+      .height = step,
+    };
+    Rgba avg = cellAverage(strip, cell, image->params);
+
+    i32 i = row * image->columns + column;
+    image->colors[i] = avg;
+    if (!image->dither.pixels) {
+      image->values[i] = cellLuminance(avg, image->params);
+    }
+  }
+
+  if (image->dither.pixels) {
+    for (i32 y = 0; y < strip.height; y++) {
+      f32* values = image->values + CAST(usize, row * step + y) * image->width;
+      const u8* pixel = bitmapPixel(strip, 0, y);
+      i32 g = bitmapChannel(strip, 1);
+      i32 b = bitmapChannel(strip, 2);
+      for (i32 px = 0; px < image->width; px++, pixel += strip.channels) {
+        Rgba color = { pixel[0], pixel[g], pixel[b], 255 };
+        values[px] = cellLuminance(color, image->params);
+      }
+    }
+  }
+}
+
+// ditherCellLevel returns size of the figure of the cell after the error
+// diffusion
+local f32 ditherCellLevel(const DitherImage* image, i32 row, i32 column) {
+  if (!image->dither.pixels) {
+    return image->values[row * image->columns + column];
+  }
+
+  i32 step = image->params.step;
+  i32 x0   = ditherOffset(image, row) + column * step;
+  i32 y0   = row * step;
+  i32 x1   = min_value(x0 + step, image->width);
+  i32 y1   = min_value(y0 + step, image->height);
+
+  f32 on = 0;
+  for (i32 y = y0; y < y1; y++) {
+    const f32* values = image->values + CAST(usize, y) * image->width;
+    for (i32 x = x0; x < x1; x++) {
+      on += values[x];
+    }
+  }
+
+  f32 steps = max_value(image->dither.levels, 2) - 1;
+  return roundf(on / ((x1 - x0) * (y1 - y0)) * steps) / steps;
+}
+
+local bool ditherImageRender(DitherImage* image, Renderer render, Workers* workers) {
+  bool ok = image->dither.pixels
+    ? ditherGrid(image->values, image->width, image->height, image->dither.kernel, 2,
+        workers, NULL)
+    : ditherGrid(image->values, image->columns, image->rows,
+        image->dither.kernel, image->dither.levels, workers, NULL);
+  if (!ok) {
+    return false;
+  }
+
+  TRACE_BEGIN("dither_render");
+  i32 step = image->params.step;
+  for (i32 row = 0; row < image->rows; row++) {
+    for (i32 column = 0; column < image->columns; column++) {
+      Rgba avg = image->colors[row * image->columns + column];
+      if (avg.a == 0) continue;
+
+      Rect cell = {
+        .x      = ditherOffset(image, row) + column * step,
+        .y      = row * step,
+        .width  = step,
+        .height = step,
+      };
+      f32 level = ditherCellLevel(image, row, column);
+      renderFigure(render, cell, cellColor(avg, image->params), level,
+          image->params.radius, image->params.figure);
+    }
+  }
+  TRACE_END();
+  return true;
+}
+
+bool renderDither(Renderer render, Bitmap bitmap, RenderParams params,
+    DitherParams dither, Workers* workers) {
+  DitherImage image;
+  if (!ditherImageInit(&image, bitmap.width, bitmap.height, params, dither)) {
+    return false;
+  }
+
+  for (i32 row = 0; row < image.rows; row++) {
+    i32 y = row * params.step;
+    Bitmap strip = bitmapViewChannels(bitmapPixel(bitmap, 0, y), bitmap.width,
+        min_value(params.step, bitmap.height - y), bitmap.stride, bitmap.channels);
+    ditherImageStrip(&image, row, strip);
+  }
+
+  bool ok = ditherImageRender(&image, render, workers);
+  ditherImageFree(&image);
+  return ok;
+}
+
+bool renderDitherStrips(Renderer render, StripReader* reader, RenderParams params,
+    DitherParams dither, Workers* workers) {
+  i32 width = stripWidth(reader);
+  i32 step  = params.step;
+
+  DitherImage image;
+  if (!ditherImageInit(&image, width, stripHeight(reader), params, dither)) {
+    return false;
+  }
+
+  u8* pixels = CAST(u8*, malloc(CAST(usize, width) * step * 4));
+  if (pixels == NULL) {
+    fprintf(stderr, "Out of memory for the strip of %d rows\n", step);
+    ditherImageFree(&image);
+    return false;
+  }
+  Bitmap strip = bitmapView(pixels, width, step, 0);
+
+  bool ok = true;
+  for (i32 row = 0; row < image.rows; row++) {
+    TRACE_BEGIN("strip_read");
+    strip.height = stripRead(reader, pixels, step);
+    TRACE_END();
+    if (strip.height <= 0) {
+      ok = false;
+      break;
+    }
+    ditherImageStrip(&image, row, strip);
+  }
+  free(pixels);
+
+  if (ok) {
+    ok = ditherImageRender(&image, render, workers);
+  }
+  ditherImageFree(&image);
+  return ok;
+}
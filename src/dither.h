@@ -0,0 +1,83 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  DITHER_FLOYD_STEINBERG = 0,
+  DITHER_ATKINSON        = 1,
+  DITHER_JARVIS          = 2,
+
+  _DITHER_MAX
+} DitherKernel;
+
+// Error diffusion picks the size of every figure instead of the luminance
+// of its cell alone, the error of rounding the size is pushed to the cells
+// that are not drawn yet.
+typedef struct {
+  DitherKernel kernel;
+  // Number of the sizes of the figures including no figure, 2 is on and off
+  i32 levels;
+  // Diffuse the error between the pixels instead of the cells, size of the
+  // figure is then the share of the pixels of the cell that are on
+  bool pixels;
+} DitherParams;
+
+// Columns a row of the wavefront processes before it lets the row below
+// know how far it got
+#define DITHER_CHUNK 32
+
+// ditherGrid quantizes values in [0, 1] to the levels diffusing the error
+// with the kernel. Rows are spread between the workers as a diagonal
+// wavefront: every row trails the one above by twice the reach of the
+// kernel, so the rows never touch the same values at the same time.
+// Overlapped, if not NULL, receives the number of the rows that started
+// before the row above was done. Returns false if out of memory.
+bool ditherGrid(f32* values, i32 columns, i32 rows, DitherKernel kernel,
+    i32 levels, Workers* workers, i32* overlapped);
+
+// renderDither renders figures of all cells of the bitmap with the sizes
+// picked by the error diffusion. Returns false if out of memory.
+bool renderDither(Renderer render, Bitmap bitmap, RenderParams params,
+    DitherParams dither, Workers* workers);
+
+// renderDitherStrips does the same for the image read in strips. Only the
+// colors of the cells are kept, or luminance of the pixels with the pixel
+// granularity.
+bool renderDitherStrips(Renderer render, StripReader* reader, RenderParams params,
+    DitherParams dither, Workers* workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DITHER_H
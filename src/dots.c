@@ -32,191 +32,101 @@
 #undef STB_DS_IMPLEMENTATION
 
 #include "types.h"
+#include "cli.h"
 #include "delaunay.h"
-#define ARENA_IMPLEMENTATION
+#include "halftone.h"
 #include "arena.h"
-#undef ARENA_IMPLEMENTATION
+#include "trace.h"
 
-#define MAX_FILENAME_SIZE 1024
-#define RADS(degs) (degs * M_PI_180)
-
-da_define(Points, Vector2);
+da_define(Points, Vec2);
 
 ////////////////////////////////////////////////////////////////////////////////
-/// FIGURES
+/// RAYLIB
 ////////////////////////////////////////////////////////////////////////////////
 
-typedef enum {
-  FIGURE_CIRCLE   = 0,
-  FIGURE_SQUARE   = 1,
-  FIGURE_TRIANGLE = 2,
-  FIGURE_STAR     = 3,
-  FIGURE_RHOMBUS  = 4,
-
-  _FIGURE_MAX
-} Figure;
-
-typedef void DrawCicrcleFn(Vector2 center, f32 radius, Color color);
-typedef void DrawTriangleStripFn(const Vector2 *points, i32 pointCount, Color color);
-typedef void DrawTriangleFn(Vector2 v1, Vector2 v2, Vector2 v3, Color color);
-typedef void DrawTriangleFanFn(const Vector2 *points, i32 pointCount, Color color);
-
-typedef struct {
-  DrawCicrcleFn* draw_circle;
-  DrawTriangleFn* draw_triangle;
-  DrawTriangleFanFn* draw_triangle_fan;
-  DrawTriangleStripFn* draw_triangle_strip;
-
-} Renderer;
+// Types of the library are laid out the same way as the raylib ones, arrays
+// of points are passed to raylib as is.
+_Static_assert(sizeof(Vec2) == sizeof(Vector2), "Vec2 must match Vector2");
+_Static_assert(sizeof(Rgba) == sizeof(Color), "Rgba must match Color");
 
-local void renderCircle(Renderer render, Rectangle area, Color color, f32 lum, f32 radius) {
-  Vector2 center = {
-    .x = area.x + area.width / 2.0f,
-    .y = area.y + area.width / 2.0f,
-  };
-  render.draw_circle(center, lum * radius, color);
+local Vector2 toVector2(Vec2 v) {
+  return (Vector2){ .x = v.x, .y = v.y };
 }
 
-local void renderSquare(Renderer render, Rectangle area, Color color, f32 lum, f32 radius) {
-  Vector2 center = {
-    .x = area.x + area.width / 2.0f,
-    .y = area.y + area.width / 2.0f,
-  };
-
-  // f32 size = (radius * lum) * 0.5;
-  f32 size = (radius * lum);
-  Vector2 strip[5];
-
-  strip[0] = (Vector2){
-    .x = center.x + size * cos(RADS(-45.0f)),
-    .y = center.y + size * sin(RADS(-45.0f)),
-  };
-  strip[1] = (Vector2){
-    .x = center.x + size * cos(RADS(-135.0f)),
-    .y = center.y + size * sin(RADS(-135.0f)),
-  };
-  strip[2] = (Vector2){
-    .x = center.x + size * cos(RADS(-225.0f)),
-    .y = center.y + size * sin(RADS(-225.0f)),
-  };
-  strip[3] = (Vector2){
-    .x = center.x + size * cos(RADS(-315.0f)),
-    .y = center.y + size * sin(RADS(-315.0f)),
-  };
-  strip[4] = (Vector2){
-    .x = center.x + size * cos(RADS(-45.0f)),
-    .y = center.y + size * sin(RADS(-45.0f)),
-  };
-
-  render.draw_triangle_strip(strip, 5, color);
+local Color toColor(Rgba color) {
+  return (Color){ .r = color.r, .g = color.g, .b = color.b, .a = color.a };
 }
 
-local void renderTriangle(Renderer render, Rectangle area, Color color, f32 lum, f32 radius) {
-  Vector2 center = {
-      .x = area.x + area.width / 2.0f,
-      .y = area.y + area.width / 2.0f,
-  };
-
-  // f32 size = (radius * lum) * 0.5;
-  f32 size = (radius * lum);
-
-  Vector2 a = (Vector2){
-    .x = center.x + size * cos(RADS(-90.0f)),
-    .y = center.y + size * sin(RADS(-90.0f)),
-  };
-  Vector2 b = (Vector2){
-    .x = center.x + size * cos(RADS(-210.0f)),
-    .y = center.y + size * sin(RADS(-210.0f)),
-  };
-  Vector2 c = (Vector2){
-    .x = center.x + size * cos(RADS(-330.0f)),
-    .y = center.y + size * sin(RADS(-330.0f)),
-  };
-
-  render.draw_triangle(a, b, c, color);
+local Rgba toRgba(Color color) {
+  return (Rgba){ .r = color.r, .g = color.g, .b = color.b, .a = color.a };
 }
 
-local void renderStar(Renderer render, Rectangle area, Color color, f32 lum, f32 radius) {
-  Vector2 center = {
-    .x = area.x + area.width / 2.0f,
-    .y = area.y + area.width / 2.0f,
-  };
-
-  f32 outer_radius = radius * lum;
-  f32 inner_radius = outer_radius * 0.5f;
-  f32 step         = RADS(-36.0f);
-  f32 angle        = RADS(-90.0f) - step;
+local Rect toRect(Rectangle rect) {
+  return (Rect){ .x = rect.x, .y = rect.y, .width = rect.width, .height = rect.height };
+}
 
-  i32 cur = 0;
-  Vector2 strip[21];
-  strip[cur++] = center;
+// imageBitmap returns view of the pixels of the image, image must be in
+// PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 format.
+local Bitmap imageBitmap(Image image) {
+  return bitmapView(image.data, image.width, image.height, 0);
+}
 
-  for (i32 i = 0; i < 5; i++) {
-    {
-      strip[cur++] = (Vector2){
-        .x = center.x + inner_radius * cos(angle),
-        .y = center.y + inner_radius * sin(angle),
-      };
+local void rayDrawCircle(void* UNUSED(ctx), Vec2 center, f32 radius, Rgba color) {
+  DrawCircleV(toVector2(center), radius, toColor(color));
+}
 
-      angle += step;
+local void rayDrawTriangle(void* UNUSED(ctx), Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  DrawTriangle(toVector2(v1), toVector2(v2), toVector2(v3), toColor(color));
+}
 
-      strip[cur++] = (Vector2){
-        .x = center.x + outer_radius * cos(angle),
-        .y = center.y + outer_radius * sin(angle),
-      };
-    }
-    {
-      strip[cur++] = (Vector2){
-        .x = center.x + outer_radius * cos(angle),
-        .y = center.y + outer_radius * sin(angle),
-      };
+local void rayDrawTriangleFan(void* UNUSED(ctx), const Vec2 *points, i32 pointCount, Rgba color) {
+  DrawTriangleFan(CAST(const Vector2*, points), pointCount, toColor(color));
+}
 
-      angle += step;
+local void rayDrawTriangleStrip(void* UNUSED(ctx), const Vec2 *points, i32 pointCount, Rgba color) {
+  DrawTriangleStrip(CAST(const Vector2*, points), pointCount, toColor(color));
+}
 
-      strip[cur++] = (Vector2){
-        .x = center.x + inner_radius * cos(angle),
-        .y = center.y + inner_radius * sin(angle),
-      };
+local const Renderer ray_renderer = {
+  .draw_circle          = rayDrawCircle,
+  .draw_triangle        = rayDrawTriangle,
+  .draw_triangle_fan    = rayDrawTriangleFan,
+  .draw_triangle_strip  = rayDrawTriangleStrip,
+};
+
+// rayDrawDisplayList draws the figures of the list that may reach into the
+// area with raylib directly.
+local void rayDrawDisplayList(const DisplayList* list, Rect area) {
+  i32 first, last;
+  displayListRange(list, area, &first, &last);
+
+  Vec2 points[FIGURE_MAX_POINTS];
+  const Vector2* vectors = CAST(const Vector2*, points);
+
+  TRACE_BEGIN("display_list_draw");
+  for (i32 i = first; i < last; i++) {
+    Vec2 center = { list->xs[i], list->ys[i] };
+    Color color = toColor(list->colors[i]);
+    i32 count   = figurePoints(list->figures[i], center, list->sizes[i], points);
+
+    switch (list->figures[i]) {
+      case FIGURE_CIRCLE:
+        DrawCircleV(toVector2(center), list->sizes[i], color);
+        break;
+      case FIGURE_TRIANGLE:
+        DrawTriangle(vectors[0], vectors[1], vectors[2], color);
+        break;
+      case FIGURE_STAR:
+        DrawTriangleFan(vectors, count, color);
+        break;
+      default:
+        DrawTriangleStrip(vectors, count, color);
+        break;
     }
   }
-
-  render.draw_triangle_fan(strip, cur, color);
+  TRACE_END();
 }
 
-local void renderRhombus(Renderer render, Rectangle area, Color color, f32 lum, f32 radius) {
-  Vector2 center = {
-    .x = area.x + area.width / 2.0f,
-    .y = area.y + area.width / 2.0f,
-  };
-
-  f32 size = radius * lum;
-  Vector2 strip[5];
-
-  strip[0] = (Vector2){
-    .x = center.x + size * cos(RADS(0.0f)),
-    .y = center.y + size * sin(RADS(0.0f)),
-  };
-  strip[1] = (Vector2){
-    .x = center.x + size * cos(RADS(-90.0f)),
-    .y = center.y + size * sin(RADS(-90.0f)),
-  };
-  strip[2] = (Vector2){
-    .x = center.x + size * cos(RADS(-180.0f)),
-    .y = center.y + size * sin(RADS(-180.0f)),
-  };
-  strip[3] = (Vector2){
-    .x = center.x + size * cos(RADS(-270.0f)),
-    .y = center.y + size * sin(RADS(-270.0f)),
-  };
-  strip[4] = (Vector2){
-    .x = center.x + size * cos(RADS(0)),
-    .y = center.y + size * sin(RADS(0)),
-  };
-
-  render.draw_triangle_strip(strip, 5, color);
-}
-
-
 ////////////////////////////////////////////////////////////////////////////////
 /// CONTROLS
 ////////////////////////////////////////////////////////////////////////////////
@@ -289,19 +199,19 @@ local void renderFigureButton(Renderer render, FigureButtonState* state) {
 
   switch (state->figure) {
   case FIGURE_CIRCLE:
-    renderCircle(render, rect, RED, 0.5f, size);
+    renderFigure(render, toRect(rect), toRgba(RED), 0.5f, size, FIGURE_CIRCLE);
     break;
   case FIGURE_SQUARE:
-    renderSquare(render, rect, DARKBLUE, 0.5f, size);
+    renderFigure(render, toRect(rect), toRgba(DARKBLUE), 0.5f, size, FIGURE_SQUARE);
     break;
   case FIGURE_TRIANGLE:
-    renderTriangle(render, rect, DARKGREEN, 0.5f, size);
+    renderFigure(render, toRect(rect), toRgba(DARKGREEN), 0.5f, size, FIGURE_TRIANGLE);
     break;
   case FIGURE_STAR:
-    renderStar(render, rect, ORANGE, 0.5f, size);
+    renderFigure(render, toRect(rect), toRgba(ORANGE), 0.5f, size, FIGURE_STAR);
     break;
   case FIGURE_RHOMBUS:
-    renderRhombus(render, rect, VIOLET, 0.5f, size);
+    renderFigure(render, toRect(rect), toRgba(VIOLET), 0.5f, size, FIGURE_RHOMBUS);
     break;
   default:
     break;
@@ -601,67 +511,169 @@ local void renderSaveButton(Button* state) {
 }
 
 
-////////////////////////////////////////////////////////////////////////////////
-/// SVG
-////////////////////////////////////////////////////////////////////////////////
+/// ALLOCATION STATISTICS ////////////////////////////////////////////////////
+
+#ifdef ARENA_STATS
 
-FILE* svg;
+local void renderStatsLine(Arena* frame, i32* y, const char* format, size_t value) {
+  local const i32 font_size = 10;
 
-local void svgBegin(i32 width, i32 height, f32 radius) {
-  fprintf(svg, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
-  fprintf(svg, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" " );
-  fprintf(svg, "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n" );
-  fprintf(svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" "
-    "width=\"%f\" "
-    "height=\"%f\" "
-    "viewBox=\"%f %f %f %f\">\n",
-    width + (radius * 2), height + (radius * 2),
-    radius, radius, width+radius, height+radius);
+  DrawText(arena_sprintf(frame, format, value), 10, *y, font_size, DARKGRAY);
+  *y += font_size + 2;
 }
 
-local void svgDrawCircleV(Vector2 center, f32 radius, Color color) {
-  fprintf(svg,
-    "<circle cx=\"%f\" cy=\"%f\" r=\"%f\" fill=\"#%02x%02x%02x\"/>\n",
-    center.x, center.y, radius, color.r, color.g, color.b);
+// renderArenaStats draws the block of the statistics of a single arena.
+local void renderArenaStats(Arena* frame, i32* y, ArenaStats stats, const char* name) {
+  DrawText(name, 10, *y, 10, BLACK);
+  *y += 12;
+  renderStatsLine(frame, y, "new_region calls:  %zu", stats.new_region_calls);
+  renderStatsLine(frame, y, "regions skipped:   %zu", stats.regions_skipped);
+  renderStatsLine(frame, y, "oversized allocs:  %zu", stats.oversized_allocs);
+  renderStatsLine(frame, y, "allocs:            %zu", stats.allocs);
+  renderStatsLine(frame, y, "reallocs:          %zu", stats.reallocs);
+  renderStatsLine(frame, y, "  in place:        %zu", stats.reallocs_in_place);
+  renderStatsLine(frame, y, "bytes requested:   %zu", stats.bytes_requested);
+  renderStatsLine(frame, y, "bytes reserved:    %zu", stats.bytes_reserved);
+  renderStatsLine(frame, y, "bytes committed:   %zu", stats.bytes_committed);
+  renderStatsLine(frame, y, "bytes copied:      %zu", stats.bytes_copied);
+  renderStatsLine(frame, y, "alignment waste:   %zu", stats.alignment_waste);
+  renderStatsLine(frame, y, "high water mark:   %zu", stats.high_water);
 }
 
-local void svgDrawTriangle(Vector2 v1, Vector2 v2, Vector2 v3, Color color) {
-  fprintf(svg,
-    "<polygon points=\"%f,%f %f,%f %f,%f\" fill=\"#%02x%02x%02x\"/>\n",
-    v1.x, v1.y, v2.x, v2.y, v3.x, v3.y, color.r, color.g, color.b);
+// renderAllocStats draws statistics of the preview cache, of the scratch
+// arenas of the workers and of the dynamic arrays in the top left corner of
+// the window.
+local void renderAllocStats(Arena* frame, ArenaStats cache, ArenaStats workers) {
+  local const Color background = { 255, 255, 255, 200 };
+
+  i32 y = 10;
+  DrawRectangle(5, 5, 220, 12 * 28 + 10, background);
+
+  renderArenaStats(frame, &y, cache, "preview cache");
+  renderArenaStats(frame, &y, workers, "worker scratch");
+
+  DrawText("dynamic arrays", 10, y, 10, BLACK);
+  y += 12;
+  renderStatsLine(frame, &y, "reallocs:          %zu",
+      CAST(size_t, __atomic_load_n(&da_stats.reallocs, __ATOMIC_RELAXED)));
+  renderStatsLine(frame, &y, "bytes copied:      %zu",
+      CAST(size_t, __atomic_load_n(&da_stats.bytes_copied, __ATOMIC_RELAXED)));
 }
 
-local void svgDrawTriangleFan(const Vector2 *points, i32 pointCount, Color color) {
-  if (pointCount >= 3) {
-    fprintf(svg, "<polygon points=\"");
-    for (i32 i = 1; i < pointCount; i++) {
-      if (i > 0) fprintf(svg, " ");
-      fprintf(svg, "%f,%f", points[i].x, points[i].y);
-    }
-    fprintf(svg, "\" fill=\"#%02x%02x%02x\"/>\n", color.r, color.g, color.b);
+#endif // ARENA_STATS
+
+/// TRACE //////////////////////////////////////////////////////////////////////
+
+#ifdef TRACE
+
+// Number of the frames in the histogram
+#define TRACE_HUD_FRAMES 120
+// Maximum number of the stages in the breakdown
+#define TRACE_HUD_STAGES 24
+
+// renderTraceHud draws histogram of the frame times and time spent in every
+// traced stage during the last frame in the top right corner of the window.
+local void renderTraceHud(Arena* frame) {
+  local const Color background  = { 255, 255, 255, 200 };
+  local const Color bar_color   = { 0, 121, 241, 200 };
+  local const Color slow_color  = { 230, 41, 55, 200 };
+  local const i32 font_size     = 10;
+  local const i32 width         = 260;
+  local const i32 chart_height  = 60;
+  // Frame time at the top of the chart and the budget of 60 FPS
+  local const f32 chart_ms      = 33.3f;
+  local const f32 budget_ms     = 16.7f;
+
+  u64 times[TRACE_HUD_FRAMES];
+  i32 frames = traceFrameTimes(times, TRACE_HUD_FRAMES);
+
+  TraceStage stages[TRACE_HUD_STAGES];
+  i32 count = traceStages(stages, TRACE_HUD_STAGES);
+
+  i32 x = GetScreenWidth() - width - 5;
+  i32 y = 5;
+  DrawRectangle(x, y, width, chart_height + (count + 2) * (font_size + 2) + 15, background);
+  x += 5;
+  y += 5;
+
+  f32 bar_width = CAST(f32, width - 10) / TRACE_HUD_FRAMES;
+  for (i32 i = 0; i < frames; i++) {
+    f32 ms = times[i] / 1e6f;
+    f32 bar_height = min_value(ms / chart_ms, 1.0f) * chart_height;
+    Rectangle bar = {
+      .x      = x + i * bar_width,
+      .y      = y + chart_height - bar_height,
+      .width  = max_value(bar_width - 1.0f, 1.0f),
+      .height = bar_height,
+    };
+    DrawRectangleRec(bar, ms > budget_ms ? slow_color : bar_color);
   }
-}
+  i32 budget_y = y + chart_height - CAST(i32, budget_ms / chart_ms * chart_height);
+  DrawLine(x, budget_y, x + width - 10, budget_y, DARKGRAY);
+  y += chart_height + 5;
 
-local void svgDrawTriangleStrip(const Vector2 *points, i32 pointCount, Color color) {
-  if (pointCount >= 3) {
-    fprintf(svg, "<polygon points=\"");
-    for (i32 i = 0; i < pointCount; i++) {
-      if (i > 0) fprintf(svg, " ");
-      fprintf(svg, "%f,%f", points[i].x, points[i].y);
-    }
-    fprintf(svg, "\" fill=\"#%02x%02x%02x\"/>\n", color.r, color.g, color.b);
+  if (frames > 0) {
+    DrawText(arena_sprintf(frame, "frame %.2f ms", times[frames - 1] / 1e6),
+        x, y, font_size, BLACK);
+  }
+  y += font_size + 2;
+
+  for (i32 i = 0; i < count; i++) {
+    TraceStage* stage = stages + i;
+    DrawText(arena_sprintf(frame, "%*s%s", CAST(i32, stage->depth) * 2, "", stage->name),
+        x, y, font_size, DARKGRAY);
+    DrawText(arena_sprintf(frame, "%4u %8.3f ms", stage->calls, stage->total / 1e6),
+        x + width - 110, y, font_size, DARKGRAY);
+    y += font_size + 2;
   }
 }
 
-local void svgEnd(void) {
-  fprintf(svg, "</svg>");
-}
+#endif // TRACE
 
 ////////////////////////////////////////////////////////////////////////////////
 /// MAIN
 ////////////////////////////////////////////////////////////////////////////////
 
-local bool loadDroppedImage(Image* image, char* filename) {
+// Picture is the dropped image: its pixels or, in the compact mode, the
+// cell store they were reduced to
+typedef struct {
+  bool compact;
+  Image image;
+  CellStore store;
+  i32 width;
+  i32 height;
+} Picture;
+
+local void pictureUnload(Picture* picture) {
+  UnloadImage(picture->image);
+  picture->image = (Image){ 0 };
+  cellStoreFree(&picture->store);
+}
+
+// pictureLoad takes over the image, in the compact mode its pixels are
+// released as soon as the store is built. Previous picture stays if the
+// store does not fit.
+local bool pictureLoad(Picture* picture, Image image) {
+  CellStore store = { 0 };
+  if (picture->compact && !cellStoreBuild(&store, imageBitmap(image))) {
+    UnloadImage(image);
+    return false;
+  }
+
+  pictureUnload(picture);
+  picture->width  = image.width;
+  picture->height = image.height;
+
+  if (picture->compact) {
+    picture->store = store;
+    UnloadImage(image);
+  } else {
+    picture->image = image;
+  }
+  return true;
+}
+
+local bool loadDroppedImage(Picture* picture, char* filename) {
   if (!IsFileDropped()) {
     return false;
   }
@@ -670,11 +682,14 @@ local bool loadDroppedImage(Image* image, char* filename) {
 
   FilePathList files = LoadDroppedFiles();
   for (u32 i = 0; i < files.count; i++) {
+    TRACE_BEGIN("load_image");
     Image img = LoadImage(files.paths[i]);
+    TRACE_END();
 
     if (IsImageValid(img)) {
-      UnloadImage(*image);
-      *image = img;
+      // Halftone reads the pixels in place
+      ImageFormat(&img, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+      if (!pictureLoad(picture, img)) continue;
       loaded = true;
 
       memset(filename, 0, MAX_FILENAME_SIZE * sizeof(char));
@@ -688,131 +703,345 @@ local bool loadDroppedImage(Image* image, char* filename) {
   return loaded;
 }
 
-local Color averageColor(Image img, Rectangle area) {
-  u64 r = 0;
-  u64 g = 0;
-  u64 b = 0;
+////////////////////////////////////////////////////////////////////////////////
+/// PREVIEW
+////////////////////////////////////////////////////////////////////////////////
 
-  i32 xend = area.x + area.width;
-  i32 yend = area.y + area.height;
+// Size of the side of the preview tile in pixels.
+#define PREVIEW_TILE_SIZE 1024
+// Maximum number of tile textures kept in video memory, 256MB worth of
+// RGBA pixels. Tiles that did not fit are drawn directly.
+#define PREVIEW_MAX_TEXTURES 64
+// Smallest size of the cell on the screen in pixels, finer cells are replaced
+// by the coarser level of the pyramid.
+#define PREVIEW_MIN_CELL_SIZE 4.0f
+
+typedef struct {
+  // Area of the world covered by the tile, every cell whose figure may reach
+  // into it is rendered into the tile.
+  Rectangle bounds;
+  // Index of the texture holding the tile or -1
+  i32 texture;
+} PreviewTile;
 
-  xend = (xend >= img.width) ? img.width : xend;
-  yend = (yend >= img.height) ? img.height : yend;
+typedef struct {
+  RenderTexture2D target;
+  // Index of the tile rendered into the texture or -1
+  i32 tile;
+  // Frame when the texture was drawn the last time
+  u64 used;
+} PreviewTexture;
+
+da_define(PreviewTiles, PreviewTile);
+da_define(PreviewTextures, PreviewTexture);
+
+// Preview splits the world into tiles and keeps the halftone of the visible
+// ones rendered into the textures. Redrawing the preview is a handful of
+// textured quads no matter how many figures there are and only the tiles
+// that come into the view are rendered, so the cost of the preview depends
+// on what is on the screen rather than on the size of the image.
+typedef struct {
+  PreviewTiles tiles;
+  PreviewTextures textures;
+  // Area of the world covered by the tiles
+  Rectangle bounds;
+  i32 columns;
+  i32 rows;
+
+  // Tiles currently visible through the camera, inclusive
+  i32 column_first, column_last;
+  i32 row_first, row_last;
+
+  CellPyramid pyramid;
+  // Figures of the finest level, tiles at that level and the export share
+  // them. Compact pictures have no list, the finest level of the pyramid is
+  // drawn instead.
+  DisplayList list;
+  RenderParams list_params;
+  bool compact;
+  // Level of the pyramid the tiles are rendered from
+  i32 level;
+  // Tiles are rendered with the scale of 1 / 2^scale, so they cover 2^scale
+  // times larger area of the world when the camera is zoomed out. Scale is
+  // negative when zoomed in, tiles have more texels than the world pixels.
+  i32 scale;
+  // Size of the tile in the world coordinates
+  f32 tile_size;
+
+  RenderParams params;
+  bool dirty;
+  u64 frame;
+} Preview;
+
+local void previewUnload(Preview* preview) {
+  for (i32 i = 0; i < preview->textures.len; i++) {
+    UnloadRenderTexture(preview->textures.arr[i].target);
+  }
+  da_clear(&preview->textures);
+  da_clear(&preview->tiles);
+  preview->columns = 0;
+  preview->rows    = 0;
+  cellPyramidFree(&preview->pyramid);
+  displayListFree(&preview->list);
+}
 
-  for (i32 y = CAST(i32, area.y); y < yend; y++) {
-    for (i32 x = CAST(i32, area.x); x < xend; x++) {
-      Color color = GetImageColor(img, x, y);
-      r += color.r;
-      g += color.g;
-      b += color.b;
+// previewSample brings the pyramid and the figures of its finest level up to
+// date with the picture and the params.
+local void previewSample(Preview* preview, const Picture* picture, RenderParams params,
+    Workers* workers) {
+  CellPyramid* pyramid = &preview->pyramid;
+  bool resample = preview->dirty || pyramid->step != params.step || pyramid->shift != params.shift;
+  if (resample) {
+    if (picture->compact) {
+      cellPyramidBuildStore(pyramid, &picture->store, params.step, params.shift, workers);
+    } else {
+      cellPyramidBuild(pyramid, imageBitmap(picture->image), params.step, params.shift, workers);
     }
   }
 
-  i32 count = area.width * area.height;
+  // Figures of every cell would take several times the memory of the store
+  preview->compact = picture->compact;
+  if (picture->compact) {
+    displayListFree(&preview->list);
+    return;
+  }
+  if (resample || !sameRenderParams(preview->list_params, params)) {
+    displayListCells(&preview->list, pyramid->levels, params);
+    preview->list_params = params;
+  }
+}
 
-  Color result = {
-    .r = CAST(u8, r / count),
-    .g = CAST(u8, g / count),
-    .b = CAST(u8, b / count),
-    .a = 255,
+// previewRenderArea draws the figures of the level that may reach into the
+// area
+local void previewRenderArea(const Preview* preview, Renderer render, i32 level,
+    RenderParams params, Rect area) {
+  if (level == 0 && !preview->compact) {
+    rayDrawDisplayList(&preview->list, area);
+  } else {
+    renderCellLevelArea(render, preview->pyramid.levels + level, params, area);
+  }
+}
+
+// previewLayout splits the area covered by the halftone into the tiles.
+local void previewLayout(Preview* preview, const Picture* picture, RenderParams params) {
+  // Figures of the border cells stick out of the image by up to one step
+  // and the radius is never larger than the step.
+  f32 margin = 2.0f * params.step;
+
+  preview->bounds = (Rectangle){
+    .x      = -margin,
+    .y      = -margin,
+    .width  = picture->width + 2.0f * margin,
+    .height = picture->height + 2.0f * margin,
   };
+  preview->tile_size = ldexpf(PREVIEW_TILE_SIZE, preview->scale);
+  preview->columns   = CAST(i32, ceilf(preview->bounds.width / preview->tile_size));
+  preview->rows      = CAST(i32, ceilf(preview->bounds.height / preview->tile_size));
+
+  da_resize(&preview->tiles, preview->columns * preview->rows);
+  for (i32 row = 0; row < preview->rows; row++) {
+    for (i32 column = 0; column < preview->columns; column++) {
+      PreviewTile* tile = preview->tiles.arr + row * preview->columns + column;
+
+      tile->bounds.x      = preview->bounds.x + column * preview->tile_size;
+      tile->bounds.y      = preview->bounds.y + row * preview->tile_size;
+      tile->bounds.width  = min_value(preview->tile_size,
+          preview->bounds.x + preview->bounds.width - tile->bounds.x);
+      tile->bounds.height = min_value(preview->tile_size,
+          preview->bounds.y + preview->bounds.height - tile->bounds.y);
+      tile->texture       = -1;
+    }
+  }
 
-  return result;
+  for (i32 i = 0; i < preview->textures.len; i++) {
+    preview->textures.arr[i].tile = -1;
+  }
 }
 
-local void renderFigure(Renderer render, Rectangle area, Color color, f32 lum, f32 radius, Figure figure) {
-  if (lum == 0) {
-    return;
+// previewVisible finds the tiles that intersect the window.
+local void previewVisible(Preview* preview, Camera2D camera) {
+  Vector2 corners[4] = {
+    GetScreenToWorld2D((Vector2){ 0, 0 }, camera),
+    GetScreenToWorld2D((Vector2){ GetScreenWidth(), 0 }, camera),
+    GetScreenToWorld2D((Vector2){ 0, GetScreenHeight() }, camera),
+    GetScreenToWorld2D((Vector2){ GetScreenWidth(), GetScreenHeight() }, camera),
+  };
+
+  Vector2 min = corners[0];
+  Vector2 max = corners[0];
+  for (i32 i = 1; i < 4; i++) {
+    min.x = min_value(min.x, corners[i].x);
+    min.y = min_value(min.y, corners[i].y);
+    max.x = max_value(max.x, corners[i].x);
+    max.y = max_value(max.y, corners[i].y);
   }
 
-  switch (figure) {
-    case FIGURE_CIRCLE:
-      renderCircle(render, area, color, lum, radius);
-      break;
-    case FIGURE_SQUARE:
-      renderSquare(render, area, color, lum, radius);
-      break;
-    case FIGURE_TRIANGLE:
-      renderTriangle(render, area, color, lum, radius);
-      break;
-    case FIGURE_STAR:
-      renderStar(render, area, color, lum, radius);
-      break;
-    case FIGURE_RHOMBUS:
-      renderRhombus(render, area, color, lum, radius);
-      break;
-    default:
-      break;
+  preview->column_first = floorf((min.x - preview->bounds.x) / preview->tile_size);
+  preview->column_last  = floorf((max.x - preview->bounds.x) / preview->tile_size);
+  preview->row_first    = floorf((min.y - preview->bounds.y) / preview->tile_size);
+  preview->row_last     = floorf((max.y - preview->bounds.y) / preview->tile_size);
+
+  preview->column_first = max_value(preview->column_first, 0);
+  preview->column_last  = min_value(preview->column_last, preview->columns - 1);
+  preview->row_first    = max_value(preview->row_first, 0);
+  preview->row_last     = min_value(preview->row_last, preview->rows - 1);
+}
+
+// previewAcquire finds the texture for the tile: either unused one or the
+// one that was not drawn for the longest time. Returns -1 if all textures are
+// used by the visible tiles.
+local i32 previewAcquire(Preview* preview, i32 tile) {
+  i32 found = -1;
+
+  if (preview->textures.len < PREVIEW_MAX_TEXTURES) {
+    PreviewTexture texture = {
+      .target = LoadRenderTexture(PREVIEW_TILE_SIZE, PREVIEW_TILE_SIZE),
+      .tile   = -1,
+    };
+    SetTextureFilter(texture.target.texture, TEXTURE_FILTER_BILINEAR);
+    da_append(&preview->textures, texture);
+    found = preview->textures.len - 1;
+  } else {
+    for (i32 i = 0; i < preview->textures.len; i++) {
+      PreviewTexture* texture = preview->textures.arr + i;
+      if (texture->used == preview->frame) continue;
+      if (found < 0 || texture->used < preview->textures.arr[found].used) {
+        found = i;
+      }
+    }
   }
+
+  if (found >= 0) {
+    PreviewTexture* texture = preview->textures.arr + found;
+    if (texture->tile >= 0) {
+      preview->tiles.arr[texture->tile].texture = -1;
+    }
+    texture->tile = tile;
+    preview->tiles.arr[tile].texture = found;
+  }
+
+  return found;
 }
 
-local void renderImage(Renderer render, Image image,
-    Figure figure, i32 step, f32 radius, bool shift, bool bw, bool size_lum) {
-  for (i32 y = 0; y < image.height; y += step) {
-    i32 x = (shift && (y % 2 == 0)) ? 0 : step / 2;
-    for (; x < image.width; x += step) {
-      Rectangle area = {
-        .x      = x,
-        .y      = y,
-        .width  = step,
-        .height = step,
-      };
+// previewUpdate renders the visible tiles that are out of date into the
+// textures. Must be called outside of the 2D mode.
+local void previewUpdate(Preview* preview, Renderer render, const Picture* picture,
+    RenderParams params, Camera2D camera, Workers* workers) {
+  CellPyramid* pyramid = &preview->pyramid;
+  previewSample(preview, picture, params, workers);
+
+  // Keep texels no larger than the pixels of the screen, both when zoomed
+  // out and in
+  i32 scale = CAST(i32, floorf(-log2f(camera.zoom)));
+  i32 level = cellPyramidLevel(pyramid, camera.zoom, PREVIEW_MIN_CELL_SIZE);
+
+  if (preview->dirty || !sameRenderParams(preview->params, params)
+      || preview->scale != scale || preview->level != level) {
+    preview->scale = scale;
+    preview->level = level;
+    previewLayout(preview, picture, params);
+    preview->params = params;
+    preview->dirty  = false;
+  }
 
-      Color avg = averageColor(image, area);
+  preview->frame++;
+  previewVisible(preview, camera);
+
+  for (i32 row = preview->row_first; row <= preview->row_last; row++) {
+    for (i32 column = preview->column_first; column <= preview->column_last; column++) {
+      i32 index = row * preview->columns + column;
+      PreviewTile* tile = preview->tiles.arr + index;
+
+      if (tile->texture < 0) {
+        if (previewAcquire(preview, index) < 0) continue;
+
+        Camera2D tile_camera = {
+          .target = { .x = tile->bounds.x, .y = tile->bounds.y },
+          .zoom   = ldexpf(1.0f, -scale),
+        };
+
+        TRACE_BEGIN("tile");
+        BeginTextureMode(preview->textures.arr[tile->texture].target);
+        ClearBackground(BLANK);
+        BeginMode2D(tile_camera);
+        previewRenderArea(preview, render, level, params, toRect(tile->bounds));
+        EndMode2D();
+        EndTextureMode();
+        TRACE_END();
+      }
 
-      f32 rf = (255.0f - avg.r);
-      f32 gf = (255.0f - avg.g);
-      f32 bf = (255.0f - avg.b);
-      f32 lum = Clamp(sqrt(rf * rf * .299f + gf * gf * .587f + bf * bf * .114f) / 255.0f, 0.0f, 1.0f);
+      preview->textures.arr[tile->texture].used = preview->frame;
+    }
+  }
+}
 
-      Color color = avg;
-      if (bw) {
-        color.r = 255.0f * (1.0f - lum);
-        color.g = 255.0f * (1.0f - lum);
-        color.b = 255.0f * (1.0f - lum);
+// previewDraw draws the visible tiles, must be called inside of the 2D mode.
+local void previewDraw(Preview* preview, Renderer render) {
+  for (i32 row = preview->row_first; row <= preview->row_last; row++) {
+    for (i32 column = preview->column_first; column <= preview->column_last; column++) {
+      PreviewTile* tile = preview->tiles.arr + row * preview->columns + column;
+
+      if (tile->texture < 0) {
+        // Out of textures, the only option left is to draw it every frame
+        previewRenderArea(preview, render, preview->level, preview->params,
+            toRect(tile->bounds));
+        continue;
       }
 
-      f32 mul = size_lum ? lum : 1.0f;
-      renderFigure(render, area, color, mul, radius, figure);
+      Texture2D texture = preview->textures.arr[tile->texture].target.texture;
+      // Render textures are stored upside down
+      f32 texels = ldexpf(1.0f, preview->scale);
+      Rectangle source = {
+        .x      = 0,
+        .y      = PREVIEW_TILE_SIZE - tile->bounds.height / texels,
+        .width  = tile->bounds.width / texels,
+        .height = -tile->bounds.height / texels,
+      };
+      DrawTexturePro(texture, source, tile->bounds, (Vector2){ 0 }, 0.0f, WHITE);
     }
   }
 }
 
-i32 main(void) {
+////////////////////////////////////////////////////////////////////////////////
+/// WINDOW
+////////////////////////////////////////////////////////////////////////////////
+
+local i32 runWindow(const Options* options) {
   static const char text[] = "Drag and drop your image here";
   static const char subtext[] = "supported file formats: .png, .jpg, .gif";
 
   char filename[MAX_FILENAME_SIZE] = { 0 };
 
   Points points = { 0 };
+  // Arena for the allocations that live until the end of the frame
+  Arena frame_arena = { 0 };
+  // Samples the preview when the picture or the cell grid changes
+  Workers* workers = workersCreate(0);
 
   InitWindow(1024, 768, "dots");
-  SetTargetFPS(30);
+  SetTargetFPS(60);
   SetWindowState(FLAG_WINDOW_RESIZABLE);
+  // Nothing changes on the screen without input, so there is no reason to
+  // spin: frames are produced only when there are events to process.
+  EnableEventWaiting();
 
   i32 text_width = MeasureText(text, 30);
   i32 subtext_width = MeasureText(subtext, 24);
 
-  Image image                       = { 0 };
+  Picture picture                   = { .compact = options->compact };
   StepRadiusState step_radius_state = { false, false, 0.5, 0.5, 0, 0 };
   FigureButtonState figure_state    = { 0 };
   Button bw_state                   = { 0 };
   Button lum_state                  = { 0 };
   Button shift_state                = { 0 };
   Button save_state                 = { 0 };
-
-  Renderer ray_renderer = {
-    .draw_circle          = DrawCircleV,
-    .draw_triangle        = DrawTriangle,
-    .draw_triangle_fan    = DrawTriangleFan,
-    .draw_triangle_strip  = DrawTriangleStrip,
-  };
-  Renderer svg_renderer = {
-    .draw_circle          = svgDrawCircleV,
-    .draw_triangle        = svgDrawTriangle,
-    .draw_triangle_fan    = svgDrawTriangleFan,
-    .draw_triangle_strip  = svgDrawTriangleStrip,
-  };
+  Preview preview                   = { 0 };
+#ifdef ARENA_STATS
+  bool show_stats                   = false;
+#endif // ARENA_STATS
+#ifdef TRACE
+  bool show_trace                   = false;
+#endif // TRACE
 
   Camera2D camera = { 0 };
   camera.rotation = 0.0f;
@@ -823,11 +1052,15 @@ i32 main(void) {
   };
 
   while (!WindowShouldClose()) {
-    if (loadDroppedImage(&image, filename)) {
+    TRACE_FRAME_BEGIN();
+    arena_reset(&frame_arena);
+
+    if (loadDroppedImage(&picture, filename)) {
+      preview.dirty = true;
       camera.zoom   = 1.0f;
       camera.target = (Vector2){
-        .x = image.width / 2.0f,
-        .y = image.height / 2.0f,
+        .x = picture.width / 2.0f,
+        .y = picture.height / 2.0f,
       };
     }
 
@@ -841,8 +1074,25 @@ i32 main(void) {
     updateShiftButton(&shift_state);
     updateSaveButton(&save_state);
 
+#ifdef ARENA_STATS
+    if (IsKeyPressed(KEY_F1)) show_stats = !show_stats;
+#endif // ARENA_STATS
+#ifdef TRACE
+    if (IsKeyPressed(KEY_F2)) show_trace = !show_trace;
+#endif // TRACE
+
+    RenderParams params = {
+      .figure   = figure_state.figure,
+      .step     = step_radius_state.step,
+      .radius   = step_radius_state.radius,
+      .shift    = shift_state.is_clicked,
+      .bw       = bw_state.is_clicked,
+      .size_lum = lum_state.is_clicked,
+    };
+
     if (save_state.is_clicked) {
-      if (IsImageValid(image)) {
+      if (picture.width > 0) {
+        FILE* svg = NULL;
         const char* filepath = TextFormat("%s/Desktop/%s.svg",
             getenv("HOME"), filename);
         if (FileExists(filepath)) {
@@ -859,17 +1109,19 @@ i32 main(void) {
         }
 
         if (svg != NULL) {
-          svgBegin(image.width, image.height, step_radius_state.radius);
-          renderImage(svg_renderer, image,
-              figure_state.figure,
-              step_radius_state.step,
-              step_radius_state.radius,
-              shift_state.is_clicked,
-              bw_state.is_clicked,
-              lum_state.is_clicked);
-          svgEnd();
+          TRACE_BEGIN("svg_export");
+          // Export writes the figures the preview already sampled
+          previewSample(&preview, &picture, params, workers);
+          svgBegin(svg, picture.width, picture.height, step_radius_state.radius);
+          if (preview.compact) {
+            Rect all = { 0, 0, picture.width, picture.height };
+            renderCellLevelArea(svgRenderer(svg), preview.pyramid.levels, params, all);
+          } else {
+            svgDisplayList(svg, &preview.list, NULL);
+          }
+          svgEnd(svg);
           fclose(svg);
-          svg = NULL;
+          TRACE_END();
         } else {
           fprintf(stderr, "Failed to open file: %s\n", strerror(errno));
         }
@@ -885,19 +1137,36 @@ i32 main(void) {
     if (IsKeyDown(KEY_W) || IsKeyDown(KEY_UP))    camera.target.y -= 2.0f;
     if (IsKeyDown(KEY_S) || IsKeyDown(KEY_DOWN))  camera.target.y += 2.0f;
 
+    // Keys held down do not produce events, keep frames coming while the
+    // camera moves or the slider is dragged.
+    bool animating = step_radius_state.changing
+      || IsKeyDown(KEY_A) || IsKeyDown(KEY_LEFT)
+      || IsKeyDown(KEY_D) || IsKeyDown(KEY_RIGHT)
+      || IsKeyDown(KEY_W) || IsKeyDown(KEY_UP)
+      || IsKeyDown(KEY_S) || IsKeyDown(KEY_DOWN);
+#ifdef TRACE
+    // Histogram is only meaningful while frames are produced continuously
+    animating = animating || show_trace;
+#endif // TRACE
+    if (animating) {
+      DisableEventWaiting();
+    } else {
+      EnableEventWaiting();
+    }
+
     BeginDrawing();
     ClearBackground(WHITE);
 
-    if (IsImageValid(image)) {
+    if (picture.width > 0) {
+      TRACE_BEGIN("preview_update");
+      previewUpdate(&preview, ray_renderer, &picture, params, camera, workers);
+      TRACE_END();
+
+      TRACE_BEGIN("preview_draw");
       BeginMode2D(camera);
-      renderImage(ray_renderer, image,
-          figure_state.figure,
-          step_radius_state.step,
-          step_radius_state.radius,
-          shift_state.is_clicked,
-          bw_state.is_clicked,
-          lum_state.is_clicked);
+      previewDraw(&preview, ray_renderer);
       EndMode2D();
+      TRACE_END();
     } else {
       i32 y = height / 2 - 40;
 
@@ -907,19 +1176,36 @@ i32 main(void) {
       // TEST
       if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
         Vector2 mouse = GetMousePosition();
-        da_append(&points, mouse);
+        da_append(&points, ((Vec2){ .x = mouse.x, .y = mouse.y }));
       }
 
       for (i32 i = 0; i < points.len; i++) {
-        DrawCircleV(points.arr[i], 2, BLACK);
+        DrawCircleV(toVector2(points.arr[i]), 2, BLACK);
       }
 
-      if (points.len >= 3) {
-        delaunay(points.arr, points.len);
+      Triangulation triangulation;
+      if (delaunay(&triangulation, points.arr, points.len)) {
+        for (i32 i = 0; i < triangulation.count; i += 3) {
+          Vector2 p0 = toVector2(points.arr[triangulation.triangles[i]]);
+          Vector2 p1 = toVector2(points.arr[triangulation.triangles[i + 1]]);
+          Vector2 p2 = toVector2(points.arr[triangulation.triangles[i + 2]]);
+          DrawLineEx(p0, p1, 1, GRAY);
+          DrawLineEx(p1, p2, 1, GRAY);
+          DrawLineEx(p2, p0, 1, GRAY);
+        }
+        Vector2 a = toVector2(triangulation.seed[0]);
+        Vector2 b = toVector2(triangulation.seed[1]);
+        Vector2 c = toVector2(triangulation.seed[2]);
+        DrawLineEx(a, b, 2, RED);
+        DrawLineEx(b, c, 2, GREEN);
+        DrawLineEx(c, a, 2, BLUE);
+        DrawCircleLinesV(toVector2(triangulation.center), triangulation.radius, BLACK);
+        triangulationFree(&triangulation);
       }
       // TEST
     }
 
+    TRACE_BEGIN("ui");
     renderStepRadiusControl(&step_radius_state);
     renderFigureButton(ray_renderer, &figure_state);
     renderBWButton(&bw_state);
@@ -927,9 +1213,54 @@ i32 main(void) {
     renderShiftButton(&shift_state);
     renderSaveButton(&save_state);
 
+#ifdef ARENA_STATS
+    if (show_stats) {
+      renderAllocStats(&frame_arena, arena_stats(&preview.pyramid.arena),
+          workersStats(workers));
+    }
+#endif // ARENA_STATS
+#ifdef TRACE
+    if (show_trace) {
+      renderTraceHud(&frame_arena);
+    }
+#endif // TRACE
+    TRACE_END();
+
+    // Submits the batch to the GPU, swaps the buffers and waits for events
+    TRACE_BEGIN("present");
     EndDrawing();
+    TRACE_END();
+    TRACE_FRAME_END();
   }
+  previewUnload(&preview);
+  pictureUnload(&picture);
+  da_free(&preview.tiles);
+  da_free(&preview.textures);
   CloseWindow();
 
+  arena_free(&frame_arena);
+  workersDestroy(workers);
+  da_free(&points);
+
   return 0;
 }
+
+i32 main(i32 argc, char** argv) {
+  Options options = { 0 };
+  if (!cliParse(&options, argc, argv)) {
+    cliUsage(argv[0], true);
+    return 1;
+  }
+
+  TRACE_THREAD("main");
+
+  i32 status = options.mode == MODE_WINDOW ? runWindow(&options) : cliRun(&options);
+
+#ifdef TRACE
+  if (options.trace != NULL && !traceDump(options.trace)) {
+    status = 1;
+  }
+#endif // TRACE
+
+  return status;
+}
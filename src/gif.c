@@ -0,0 +1,395 @@
+#include "gif.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Largest code of the LZW dictionary
+#define GIF_MAX_CODES 4096
+
+#define GIF_EXTENSION  0x21
+#define GIF_IMAGE      0x2c
+#define GIF_TRAILER    0x3b
+#define GIF_GRAPHICS   0xf9
+
+#define GIF_DISPOSE_BACKGROUND 2
+#define GIF_DISPOSE_PREVIOUS   3
+
+typedef struct {
+  const u8* data;
+  usize size;
+  usize pos;
+} GifData;
+
+// Graphic control extension applies to the next image only
+typedef struct {
+  i32 disposal;
+  i32 transparent;
+} GifControl;
+
+local bool gifByte(GifData* gif, i32* value) {
+  if (gif->pos >= gif->size) return false;
+  *value = gif->data[gif->pos++];
+  return true;
+}
+
+local bool gifU16(GifData* gif, i32* value) {
+  if (gif->size - gif->pos < 2) return false;
+  *value = gif->data[gif->pos] | (gif->data[gif->pos + 1] << 8);
+  gif->pos += 2;
+  return true;
+}
+
+local bool gifTable(GifData* gif, i32 flags, u8* table) {
+  usize size = 3u << ((flags & 0x07) + 1);
+  if (gif->size - gif->pos < size) return false;
+  memcpy(table, gif->data + gif->pos, size);
+  gif->pos += size;
+  return true;
+}
+
+// gifBlocks joins the data sub-blocks into a single buffer, NULL block
+// only skips them
+local bool gifBlocks(GifData* gif, u8** block, usize* length) {
+  usize capacity = 0;
+  *length = 0;
+
+  for (;;) {
+    i32 size;
+    if (!gifByte(gif, &size)) return false;
+    if (size == 0) return true;
+    if (gif->size - gif->pos < CAST(usize, size)) return false;
+
+    if (block != NULL) {
+      if (*length + size > capacity) {
+        capacity = max_value(capacity * 2, *length + size);
+        u8* grown = CAST(u8*, realloc(*block, capacity));
+        if (grown == NULL) return false;
+        *block = grown;
+      }
+      memcpy(*block + *length, gif->data + gif->pos, size);
+      *length += size;
+    }
+    gif->pos += size;
+  }
+}
+
+// gifLzw decodes color indices of the image, returns number of the indices
+// decoded which is less than count only if the data ends early
+local usize gifLzw(const u8* data, usize size, i32 min_size, u8* out, usize count) {
+  u16 prefix[GIF_MAX_CODES];
+  u8 suffix[GIF_MAX_CODES];
+  u8 stack[GIF_MAX_CODES + 1];
+
+  i32 clear = 1 << min_size;
+  i32 end   = clear + 1;
+  for (i32 i = 0; i < clear; i++) {
+    prefix[i] = 0;
+    suffix[i] = i;
+  }
+
+  i32 code_size = min_size + 1;
+  i32 next      = clear + 2;
+  i32 old       = -1;
+  u8 first      = 0;
+
+  u32 bits  = 0;
+  i32 ready = 0;
+  usize pos = 0;
+  usize written = 0;
+
+  while (written < count) {
+    while (ready < code_size) {
+      if (pos == size) return written;
+      bits |= CAST(u32, data[pos++]) << ready;
+      ready += 8;
+    }
+    i32 code = bits & ((1 << code_size) - 1);
+    bits  >>= code_size;
+    ready  -= code_size;
+
+    if (code == clear) {
+      code_size = min_size + 1;
+      next      = clear + 2;
+      old       = -1;
+      continue;
+    }
+    if (code == end) {
+      break;
+    }
+
+    if (old < 0) {
+      if (code >= clear) return written;
+      out[written++] = code;
+      old   = code;
+      first = code;
+      continue;
+    }
+
+    // Code that is not in the dictionary yet is the previous string
+    // followed by its own first index
+    i32 top  = 0;
+    i32 walk = code;
+    if (code > next) return written;
+    if (code == next) {
+      stack[top++] = first;
+      walk = old;
+    }
+    while (walk >= clear) {
+      stack[top++] = suffix[walk];
+      walk = prefix[walk];
+    }
+    stack[top++] = walk;
+    first = walk;
+
+    while (top > 0 && written < count) {
+      out[written++] = stack[--top];
+    }
+
+    if (next < GIF_MAX_CODES) {
+      prefix[next] = old;
+      suffix[next] = first;
+      next++;
+      if (next == (1 << code_size) && code_size < 12) {
+        code_size++;
+      }
+    }
+    old = code;
+  }
+
+  return written;
+}
+
+// gifRow returns row of the image the decoded row lands on, interlaced
+// images come in four passes over every 8th, 8th, 4th and 2nd row
+local i32 gifRow(i32 row, i32 height, bool interlaced) {
+  if (!interlaced) {
+    return row;
+  }
+  local const i32 starts[4] = { 0, 4, 2, 1 };
+  local const i32 steps[4]  = { 8, 8, 4, 2 };
+  for (i32 pass = 0; pass < 4; pass++) {
+    i32 rows = (height - starts[pass] + steps[pass] - 1) / steps[pass];
+    if (row < rows) {
+      return starts[pass] + row * steps[pass];
+    }
+    row -= rows;
+  }
+  return -1;
+}
+
+// gifImage decodes the image and draws it onto the canvas
+local bool gifImage(GifData* gif, GifAnimation* anim, const u8* global, bool has_global,
+    GifControl control, u8* canvas) {
+  i32 left, top, width, height, flags, min_size;
+  if (!gifU16(gif, &left) || !gifU16(gif, &top) || !gifU16(gif, &width)
+      || !gifU16(gif, &height) || !gifByte(gif, &flags)) {
+    return false;
+  }
+
+  u8 local_table[256 * 3] = { 0 };
+  const u8* table = global;
+  if (flags & 0x80) {
+    if (!gifTable(gif, flags, local_table)) return false;
+    table = local_table;
+  } else if (!has_global) {
+    fprintf(stderr, "GIF image has no color table\n");
+    return false;
+  }
+
+  if (!gifByte(gif, &min_size) || min_size < 2 || min_size > 8) {
+    return false;
+  }
+
+  u8* data = NULL;
+  usize length;
+  bool ok = gifBlocks(gif, &data, &length);
+
+  usize count = CAST(usize, width) * height;
+  u8* indices = CAST(u8*, malloc(max_value(count, 1)));
+  ok = ok && indices != NULL;
+  usize decoded = ok ? gifLzw(data, length, min_size, indices, count) : 0;
+  free(data);
+
+  bool interlaced = (flags & 0x40) != 0;
+  for (usize i = 0; i < decoded; i++) {
+    i32 x = left + CAST(i32, i % width);
+    i32 y = top + gifRow(CAST(i32, i / width), height, interlaced);
+    if (x >= anim->width || y >= anim->height) continue;
+    if (indices[i] == control.transparent) continue;
+
+    u8* pixel = canvas + (CAST(usize, y) * anim->width + x) * 4;
+    memcpy(pixel, table + indices[i] * 3, 3);
+    pixel[3] = 255;
+  }
+
+  free(indices);
+  return ok;
+}
+
+// gifDispose clears the area of the frame or restores what was under it
+local void gifDispose(GifAnimation* anim, u8* canvas, const u8* previous,
+    i32 disposal, const i32* area) {
+  if (disposal == GIF_DISPOSE_PREVIOUS) {
+    memcpy(canvas, previous, CAST(usize, anim->width) * anim->height * 4);
+    return;
+  }
+  if (disposal != GIF_DISPOSE_BACKGROUND) {
+    return;
+  }
+
+  i32 x0 = min_value(area[0], anim->width);
+  i32 y0 = min_value(area[1], anim->height);
+  i32 x1 = min_value(area[0] + area[2], anim->width);
+  i32 y1 = min_value(area[1] + area[3], anim->height);
+  for (i32 y = y0; y < y1; y++) {
+    memset(canvas + (CAST(usize, y) * anim->width + x0) * 4, 0, CAST(usize, x1 - x0) * 4);
+  }
+}
+
+local bool gifDecode(GifAnimation* anim, GifData* gif) {
+  i32 flags, background, aspect;
+  if (gif->size < 6 || (memcmp(gif->data, "GIF87a", 6) != 0 && memcmp(gif->data, "GIF89a", 6) != 0)) {
+    fprintf(stderr, "Not a GIF file\n");
+    return false;
+  }
+  gif->pos = 6;
+
+  u8 global[256 * 3] = { 0 };
+  if (!gifU16(gif, &anim->width) || !gifU16(gif, &anim->height)
+      || !gifByte(gif, &flags) || !gifByte(gif, &background) || !gifByte(gif, &aspect)
+      || ((flags & 0x80) && !gifTable(gif, flags, global))) {
+    fprintf(stderr, "Malformed GIF header\n");
+    return false;
+  }
+  if (anim->width == 0 || anim->height == 0) {
+    fprintf(stderr, "Invalid image size %dx%d\n", anim->width, anim->height);
+    return false;
+  }
+
+  usize frame_size = CAST(usize, anim->width) * anim->height * 4;
+  u8* canvas   = CAST(u8*, calloc(frame_size, 1));
+  u8* previous = CAST(u8*, malloc(frame_size));
+  i32 capacity = 0;
+  if (canvas == NULL || previous == NULL) {
+    fprintf(stderr, "Out of memory for %dx%d GIF\n", anim->width, anim->height);
+    free(previous);
+    free(canvas);
+    return false;
+  }
+
+  GifControl control = { .transparent = -1 };
+  bool done = false;
+  while (!done) {
+    i32 block;
+    if (!gifByte(gif, &block)) break;
+
+    if (block == GIF_TRAILER) {
+      done = true;
+    } else if (block == GIF_EXTENSION) {
+      i32 label;
+      u8* data = NULL;
+      usize length;
+      if (!gifByte(gif, &label) || !gifBlocks(gif, label == GIF_GRAPHICS ? &data : NULL, &length)) {
+        free(data);
+        break;
+      }
+      if (label == GIF_GRAPHICS && length >= 4) {
+        control.disposal    = (data[0] >> 2) & 0x07;
+        control.transparent = (data[0] & 0x01) ? data[3] : -1;
+      }
+      free(data);
+    } else if (block == GIF_IMAGE) {
+      if (control.disposal == GIF_DISPOSE_PREVIOUS) {
+        memcpy(previous, canvas, frame_size);
+      }
+
+      // Area of the frame is needed for its disposal
+      i32 area[4];
+      GifData descriptor = *gif;
+      if (!gifU16(&descriptor, area) || !gifU16(&descriptor, area + 1)
+          || !gifU16(&descriptor, area + 2) || !gifU16(&descriptor, area + 3)) {
+        break;
+      }
+      if (!gifImage(gif, anim, global, (flags & 0x80) != 0, control, canvas)) {
+        break;
+      }
+
+      if (anim->count == capacity) {
+        u8* grown = CAST(u8*, realloc(anim->pixels, frame_size * max_value(capacity * 2, 8)));
+        if (grown == NULL) break;
+        anim->pixels = grown;
+        capacity = max_value(capacity * 2, 8);
+      }
+      memcpy(anim->pixels + frame_size * anim->count, canvas, frame_size);
+      anim->count++;
+
+      gifDispose(anim, canvas, previous, control.disposal, area);
+      control = (GifControl){ .transparent = -1 };
+    } else {
+      break;
+    }
+  }
+
+  free(previous);
+  free(canvas);
+
+  if (anim->count == 0) {
+    fprintf(stderr, "GIF has no frames or the first one is damaged\n");
+    return false;
+  }
+  if (!done) {
+    fprintf(stderr, "GIF is damaged after %d frames\n", anim->count);
+  }
+  return true;
+}
+
+bool gifLoad(GifAnimation* anim, const char* path) {
+  memset(anim, 0, sizeof(GifAnimation));
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  u8* data = NULL;
+  usize size = 0;
+  usize capacity = 0;
+  bool ok = true;
+  for (;;) {
+    if (size == capacity) {
+      u8* grown = CAST(u8*, realloc(data, max_value(capacity * 2, 1 << 16)));
+      if (grown == NULL) {
+        ok = false;
+        break;
+      }
+      data = grown;
+      capacity = max_value(capacity * 2, 1 << 16);
+    }
+    usize read = fread(data + size, 1, capacity - size, file);
+    size += read;
+    if (read == 0) break;
+  }
+  ok = ok && !ferror(file);
+  fclose(file);
+
+  if (!ok) {
+    fprintf(stderr, "Failed to read %s\n", path);
+  } else {
+    GifData gif = { .data = data, .size = size };
+    ok = gifDecode(anim, &gif);
+  }
+  free(data);
+
+  if (!ok) {
+    gifFree(anim);
+  }
+  return ok;
+}
+
+void gifFree(GifAnimation* anim) {
+  free(anim->pixels);
+  memset(anim, 0, sizeof(GifAnimation));
+}
@@ -0,0 +1,53 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef GIF_H
+#define GIF_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GifAnimation is every frame of the GIF composited onto the logical screen
+// the way a viewer shows it: transparent pixels keep what is under them and
+// the disposal of the previous frame is applied first. Area that no frame
+// has covered yet is transparent black.
+typedef struct {
+  i32 width;
+  i32 height;
+  i32 count;
+  // Frames of width * height RGBA pixels one after another
+  u8* pixels;
+} GifAnimation;
+
+// gifLoad decodes all frames of the file at path. Returns false and prints
+// the reason if the file is not a GIF or is damaged before the first frame,
+// frames after the damage are dropped.
+bool gifLoad(GifAnimation* anim, const char* path);
+void gifFree(GifAnimation* anim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GIF_H
@@ -0,0 +1,1135 @@
+#include "halftone.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <math.h>
+
+#include "palette.h"
+#include "trace.h"
+
+#define RADS(degs) (degs * M_PI_180)
+
+////////////////////////////////////////////////////////////////////////////////
+/// FIGURES
+////////////////////////////////////////////////////////////////////////////////
+
+const char* const figure_names[_FIGURE_MAX] = {
+  [FIGURE_CIRCLE]   = "circle",
+  [FIGURE_SQUARE]   = "square",
+  [FIGURE_TRIANGLE] = "triangle",
+  [FIGURE_STAR]     = "star",
+  [FIGURE_RHOMBUS]  = "rhombus",
+};
+
+bool sameRenderParams(RenderParams a, RenderParams b) {
+  return a.figure == b.figure
+    && a.step == b.step
+    && a.radius == b.radius
+    && a.shift == b.shift
+    && a.bw == b.bw
+    && a.size_lum == b.size_lum
+    && a.linear == b.linear
+    && a.palette == b.palette;
+}
+
+local i32 squarePoints(Vec2 center, f32 size, Vec2* strip) {
+  strip[0] = (Vec2){
+    .x = center.x + size * cos(RADS(-45.0f)),
+    .y = center.y + size * sin(RADS(-45.0f)),
+  };
+  strip[1] = (Vec2){
+    .x = center.x + size * cos(RADS(-135.0f)),
+    .y = center.y + size * sin(RADS(-135.0f)),
+  };
+  strip[2] = (Vec2){
+    .x = center.x + size * cos(RADS(-225.0f)),
+    .y = center.y + size * sin(RADS(-225.0f)),
+  };
+  strip[3] = (Vec2){
+    .x = center.x + size * cos(RADS(-315.0f)),
+    .y = center.y + size * sin(RADS(-315.0f)),
+  };
+  strip[4] = (Vec2){
+    .x = center.x + size * cos(RADS(-45.0f)),
+    .y = center.y + size * sin(RADS(-45.0f)),
+  };
+  return 5;
+}
+
+local i32 trianglePoints(Vec2 center, f32 size, Vec2* points) {
+  points[0] = (Vec2){
+    .x = center.x + size * cos(RADS(-90.0f)),
+    .y = center.y + size * sin(RADS(-90.0f)),
+  };
+  points[1] = (Vec2){
+    .x = center.x + size * cos(RADS(-210.0f)),
+    .y = center.y + size * sin(RADS(-210.0f)),
+  };
+  points[2] = (Vec2){
+    .x = center.x + size * cos(RADS(-330.0f)),
+    .y = center.y + size * sin(RADS(-330.0f)),
+  };
+  return 3;
+}
+
+local i32 starPoints(Vec2 center, f32 size, Vec2* strip) {
+  f32 outer_radius = size;
+  f32 inner_radius = outer_radius * 0.5f;
+  f32 step         = RADS(-36.0f);
+  f32 angle        = RADS(-90.0f) - step;
+
+  i32 cur = 0;
+  strip[cur++] = center;
+
+  for (i32 i = 0; i < 5; i++) {
+    {
+      strip[cur++] = (Vec2){
+        .x = center.x + inner_radius * cos(angle),
+        .y = center.y + inner_radius * sin(angle),
+      };
+
+      angle += step;
+
+      strip[cur++] = (Vec2){
+        .x = center.x + outer_radius * cos(angle),
+        .y = center.y + outer_radius * sin(angle),
+      };
+    }
+    {
+      strip[cur++] = (Vec2){
+        .x = center.x + outer_radius * cos(angle),
+        .y = center.y + outer_radius * sin(angle),
+      };
+
+      angle += step;
+
+      strip[cur++] = (Vec2){
+        .x = center.x + inner_radius * cos(angle),
+        .y = center.y + inner_radius * sin(angle),
+      };
+    }
+  }
+
+  return cur;
+}
+
+local i32 rhombusPoints(Vec2 center, f32 size, Vec2* strip) {
+  strip[0] = (Vec2){
+    .x = center.x + size * cos(RADS(0.0f)),
+    .y = center.y + size * sin(RADS(0.0f)),
+  };
+  strip[1] = (Vec2){
+    .x = center.x + size * cos(RADS(-90.0f)),
+    .y = center.y + size * sin(RADS(-90.0f)),
+  };
+  strip[2] = (Vec2){
+    .x = center.x + size * cos(RADS(-180.0f)),
+    .y = center.y + size * sin(RADS(-180.0f)),
+  };
+  strip[3] = (Vec2){
+    .x = center.x + size * cos(RADS(-270.0f)),
+    .y = center.y + size * sin(RADS(-270.0f)),
+  };
+  strip[4] = (Vec2){
+    .x = center.x + size * cos(RADS(0)),
+    .y = center.y + size * sin(RADS(0)),
+  };
+  return 5;
+}
+
+i32 figurePoints(Figure figure, Vec2 center, f32 size, Vec2* points) {
+  switch (figure) {
+    case FIGURE_SQUARE:
+      return squarePoints(center, size, points);
+    case FIGURE_TRIANGLE:
+      return trianglePoints(center, size, points);
+    case FIGURE_STAR:
+      return starPoints(center, size, points);
+    case FIGURE_RHOMBUS:
+      return rhombusPoints(center, size, points);
+    case FIGURE_CIRCLE:
+    case _FIGURE_MAX:
+      break;
+  }
+  return 0;
+}
+
+// drawFigure draws the figure of the size around the center
+local void drawFigure(Renderer render, Figure figure, Vec2 center, f32 size, Rgba color) {
+  Vec2 points[FIGURE_MAX_POINTS];
+  i32 count = figurePoints(figure, center, size, points);
+
+  switch (figure) {
+    case FIGURE_CIRCLE:
+      render.draw_circle(render.ctx, center, size, color);
+      break;
+    case FIGURE_TRIANGLE:
+      render.draw_triangle(render.ctx, points[0], points[1], points[2], color);
+      break;
+    case FIGURE_STAR:
+      render.draw_triangle_fan(render.ctx, points, count, color);
+      break;
+    case FIGURE_SQUARE:
+    case FIGURE_RHOMBUS:
+      render.draw_triangle_strip(render.ctx, points, count, color);
+      break;
+    case _FIGURE_MAX:
+      break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// HALFTONE
+////////////////////////////////////////////////////////////////////////////////
+
+Rgba averageColor(Bitmap bitmap, Rect area) {
+  u64 r = 0;
+  u64 g = 0;
+  u64 b = 0;
+
+  i32 xend = area.x + area.width;
+  i32 yend = area.y + area.height;
+
+  xend = (xend >= bitmap.width) ? bitmap.width : xend;
+  yend = (yend >= bitmap.height) ? bitmap.height : yend;
+
+  i32 go = bitmapChannel(bitmap, 1);
+  i32 bo = bitmapChannel(bitmap, 2);
+  for (i32 y = CAST(i32, area.y); y < yend; y++) {
+    const u8* pixel = bitmapPixel(bitmap, area.x, y);
+    for (i32 x = CAST(i32, area.x); x < xend; x++, pixel += bitmap.channels) {
+      r += pixel[0];
+      g += pixel[go];
+      b += pixel[bo];
+    }
+  }
+
+  i32 count = area.width * area.height;
+
+  Rgba result = {
+    .r = CAST(u8, r / count),
+    .g = CAST(u8, g / count),
+    .b = CAST(u8, b / count),
+    .a = 255,
+  };
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// LINEAR LIGHT
+////////////////////////////////////////////////////////////////////////////////
+
+// Linear light is kept in 16 bits, the way back is indexed by its top 12 bits
+#define LINEAR_MAX   65535
+#define LINEAR_SHIFT 4
+#define LINEAR_SIZE  (1 << (16 - LINEAR_SHIFT))
+
+local u16 srgb_to_linear[256];
+local u8 linear_to_srgb[LINEAR_SIZE];
+local pthread_once_t linear_once = PTHREAD_ONCE_INIT;
+
+local f64 srgbDecode(f64 v) {
+  return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+local f64 srgbEncode(f64 v) {
+  return v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1 / 2.4) - 0.055;
+}
+
+local void linearTablesInit(void) {
+  for (i32 i = 0; i < 256; i++) {
+    srgb_to_linear[i] = CAST(u16, round(srgbDecode(i / 255.0) * LINEAR_MAX));
+  }
+  // Every entry encodes the middle of the range of the values it stands for
+  for (i32 i = 0; i < LINEAR_SIZE; i++) {
+    f64 linear = ((i << LINEAR_SHIFT) + (1 << (LINEAR_SHIFT - 1))) / CAST(f64, LINEAR_MAX);
+    linear_to_srgb[i] = CAST(u8, round(srgbEncode(min_value(linear, 1.0)) * 255));
+  }
+}
+
+local void linearTables(void) {
+  pthread_once(&linear_once, linearTablesInit);
+}
+
+local u8 linearEncode(u32 linear) {
+  return linear_to_srgb[min_value(linear, LINEAR_MAX) >> LINEAR_SHIFT];
+}
+
+Rgba averageColorLinear(Bitmap bitmap, Rect area) {
+  linearTables();
+
+  u64 r = 0;
+  u64 g = 0;
+  u64 b = 0;
+
+  i32 xend = min_value(CAST(i32, area.x + area.width), bitmap.width);
+  i32 yend = min_value(CAST(i32, area.y + area.height), bitmap.height);
+
+  i32 go = bitmapChannel(bitmap, 1);
+  i32 bo = bitmapChannel(bitmap, 2);
+  for (i32 y = CAST(i32, area.y); y < yend; y++) {
+    const u8* pixel = bitmapPixel(bitmap, area.x, y);
+    for (i32 x = CAST(i32, area.x); x < xend; x++, pixel += bitmap.channels) {
+      r += srgb_to_linear[pixel[0]];
+      g += srgb_to_linear[pixel[go]];
+      b += srgb_to_linear[pixel[bo]];
+    }
+  }
+
+  u64 count = area.width * area.height;
+
+  Rgba result = {
+    .r = linearEncode(r / count),
+    .g = linearEncode(g / count),
+    .b = linearEncode(b / count),
+    .a = 255,
+  };
+
+  return result;
+}
+
+Rgba cellAverage(Bitmap bitmap, Rect cell, RenderParams params) {
+  return params.linear ? averageColorLinear(bitmap, cell) : averageColor(bitmap, cell);
+}
+
+// linearLuminance returns relative luminance of the color in [0, 1]
+local f32 linearLuminance(Rgba color) {
+  linearTables();
+  return (0.2126f * srgb_to_linear[color.r]
+    + 0.7152f * srgb_to_linear[color.g]
+    + 0.0722f * srgb_to_linear[color.b]) / LINEAR_MAX;
+}
+
+void renderFigure(Renderer render, Rect area, Rgba color, f32 lum, f32 radius, Figure figure) {
+  if (lum == 0) {
+    return;
+  }
+
+  Vec2 center = {
+    .x = area.x + area.width / 2.0f,
+    .y = area.y + area.height / 2.0f,
+  };
+  drawFigure(render, figure, center, radius * lum, color);
+}
+
+f32 cellLuminance(Rgba avg, RenderParams params) {
+  // Ink covering the part of the cell reflects the rest of the light
+  if (params.linear) {
+    return min_value(max_value(1.0f - linearLuminance(avg), 0.0f), 1.0f);
+  }
+
+  f32 rf = (255.0f - avg.r);
+  f32 gf = (255.0f - avg.g);
+  f32 bf = (255.0f - avg.b);
+  f32 lum = sqrt(rf * rf * .299f + gf * gf * .587f + bf * bf * .114f) / 255.0f;
+  return min_value(max_value(lum, 0.0f), 1.0f);
+}
+
+Rgba cellColor(Rgba avg, RenderParams params) {
+  Rgba color = avg;
+  if (params.bw && params.linear) {
+    u8 gray = linearEncode(linearLuminance(avg) * LINEAR_MAX);
+    color.r = gray;
+    color.g = gray;
+    color.b = gray;
+  } else if (params.bw) {
+    f32 lum = cellLuminance(avg, params);
+    color.r = 255.0f * (1.0f - lum);
+    color.g = 255.0f * (1.0f - lum);
+    color.b = 255.0f * (1.0f - lum);
+  }
+  if (params.palette != NULL) {
+    color = params.palette->inks[paletteNearest(params.palette, color)];
+  }
+  return color;
+}
+
+void renderCell(Renderer render, Rect cell, Rgba avg, RenderParams params) {
+  f32 lum = params.size_lum ? cellLuminance(avg, params) : 1.0f;
+  renderFigure(render, cell, cellColor(avg, params), lum, params.radius, params.figure);
+}
+
+void renderImageArea(Renderer render, Bitmap bitmap, RenderParams params, Rect area) {
+  i32 step   = params.step;
+  f32 reach  = step / 2.0f;
+  f32 radius = params.radius;
+
+  i32 rows = (bitmap.height + step - 1) / step;
+  i32 row_first = max_value(0, CAST(i32, floorf((area.y + reach - radius - step) / step)));
+  i32 row_last  = min_value(rows - 1, CAST(i32, ceilf((area.y + area.height - reach + radius) / step)));
+
+  TRACE_BEGIN("render_image");
+  for (i32 row = row_first; row <= row_last; row++) {
+    i32 y  = row * step;
+    i32 x0 = cellOffset(params, y);
+
+    i32 col_first = max_value(0, CAST(i32, floorf((area.x - x0 + reach - radius - step) / step)));
+    i32 x = x0 + col_first * step;
+    i32 xend = min_value(bitmap.width, CAST(i32, ceilf(area.x + area.width + radius)));
+
+    for (; x < xend; x += step) {
+      Rect cell = {
+        .x      = x,
+        .y      = y,
+        .width  = step,
+        .height = step,
+      };
+
+      renderCell(render, cell, cellAverage(bitmap, cell, params), params);
+    }
+  }
+  TRACE_END();
+}
+
+void renderImage(Renderer render, Bitmap bitmap, RenderParams params) {
+  Rect area = {
+    .x      = -params.radius - params.step,
+    .y      = -params.radius - params.step,
+    .width  = bitmap.width + 2 * (params.radius + params.step),
+    .height = bitmap.height + 2 * (params.radius + params.step),
+  };
+  renderImageArea(render, bitmap, params, area);
+}
+
+bool renderStrips(Renderer render, StripReader* reader, RenderParams params) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+  i32 step   = params.step;
+
+  u8* pixels = CAST(u8*, malloc(CAST(usize, width) * step * 4));
+  if (pixels == NULL) {
+    fprintf(stderr, "Out of memory for the strip of %d rows\n", step);
+    return false;
+  }
+  Bitmap strip = bitmapView(pixels, width, step, 0);
+
+  bool ok = true;
+  for (i32 y = 0; y < height; y += step) {
+    TRACE_BEGIN("strip_read");
+    strip.height = stripRead(reader, pixels, step);
+    TRACE_END();
+    if (strip.height <= 0) {
+      ok = false;
+      break;
+    }
+
+    TRACE_BEGIN("strip_render");
+    i32 x = cellOffset(params, y);
+    for (; x < width; x += step) {
+      Rect area = {
+        .x      = x,
+        .y      = 0,
+        .width  = step,
+        .height = step,
+      };
+      Rgba avg = cellAverage(strip, area, params);
+
+      area.y = y;
+      renderCell(render, area, avg, params);
+    }
+    TRACE_END();
+  }
+
+  free(pixels);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// CELL PYRAMID
+////////////////////////////////////////////////////////////////////////////////
+
+local i32 cellLevelOffset(const CellLevel* level, i32 row) {
+  RenderParams params = { .step = level->step, .shift = level->shift };
+  return cellOffset(params, row * level->step);
+}
+
+void cellPyramidFree(CellPyramid* pyramid) {
+  arena_free(&pyramid->arena);
+  memset(pyramid, 0, sizeof(CellPyramid));
+}
+
+// cellLevelAlloc allocates the colors of the level cleared to the cells
+// outside of the image
+local Rgba* cellLevelAlloc(CellPyramid* pyramid, const CellLevel* level) {
+  usize size = CAST(usize, level->columns) * level->rows * sizeof(Rgba);
+  Rgba* colors = CAST(Rgba*, arena_alloc(&pyramid->arena, size));
+  memset(colors, 0, size);
+  return colors;
+}
+
+// cellPyramidInit starts the pyramid with the finest level, its colors are
+// left to the caller
+local CellLevel* cellPyramidInit(CellPyramid* pyramid, i32 width, i32 height,
+    i32 step, bool shift) {
+  arena_reset(&pyramid->arena);
+  memset(pyramid->levels, 0, sizeof(pyramid->levels));
+
+  pyramid->width  = width;
+  pyramid->height = height;
+  pyramid->step   = step;
+  pyramid->shift  = shift;
+
+  CellLevel* base = pyramid->levels;
+  base->step    = step;
+  base->shift   = shift;
+  base->columns = (width + step - 1) / step;
+  base->rows    = (height + step - 1) / step;
+  pyramid->count = 1;
+
+  return base;
+}
+
+// cellPyramidMips averages the levels above the finest one
+local void cellPyramidMips(CellPyramid* pyramid) {
+  TRACE_BEGIN("pyramid");
+  while (pyramid->count < CELL_PYRAMID_MAX_LEVELS) {
+    CellLevel* fine = pyramid->levels + pyramid->count - 1;
+    if (fine->columns == 1 && fine->rows == 1) break;
+
+    CellLevel* coarse = pyramid->levels + pyramid->count;
+    coarse->step    = fine->step * 2;
+    coarse->shift   = false;
+    coarse->columns = (fine->columns + 1) / 2;
+    coarse->rows    = (fine->rows + 1) / 2;
+    coarse->colors  = cellLevelAlloc(pyramid, coarse);
+    pyramid->count++;
+
+    for (i32 row = 0; row < coarse->rows; row++) {
+      for (i32 column = 0; column < coarse->columns; column++) {
+        u32 r = 0, g = 0, b = 0, count = 0;
+
+        for (i32 dy = 0; dy < 2; dy++) {
+          for (i32 dx = 0; dx < 2; dx++) {
+            i32 y = row * 2 + dy;
+            i32 x = column * 2 + dx;
+            if (y >= fine->rows || x >= fine->columns) continue;
+
+            Rgba color = fine->colors[y * fine->columns + x];
+            if (color.a == 0) continue;
+
+            r += color.r;
+            g += color.g;
+            b += color.b;
+            count++;
+          }
+        }
+
+        if (count > 0) {
+          coarse->colors[row * coarse->columns + column] = (Rgba){
+            .r = r / count,
+            .g = g / count,
+            .b = b / count,
+            .a = 255,
+          };
+        }
+      }
+    }
+  }
+  TRACE_END();
+}
+
+bool cellStoreBuild(CellStore* store, Bitmap bitmap) {
+  i32 step = CELL_STORE_STEP;
+  *store = (CellStore){
+    .width  = bitmap.width,
+    .height = bitmap.height,
+    .cells  = {
+      .step    = step,
+      .columns = (bitmap.width + step - 1) / step,
+      .rows    = (bitmap.height + step - 1) / step,
+    },
+  };
+  CellLevel* cells = &store->cells;
+  usize total = CAST(usize, cells->columns) * cells->rows;
+  cells->colors = CAST(Rgba*, malloc(total * sizeof(Rgba)));
+  if (cells->colors == NULL) {
+    fprintf(stderr, "Out of memory for %zu cells of the store\n", total);
+    return false;
+  }
+
+  i32 go = bitmapChannel(bitmap, 1);
+  i32 bo = bitmapChannel(bitmap, 2);
+  TRACE_BEGIN("cell_store");
+  for (i32 row = 0; row < cells->rows; row++) {
+    i32 y0 = row * step;
+    i32 y1 = min_value(y0 + step, bitmap.height);
+    for (i32 column = 0; column < cells->columns; column++) {
+      i32 x0 = column * step;
+      i32 x1 = min_value(x0 + step, bitmap.width);
+
+      u32 r = 0, g = 0, b = 0;
+      for (i32 y = y0; y < y1; y++) {
+        const u8* pixel = bitmapPixel(bitmap, x0, y);
+        for (i32 x = x0; x < x1; x++, pixel += bitmap.channels) {
+          r += pixel[0];
+          g += pixel[go];
+          b += pixel[bo];
+        }
+      }
+
+      u32 count = (x1 - x0) * (y1 - y0);
+      cells->colors[CAST(usize, row) * cells->columns + column] = (Rgba){
+        .r = (r + count / 2) / count,
+        .g = (g + count / 2) / count,
+        .b = (b + count / 2) / count,
+        .a = 255,
+      };
+    }
+  }
+  TRACE_END();
+  return true;
+}
+
+void cellStoreFree(CellStore* store) {
+  free(store->cells.colors);
+  *store = (CellStore){ 0 };
+}
+
+// storeAverage sums the store cells under the cell weighted by the overlap
+// and divides by the full area of the cell like averageColor does
+local Rgba storeAverage(const CellStore* store, i32 x0, i32 y0, i32 step) {
+  const CellLevel* cells = &store->cells;
+  i32 size = cells->step;
+  i32 x1 = min_value(x0 + step, store->width);
+  i32 y1 = min_value(y0 + step, store->height);
+
+  u64 r = 0, g = 0, b = 0;
+  for (i32 row = y0 / size; row * size < y1; row++) {
+    i32 height = min_value((row + 1) * size, y1) - max_value(row * size, y0);
+    const Rgba* colors = cells->colors + CAST(usize, row) * cells->columns;
+
+    for (i32 column = x0 / size; column * size < x1; column++) {
+      i32 area = height * (min_value((column + 1) * size, x1) - max_value(column * size, x0));
+      r += colors[column].r * area;
+      g += colors[column].g * area;
+      b += colors[column].b * area;
+    }
+  }
+
+  u64 count = CAST(u64, step) * step;
+  Rgba result = {
+    .r = CAST(u8, r / count),
+    .g = CAST(u8, g / count),
+    .b = CAST(u8, b / count),
+    .a = 255,
+  };
+  return result;
+}
+
+// Rows of the finest level sampled by a single job
+#define CELL_PYRAMID_CHUNK 16
+
+typedef struct {
+  CellLevel* base;
+  Bitmap bitmap;
+  const CellStore* store;
+} PyramidJob;
+
+local void pyramidSampleRows(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  PyramidJob* job = CAST(PyramidJob*, ctx);
+  CellLevel* base = job->base;
+  i32 step        = base->step;
+  i32 width       = job->store != NULL ? job->store->width : job->bitmap.width;
+
+  i32 first = index * CELL_PYRAMID_CHUNK;
+  i32 last  = min_value(first + CELL_PYRAMID_CHUNK, base->rows);
+  for (i32 row = first; row < last; row++) {
+    i32 x0 = cellLevelOffset(base, row);
+    for (i32 column = 0; column < base->columns; column++) {
+      i32 x = x0 + column * step;
+      if (x >= width) break;
+
+      Rgba* color = base->colors + row * base->columns + column;
+      if (job->store != NULL) {
+        *color = storeAverage(job->store, x, row * step, step);
+      } else {
+        Rect cell = {
+          .x      = x,
+          .y      = row * step,
+          .width  = step,
+          .height = step,
+        };
+        *color = averageColor(job->bitmap, cell);
+      }
+    }
+  }
+}
+
+// cellPyramidSample fills the finest level from the bitmap or the store
+local void cellPyramidSample(CellPyramid* pyramid, PyramidJob* job, Workers* workers) {
+  TRACE_BEGIN("sample");
+  job->base = pyramid->levels;
+  job->base->colors = cellLevelAlloc(pyramid, job->base);
+  workersRun(workers, (job->base->rows + CELL_PYRAMID_CHUNK - 1) / CELL_PYRAMID_CHUNK,
+      pyramidSampleRows, job);
+  TRACE_END();
+
+  cellPyramidMips(pyramid);
+}
+
+void cellPyramidBuild(CellPyramid* pyramid, Bitmap bitmap, i32 step, bool shift,
+    Workers* workers) {
+  cellPyramidInit(pyramid, bitmap.width, bitmap.height, step, shift);
+  PyramidJob job = { .bitmap = bitmap };
+  cellPyramidSample(pyramid, &job, workers);
+}
+
+void cellPyramidBuildStore(CellPyramid* pyramid, const CellStore* store, i32 step, bool shift,
+    Workers* workers) {
+  CellLevel* base = cellPyramidInit(pyramid, store->width, store->height, step, shift);
+  // Store is the finest level of the smallest step, the pyramid shares it
+  if (step == store->cells.step && !shift) {
+    base->colors = store->cells.colors;
+    cellPyramidMips(pyramid);
+    return;
+  }
+
+  PyramidJob job = { .store = store };
+  cellPyramidSample(pyramid, &job, workers);
+}
+
+i32 cellPyramidLevel(const CellPyramid* pyramid, f32 zoom, f32 min_size) {
+  i32 level = 0;
+  while (level + 1 < pyramid->count && pyramid->levels[level].step * zoom < min_size) {
+    level++;
+  }
+  return level;
+}
+
+void renderCellLevelArea(Renderer render, const CellLevel* level,
+    RenderParams params, Rect area) {
+  i32 step   = level->step;
+  f32 reach  = step / 2.0f;
+  f32 radius = params.radius * step / params.step;
+
+  params.step   = step;
+  params.radius = radius;
+
+  i32 row_first = max_value(0, CAST(i32, floorf((area.y - reach - radius) / step)));
+  i32 row_last  = min_value(level->rows - 1, CAST(i32, ceilf((area.y + area.height - reach + radius) / step)));
+
+  TRACE_BEGIN("geometry");
+  for (i32 row = row_first; row <= row_last; row++) {
+    i32 x0 = cellLevelOffset(level, row);
+
+    i32 column_first = max_value(0, CAST(i32, floorf((area.x - x0 - reach - radius) / step)));
+    i32 column_last  = min_value(level->columns - 1,
+        CAST(i32, ceilf((area.x + area.width - x0 - reach + radius) / step)));
+
+    for (i32 column = column_first; column <= column_last; column++) {
+      Rgba avg = level->colors[row * level->columns + column];
+      if (avg.a == 0) continue;
+
+      Rect cell = {
+        .x      = x0 + column * step,
+        .y      = row * step,
+        .width  = step,
+        .height = step,
+      };
+      renderCell(render, cell, avg, params);
+    }
+  }
+  TRACE_END();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// DISPLAY LIST
+////////////////////////////////////////////////////////////////////////////////
+
+void displayListFree(DisplayList* list) {
+  free(list->figures);
+  free(list->xs);
+  free(list->ys);
+  free(list->sizes);
+  free(list->colors);
+  free(list->rows);
+  *list = (DisplayList){ 0 };
+}
+
+void displayListBegin(DisplayList* list, i32 step, i32 rows) {
+  list->count     = 0;
+  list->row_count = 0;
+  list->step      = step;
+  list->reach     = 0;
+  list->rows      = CAST(i32*, realloc(list->rows, (rows + 1) * sizeof(i32)));
+  list->rows[0]   = 0;
+}
+
+void displayListEndRow(DisplayList* list) {
+  list->rows[++list->row_count] = list->count;
+}
+
+local void displayListPush(DisplayList* list, Figure figure, Vec2 center, f32 size, Rgba color) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 256 : list->capacity * 2;
+    list->figures = CAST(u8*, realloc(list->figures, list->capacity * sizeof(u8)));
+    list->xs      = CAST(f32*, realloc(list->xs, list->capacity * sizeof(f32)));
+    list->ys      = CAST(f32*, realloc(list->ys, list->capacity * sizeof(f32)));
+    list->sizes   = CAST(f32*, realloc(list->sizes, list->capacity * sizeof(f32)));
+    list->colors  = CAST(Rgba*, realloc(list->colors, list->capacity * sizeof(Rgba)));
+  }
+
+  i32 i = list->count++;
+  list->figures[i] = CAST(u8, figure);
+  list->xs[i]      = center.x;
+  list->ys[i]      = center.y;
+  list->sizes[i]   = size;
+  list->colors[i]  = color;
+  list->reach      = max_value(list->reach, size);
+}
+
+void displayListAddCell(DisplayList* list, Rect cell, Rgba avg, RenderParams params) {
+  f32 lum = params.size_lum ? cellLuminance(avg, params) : 1.0f;
+  if (lum == 0) {
+    return;
+  }
+
+  Vec2 center = {
+    .x = cell.x + cell.width / 2.0f,
+    .y = cell.y + cell.width / 2.0f,
+  };
+  displayListPush(list, params.figure, center, params.radius * lum, cellColor(avg, params));
+}
+
+void displayListImage(DisplayList* list, Bitmap bitmap, RenderParams params) {
+  i32 step = params.step;
+  i32 rows = (bitmap.height + step - 1) / step;
+  displayListBegin(list, step, rows);
+
+  TRACE_BEGIN("display_list");
+  for (i32 row = 0; row < rows; row++) {
+    i32 y = row * step;
+    i32 x = cellOffset(params, y);
+    for (; x < bitmap.width; x += step) {
+      Rect cell = {
+        .x      = x,
+        .y      = y,
+        .width  = step,
+        .height = step,
+      };
+      displayListAddCell(list, cell, cellAverage(bitmap, cell, params), params);
+    }
+    displayListEndRow(list);
+  }
+  TRACE_END();
+}
+
+// Cells of the row of the band sampled by a single job
+#define BAND_CHUNK 256
+
+typedef struct {
+  Bitmap strip;
+  RenderParams params;
+  // x of the first cell of the row
+  i32 x0;
+  i32 columns;
+  Rgba* colors;
+} BandJob;
+
+local void bandSampleCells(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  BandJob* job = CAST(BandJob*, ctx);
+  i32 step  = job->params.step;
+  i32 first = index * BAND_CHUNK;
+  i32 last  = min_value(first + BAND_CHUNK, job->columns);
+
+  for (i32 column = first; column < last; column++) {
+    Rect cell = {
+      .x      = job->x0 + column * step,
+      .y      = 0,
+      .width  = step,
+      .height = step,
+    };
+    job->colors[column] = cellAverage(job->strip, cell, job->params);
+  }
+}
+
+bool displayListBands(StripReader* reader, const Bitmap* image, RenderParams params,
+    Workers* workers, DisplayListFn* fn, void* ctx) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+  i32 step   = params.step;
+
+  BandJob job = {
+    .params = params,
+    .colors = CAST(Rgba*, malloc(CAST(usize, width / step + 2) * sizeof(Rgba))),
+  };
+  u8* pixels = NULL;
+  if (image == NULL) {
+    pixels = CAST(u8*, malloc(CAST(usize, width) * step * 4));
+  }
+  if (job.colors == NULL || (image == NULL && pixels == NULL)) {
+    fprintf(stderr, "Out of memory for the strip of %d rows\n", step);
+    free(job.colors);
+    free(pixels);
+    return false;
+  }
+
+  DisplayList band = { 0 };
+  bool ok = true;
+  for (i32 y = 0; y < height && ok; y += step) {
+    Bitmap strip;
+    if (image != NULL) {
+      strip        = *image;
+      strip.pixels = bitmapPixel(*image, 0, y);
+      strip.height = min_value(step, height - y);
+    } else {
+      strip = bitmapView(pixels, width, step, 0);
+      TRACE_BEGIN("strip_read");
+      strip.height = stripRead(reader, pixels, step);
+      TRACE_END();
+      if (strip.height <= 0) {
+        ok = false;
+        break;
+      }
+    }
+
+    job.strip   = strip;
+    job.x0      = cellOffset(params, y);
+    job.columns = (width - job.x0 + step - 1) / step;
+
+    TRACE_BEGIN("band_sample");
+    workersRun(workers, (job.columns + BAND_CHUNK - 1) / BAND_CHUNK, bandSampleCells, &job);
+    workersReset(workers);
+    TRACE_END();
+
+    TRACE_BEGIN("display_list");
+    displayListBegin(&band, step, 1);
+    for (i32 column = 0; column < job.columns; column++) {
+      Rect area = {
+        .x      = job.x0 + column * step,
+        .y      = y,
+        .width  = step,
+        .height = step,
+      };
+      displayListAddCell(&band, area, job.colors[column], params);
+    }
+    displayListEndRow(&band);
+    TRACE_END();
+
+    ok = fn(ctx, &band);
+  }
+
+  displayListFree(&band);
+  free(job.colors);
+  free(pixels);
+  return ok;
+}
+
+void displayListCells(DisplayList* list, const CellLevel* level, RenderParams params) {
+  i32 step = level->step;
+  params.radius = params.radius * step / params.step;
+  params.step   = step;
+  displayListBegin(list, step, level->rows);
+
+  TRACE_BEGIN("display_list");
+  for (i32 row = 0; row < level->rows; row++) {
+    i32 x0 = cellLevelOffset(level, row);
+    for (i32 column = 0; column < level->columns; column++) {
+      Rgba avg = level->colors[row * level->columns + column];
+      if (avg.a == 0) continue;
+
+      Rect cell = {
+        .x      = x0 + column * step,
+        .y      = row * step,
+        .width  = step,
+        .height = step,
+      };
+      displayListAddCell(list, cell, avg, params);
+    }
+    displayListEndRow(list);
+  }
+  TRACE_END();
+}
+
+void displayListRange(const DisplayList* list, Rect area, i32* first, i32* last) {
+  i32 step  = list->step;
+  f32 reach = step / 2.0f;
+
+  i32 row_first = max_value(0, CAST(i32, floorf((area.y - reach - list->reach) / step)));
+  i32 row_last  = min_value(list->row_count - 1,
+      CAST(i32, ceilf((area.y + area.height - reach + list->reach) / step)));
+
+  if (row_first > row_last) {
+    *first = 0;
+    *last  = 0;
+    return;
+  }
+  *first = list->rows[row_first];
+  *last  = list->rows[row_last + 1];
+}
+
+void displayListRender(const DisplayList* list, Renderer render, i32 first, i32 last) {
+  TRACE_BEGIN("display_list_render");
+  for (i32 i = first; i < last; i++) {
+    Vec2 center = { list->xs[i], list->ys[i] };
+    drawFigure(render, list->figures[i], center, list->sizes[i], list->colors[i]);
+  }
+  TRACE_END();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SVG
+////////////////////////////////////////////////////////////////////////////////
+
+Renderer svgRenderer(FILE* file) {
+  Renderer render = {
+    .draw_circle          = svgDrawCircle,
+    .draw_triangle        = svgDrawTriangle,
+    .draw_triangle_fan    = svgDrawTriangleFan,
+    .draw_triangle_strip  = svgDrawTriangleStrip,
+    .ctx                  = file,
+  };
+  return render;
+}
+
+void svgBegin(FILE* svg, i32 width, i32 height, f32 radius) {
+  fprintf(svg, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
+  fprintf(svg, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" " );
+  fprintf(svg, "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n" );
+  fprintf(svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+    "width=\"%f\" "
+    "height=\"%f\" "
+    "viewBox=\"%f %f %f %f\">\n",
+    width + (radius * 2), height + (radius * 2),
+    radius, radius, width+radius, height+radius);
+}
+
+void svgBackground(FILE* svg, i32 width, i32 height, f32 radius, Rgba color) {
+  fprintf(svg, "<rect x=\"%f\" y=\"%f\" width=\"%f\" height=\"%f\" "
+    "fill=\"#%02x%02x%02x\"/>\n",
+    radius, radius, width + radius, height + radius, color.r, color.g, color.b);
+}
+
+// svgFill writes the fill of the figure, the class of the ink if the color
+// is one of the palette
+local void svgFill(FILE* svg, const Palette* palette, Rgba color) {
+  i32 ink = palette != NULL ? paletteFind(palette, color) : -1;
+  if (ink >= 0) {
+    fprintf(svg, " class=\"i%d\"/>\n", ink);
+  } else {
+    fprintf(svg, " fill=\"#%02x%02x%02x\"/>\n", color.r, color.g, color.b);
+  }
+}
+
+local void svgCircle(FILE* svg, const Palette* palette, Vec2 center, f32 radius, Rgba color) {
+  fprintf(svg, "<circle cx=\"%f\" cy=\"%f\" r=\"%f\"", center.x, center.y, radius);
+  svgFill(svg, palette, color);
+}
+
+local void svgTriangle(FILE* svg, const Palette* palette, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  fprintf(svg, "<polygon points=\"%f,%f %f,%f %f,%f\"", v1.x, v1.y, v2.x, v2.y, v3.x, v3.y);
+  svgFill(svg, palette, color);
+}
+
+local void svgPolygon(FILE* svg, const Palette* palette, const Vec2 *points, i32 pointCount, Rgba color) {
+  fprintf(svg, "<polygon points=\"");
+  for (i32 i = 0; i < pointCount; i++) {
+    if (i > 0) fprintf(svg, " ");
+    fprintf(svg, "%f,%f", points[i].x, points[i].y);
+  }
+  fprintf(svg, "\"");
+  svgFill(svg, palette, color);
+}
+
+void svgDrawCircle(void* ctx, Vec2 center, f32 radius, Rgba color) {
+  svgCircle(CAST(FILE*, ctx), NULL, center, radius, color);
+}
+
+void svgDrawTriangle(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  svgTriangle(CAST(FILE*, ctx), NULL, v1, v2, v3, color);
+}
+
+// Fan is written without its center, the rest of the points outline it
+void svgDrawTriangleFan(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  if (pointCount >= 3) {
+    svgPolygon(CAST(FILE*, ctx), NULL, points + 1, pointCount - 1, color);
+  }
+}
+
+void svgDrawTriangleStrip(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  if (pointCount >= 3) {
+    svgPolygon(CAST(FILE*, ctx), NULL, points, pointCount, color);
+  }
+}
+
+void svgEnd(FILE* svg) {
+  fprintf(svg, "</svg>");
+}
+
+local void svgPaletteCircle(void* ctx, Vec2 center, f32 radius, Rgba color) {
+  SvgPalette* svg = CAST(SvgPalette*, ctx);
+  svgCircle(svg->file, svg->palette, center, radius, color);
+}
+
+local void svgPaletteTriangle(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  SvgPalette* svg = CAST(SvgPalette*, ctx);
+  svgTriangle(svg->file, svg->palette, v1, v2, v3, color);
+}
+
+local void svgPaletteTriangleFan(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  SvgPalette* svg = CAST(SvgPalette*, ctx);
+  if (pointCount >= 3) {
+    svgPolygon(svg->file, svg->palette, points + 1, pointCount - 1, color);
+  }
+}
+
+local void svgPaletteTriangleStrip(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  SvgPalette* svg = CAST(SvgPalette*, ctx);
+  if (pointCount >= 3) {
+    svgPolygon(svg->file, svg->palette, points, pointCount, color);
+  }
+}
+
+Renderer svgPaletteRenderer(SvgPalette* svg) {
+  Renderer render = {
+    .draw_circle          = svgPaletteCircle,
+    .draw_triangle        = svgPaletteTriangle,
+    .draw_triangle_fan    = svgPaletteTriangleFan,
+    .draw_triangle_strip  = svgPaletteTriangleStrip,
+    .ctx                  = svg,
+  };
+  return render;
+}
+
+void svgPaletteStyle(FILE* svg, const Palette* palette) {
+  fprintf(svg, "<style>\n");
+  for (i32 i = 0; i < palette->count; i++) {
+    Rgba ink = palette->inks[i];
+    fprintf(svg, ".i%d{fill:#%02x%02x%02x}\n", i, ink.r, ink.g, ink.b);
+  }
+  fprintf(svg, "</style>\n");
+}
+
+void svgDisplayList(FILE* svg, const DisplayList* list, const Palette* palette) {
+  Vec2 points[FIGURE_MAX_POINTS];
+
+  TRACE_BEGIN("svg_display_list");
+  for (i32 i = 0; i < list->count; i++) {
+    Vec2 center = { list->xs[i], list->ys[i] };
+    Figure figure = list->figures[i];
+    i32 count = figurePoints(figure, center, list->sizes[i], points);
+
+    switch (figure) {
+      case FIGURE_CIRCLE:
+        svgCircle(svg, palette, center, list->sizes[i], list->colors[i]);
+        break;
+      case FIGURE_TRIANGLE:
+        svgTriangle(svg, palette, points[0], points[1], points[2], list->colors[i]);
+        break;
+      case FIGURE_STAR:
+        // Center of the fan is not a part of the outline
+        svgPolygon(svg, palette, points + 1, count - 1, list->colors[i]);
+        break;
+      case FIGURE_SQUARE:
+      case FIGURE_RHOMBUS:
+        svgPolygon(svg, palette, points, count, list->colors[i]);
+        break;
+      case _FIGURE_MAX:
+        break;
+    }
+  }
+  TRACE_END();
+}
@@ -0,0 +1,321 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef HALFTONE_H
+#define HALFTONE_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "imagine.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// FIGURES
+////////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  FIGURE_CIRCLE   = 0,
+  FIGURE_SQUARE   = 1,
+  FIGURE_TRIANGLE = 2,
+  FIGURE_STAR     = 3,
+  FIGURE_RHOMBUS  = 4,
+
+  _FIGURE_MAX
+} Figure;
+
+// Names of the figures on the command line and in the reports
+extern const char* const figure_names[_FIGURE_MAX];
+
+// Every drawing function receives ctx of the renderer as the first argument
+typedef void DrawCircleFn(void* ctx, Vec2 center, f32 radius, Rgba color);
+typedef void DrawTriangleStripFn(void* ctx, const Vec2 *points, i32 pointCount, Rgba color);
+typedef void DrawTriangleFn(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color);
+typedef void DrawTriangleFanFn(void* ctx, const Vec2 *points, i32 pointCount, Rgba color);
+
+typedef struct {
+  DrawCircleFn* draw_circle;
+  DrawTriangleFn* draw_triangle;
+  DrawTriangleFanFn* draw_triangle_fan;
+  DrawTriangleStripFn* draw_triangle_strip;
+
+  void* ctx;
+} Renderer;
+
+// Inks the colors of the figures are limited to, see palette.h
+FWD_STRUCT(Palette);
+
+// Parameters of the halftone that affect the result
+typedef struct {
+  Figure figure;
+  i32 step;
+  f32 radius;
+  // Shift every other row by half of the step
+  bool shift;
+  // Black and white instead of the average color of the cell
+  bool bw;
+  // Scale figures by luminance of the cell
+  bool size_lum;
+  // Average colors and take luminance in linear light instead of the sRGB
+  // encoded values
+  bool linear;
+  // Map colors of the figures to the nearest ink, NULL keeps full color
+  const Palette* palette;
+} RenderParams;
+
+// cellOffset returns x of the first cell of the row whose top is at y, every
+// other row is shifted by half of the step unless shift is off.
+static inline i32 cellOffset(RenderParams params, i32 y) {
+  return (params.shift && (y % 2 == 0)) ? 0 : params.step / 2;
+}
+
+bool sameRenderParams(RenderParams a, RenderParams b);
+
+// renderFigure renders the figure in the center of the area.
+void renderFigure(Renderer render, Rect area, Rgba color, f32 lum, f32 radius, Figure figure);
+
+// Largest number of the points of the outline of a figure
+#define FIGURE_MAX_POINTS 21
+
+// figurePoints fills the outline of the figure of the size around the
+// center the way renderers draw it: the triangle as is, the square and the
+// rhombus as a triangle strip, the star as a triangle fan. Circle has no
+// outline. Returns number of the points.
+i32 figurePoints(Figure figure, Vec2 center, f32 size, Vec2* points);
+
+////////////////////////////////////////////////////////////////////////////////
+/// HALFTONE
+////////////////////////////////////////////////////////////////////////////////
+
+// averageColor returns average color of the pixels of the area.
+Rgba averageColor(Bitmap bitmap, Rect area);
+
+// averageColorLinear returns average color of the pixels of the area taken
+// in linear light, converted with the lookup tables both ways.
+Rgba averageColorLinear(Bitmap bitmap, Rect area);
+
+// cellAverage returns average color of the cell the way params ask for.
+Rgba cellAverage(Bitmap bitmap, Rect cell, RenderParams params);
+
+// cellLuminance returns darkness of the average color of the cell in [0, 1],
+// figures are scaled by it with size_lum.
+f32 cellLuminance(Rgba avg, RenderParams params);
+
+// cellColor returns color of the figure of the cell with the given average
+// color.
+Rgba cellColor(Rgba avg, RenderParams params);
+
+// renderCell renders figure of the cell with the given average color.
+void renderCell(Renderer render, Rect cell, Rgba avg, RenderParams params);
+
+// renderImageArea renders figures of the cells that may be visible inside
+// of the area.
+void renderImageArea(Renderer render, Bitmap bitmap, RenderParams params, Rect area);
+
+// renderImage renders figures of all the cells of the bitmap. Pixels are
+// read in place, so any caller owned buffer can be rendered without a copy.
+void renderImage(Renderer render, Bitmap bitmap, RenderParams params);
+
+// renderStrips renders the halftone of the image that is read one row of the
+// cells at a time, so no more than step rows of pixels are ever in memory.
+bool renderStrips(Renderer render, StripReader* reader, RenderParams params);
+
+////////////////////////////////////////////////////////////////////////////////
+/// CELL PYRAMID
+////////////////////////////////////////////////////////////////////////////////
+
+// Maximum number of the levels in the pyramid, enough to shrink a gigapixel
+// image with the smallest step down to a single cell.
+#define CELL_PYRAMID_MAX_LEVELS 16
+
+// CellLevel is a grid of the average colors of equally sized cells.
+typedef struct {
+  // Size of the cell in pixels
+  i32 step;
+  i32 columns;
+  i32 rows;
+  // Only the finest level follows the shifted layout
+  bool shift;
+  // Colors with zero alpha mark the cells outside of the image
+  Rgba* colors;
+} CellLevel;
+
+// CellPyramid is a mip chain of the cell grids: every level averages 2x2
+// cells of the previous one. Preview draws the level whose cells are large
+// enough to be seen on the screen, which keeps the number of figures bounded
+// no matter how far the camera is zoomed out.
+typedef struct {
+  CellLevel levels[CELL_PYRAMID_MAX_LEVELS];
+  i32 count;
+  // Colors of all levels, rebuilding the pyramid reuses its regions
+  Arena arena;
+
+  // Parameters the pyramid was built for
+  i32 width;
+  i32 height;
+  i32 step;
+  bool shift;
+} CellPyramid;
+
+// cellPyramidBuild samples the rows of the finest level on the workers.
+void cellPyramidBuild(CellPyramid* pyramid, Bitmap bitmap, i32 step, bool shift,
+    Workers* workers);
+void cellPyramidFree(CellPyramid* pyramid);
+
+// Size of the cell of the store in pixels, the smallest step of the preview
+// so the store is the finest level of that step exactly
+#define CELL_STORE_STEP 5
+
+// CellStore is the image reduced to the average colors of the cells of
+// CELL_STORE_STEP pixels, 4 bytes for every CELL_STORE_STEP^2 pixels. Cells
+// on the border average only the pixels inside of the image.
+typedef struct {
+  i32 width;
+  i32 height;
+  CellLevel cells;
+} CellStore;
+
+// cellStoreBuild returns false if the store does not fit into memory.
+bool cellStoreBuild(CellStore* store, Bitmap bitmap);
+void cellStoreFree(CellStore* store);
+
+// cellPyramidBuildStore builds the pyramid without the pixels: every cell of
+// the finest level sums the store cells it overlaps weighted by the area of
+// the overlap. Colors match cellPyramidBuild up to the rounding and the
+// detail finer than the store. Without the shift the pyramid of the step of
+// the store uses its colors as the finest level, the store must outlive it.
+void cellPyramidBuildStore(CellPyramid* pyramid, const CellStore* store, i32 step, bool shift,
+    Workers* workers);
+
+// cellPyramidLevel picks the finest level whose cells are at least min_size
+// pixels large on the screen.
+i32 cellPyramidLevel(const CellPyramid* pyramid, f32 zoom, f32 min_size);
+
+// renderCellLevelArea renders figures of the level that may be visible
+// inside of the area. Figures are scaled together with the cells.
+void renderCellLevelArea(Renderer render, const CellLevel* level,
+    RenderParams params, Rect area);
+
+////////////////////////////////////////////////////////////////////////////////
+/// DISPLAY LIST
+////////////////////////////////////////////////////////////////////////////////
+
+// DisplayList keeps the figures produced by sampling as a structure of
+// arrays, so every backend draws them in a single loop without sampling the
+// image again. Instances go row by row of the cells.
+typedef struct {
+  i32 count;
+  i32 capacity;
+  u8* figures;
+  f32* xs;
+  f32* ys;
+  // Radius of the figure
+  f32* sizes;
+  Rgba* colors;
+
+  // Instances of the row r are rows[r] up to rows[r + 1]
+  i32* rows;
+  i32 row_count;
+  i32 step;
+  // Largest radius of the figures
+  f32 reach;
+} DisplayList;
+
+void displayListFree(DisplayList* list);
+
+// Lists are filled row by row: displayListBegin clears the list for the
+// number of the rows of the cells of the step, displayListAddCell adds the
+// figure of the cell the way renderCell draws it and displayListEndRow
+// closes the row.
+void displayListBegin(DisplayList* list, i32 step, i32 rows);
+void displayListAddCell(DisplayList* list, Rect cell, Rgba avg, RenderParams params);
+void displayListEndRow(DisplayList* list);
+
+// displayListImage samples the cells of the bitmap into the list.
+void displayListImage(DisplayList* list, Bitmap bitmap, RenderParams params);
+
+// DisplayListFn receives the figures of a single row of the cells, the list
+// is reused for the next row once it returns. Returning false stops.
+typedef bool DisplayListFn(void* ctx, const DisplayList* band);
+
+// displayListBands samples the image one row of the cells at a time and
+// passes the figures of every row to fn, so neither the pixels nor the
+// figures of the whole image are ever held in memory. Pixels come from the
+// image when it is not NULL, otherwise they are read in strips. Cells of the
+// row are sampled on the workers.
+bool displayListBands(StripReader* reader, const Bitmap* image, RenderParams params,
+    Workers* workers, DisplayListFn* fn, void* ctx);
+
+// displayListCells fills the list from the average colors of the cells of
+// the level, figures are scaled together with the cells.
+void displayListCells(DisplayList* list, const CellLevel* level, RenderParams params);
+
+// displayListRange returns the instances of the rows whose figures may reach
+// into the area as [first, last).
+void displayListRange(const DisplayList* list, Rect area, i32* first, i32* last);
+
+// displayListRender draws the instances [first, last) with the renderer.
+void displayListRender(const DisplayList* list, Renderer render, i32 first, i32 last);
+
+////////////////////////////////////////////////////////////////////////////////
+/// SVG
+////////////////////////////////////////////////////////////////////////////////
+
+// svgRenderer returns renderer that writes figures to the file as SVG
+// elements, the file is passed to the svg* functions as ctx.
+Renderer svgRenderer(FILE* file);
+
+void svgBegin(FILE* svg, i32 width, i32 height, f32 radius);
+// svgBackground fills the view box of svgBegin with the color, figures
+// drawn before it are hidden.
+void svgBackground(FILE* svg, i32 width, i32 height, f32 radius, Rgba color);
+void svgDrawCircle(void* ctx, Vec2 center, f32 radius, Rgba color);
+void svgDrawTriangle(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color);
+void svgDrawTriangleFan(void* ctx, const Vec2 *points, i32 pointCount, Rgba color);
+void svgDrawTriangleStrip(void* ctx, const Vec2 *points, i32 pointCount, Rgba color);
+void svgEnd(FILE* svg);
+
+// SvgPalette writes the figures painted with the inks of the palette with
+// the class of the ink instead of the fill, so the color of every ink is
+// written once by svgPaletteStyle. Other colors keep the fill.
+typedef struct {
+  FILE* file;
+  const Palette* palette;
+} SvgPalette;
+
+Renderer svgPaletteRenderer(SvgPalette* svg);
+void svgPaletteStyle(FILE* svg, const Palette* palette);
+
+// svgDisplayList writes all instances of the list, colors of the palette
+// are written as classes like SvgPalette does. Palette may be NULL.
+void svgDisplayList(FILE* svg, const DisplayList* list, const Palette* palette);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HALFTONE_H
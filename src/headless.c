@@ -0,0 +1,31 @@
+// Entry of dots_cli: the command line modes of dots without the window, so
+// the build needs no raylib.
+
+#include <stdio.h>
+
+#include "cli.h"
+#include "trace.h"
+
+i32 main(i32 argc, char** argv) {
+  Options options = { 0 };
+  if (!cliParse(&options, argc, argv)) {
+    cliUsage(argv[0], false);
+    return 1;
+  }
+  if (options.mode == MODE_WINDOW) {
+    fprintf(stderr, "%s has no window, pick one of the modes\n", argv[0]);
+    cliUsage(argv[0], false);
+    return 1;
+  }
+
+  TRACE_THREAD("main");
+  i32 status = cliRun(&options);
+
+#ifdef TRACE
+  if (options.trace != NULL && !traceDump(options.trace)) {
+    status = 1;
+  }
+#endif // TRACE
+
+  return status;
+}
@@ -0,0 +1,121 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef IMAGINE_H
+#define IMAGINE_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Types shared by the imagine library. They are laid out the same way as
+// the raylib ones, but the library itself never depends on raylib.
+
+typedef struct {
+  f32 x;
+  f32 y;
+} Vec2;
+
+typedef struct {
+  u8 r;
+  u8 g;
+  u8 b;
+  u8 a;
+} Rgba;
+
+typedef struct {
+  f32 x;
+  f32 y;
+  f32 width;
+  f32 height;
+} Rect;
+
+// Bitmap is a view of the 8-bit pixels owned by the caller, rows start
+// stride bytes apart. Pixels are RGBA, RGB or gray with 4, 3 or 1 channels,
+// so the pixels of the mapped file can be sampled in place. Library never
+// copies or frees the pixels.
+typedef struct {
+  const u8* pixels;
+  i32 width;
+  i32 height;
+  i32 stride;
+  i32 channels;
+} Bitmap;
+
+// bitmapViewChannels wraps the pixels of the given number of the channels,
+// stride of zero means tightly packed rows.
+static inline Bitmap bitmapViewChannels(const void* pixels, i32 width, i32 height,
+    i32 stride, i32 channels) {
+  Bitmap bitmap = {
+    CAST(const u8*, pixels), width, height, stride > 0 ? stride : width * channels, channels,
+  };
+  return bitmap;
+}
+
+// bitmapView wraps the RGBA pixels, stride of zero means tightly packed rows.
+static inline Bitmap bitmapView(const void* pixels, i32 width, i32 height, i32 stride) {
+  return bitmapViewChannels(pixels, width, height, stride, 4);
+}
+
+// bitmapPixel returns pointer to the pixel at x, y.
+static inline const u8* bitmapPixel(Bitmap bitmap, i32 x, i32 y) {
+  return bitmap.pixels + CAST(i64, y) * bitmap.stride + CAST(i64, x) * bitmap.channels;
+}
+
+// bitmapChannel returns offset of the red, green or blue channel inside of
+// the pixel, gray pixels have all three in the single byte.
+static inline i32 bitmapChannel(Bitmap bitmap, i32 channel) {
+  return bitmap.channels >= 3 ? channel : 0;
+}
+
+// Summed-area table holds at every element the sum of the pixels above and
+// to the left of it. SAT_BOX sums the columns [x0, x1) between the rows top
+// and bottom from the four corners, member picks the field of the struct
+// elements and is left empty for the plain ones. Sums of the table may wrap
+// around, the difference of the corners stays exact while the sum of the
+// box fits the type: 8 bit sums fit 32 bits up to SAT_MAX_STEP on a side.
+#define SAT_MAX_STEP 4096
+#define SAT_BOX(top, bottom, x0, x1, member) \
+  ((bottom)[x1]member - (bottom)[x0]member - (top)[x1]member + (top)[x0]member)
+
+// nextRandom advances the xorshift64 state and returns it, the state must not
+// be zero. Fixed seeds keep the output of the same options the same.
+static inline u64 nextRandom(u64* state) {
+  u64 x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+// randomUnit returns the next number of the state uniform in [0, 1).
+static inline f32 randomUnit(u64* state) {
+  return (nextRandom(state) >> 40) / CAST(f32, 1 << 24);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGINE_H
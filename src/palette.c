@@ -0,0 +1,393 @@
+#include "palette.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "trace.h"
+
+// Number of the colors handed to a worker at once
+#define PALETTE_CHUNK 1024
+#define PALETTE_ITERATIONS 32
+#define PALETTE_SEED 0x9e3779b97f4a7c15ull
+
+////////////////////////////////////////////////////////////////////////////////
+/// INKS
+////////////////////////////////////////////////////////////////////////////////
+
+local i32 hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool paletteParse(Palette* palette, const char* list) {
+  palette->count = 0;
+
+  const char* c = list;
+  while (*c != '\0') {
+    if (*c == '#') c++;
+
+    u32 rgb = 0;
+    i32 digits = 0;
+    for (; hexDigit(*c) >= 0; c++, digits++) {
+      rgb = (rgb << 4) | hexDigit(*c);
+    }
+    if (digits != 6 || (*c != ',' && *c != '\0')) {
+      fprintf(stderr, "Invalid palette color in %s\n", list);
+      return false;
+    }
+    if (palette->count == PALETTE_MAX_INKS) {
+      fprintf(stderr, "Palette has more than %d colors\n", PALETTE_MAX_INKS);
+      return false;
+    }
+
+    palette->inks[palette->count++] = (Rgba){
+      .r = CAST(u8, rgb >> 16),
+      .g = CAST(u8, rgb >> 8),
+      .b = CAST(u8, rgb),
+      .a = 255,
+    };
+    if (*c == ',') c++;
+  }
+
+  if (palette->count == 0) {
+    fprintf(stderr, "Palette is empty\n");
+    return false;
+  }
+  return true;
+}
+
+local i32 colorDistance(Rgba a, Rgba b) {
+  i32 dr = a.r - b.r;
+  i32 dg = a.g - b.g;
+  i32 db = a.b - b.b;
+  return dr * dr + dg * dg + db * db;
+}
+
+i32 paletteNearest(const Palette* palette, Rgba color) {
+  i32 nearest = 0;
+  i32 best    = INT32_MAX;
+  for (i32 i = 0; i < palette->count; i++) {
+    i32 distance = colorDistance(palette->inks[i], color);
+    if (distance < best) {
+      best    = distance;
+      nearest = i;
+    }
+  }
+  return nearest;
+}
+
+i32 paletteFind(const Palette* palette, Rgba color) {
+  for (i32 i = 0; i < palette->count; i++) {
+    Rgba ink = palette->inks[i];
+    if (ink.r == color.r && ink.g == color.g && ink.b == color.b) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// ASSIGNMENT
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const Palette* palette;
+  const Rgba* colors;
+  i32 count;
+  u8* inks;
+  // Number of the colors that moved to another ink, one per chunk
+  i32* changes;
+} AssignJob;
+
+local void assignChunk(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  AssignJob* job = CAST(AssignJob*, ctx);
+  i32 first = index * PALETTE_CHUNK;
+  i32 count = min_value(PALETTE_CHUNK, job->count - first);
+  const Rgba* colors = job->colors + first;
+
+  // Channels are split so the loop over the colors has no gathers, squared
+  // distances of 8 bit channels are exact in integers
+  i32 r[PALETTE_CHUNK];
+  i32 g[PALETTE_CHUNK];
+  i32 b[PALETTE_CHUNK];
+  i32 best[PALETTE_CHUNK];
+  i32 nearest[PALETTE_CHUNK];
+
+  for (i32 i = 0; i < count; i++) {
+    r[i] = colors[i].r;
+    g[i] = colors[i].g;
+    b[i] = colors[i].b;
+    best[i]    = INT32_MAX;
+    nearest[i] = 0;
+  }
+
+  for (i32 k = 0; k < job->palette->count; k++) {
+    Rgba ink = job->palette->inks[k];
+    i32 ir = ink.r;
+    i32 ig = ink.g;
+    i32 ib = ink.b;
+
+    for (i32 i = 0; i < count; i++) {
+      i32 dr = r[i] - ir;
+      i32 dg = g[i] - ig;
+      i32 db = b[i] - ib;
+      i32 distance = dr * dr + dg * dg + db * db;
+
+      // Both selects read the old values, so the loop has no branches
+      i32 old     = best[i];
+      i32 current = nearest[i];
+      bool closer = distance < old;
+      best[i]    = closer ? distance : old;
+      nearest[i] = closer ? k : current;
+    }
+  }
+
+  u8* inks = job->inks + first;
+  i32 changes = 0;
+  for (i32 i = 0; i < count; i++) {
+    changes += inks[i] != nearest[i];
+    inks[i] = CAST(u8, nearest[i]);
+  }
+  if (job->changes != NULL) {
+    job->changes[index] = changes;
+  }
+}
+
+void paletteAssign(const Palette* palette, const Rgba* colors, i32 count,
+    u8* inks, Workers* workers) {
+  AssignJob job = {
+    .palette = palette,
+    .colors  = colors,
+    .count   = count,
+    .inks    = inks,
+  };
+
+  TRACE_BEGIN("palette_assign");
+  workersRun(workers, (count + PALETTE_CHUNK - 1) / PALETTE_CHUNK, assignChunk, &job);
+  TRACE_END();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// K-MEANS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const Rgba* colors;
+  i32 count;
+  Rgba ink;
+  // Squared distance of every color to the closest ink picked so far
+  f32* distances;
+  // Sum of the distances of every chunk
+  f64* totals;
+} SeedJob;
+
+local void seedChunk(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  SeedJob* job = CAST(SeedJob*, ctx);
+  i32 first = index * PALETTE_CHUNK;
+  i32 last  = min_value(first + PALETTE_CHUNK, job->count);
+
+  f64 total = 0;
+  for (i32 i = first; i < last; i++) {
+    f32 distance = colorDistance(job->colors[i], job->ink);
+    job->distances[i] = min_value(job->distances[i], distance);
+    total += job->distances[i];
+  }
+  job->totals[index] = total;
+}
+
+// seedInks picks the inks with k-means++: every next ink is one of the
+// colors with probability proportional to the squared distance to the
+// closest ink picked before it. Returns number of inks picked, which is less
+// than requested if there are not enough distinct colors, or -1 if out of
+// memory.
+local i32 seedInks(Palette* palette, i32 inks, const Rgba* colors, i32 count,
+    Workers* workers) {
+  i32 chunks = (count + PALETTE_CHUNK - 1) / PALETTE_CHUNK;
+  SeedJob job = {
+    .colors    = colors,
+    .count     = count,
+    .distances = CAST(f32*, malloc(count * sizeof(f32))),
+    .totals    = CAST(f64*, malloc(chunks * sizeof(f64))),
+  };
+  if (job.distances == NULL || job.totals == NULL) {
+    fprintf(stderr, "Out of memory for the distances of %d colors\n", count);
+    free(job.distances);
+    free(job.totals);
+    return -1;
+  }
+  for (i32 i = 0; i < count; i++) {
+    job.distances[i] = FLT_MAX;
+  }
+
+  u64 random = PALETTE_SEED;
+  i32 picked = 0;
+  i32 next   = nextRandom(&random) % count;
+
+  while (picked < inks) {
+    job.ink = colors[next];
+    palette->inks[picked++] = job.ink;
+    if (picked == inks) break;
+
+    workersRun(workers, chunks, seedChunk, &job);
+
+    f64 total = 0;
+    for (i32 i = 0; i < chunks; i++) {
+      total += job.totals[i];
+    }
+    if (total <= 0) break;
+
+    f64 target = (nextRandom(&random) >> 11) * (1.0 / 9007199254740992.0) * total;
+    i32 chunk = 0;
+    while (chunk < chunks - 1 && target >= job.totals[chunk]) {
+      target -= job.totals[chunk++];
+    }
+
+    i32 last = min_value((chunk + 1) * PALETTE_CHUNK, count);
+    next = last - 1;
+    for (i32 i = chunk * PALETTE_CHUNK; i < last; i++) {
+      if (target < job.distances[i] && job.distances[i] > 0) {
+        next = i;
+        break;
+      }
+      target -= job.distances[i];
+    }
+  }
+
+  free(job.distances);
+  free(job.totals);
+  return picked;
+}
+
+bool paletteKMeans(Palette* palette, i32 inks, const Rgba* colors, i32 count,
+    Workers* workers) {
+  if (inks < 1 || inks > PALETTE_MAX_INKS) {
+    fprintf(stderr, "Number of inks must be between 1 and %d\n", PALETTE_MAX_INKS);
+    return false;
+  }
+  if (count == 0) {
+    fprintf(stderr, "No colors to build the palette from\n");
+    return false;
+  }
+
+  i32 chunks = (count + PALETTE_CHUNK - 1) / PALETTE_CHUNK;
+  AssignJob job = {
+    .palette = palette,
+    .colors  = colors,
+    .count   = count,
+    .inks    = CAST(u8*, calloc(count, sizeof(u8))),
+    .changes = CAST(i32*, calloc(chunks, sizeof(i32))),
+  };
+  if (job.inks == NULL || job.changes == NULL) {
+    fprintf(stderr, "Out of memory for the inks of %d colors\n", count);
+    free(job.inks);
+    free(job.changes);
+    return false;
+  }
+
+  TRACE_BEGIN("palette_kmeans");
+  palette->count = seedInks(palette, inks, colors, count, workers);
+  if (palette->count < 0) {
+    palette->count = 0;
+    free(job.inks);
+    free(job.changes);
+    TRACE_END();
+    return false;
+  }
+
+  for (i32 iteration = 0; iteration < PALETTE_ITERATIONS; iteration++) {
+    workersRun(workers, chunks, assignChunk, &job);
+
+    i32 changes = 0;
+    for (i32 i = 0; i < chunks; i++) {
+      changes += job.changes[i];
+    }
+    if (iteration > 0 && changes == 0) break;
+
+    // Summation is cheap next to the assignment and stays on one thread
+    u64 sums[PALETTE_MAX_INKS][4] = { 0 };
+    for (i32 i = 0; i < count; i++) {
+      u64* sum = sums[job.inks[i]];
+      sum[0] += colors[i].r;
+      sum[1] += colors[i].g;
+      sum[2] += colors[i].b;
+      sum[3] += 1;
+    }
+
+    // Inks left without colors stay where they are
+    for (i32 k = 0; k < palette->count; k++) {
+      u64* sum = sums[k];
+      if (sum[3] == 0) continue;
+      palette->inks[k] = (Rgba){
+        .r = CAST(u8, (sum[0] + sum[3] / 2) / sum[3]),
+        .g = CAST(u8, (sum[1] + sum[3] / 2) / sum[3]),
+        .b = CAST(u8, (sum[2] + sum[3] / 2) / sum[3]),
+        .a = 255,
+      };
+    }
+  }
+
+  free(job.inks);
+  free(job.changes);
+  TRACE_END();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// COLLECTION
+////////////////////////////////////////////////////////////////////////////////
+
+void paletteCollect(Colors* colors, Bitmap bitmap, RenderParams params) {
+  i32 step = params.step;
+  params.palette = NULL;
+
+  for (i32 y = 0; y < bitmap.height; y += step) {
+    i32 x = cellOffset(params, y);
+    for (; x < bitmap.width; x += step) {
+      Rect cell = {
+        .x      = x,
+        .y      = y,
+        .width  = step,
+        .height = step,
+      };
+      da_append(colors, cellColor(cellAverage(bitmap, cell, params), params));
+    }
+  }
+}
+
+bool paletteCollectStrips(Colors* colors, StripReader* reader, RenderParams params) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+  i32 step   = params.step;
+  params.palette = NULL;
+
+  u8* pixels   = CAST(u8*, malloc(CAST(usize, width) * step * 4));
+  Bitmap strip = bitmapView(pixels, width, step, 0);
+
+  bool ok = true;
+  for (i32 y = 0; y < height; y += step) {
+    strip.height = stripRead(reader, pixels, step);
+    if (strip.height <= 0) {
+      ok = false;
+      break;
+    }
+
+    // Strip always starts at the row zero, offset follows the real row
+    i32 x = cellOffset(params, y);
+    for (; x < width; x += step) {
+      Rect cell = {
+        .x      = x,
+        .y      = 0,
+        .width  = step,
+        .height = step,
+      };
+      da_append(colors, cellColor(cellAverage(strip, cell, params), params));
+    }
+  }
+
+  free(pixels);
+  return ok;
+}
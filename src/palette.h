@@ -0,0 +1,78 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PALETTE_MAX_INKS 256
+
+// Palette is the set of inks the figures are printed with.
+struct Palette {
+  i32 count;
+  Rgba inks[PALETTE_MAX_INKS];
+};
+
+da_define(Colors, Rgba);
+
+// paletteParse reads comma separated list of hex colors, e.g.
+// "#00ffff,#ff00ff,#ffff00,#000000".
+bool paletteParse(Palette* palette, const char* list);
+
+// paletteNearest returns index of the ink closest to the color.
+i32 paletteNearest(const Palette* palette, Rgba color);
+
+// paletteFind returns index of the ink of exactly the same color or -1.
+i32 paletteFind(const Palette* palette, Rgba color);
+
+// paletteAssign stores index of the nearest ink of every color to inks.
+// Colors are split in chunks between the workers and every chunk is
+// compared against one ink at a time, so the inner loop is vectorized.
+void paletteAssign(const Palette* palette, const Rgba* colors, i32 count,
+    u8* inks, Workers* workers);
+
+// paletteKMeans clusters the colors into the given number of inks with
+// k-means seeded by k-means++. Result is the same for the same colors.
+bool paletteKMeans(Palette* palette, i32 inks, const Rgba* colors, i32 count,
+    Workers* workers);
+
+// paletteCollect appends colors of the figures of all cells of the bitmap,
+// before they are mapped to the palette.
+void paletteCollect(Colors* colors, Bitmap bitmap, RenderParams params);
+
+// paletteCollectStrips does the same as paletteCollect for the image read
+// in strips.
+bool paletteCollectStrips(Colors* colors, StripReader* reader, RenderParams params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PALETTE_H
@@ -0,0 +1,352 @@
+#include "quadtree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// SUMMED-AREA TABLES
+////////////////////////////////////////////////////////////////////////////////
+
+// Moments are the sums of the channels and of their squares
+typedef struct {
+  u64 r;
+  u64 g;
+  u64 b;
+  u64 squares;
+} Moments;
+
+// satBuild fills the table of (width + 1) x (height + 1) moments of the
+// pixels of the bitmap that start at x, the first row and column are zero.
+local void satBuild(Moments* sat, Bitmap bitmap, i32 x, i32 width, i32 height) {
+  i32 stride = width + 1;
+  memset(sat, 0, stride * sizeof(Moments));
+
+  i32 g = bitmapChannel(bitmap, 1);
+  i32 b = bitmapChannel(bitmap, 2);
+  for (i32 y = 0; y < height; y++) {
+    const u8* pixel = bitmapPixel(bitmap, x, y);
+    const Moments* above = sat + CAST(usize, y) * stride;
+    Moments* row = sat + CAST(usize, y + 1) * stride;
+
+    Moments sum = { 0 };
+    row[0] = sum;
+    for (i32 i = 0; i < width; i++, pixel += bitmap.channels) {
+      sum.r += pixel[0];
+      sum.g += pixel[g];
+      sum.b += pixel[b];
+      sum.squares += pixel[0] * pixel[0] + pixel[g] * pixel[g] + pixel[b] * pixel[b];
+
+      row[i + 1] = (Moments){
+        .r       = above[i + 1].r + sum.r,
+        .g       = above[i + 1].g + sum.g,
+        .b       = above[i + 1].b + sum.b,
+        .squares = above[i + 1].squares + sum.squares,
+      };
+    }
+  }
+}
+
+local Moments satRect(const Moments* sat, i32 stride, i32 x0, i32 y0, i32 x1, i32 y1) {
+  const Moments* top    = sat + CAST(usize, y0) * stride;
+  const Moments* bottom = sat + CAST(usize, y1) * stride;
+
+  Moments result = {
+    .r       = SAT_BOX(top, bottom, x0, x1, .r),
+    .g       = SAT_BOX(top, bottom, x0, x1, .g),
+    .b       = SAT_BOX(top, bottom, x0, x1, .b),
+    .squares = SAT_BOX(top, bottom, x0, x1, .squares),
+  };
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SUBDIVISION
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  // Position inside of the block
+  i32 x;
+  i32 y;
+  // Odd sizes split into the halves that differ by a pixel, the leaves may
+  // be that much off the square
+  i32 width;
+  i32 height;
+  // Split of the node does not fit the budget anymore
+  bool full;
+} QuadNode;
+
+typedef struct {
+  Rect cell;
+  Rgba color;
+} QuadLeaf;
+
+typedef struct {
+  Bitmap band;
+  // Row of the image the band starts at
+  i32 y;
+  QuadtreeParams quadtree;
+  // Leaves are averaged in linear light, variance stays on the encoded values
+  bool linear;
+  i32 block;
+  i32 min_size;
+  // Largest number of the leaves of the full block, the blocks cut by the
+  // edge of the image get the part of it their pixels cover
+  i32 budget;
+
+  // Leaves of every block, budget per block
+  QuadLeaf* leaves;
+  i32* counts;
+} QuadJob;
+
+// nodeStats returns number of the pixels of the node inside of the image and
+// their moments
+local i32 nodeStats(const Moments* sat, i32 width, i32 height, QuadNode node,
+    Moments* moments) {
+  i32 x1 = min_value(node.x + node.width, width);
+  i32 y1 = min_value(node.y + node.height, height);
+  if (node.x >= x1 || node.y >= y1) {
+    return 0;
+  }
+
+  *moments = satRect(sat, width + 1, node.x, node.y, x1, y1);
+  return (x1 - node.x) * (y1 - node.y);
+}
+
+local f64 nodeVariance(Moments m, i32 count) {
+  f64 n = count;
+  f64 means = (square(CAST(f64, m.r)) + square(CAST(f64, m.g)) + square(CAST(f64, m.b))) / n;
+  return max_value((m.squares - means) / n, 0.0) / 3.0;
+}
+
+local void quadBlock(void* ctx, i32 index, Arena* scratch) {
+  QuadJob* job = CAST(QuadJob*, ctx);
+  i32 x      = index * job->block;
+  i32 width  = min_value(job->block, job->band.width - x);
+  i32 height = job->band.height;
+
+  Moments* sat = CAST(Moments*, arena_alloc(scratch,
+        CAST(usize, width + 1) * (height + 1) * sizeof(Moments)));
+  satBuild(sat, job->band, x, width, height);
+
+  i64 area   = CAST(i64, job->block) * job->block;
+  i32 budget = CAST(i32, (CAST(i64, job->budget) * width * height + area - 1) / area);
+
+  QuadNode* nodes = CAST(QuadNode*, arena_alloc(scratch, budget * sizeof(QuadNode)));
+  i32 count = 1;
+  nodes[0] = (QuadNode){ 0, 0, job->block, job->block, false };
+
+  f64 threshold = square(CAST(f64, job->quadtree.threshold));
+  for (;;) {
+    // Node with the largest squared error is split first
+    i32 worst = -1;
+    f64 worst_error = 0;
+    for (i32 i = 0; i < count; i++) {
+      QuadNode node = nodes[i];
+      if (node.full || min_value(node.width, node.height) / 2 < job->min_size) continue;
+
+      Moments m;
+      i32 pixels = nodeStats(sat, width, height, nodes[i], &m);
+      if (pixels == 0) continue;
+
+      f64 variance = nodeVariance(m, pixels);
+      if (variance > threshold && variance * pixels > worst_error) {
+        worst = i;
+        worst_error = variance * pixels;
+      }
+    }
+    if (worst < 0) break;
+
+    // Second halves take the odd pixel, children tile the node exactly
+    QuadNode node = nodes[worst];
+    i32 left  = node.width / 2;
+    i32 top   = node.height / 2;
+    i32 right = node.width - left;
+    i32 down  = node.height - top;
+    QuadNode children[4] = {
+      { node.x,        node.y,       left,  top,  false },
+      { node.x + left, node.y,       right, top,  false },
+      { node.x,        node.y + top, left,  down, false },
+      { node.x + left, node.y + top, right, down, false },
+    };
+
+    // Children outside of the image are dropped
+    i32 inside = 0;
+    for (i32 i = 0; i < 4; i++) {
+      inside += children[i].x < width && children[i].y < height;
+    }
+    // Nodes cut by the edge of the image have fewer children and may still
+    // fit
+    if (count - 1 + inside > budget) {
+      nodes[worst].full = true;
+      continue;
+    }
+
+    nodes[worst] = nodes[--count];
+    for (i32 i = 0; i < 4; i++) {
+      if (children[i].x < width && children[i].y < height) {
+        nodes[count++] = children[i];
+      }
+    }
+  }
+
+  QuadLeaf* leaves = job->leaves + index * job->budget;
+  i32 leaf_count = 0;
+  for (i32 i = 0; i < count; i++) {
+    Moments m;
+    i32 pixels = nodeStats(sat, width, height, nodes[i], &m);
+    if (pixels == 0) continue;
+
+    Rgba color = {
+      .r = CAST(u8, (m.r + pixels / 2) / pixels),
+      .g = CAST(u8, (m.g + pixels / 2) / pixels),
+      .b = CAST(u8, (m.b + pixels / 2) / pixels),
+      .a = 255,
+    };
+    if (job->linear) {
+      Rect inside = {
+        .x      = x + nodes[i].x,
+        .y      = nodes[i].y,
+        .width  = min_value(nodes[i].width, width - nodes[i].x),
+        .height = min_value(nodes[i].height, height - nodes[i].y),
+      };
+      color = averageColorLinear(job->band, inside);
+    }
+
+    leaves[leaf_count++] = (QuadLeaf){
+      .cell = {
+        .x      = x + nodes[i].x,
+        .y      = job->y + nodes[i].y,
+        .width  = nodes[i].width,
+        .height = nodes[i].height,
+      },
+      .color = color,
+    };
+  }
+  job->counts[index] = leaf_count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RENDERING
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  QuadJob job;
+  i32 blocks;
+  QuadtreeCellFn* fn;
+  void* ctx;
+} Quadtree;
+
+local void quadtreeInit(Quadtree* tree, i32 width, RenderParams params,
+    QuadtreeParams quadtree, QuadtreeCellFn* fn, void* ctx) {
+  i32 block = params.step << QUADTREE_DEPTH;
+  i32 cells = 1 << QUADTREE_DEPTH;
+
+  *tree = (Quadtree){
+    .blocks = (width + block - 1) / block,
+    .fn     = fn,
+    .ctx    = ctx,
+    .job    = {
+      .quadtree = quadtree,
+      .linear   = params.linear,
+      .block    = block,
+      .min_size = max_value(params.step >> QUADTREE_DEPTH, 1),
+      .budget   = cells * cells,
+    },
+  };
+  tree->job.leaves = CAST(QuadLeaf*, malloc(tree->blocks * tree->job.budget * sizeof(QuadLeaf)));
+  tree->job.counts = CAST(i32*, malloc(tree->blocks * sizeof(i32)));
+}
+
+local void quadtreeFree(Quadtree* tree) {
+  free(tree->job.leaves);
+  free(tree->job.counts);
+}
+
+// quadtreeBand splits the blocks of the band that starts at the row y and
+// passes their leaves on
+local void quadtreeBand(Quadtree* tree, Bitmap band, i32 y, Workers* workers) {
+  tree->job.band = band;
+  tree->job.y    = y;
+
+  TRACE_BEGIN("quadtree_split");
+  workersRun(workers, tree->blocks, quadBlock, &tree->job);
+  workersReset(workers);
+  TRACE_END();
+
+  TRACE_BEGIN("quadtree_render");
+  for (i32 i = 0; i < tree->blocks; i++) {
+    const QuadLeaf* leaves = tree->job.leaves + i * tree->job.budget;
+    for (i32 j = 0; j < tree->job.counts[i]; j++) {
+      tree->fn(tree->ctx, leaves[j].cell, leaves[j].color);
+    }
+  }
+  TRACE_END();
+}
+
+void quadtreeCells(Bitmap bitmap, RenderParams params, QuadtreeParams quadtree,
+    Workers* workers, QuadtreeCellFn* fn, void* ctx) {
+  Quadtree tree;
+  quadtreeInit(&tree, bitmap.width, params, quadtree, fn, ctx);
+
+  i32 block = tree.job.block;
+  for (i32 y = 0; y < bitmap.height; y += block) {
+    Bitmap band = bitmapViewChannels(bitmapPixel(bitmap, 0, y), bitmap.width,
+        min_value(block, bitmap.height - y), bitmap.stride, bitmap.channels);
+    quadtreeBand(&tree, band, y, workers);
+  }
+
+  quadtreeFree(&tree);
+}
+
+typedef struct {
+  Renderer render;
+  RenderParams params;
+} QuadRender;
+
+// quadRenderCell scales the radius of the figure with the side of the cell
+local void quadRenderCell(void* ctx, Rect cell, Rgba color) {
+  QuadRender* quad    = CAST(QuadRender*, ctx);
+  RenderParams params = quad->params;
+  params.radius *= (cell.width + cell.height) / (2.0f * params.step);
+  renderCell(quad->render, cell, color, params);
+}
+
+void renderQuadtree(Renderer render, Bitmap bitmap, RenderParams params,
+    QuadtreeParams quadtree, Workers* workers) {
+  QuadRender quad = { render, params };
+  quadtreeCells(bitmap, params, quadtree, workers, quadRenderCell, &quad);
+}
+
+bool renderQuadtreeStrips(Renderer render, StripReader* reader, RenderParams params,
+    QuadtreeParams quadtree, Workers* workers) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+
+  QuadRender quad = { render, params };
+  Quadtree tree;
+  quadtreeInit(&tree, width, params, quadtree, quadRenderCell, &quad);
+
+  i32 block  = tree.job.block;
+  u8* pixels = CAST(u8*, malloc(CAST(usize, width) * block * 4));
+  Bitmap band = bitmapView(pixels, width, block, 0);
+
+  bool ok = true;
+  for (i32 y = 0; y < height; y += block) {
+    TRACE_BEGIN("strip_read");
+    band.height = stripRead(reader, pixels, block);
+    TRACE_END();
+    if (band.height <= 0) {
+      ok = false;
+      break;
+    }
+    quadtreeBand(&tree, band, y, workers);
+  }
+
+  free(pixels);
+  quadtreeFree(&tree);
+  return ok;
+}
@@ -0,0 +1,75 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of times the cell can be merged or split relative to the step:
+// image is covered with blocks of step << QUADTREE_DEPTH pixels and the
+// smallest cell is step >> QUADTREE_DEPTH pixels.
+#define QUADTREE_DEPTH 2
+
+// Adaptive layout starts with the whole block as a single cell and keeps
+// splitting the cell with the largest squared error while the standard
+// deviation of its color is above the threshold. Every block may have no
+// more cells than the uniform grid would put into it, so detail moves to
+// where it matters without adding figures. Mean and variance of any cell
+// come in O(1) from the summed-area tables of the block, blocks are split
+// in parallel on the workers. Rows are never shifted.
+typedef struct {
+  // Standard deviation of the color channels that is flat enough
+  f32 threshold;
+} QuadtreeParams;
+
+// QuadtreeCellFn receives every leaf of the layout with its average color.
+typedef void QuadtreeCellFn(void* ctx, Rect cell, Rgba color);
+
+// quadtreeCells splits the bitmap and passes the leaves to fn band by band,
+// the leaves tile the image without gaps or overlaps and may reach past its
+// right and bottom edges.
+void quadtreeCells(Bitmap bitmap, RenderParams params, QuadtreeParams quadtree,
+    Workers* workers, QuadtreeCellFn* fn, void* ctx);
+
+// renderQuadtree renders figures of the adaptive cells of the bitmap, the
+// radius of every figure is scaled with its cell.
+void renderQuadtree(Renderer render, Bitmap bitmap, RenderParams params,
+    QuadtreeParams quadtree, Workers* workers);
+
+// renderQuadtreeStrips does the same for the image read in strips, a single
+// row of the blocks is kept in memory.
+bool renderQuadtreeStrips(Renderer render, StripReader* reader, RenderParams params,
+    QuadtreeParams quadtree, Workers* workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUADTREE_H
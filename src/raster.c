@@ -0,0 +1,749 @@
+#include "raster.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <zlib.h>
+
+#include "trace.h"
+
+// Shape is a recorded figure in the pixels of the output
+typedef struct {
+  // Bounds of the shape
+  f32 x0;
+  f32 y0;
+  f32 x1;
+  f32 y1;
+  Rgba color;
+  // Radius of the circle, zero for the polygons
+  f32 radius;
+  // Center of the circle or the closed outline of the polygon
+  i32 first;
+  i32 count;
+} Shape;
+
+da_define(Shapes, Shape);
+da_define(Vertices, Vec2);
+da_define(Bin, i32);
+
+struct Raster {
+  i32 width;
+  i32 height;
+  f32 scale;
+  Rgba background;
+
+  // Number of the tiles
+  i32 columns;
+  i32 rows;
+
+  Shapes shapes;
+  Vertices vertices;
+  // Indices of the shapes that overlap every tile in order of drawing
+  Bin* bins;
+};
+
+Raster* rasterCreate(i32 width, i32 height, f32 scale, Rgba background) {
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "Invalid raster size %dx%d\n", width, height);
+    return NULL;
+  }
+
+  Raster* raster = CAST(Raster*, calloc(1, sizeof(Raster)));
+  raster->width      = width;
+  raster->height     = height;
+  raster->scale      = scale;
+  raster->background = background;
+  raster->columns    = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  raster->rows       = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  raster->bins       = CAST(Bin*, calloc(raster->columns * raster->rows, sizeof(Bin)));
+
+  return raster;
+}
+
+void rasterDestroy(Raster* raster) {
+  if (raster == NULL) {
+    return;
+  }
+
+  for (i32 i = 0; i < raster->columns * raster->rows; i++) {
+    da_free(&raster->bins[i]);
+  }
+  free(raster->bins);
+  da_free(&raster->shapes);
+  da_free(&raster->vertices);
+  free(raster);
+}
+
+void rasterClear(Raster* raster) {
+  for (i32 i = 0; i < raster->columns * raster->rows; i++) {
+    da_clear(&raster->bins[i]);
+  }
+  da_clear(&raster->shapes);
+  da_clear(&raster->vertices);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RECORDING
+////////////////////////////////////////////////////////////////////////////////
+
+local bool rasterVisible(Raster* raster, Shape* shape) {
+  return shape->x1 > 0 && shape->y1 > 0
+    && shape->x0 < raster->width && shape->y0 < raster->height;
+}
+
+local void rasterBin(Raster* raster, Shape shape) {
+  i32 index = raster->shapes.len;
+  da_append(&raster->shapes, shape);
+
+  i32 column_first = max_value(0, CAST(i32, shape.x0) / RASTER_TILE_SIZE);
+  i32 column_last  = min_value(raster->columns - 1, CAST(i32, shape.x1) / RASTER_TILE_SIZE);
+  i32 row_first    = max_value(0, CAST(i32, shape.y0) / RASTER_TILE_SIZE);
+  i32 row_last     = min_value(raster->rows - 1, CAST(i32, shape.y1) / RASTER_TILE_SIZE);
+
+  for (i32 row = row_first; row <= row_last; row++) {
+    for (i32 column = column_first; column <= column_last; column++) {
+      da_append(&raster->bins[row * raster->columns + column], index);
+    }
+  }
+}
+
+local Vec2 rasterPoint(Raster* raster, Vec2 point) {
+  return (Vec2){ .x = point.x * raster->scale, .y = point.y * raster->scale };
+}
+
+local void rasterDrawCircle(void* ctx, Vec2 center, f32 radius, Rgba color) {
+  Raster* raster = CAST(Raster*, ctx);
+
+  center = rasterPoint(raster, center);
+  radius = radius * raster->scale;
+  if (radius <= 0.0f) return;
+
+  Shape shape = {
+    .x0     = center.x - radius - 1.0f,
+    .y0     = center.y - radius - 1.0f,
+    .x1     = center.x + radius + 1.0f,
+    .y1     = center.y + radius + 1.0f,
+    .color  = color,
+    .radius = radius,
+    .first  = raster->vertices.len,
+    .count  = 1,
+  };
+  if (!rasterVisible(raster, &shape)) return;
+
+  da_append(&raster->vertices, center);
+  rasterBin(raster, shape);
+}
+
+// rasterDrawPolygon records the closed outline of the figure, the last point
+// connects back to the first.
+local void rasterDrawPolygon(Raster* raster, const Vec2* points, i32 count, Rgba color) {
+  if (count < 3) return;
+
+  Shape shape = {
+    .x0    = INFINITY,
+    .y0    = INFINITY,
+    .x1    = -INFINITY,
+    .y1    = -INFINITY,
+    .color = color,
+    .first = raster->vertices.len,
+    .count = count,
+  };
+
+  f32 area = 0.0f;
+  Vec2 last = rasterPoint(raster, points[count - 1]);
+  for (i32 i = 0; i < count; i++) {
+    Vec2 point = rasterPoint(raster, points[i]);
+    area += last.x * point.y - point.x * last.y;
+    last = point;
+
+    shape.x0 = min_value(shape.x0, point.x);
+    shape.y0 = min_value(shape.y0, point.y);
+    shape.x1 = max_value(shape.x1, point.x);
+    shape.y1 = max_value(shape.y1, point.y);
+    da_append(&raster->vertices, point);
+  }
+
+  if (area == 0.0f || !rasterVisible(raster, &shape)) {
+    raster->vertices.len = shape.first;
+    return;
+  }
+  rasterBin(raster, shape);
+}
+
+local void rasterDrawTriangle(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  Vec2 points[3] = { v1, v2, v3 };
+  rasterDrawPolygon(CAST(Raster*, ctx), points, 3, color);
+}
+
+// Fans and strips of the figures are drawn as their outlines, the same way
+// as in SVG: the fan goes around its center and the strip around the figure.
+// Triangles of the strip overlap, outline covers every pixel once.
+local void rasterDrawTriangleFan(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  if (pointCount < 3) return;
+  rasterDrawPolygon(CAST(Raster*, ctx), points + 1, pointCount - 1, color);
+}
+
+local void rasterDrawTriangleStrip(void* ctx, const Vec2 *points, i32 pointCount, Rgba color) {
+  rasterDrawPolygon(CAST(Raster*, ctx), points, pointCount, color);
+}
+
+Renderer rasterRenderer(Raster* raster) {
+  Renderer render = {
+    .draw_circle          = rasterDrawCircle,
+    .draw_triangle        = rasterDrawTriangle,
+    .draw_triangle_fan    = rasterDrawTriangleFan,
+    .draw_triangle_strip  = rasterDrawTriangleStrip,
+    .ctx                  = raster,
+  };
+  return render;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// TILES
+////////////////////////////////////////////////////////////////////////////////
+
+// Coverage accumulation buffer has two extra columns, edges clipped to the
+// right border of the tile spill into them.
+#define ACCUMULATOR_STRIDE (RASTER_TILE_SIZE + 2)
+
+typedef struct {
+  Raster* raster;
+  i32 y;
+  u8* pixels;
+  i32 stride;
+} Band;
+
+local f32 clampf(f32 value, f32 low, f32 high) {
+  return min_value(max_value(value, low), high);
+}
+
+local void blendPixel(u8* pixel, Rgba color, f32 coverage) {
+  f32 alpha = coverage * color.a / 255.0f;
+  pixel[0] = CAST(u8, pixel[0] + (color.r - pixel[0]) * alpha + 0.5f);
+  pixel[1] = CAST(u8, pixel[1] + (color.g - pixel[1]) * alpha + 0.5f);
+  pixel[2] = CAST(u8, pixel[2] + (color.b - pixel[2]) * alpha + 0.5f);
+}
+
+// accumulateLine adds signed area covered to the left of the line from a to
+// b to the cells of the accumulator, a must be above b. Sum of the row up to
+// the pixel is the coverage of the pixel. Both ends must be in [0, width].
+local void accumulateLine(f32* acc, i32 width, i32 height, Vec2 a, Vec2 b, f32 dir) {
+  f32 dxdy = (b.x - a.x) / (b.y - a.y);
+  f32 x    = a.x;
+  i32 y0   = max_value(0, CAST(i32, floorf(a.y)));
+  i32 y1   = min_value(height, CAST(i32, ceilf(b.y)));
+  if (a.y < 0.0f) {
+    x -= a.y * dxdy;
+  }
+
+  for (i32 y = y0; y < y1; y++) {
+    f32* row   = acc + y * ACCUMULATOR_STRIDE;
+    f32 dy     = min_value(y + 1.0f, b.y) - max_value(CAST(f32, y), a.y);
+    f32 xnext  = x + dxdy * dy;
+    f32 d      = dy * dir;
+
+    f32 x0 = clampf(min_value(x, xnext), 0.0f, width);
+    f32 x1 = clampf(max_value(x, xnext), 0.0f, width);
+
+    f32 x0floor = floorf(x0);
+    i32 x0i     = CAST(i32, x0floor);
+    f32 x1ceil  = ceilf(x1);
+    i32 x1i     = CAST(i32, x1ceil);
+
+    if (x1i <= x0i + 1) {
+      // Line crosses single pixel of the row
+      f32 xmf = 0.5f * (x0 + x1) - x0floor;
+      row[x0i]     += d - d * xmf;
+      row[x0i + 1] += d * xmf;
+    } else {
+      f32 s   = 1.0f / (x1 - x0);
+      f32 x0f = x0 - x0floor;
+      f32 a0  = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+      f32 x1f = x1 - x1ceil + 1.0f;
+      f32 am  = 0.5f * s * x1f * x1f;
+
+      row[x0i] += d * a0;
+      if (x1i == x0i + 2) {
+        row[x0i + 1] += d * (1.0f - a0 - am);
+      } else {
+        f32 a1 = s * (1.5f - x0f);
+        row[x0i + 1] += d * (a1 - a0);
+        for (i32 xi = x0i + 2; xi < x1i - 1; xi++) {
+          row[xi] += d * s;
+        }
+        f32 a2 = a1 + (x1i - x0i - 3) * s;
+        row[x1i - 1] += d * (1.0f - a2 - am);
+      }
+      row[x1i] += d * am;
+    }
+
+    x = xnext;
+  }
+}
+
+// accumulateEdge splits the edge at the left and right borders of the tile.
+// Parts outside become vertical lines on the border, which keeps the area to
+// the left of the edge exact inside of the tile.
+local void accumulateEdge(f32* acc, i32 width, i32 height, Vec2 a, Vec2 b) {
+  if (a.y == b.y) return;
+
+  f32 dir = 1.0f;
+  if (a.y > b.y) {
+    Vec2 tmp = a;
+    a   = b;
+    b   = tmp;
+    dir = -1.0f;
+  }
+
+  Vec2 points[4] = { a };
+  i32 count = 1;
+
+  // Crossings of the borders ordered from a to b
+  f32 borders[2] = { 0.0f, CAST(f32, width) };
+  f32 ts[2];
+  i32 crossings = 0;
+  for (i32 i = 0; i < 2; i++) {
+    f32 border = borders[i];
+    if ((a.x < border && b.x > border) || (a.x > border && b.x < border)) {
+      ts[crossings++] = (border - a.x) / (b.x - a.x);
+    }
+  }
+  if (crossings == 2 && ts[0] > ts[1]) {
+    f32 tmp = ts[0];
+    ts[0] = ts[1];
+    ts[1] = tmp;
+  }
+  for (i32 i = 0; i < crossings; i++) {
+    points[count++] = (Vec2){
+      .x = a.x + (b.x - a.x) * ts[i],
+      .y = a.y + (b.y - a.y) * ts[i],
+    };
+  }
+  points[count++] = b;
+
+  for (i32 i = 1; i < count; i++) {
+    Vec2 p0 = points[i - 1];
+    Vec2 p1 = points[i];
+    if (p0.y == p1.y) continue;
+    p0.x = clampf(p0.x, 0.0f, width);
+    p1.x = clampf(p1.x, 0.0f, width);
+    accumulateLine(acc, width, height, p0, p1, dir);
+  }
+}
+
+local void rasterPolygon(Raster* raster, Shape* shape, f32* acc,
+    i32 tx, i32 ty, i32 width, i32 height, u8* pixels, i32 stride) {
+  Vec2* vertices = raster->vertices.arr + shape->first;
+  Vec2 origin    = { .x = tx, .y = ty };
+
+  for (i32 i = 0; i < shape->count; i++) {
+    Vec2 a = vertices[i];
+    Vec2 b = vertices[(i + 1) % shape->count];
+    a.x -= origin.x;
+    a.y -= origin.y;
+    b.x -= origin.x;
+    b.y -= origin.y;
+    accumulateEdge(acc, width, height, a, b);
+  }
+
+  i32 x0 = max_value(0, CAST(i32, floorf(shape->x0 - tx)));
+  i32 x1 = min_value(width + 1, max_value(1, CAST(i32, ceilf(shape->x1 - tx)) + 1));
+  i32 y0 = max_value(0, CAST(i32, floorf(shape->y0 - ty)));
+  i32 y1 = min_value(height, CAST(i32, ceilf(shape->y1 - ty)));
+
+  // Sign of the sum depends on the direction of the outline, clamped
+  // magnitude is the non-zero winding coverage
+  for (i32 y = y0; y < y1; y++) {
+    f32* row  = acc + y * ACCUMULATOR_STRIDE;
+    u8* pixel = pixels + y * stride + x0 * 4;
+    f32 sum   = 0.0f;
+
+    for (i32 x = x0; x <= x1; x++, pixel += 4) {
+      sum += row[x];
+      row[x] = 0.0f;
+      if (x >= width) continue;
+
+      f32 coverage = min_value(fabsf(sum), 1.0f);
+      if (coverage > 1.0f / 512.0f) {
+        blendPixel(pixel, shape->color, coverage);
+      }
+    }
+  }
+}
+
+local void rasterCircle(Raster* raster, Shape* shape,
+    i32 tx, i32 ty, i32 width, i32 height, u8* pixels, i32 stride) {
+  Vec2 center = raster->vertices.arr[shape->first];
+  f32 radius  = shape->radius;
+
+  i32 x0 = max_value(0, CAST(i32, floorf(shape->x0)) - tx);
+  i32 x1 = min_value(width, CAST(i32, ceilf(shape->x1)) - tx);
+  i32 y0 = max_value(0, CAST(i32, floorf(shape->y0)) - ty);
+  i32 y1 = min_value(height, CAST(i32, ceilf(shape->y1)) - ty);
+
+  // Coverage is the distance from the center of the pixel to the edge,
+  // circles smaller than the pixel are dimmed by their size.
+  f32 inner = max_value(radius - 0.5f, 0.0f);
+  f32 outer = radius + 0.5f;
+  f32 small = min_value(2.0f * radius, 1.0f);
+
+  for (i32 y = y0; y < y1; y++) {
+    f32 dy    = ty + y + 0.5f - center.y;
+    u8* pixel = pixels + y * stride + x0 * 4;
+
+    for (i32 x = x0; x < x1; x++, pixel += 4) {
+      f32 dx = tx + x + 0.5f - center.x;
+      f32 d2 = dx * dx + dy * dy;
+      if (d2 >= outer * outer) continue;
+
+      f32 coverage = small;
+      if (d2 > inner * inner) {
+        coverage *= outer - sqrtf(d2);
+      }
+      blendPixel(pixel, shape->color, coverage);
+    }
+  }
+}
+
+local void rasterTile(void* ctx, i32 column, Arena* scratch) {
+  Band* band     = CAST(Band*, ctx);
+  Raster* raster = band->raster;
+
+  i32 tx     = column * RASTER_TILE_SIZE;
+  i32 ty     = band->y;
+  i32 width  = min_value(RASTER_TILE_SIZE, raster->width - tx);
+  i32 height = min_value(RASTER_TILE_SIZE, raster->height - ty);
+  u8* pixels = band->pixels + tx * 4;
+
+  Rgba background = raster->background;
+  for (i32 y = 0; y < height; y++) {
+    u8* pixel = pixels + y * band->stride;
+    for (i32 x = 0; x < width; x++, pixel += 4) {
+      pixel[0] = background.r;
+      pixel[1] = background.g;
+      pixel[2] = background.b;
+      pixel[3] = 255;
+    }
+  }
+
+  Bin* bin = raster->bins + (ty / RASTER_TILE_SIZE) * raster->columns + column;
+  if (bin->len == 0) return;
+
+  usize acc_size = sizeof(f32) * ACCUMULATOR_STRIDE * RASTER_TILE_SIZE;
+  f32* acc = CAST(f32*, arena_alloc(scratch, acc_size));
+  memset(acc, 0, acc_size);
+
+  for (i32 i = 0; i < bin->len; i++) {
+    Shape* shape = raster->shapes.arr + bin->arr[i];
+    if (shape->radius > 0.0f) {
+      rasterCircle(raster, shape, tx, ty, width, height, pixels, band->stride);
+    } else {
+      rasterPolygon(raster, shape, acc, tx, ty, width, height, pixels, band->stride);
+    }
+  }
+}
+
+i32 rasterRenderBand(Raster* raster, Workers* workers, i32 y, u8* pixels, i32 stride) {
+  if (y < 0 || y >= raster->height) {
+    return 0;
+  }
+
+  Band band = {
+    .raster = raster,
+    .y      = y,
+    .pixels = pixels,
+    .stride = stride,
+  };
+
+  TRACE_BEGIN("raster_band");
+  workersRun(workers, raster->columns, rasterTile, &band);
+  workersReset(workers);
+  TRACE_END();
+
+  return min_value(RASTER_TILE_SIZE, raster->height - y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// ENCODERS
+////////////////////////////////////////////////////////////////////////////////
+
+// Size of the buffer encoders collect the output in
+#define ENCODER_BUFFER_SIZE (1 << 16)
+
+typedef struct {
+  FILE* file;
+  i32 width;
+  i32 height;
+
+  u8 out[ENCODER_BUFFER_SIZE];
+  i32 len;
+
+  // PNG
+  z_stream zs;
+  u8* row;
+
+  // QOI
+  Rgba index[64];
+  Rgba prev;
+  i32 run;
+} Encoder;
+
+local void putU32(u8* dst, u32 value) {
+  dst[0] = CAST(u8, value >> 24);
+  dst[1] = CAST(u8, value >> 16);
+  dst[2] = CAST(u8, value >> 8);
+  dst[3] = CAST(u8, value);
+}
+
+/// PNG ////////////////////////////////////////////////////////////////////////
+
+local void pngChunk(FILE* file, const char* type, const u8* data, u32 length) {
+  u8 header[8];
+  putU32(header, length);
+  memcpy(header + 4, type, 4);
+
+  uLong crc = crc32(0, header + 4, 4);
+  if (length > 0) {
+    crc = crc32(crc, data, length);
+  }
+
+  u8 footer[4];
+  putU32(footer, CAST(u32, crc));
+
+  fwrite(header, 1, sizeof(header), file);
+  if (length > 0) {
+    fwrite(data, 1, length, file);
+  }
+  fwrite(footer, 1, sizeof(footer), file);
+}
+
+local bool pngBegin(Encoder* encoder) {
+  static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  fwrite(signature, 1, sizeof(signature), encoder->file);
+
+  u8 ihdr[13];
+  putU32(ihdr, encoder->width);
+  putU32(ihdr + 4, encoder->height);
+  ihdr[8]  = 8; // bit depth
+  ihdr[9]  = 2; // RGB
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+  pngChunk(encoder->file, "IHDR", ihdr, sizeof(ihdr));
+
+  // Halftone is mostly flat areas, fastest level compresses it well enough
+  if (deflateInit(&encoder->zs, Z_BEST_SPEED) != Z_OK) {
+    fprintf(stderr, "Failed to initialize deflate\n");
+    return false;
+  }
+  encoder->row = CAST(u8*, malloc(1 + CAST(usize, encoder->width) * 3));
+  if (encoder->row == NULL) {
+    deflateEnd(&encoder->zs);
+    return false;
+  }
+  return true;
+}
+
+local void pngDeflate(Encoder* encoder, const u8* data, usize size, i32 flush) {
+  z_stream* zs = &encoder->zs;
+  zs->next_in  = CAST(Bytef*, data);
+  zs->avail_in = CAST(uInt, size);
+
+  do {
+    zs->next_out  = encoder->out;
+    zs->avail_out = ENCODER_BUFFER_SIZE;
+    deflate(zs, flush);
+    u32 produced = ENCODER_BUFFER_SIZE - zs->avail_out;
+    if (produced > 0) {
+      pngChunk(encoder->file, "IDAT", encoder->out, produced);
+    }
+  } while (zs->avail_out == 0);
+}
+
+local void pngRows(Encoder* encoder, const u8* pixels, i32 stride, i32 rows) {
+  for (i32 y = 0; y < rows; y++) {
+    const u8* src = pixels + CAST(i64, y) * stride;
+    u8* dst = encoder->row;
+    *dst++ = 0; // no filter
+    for (i32 x = 0; x < encoder->width; x++, src += 4) {
+      *dst++ = src[0];
+      *dst++ = src[1];
+      *dst++ = src[2];
+    }
+    pngDeflate(encoder, encoder->row, 1 + CAST(usize, encoder->width) * 3, Z_NO_FLUSH);
+  }
+}
+
+local void pngEnd(Encoder* encoder) {
+  pngDeflate(encoder, NULL, 0, Z_FINISH);
+  deflateEnd(&encoder->zs);
+  free(encoder->row);
+  pngChunk(encoder->file, "IEND", NULL, 0);
+}
+
+/// QOI ////////////////////////////////////////////////////////////////////////
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+
+local void qoiFlush(Encoder* encoder) {
+  fwrite(encoder->out, 1, encoder->len, encoder->file);
+  encoder->len = 0;
+}
+
+local bool qoiBegin(Encoder* encoder) {
+  u8 header[14] = { 'q', 'o', 'i', 'f' };
+  putU32(header + 4, encoder->width);
+  putU32(header + 8, encoder->height);
+  header[12] = 3; // RGB
+  header[13] = 0; // sRGB
+  fwrite(header, 1, sizeof(header), encoder->file);
+
+  memset(encoder->index, 0, sizeof(encoder->index));
+  encoder->prev = (Rgba){ .r = 0, .g = 0, .b = 0, .a = 255 };
+  encoder->run  = 0;
+  return true;
+}
+
+local void qoiRun(Encoder* encoder) {
+  if (encoder->run > 0) {
+    encoder->out[encoder->len++] = QOI_OP_RUN | (encoder->run - 1);
+    encoder->run = 0;
+  }
+}
+
+local void qoiRows(Encoder* encoder, const u8* pixels, i32 stride, i32 rows) {
+  for (i32 y = 0; y < rows; y++) {
+    const u8* src = pixels + CAST(i64, y) * stride;
+
+    for (i32 x = 0; x < encoder->width; x++, src += 4) {
+      if (encoder->len > ENCODER_BUFFER_SIZE - 8) {
+        qoiFlush(encoder);
+      }
+
+      Rgba px   = { .r = src[0], .g = src[1], .b = src[2], .a = 255 };
+      Rgba prev = encoder->prev;
+
+      if (px.r == prev.r && px.g == prev.g && px.b == prev.b) {
+        encoder->run++;
+        if (encoder->run == 62) {
+          qoiRun(encoder);
+        }
+        continue;
+      }
+      qoiRun(encoder);
+
+      i32 hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+      Rgba seen = encoder->index[hash];
+      encoder->prev = px;
+
+      if (seen.r == px.r && seen.g == px.g && seen.b == px.b && seen.a == px.a) {
+        encoder->out[encoder->len++] = QOI_OP_INDEX | hash;
+        continue;
+      }
+      encoder->index[hash] = px;
+
+      i8 vr   = CAST(i8, px.r - prev.r);
+      i8 vg   = CAST(i8, px.g - prev.g);
+      i8 vb   = CAST(i8, px.b - prev.b);
+      i8 vg_r = CAST(i8, vr - vg);
+      i8 vg_b = CAST(i8, vb - vg);
+
+      if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+        encoder->out[encoder->len++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+      } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+        encoder->out[encoder->len++] = QOI_OP_LUMA | (vg + 32);
+        encoder->out[encoder->len++] = (vg_r + 8) << 4 | (vg_b + 8);
+      } else {
+        encoder->out[encoder->len++] = QOI_OP_RGB;
+        encoder->out[encoder->len++] = px.r;
+        encoder->out[encoder->len++] = px.g;
+        encoder->out[encoder->len++] = px.b;
+      }
+    }
+  }
+}
+
+local void qoiEnd(Encoder* encoder) {
+  static const u8 padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  qoiRun(encoder);
+  qoiFlush(encoder);
+  memcpy(encoder->out + encoder->len, padding, sizeof(padding));
+  encoder->len += sizeof(padding);
+  qoiFlush(encoder);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// OUTPUT
+////////////////////////////////////////////////////////////////////////////////
+
+bool rasterFormat(const char* path, RasterFormat* format) {
+  const char* ext = strrchr(path, '.');
+  if (ext == NULL) {
+    return false;
+  }
+
+  if (strcasecmp(ext, ".png") == 0) {
+    *format = RASTER_PNG;
+    return true;
+  }
+  if (strcasecmp(ext, ".qoi") == 0) {
+    *format = RASTER_QOI;
+    return true;
+  }
+  return false;
+}
+
+bool rasterWrite(Raster* raster, Workers* workers, FILE* file, RasterFormat format) {
+  i32 stride = raster->width * 4;
+  u8* band   = CAST(u8*, malloc(CAST(usize, stride) * RASTER_TILE_SIZE));
+  Encoder* encoder = CAST(Encoder*, calloc(1, sizeof(Encoder)));
+  if (band == NULL || encoder == NULL) {
+    fprintf(stderr, "Failed to allocate band of %dx%d pixels\n", raster->width, RASTER_TILE_SIZE);
+    free(band);
+    free(encoder);
+    return false;
+  }
+
+  encoder->file   = file;
+  encoder->width  = raster->width;
+  encoder->height = raster->height;
+
+  bool ok = format == RASTER_PNG ? pngBegin(encoder) : qoiBegin(encoder);
+
+  for (i32 y = 0; ok && y < raster->height; y += RASTER_TILE_SIZE) {
+    i32 rows = rasterRenderBand(raster, workers, y, band, stride);
+
+    TRACE_BEGIN("encode");
+    if (format == RASTER_PNG) {
+      pngRows(encoder, band, stride, rows);
+    } else {
+      qoiRows(encoder, band, stride, rows);
+    }
+    TRACE_END();
+
+    ok = !ferror(file);
+  }
+
+  if (ok) {
+    if (format == RASTER_PNG) {
+      pngEnd(encoder);
+    } else {
+      qoiEnd(encoder);
+    }
+    ok = !ferror(file);
+  }
+
+  free(encoder);
+  free(band);
+
+  if (!ok) {
+    fprintf(stderr, "Failed to write the image\n");
+  }
+  return ok;
+}
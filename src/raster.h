@@ -0,0 +1,80 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Raster is a software rasterizer behind the Renderer interface. Figures
+// are recorded into a display list binned by the tiles of the output, then
+// the tiles are drawn on the workers with analytic coverage anti-aliasing:
+// exact area of the polygons and distance to the edge of the circles.
+//
+// Output is produced in bands of one row of tiles, so only the display list
+// and a single band of pixels are ever in memory.
+FWD_STRUCT(Raster);
+
+// Size of the square tile in pixels, also the height of the band
+#define RASTER_TILE_SIZE 256
+
+typedef enum {
+  RASTER_PNG = 0,
+  RASTER_QOI = 1,
+} RasterFormat;
+
+// rasterCreate creates canvas of width by height pixels filled with the
+// background. Coordinates of the figures are multiplied by scale.
+Raster* rasterCreate(i32 width, i32 height, f32 scale, Rgba background);
+void rasterDestroy(Raster* raster);
+
+// rasterClear drops all recorded figures, memory is kept for the next ones.
+void rasterClear(Raster* raster);
+
+// rasterRenderer returns renderer that records figures into the raster.
+Renderer rasterRenderer(Raster* raster);
+
+// rasterRenderBand draws the band of tiles that starts at the row y into
+// the caller owned RGBA pixels, y must be a multiple of RASTER_TILE_SIZE.
+// Returns number of rows drawn.
+i32 rasterRenderBand(Raster* raster, Workers* workers, i32 y, u8* pixels, i32 stride);
+
+// rasterFormat guesses the format from the extension of the path.
+bool rasterFormat(const char* path, RasterFormat* format);
+
+// rasterWrite draws all of the bands and writes them to the file as the
+// opaque RGB image.
+bool rasterWrite(Raster* raster, Workers* workers, FILE* file, RasterFormat format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RASTER_H
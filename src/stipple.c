@@ -0,0 +1,422 @@
+#include "stipple.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+// Candidates tried around an active dot before it is retired
+#define STIPPLE_CANDIDATES 6
+// Candidates lie no further than this part of the spacing beyond it, the
+// narrow ring packs the dots tighter and needs fewer tries than the classic
+// ring twice the spacing wide
+#define STIPPLE_RING 0.25f
+// Directions the candidates are picked from
+#define STIPPLE_DIRECTIONS 64
+// Smallest side of the tile in the cells of the grid
+#define STIPPLE_TILE 32
+// Columns of the cells averaged by a single job of the strips
+#define STIPPLE_CHUNK 64
+#define STIPPLE_SEED 0x9e3779b97f4a7c15ull
+
+////////////////////////////////////////////////////////////////////////////////
+/// CELLS
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  StippleLayout* layout;
+  RenderParams params;
+  // Spacing of the dots of every cell, negative for the cells left empty
+  f32* spacing;
+  f32 max_spacing;
+  // Rows of the cells of the band, starting at the row
+  Bitmap band;
+  i32 row;
+  i32 chunks;
+} CellsJob;
+
+local void cellsChunk(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  CellsJob* job = CAST(CellsJob*, ctx);
+  StippleLayout* layout = job->layout;
+  i32 step  = layout->step;
+  i32 row   = index / job->chunks;
+  i32 first = index % job->chunks * STIPPLE_CHUNK;
+  i32 last  = min_value(first + STIPPLE_CHUNK, layout->columns);
+
+  i32 y = row * step;
+  for (i32 column = first; column < last; column++) {
+    i32 x = column * step;
+    Rect cell = {
+      .x      = x,
+      .y      = y,
+      .width  = min_value(step, job->band.width - x),
+      .height = min_value(step, job->band.height - y),
+    };
+    Rgba avg = cellAverage(job->band, cell, job->params);
+    f32 darkness = cellLuminance(avg, job->params);
+
+    usize i = CAST(usize, job->row + row) * layout->columns + column;
+    layout->cells[i] = avg;
+    // Density of the dots is proportional to the darkness
+    f32 spacing = step / sqrtf(max_value(darkness, 1e-6f));
+    job->spacing[i] = spacing > job->max_spacing ? -job->max_spacing : spacing;
+  }
+}
+
+// cellsBand averages the cells of the band that starts at the row of cells
+local void cellsBand(CellsJob* job, Bitmap band, i32 row, Workers* workers) {
+  job->band = band;
+  job->row  = row;
+
+  i32 rows = (band.height + job->layout->step - 1) / job->layout->step;
+  workersRun(workers, rows * job->chunks, cellsChunk, job);
+  workersReset(workers);
+}
+
+local void cellsInit(CellsJob* job, StippleLayout* layout, i32 width, i32 height,
+    RenderParams params, StippleParams stipple) {
+  i32 step = params.step;
+  *layout = (StippleLayout){
+    .width   = width,
+    .height  = height,
+    .step    = step,
+    .columns = (width + step - 1) / step,
+    .rows    = (height + step - 1) / step,
+  };
+  layout->cells = CAST(Rgba*, malloc(CAST(usize, layout->columns) * layout->rows * sizeof(Rgba)));
+
+  *job = (CellsJob){
+    .layout      = layout,
+    .params      = params,
+    .max_spacing = step * max_value(stipple.spread, 1.0f),
+    .chunks      = (layout->columns + STIPPLE_CHUNK - 1) / STIPPLE_CHUNK,
+  };
+  job->spacing = CAST(f32*, malloc(CAST(usize, layout->columns) * layout->rows * sizeof(f32)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// POISSON DISK
+////////////////////////////////////////////////////////////////////////////////
+
+// Neighbouring cell of the grid and the smallest squared distance between
+// the points of the two cells
+typedef struct {
+  i64 delta;
+  f32 distance;
+} Offset;
+
+typedef struct {
+  const StippleLayout* layout;
+  const f32* spacing;
+  f32 inverse_step;
+  Vec2 directions[STIPPLE_DIRECTIONS];
+  // Cells around the cell from the nearest, conflicts are found early and
+  // the search stops once the cells are farther than the spacing
+  Offset* offsets;
+  i32 offset_count;
+
+  // Every cell of the grid holds no more than one dot, x is negative in the
+  // empty ones. Border of the empty cells as wide as the largest spacing
+  // keeps the search inside of the grid.
+  f32 size;
+  f32 inverse_size;
+  i32 grid_width;
+  i32 grid_height;
+  i32 border;
+  i32 stride;
+  Vec2* grid;
+
+  // Tiles of the same phase are a tile apart from each other
+  i32 tile;
+  i32 tiles_x;
+  i32 tiles_y;
+  i32 phase;
+} Poisson;
+
+// cellIndex returns index of the cell of the layout under the point
+local usize cellIndex(const Poisson* poisson, Vec2 point) {
+  const StippleLayout* layout = poisson->layout;
+  i32 column = min_value(CAST(i32, point.x * poisson->inverse_step), layout->columns - 1);
+  i32 row    = min_value(CAST(i32, point.y * poisson->inverse_step), layout->rows - 1);
+  return CAST(usize, row) * layout->columns + column;
+}
+
+local f32 spacingAt(const Poisson* poisson, Vec2 point) {
+  return fabsf(poisson->spacing[cellIndex(poisson, point)]);
+}
+
+local Vec2* gridCell(const Poisson* poisson, i32 gx, i32 gy) {
+  return poisson->grid + CAST(i64, gy + poisson->border) * poisson->stride + gx + poisson->border;
+}
+
+local i32 compareOffsets(const void* a, const void* b) {
+  const Offset* p = CAST(const Offset*, a);
+  const Offset* q = CAST(const Offset*, b);
+  return (p->distance > q->distance) - (p->distance < q->distance);
+}
+
+local void offsetsInit(Poisson* poisson) {
+  i32 reach = poisson->border;
+  i32 side  = 2 * reach + 1;
+  poisson->offsets = CAST(Offset*, malloc(side * side * sizeof(Offset)));
+  poisson->offset_count = 0;
+
+  for (i32 dy = -reach; dy <= reach; dy++) {
+    for (i32 dx = -reach; dx <= reach; dx++) {
+      f32 x = max_value(abs(dx) - 1, 0) * poisson->size;
+      f32 y = max_value(abs(dy) - 1, 0) * poisson->size;
+      poisson->offsets[poisson->offset_count++] = (Offset){
+        .delta    = CAST(i64, dy) * poisson->stride + dx,
+        .distance = x * x + y * y,
+      };
+    }
+  }
+  qsort(poisson->offsets, poisson->offset_count, sizeof(Offset), compareOffsets);
+}
+
+// poissonFits returns true if no dot is closer to the point in the cell than
+// its spacing
+local bool poissonFits(const Poisson* poisson, Vec2 point, const Vec2* cell) {
+  f32 spacing = square(spacingAt(poisson, point));
+
+  for (const Offset* offset = poisson->offsets; offset->distance < spacing; offset++) {
+    Vec2 dot = cell[offset->delta];
+    if (dot.x >= 0 && square(dot.x - point.x) + square(dot.y - point.y) < spacing) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// poissonTile fills the tile with Bridson's algorithm, every empty cell of
+// the grid the dots could not reach seeds the next run
+local void poissonTile(void* ctx, i32 index, Arena* scratch) {
+  Poisson* poisson = CAST(Poisson*, ctx);
+  i32 phase   = poisson->phase;
+  i32 per_row = (poisson->tiles_x - (phase & 1) + 1) / 2;
+  i32 tx = (phase & 1) + 2 * (index % per_row);
+  i32 ty = (phase >> 1) + 2 * (index / per_row);
+
+  i32 gx0 = tx * poisson->tile;
+  i32 gy0 = ty * poisson->tile;
+  i32 gx1 = min_value(gx0 + poisson->tile, poisson->grid_width);
+  i32 gy1 = min_value(gy0 + poisson->tile, poisson->grid_height);
+  f32 x1 = min_value(gx1 * poisson->size, CAST(f32, poisson->layout->width));
+  f32 y1 = min_value(gy1 * poisson->size, CAST(f32, poisson->layout->height));
+
+  Vec2* active = CAST(Vec2*, arena_alloc(scratch,
+        CAST(usize, gx1 - gx0) * (gy1 - gy0) * sizeof(Vec2)));
+  i32 count = 0;
+  u64 random = STIPPLE_SEED ^ (CAST(u64, ty) * poisson->tiles_x + tx + 1) * 0xbf58476d1ce4e5b9ull;
+
+  for (i32 gy = gy0; gy < gy1; gy++) {
+    for (i32 gx = gx0; gx < gx1; gx++) {
+      Vec2* cell = gridCell(poisson, gx, gy);
+      if (cell->x >= 0) continue;
+
+      // Middle of the part of the cell inside of the image
+      Vec2 seed = {
+        .x = (gx * poisson->size + min_value((gx + 1) * poisson->size, x1)) / 2,
+        .y = (gy * poisson->size + min_value((gy + 1) * poisson->size, y1)) / 2,
+      };
+      if (!poissonFits(poisson, seed, cell)) continue;
+      *cell = seed;
+      active[count++] = seed;
+
+      while (count > 0) {
+        i32 a = nextRandom(&random) % count;
+        Vec2 point = active[a];
+        f32 spacing = spacingAt(poisson, point);
+
+        bool found = false;
+        for (i32 k = 0; k < STIPPLE_CANDIDATES && !found; k++) {
+          u64 bits = nextRandom(&random);
+          Vec2 direction = poisson->directions[bits % STIPPLE_DIRECTIONS];
+          f32 distance = spacing * (1.0f + STIPPLE_RING * (bits >> 40) / CAST(f32, 1 << 24));
+          Vec2 candidate = {
+            .x = point.x + direction.x * distance,
+            .y = point.y + direction.y * distance,
+          };
+          if (candidate.x < 0 || candidate.x >= x1 || candidate.y < 0 || candidate.y >= y1) {
+            continue;
+          }
+          // Tile owns the cells, not the coordinates, so rounding can never
+          // put the dot onto the neighbour
+          i32 cx = CAST(i32, candidate.x * poisson->inverse_size);
+          i32 cy = CAST(i32, candidate.y * poisson->inverse_size);
+          if (cx < gx0 || cx >= gx1 || cy < gy0 || cy >= gy1) {
+            continue;
+          }
+
+          Vec2* target = gridCell(poisson, cx, cy);
+          if (poissonFits(poisson, candidate, target)) {
+            *target = candidate;
+            active[count++] = candidate;
+            found = true;
+          }
+        }
+        if (!found) {
+          active[a] = active[--count];
+        }
+      }
+    }
+  }
+}
+
+// poissonLayout places the dots over the cells of the layout
+local void poissonLayout(StippleLayout* layout, const f32* spacing, f32 max_spacing,
+    Workers* workers) {
+  // Diagonal of the cell is the smallest spacing
+  f32 size = layout->step / sqrtf(2.0f);
+  Poisson poisson = {
+    .layout       = layout,
+    .spacing      = spacing,
+    .inverse_step = 1.0f / layout->step,
+    .size         = size,
+    .inverse_size = 1.0f / size,
+    .grid_width   = CAST(i32, ceilf(layout->width / size)),
+    .grid_height  = CAST(i32, ceilf(layout->height / size)),
+    .border       = CAST(i32, ceilf(max_spacing / size)) + 1,
+  };
+  poisson.stride = poisson.grid_width + 2 * poisson.border;
+
+  u64 random = STIPPLE_SEED;
+  for (i32 i = 0; i < STIPPLE_DIRECTIONS; i++) {
+    f32 angle = M_PI_180 * 360.0f * (i + randomUnit(&random)) / STIPPLE_DIRECTIONS;
+    poisson.directions[i] = (Vec2){ cosf(angle), sinf(angle) };
+  }
+  offsetsInit(&poisson);
+
+  usize cells = CAST(usize, poisson.stride) * (poisson.grid_height + 2 * poisson.border);
+  poisson.grid = CAST(Vec2*, malloc(cells * sizeof(Vec2)));
+  for (usize i = 0; i < cells; i++) {
+    poisson.grid[i].x = -1;
+  }
+
+  // Tile reads no further than the border around itself, so it never sees
+  // the other tiles of the same phase being filled
+  poisson.tile    = max_value(poisson.border + 1, STIPPLE_TILE);
+  poisson.tiles_x = (poisson.grid_width + poisson.tile - 1) / poisson.tile;
+  poisson.tiles_y = (poisson.grid_height + poisson.tile - 1) / poisson.tile;
+
+  TRACE_BEGIN("stipple_poisson");
+  for (i32 phase = 0; phase < 4; phase++) {
+    i32 columns = (poisson.tiles_x - (phase & 1) + 1) / 2;
+    i32 rows    = (poisson.tiles_y - (phase >> 1) + 1) / 2;
+    if (columns <= 0 || rows <= 0) continue;
+
+    poisson.phase = phase;
+    workersRun(workers, columns * rows, poissonTile, &poisson);
+    workersReset(workers);
+  }
+  TRACE_END();
+
+  // Grid keeps the dots in the order of the rows, the ones of the cells
+  // left empty only carried the sampling across them
+  da_clear(&layout->dots);
+  for (i32 gy = 0; gy < poisson.grid_height; gy++) {
+    const Vec2* row = gridCell(&poisson, 0, gy);
+    for (i32 gx = 0; gx < poisson.grid_width; gx++) {
+      Vec2 dot = row[gx];
+      if (dot.x < 0) continue;
+      if (spacing[cellIndex(&poisson, dot)] < 0) continue;
+
+      da_append(&layout->dots, dot);
+    }
+  }
+
+  free(poisson.grid);
+  free(poisson.offsets);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// LAYOUT
+////////////////////////////////////////////////////////////////////////////////
+
+void stippleLayout(StippleLayout* layout, Bitmap bitmap, RenderParams params,
+    StippleParams stipple, Workers* workers) {
+  CellsJob job;
+  cellsInit(&job, layout, bitmap.width, bitmap.height, params, stipple);
+
+  TRACE_BEGIN("stipple_cells");
+  cellsBand(&job, bitmap, 0, workers);
+  TRACE_END();
+
+  poissonLayout(layout, job.spacing, job.max_spacing, workers);
+  free(job.spacing);
+}
+
+bool stippleLayoutStrips(StippleLayout* layout, StripReader* reader, RenderParams params,
+    StippleParams stipple, Workers* workers) {
+  i32 width  = stripWidth(reader);
+  i32 height = stripHeight(reader);
+  i32 step   = params.step;
+
+  CellsJob job;
+  cellsInit(&job, layout, width, height, params, stipple);
+
+  u8* pixels  = CAST(u8*, malloc(CAST(usize, width) * step * 4));
+  Bitmap band = bitmapView(pixels, width, step, 0);
+
+  bool ok = true;
+  for (i32 y = 0; y < height; y += step) {
+    TRACE_BEGIN("strip_read");
+    band.height = stripRead(reader, pixels, step);
+    TRACE_END();
+    if (band.height <= 0) {
+      ok = false;
+      break;
+    }
+    TRACE_BEGIN("stipple_cells");
+    cellsBand(&job, band, y / step, workers);
+    TRACE_END();
+  }
+  free(pixels);
+
+  if (ok) {
+    poissonLayout(layout, job.spacing, job.max_spacing, workers);
+  }
+  free(job.spacing);
+  if (!ok) {
+    stippleLayoutFree(layout);
+  }
+  return ok;
+}
+
+void stippleLayoutFree(StippleLayout* layout) {
+  free(layout->cells);
+  da_free(&layout->dots);
+  memset(layout, 0, sizeof(StippleLayout));
+}
+
+void renderStippleLayout(Renderer render, const StippleLayout* layout, RenderParams params) {
+  f32 half = layout->step / 2.0f;
+
+  TRACE_BEGIN("stipple_render");
+  for (i32 i = 0; i < layout->dots.len; i++) {
+    Vec2 dot = layout->dots.arr[i];
+    i32 column = CAST(i32, dot.x) / layout->step;
+    i32 row    = CAST(i32, dot.y) / layout->step;
+    Rect cell = {
+      .x      = dot.x - half,
+      .y      = dot.y - half,
+      .width  = layout->step,
+      .height = layout->step,
+    };
+    renderCell(render, cell, layout->cells[CAST(usize, row) * layout->columns + column], params);
+  }
+  TRACE_END();
+}
+
+bool renderStippleStrips(Renderer render, StripReader* reader, RenderParams params,
+    StippleParams stipple, Workers* workers) {
+  StippleLayout layout;
+  if (!stippleLayoutStrips(&layout, reader, params, stipple, workers)) {
+    return false;
+  }
+  renderStippleLayout(render, &layout, params);
+  stippleLayoutFree(&layout);
+  return true;
+}
@@ -0,0 +1,86 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#ifndef STIPPLE_H
+#define STIPPLE_H
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "strip.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stipple layout places the figures with variable radius Poisson-disk
+// sampling instead of the grid, so textures do not beat against the rows.
+// Dots are never closer than the spacing taken from the darkness of the
+// step x step cell under them: the step in black growing with the inverse
+// square root of the darkness up to the spread in steps, so the density of
+// the dots follows the tone. Cells lighter than the spread can show are left
+// empty. Bridson's algorithm runs on the grid of the cells half of the step
+// diagonal wide, tiles of the grid are filled in four passes so no two tiles
+// of the same pass touch and every tile sees the dots its earlier
+// neighbours put near the seam.
+typedef struct {
+  // Largest spacing of the dots in steps, at least 1
+  f32 spread;
+} StippleParams;
+
+da_define(StippleDots, Vec2);
+
+// Dots of the layout with the average colors of the cells they come from
+typedef struct {
+  i32 width;
+  i32 height;
+  i32 step;
+  i32 columns;
+  i32 rows;
+  Rgba* cells;
+
+  StippleDots dots;
+} StippleLayout;
+
+// stippleLayout places the dots over the bitmap, same params and image
+// always give the same dots whatever the number of the workers.
+void stippleLayout(StippleLayout* layout, Bitmap bitmap, RenderParams params,
+    StippleParams stipple, Workers* workers);
+
+// stippleLayoutStrips does the same for the image read in strips, only the
+// average colors of the cells are kept in memory.
+bool stippleLayoutStrips(StippleLayout* layout, StripReader* reader, RenderParams params,
+    StippleParams stipple, Workers* workers);
+
+void stippleLayoutFree(StippleLayout* layout);
+
+// renderStippleLayout renders figures of the dots of the layout.
+void renderStippleLayout(Renderer render, const StippleLayout* layout, RenderParams params);
+
+// renderStippleStrips lays out and renders the image read in strips.
+bool renderStippleStrips(Renderer render, StripReader* reader, RenderParams params,
+    StippleParams stipple, Workers* workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STIPPLE_H
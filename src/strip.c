@@ -0,0 +1,444 @@
+#include "strip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STRIP_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+typedef enum {
+  STRIP_PNM = 0,
+  STRIP_QOI = 1,
+} StripFormat;
+
+struct StripReader {
+  FILE* file;
+  StripFormat format;
+
+  i32 width;
+  i32 height;
+  // Rows decoded so far
+  i32 row;
+
+  // Netpbm
+  i32 channels;
+  i32 maxval;
+  u8* line;
+
+  // QOI decoder state carried between the rows
+  u8 index[64][4];
+  u8 px[4];
+  i32 run;
+
+  // Pixel data of the mapped file, decoded instead of reading the file
+  // while it is not NULL
+  const u8* data;
+  usize size;
+  usize cursor;
+};
+
+/// NETPBM ///////////////////////////////////////////////////////////////////
+
+local bool pnmSkipSpace(FILE* file) {
+  i32 c;
+  for (;;) {
+    c = getc(file);
+    if (c == '#') {
+      while (c != EOL && c != EOF) c = getc(file);
+    }
+    if (c == EOF) return false;
+    if (c != ' ' && c != '\t' && c != '\r' && c != EOL && c != '#') break;
+  }
+  ungetc(c, file);
+  return true;
+}
+
+local bool pnmReadInt(FILE* file, i32* value) {
+  if (!pnmSkipSpace(file)) return false;
+
+  i32 c = getc(file);
+  if (c < '0' || c > '9') return false;
+
+  i64 result = 0;
+  while (c >= '0' && c <= '9') {
+    result = result * 10 + (c - '0');
+    if (result > INT32_MAX) return false;
+    c = getc(file);
+  }
+  // Exactly one whitespace separates header from the pixels
+  if (c == EOF) return false;
+
+  *value = CAST(i32, result);
+  return true;
+}
+
+local bool pnmOpen(StripReader* reader, i32 magic) {
+  reader->format   = STRIP_PNM;
+  reader->channels = magic == '6' ? 3 : 1;
+
+  if (!pnmReadInt(reader->file, &reader->width)
+      || !pnmReadInt(reader->file, &reader->height)
+      || !pnmReadInt(reader->file, &reader->maxval)) {
+    fprintf(stderr, "Malformed Netpbm header\n");
+    return false;
+  }
+
+  if (reader->maxval < 1 || reader->maxval > 65535) {
+    fprintf(stderr, "Unsupported Netpbm maxval: %d\n", reader->maxval);
+    return false;
+  }
+
+  i32 depth = reader->maxval > 255 ? 2 : 1;
+  reader->line = CAST(u8*, malloc(CAST(usize, reader->width) * reader->channels * depth));
+  return true;
+}
+
+local usize pnmLineSize(const StripReader* reader) {
+  i32 depth = reader->maxval > 255 ? 2 : 1;
+  return CAST(usize, reader->width) * reader->channels * depth;
+}
+
+// pnmConvert converts the line of the file into RGBA pixels
+local void pnmConvert(const StripReader* reader, const u8* line, u8* out) {
+  i32 depth = reader->maxval > 255 ? 2 : 1;
+  for (i32 x = 0; x < reader->width; x++) {
+    for (i32 c = 0; c < 3; c++) {
+      i32 i = x * reader->channels + (reader->channels == 3 ? c : 0);
+      u32 value = depth == 2
+        ? (CAST(u32, line[i * 2]) << 8) | line[i * 2 + 1]
+        : line[i];
+      out[x * 4 + c] = reader->maxval == 255 ? value : value * 255 / reader->maxval;
+    }
+    out[x * 4 + 3] = 255;
+  }
+}
+
+local i32 pnmRead(StripReader* reader, u8* pixels, i32 rows) {
+  usize line_size = pnmLineSize(reader);
+
+  if (reader->data != NULL) {
+    // Size of the mapped data is checked when the file is mapped
+    for (i32 row = 0; row < rows; row++) {
+      pnmConvert(reader, reader->data + reader->cursor,
+          pixels + CAST(usize, row) * reader->width * 4);
+      reader->cursor += line_size;
+    }
+    return rows;
+  }
+
+  for (i32 row = 0; row < rows; row++) {
+    if (fread(reader->line, 1, line_size, reader->file) != line_size) {
+      fprintf(stderr, "Unexpected end of Netpbm data\n");
+      return -1;
+    }
+    pnmConvert(reader, reader->line, pixels + CAST(usize, row) * reader->width * 4);
+  }
+
+  return rows;
+}
+
+/// QOI //////////////////////////////////////////////////////////////////////
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+
+local bool qoiReadU32(FILE* file, i32* value) {
+  u8 bytes[4];
+  if (fread(bytes, 1, 4, file) != 4) return false;
+
+  u32 result = (CAST(u32, bytes[0]) << 24) | (CAST(u32, bytes[1]) << 16)
+    | (CAST(u32, bytes[2]) << 8) | bytes[3];
+  if (result > INT32_MAX) return false;
+
+  *value = CAST(i32, result);
+  return true;
+}
+
+local bool qoiOpen(StripReader* reader) {
+  reader->format = STRIP_QOI;
+
+  u8 info[2];
+  if (!qoiReadU32(reader->file, &reader->width)
+      || !qoiReadU32(reader->file, &reader->height)
+      || fread(info, 1, 2, reader->file) != 2) {
+    fprintf(stderr, "Malformed QOI header\n");
+    return false;
+  }
+
+  memset(reader->index, 0, sizeof(reader->index));
+  reader->px[0] = 0;
+  reader->px[1] = 0;
+  reader->px[2] = 0;
+  reader->px[3] = 255;
+  reader->run   = 0;
+  return true;
+}
+
+// qoiDecode is qoiRead of the mapped data, a byte at a time out of memory
+// instead of through the stdio
+local i32 qoiDecode(StripReader* reader, u8* pixels, i32 rows) {
+  const u8* data = reader->data;
+  usize size  = reader->size;
+  usize p     = reader->cursor;
+  u8* px      = reader->px;
+  usize count = CAST(usize, rows) * reader->width;
+
+  for (usize i = 0; i < count; i++) {
+    if (reader->run > 0) {
+      reader->run--;
+    } else {
+      if (p >= size) goto eof;
+      u8 b1 = data[p++];
+
+      if (b1 == QOI_OP_RGB) {
+        if (size - p < 3) goto eof;
+        memcpy(px, data + p, 3);
+        p += 3;
+      } else if (b1 == QOI_OP_RGBA) {
+        if (size - p < 4) goto eof;
+        memcpy(px, data + p, 4);
+        p += 4;
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        memcpy(px, reader->index[b1], 4);
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px[0] += ((b1 >> 4) & 0x03) - 2;
+        px[1] += ((b1 >> 2) & 0x03) - 2;
+        px[2] += ( b1       & 0x03) - 2;
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        if (p >= size) goto eof;
+        u8 b2 = data[p++];
+        i32 vg = (b1 & 0x3f) - 32;
+        px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+        px[1] += vg;
+        px[2] += vg - 8 +  (b2       & 0x0f);
+      } else {
+        reader->run = (b1 & 0x3f);
+      }
+
+      i32 hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+      memcpy(reader->index[hash], px, 4);
+    }
+
+    memcpy(pixels + i * 4, px, 4);
+  }
+
+  reader->cursor = p;
+  return rows;
+
+eof:
+  fprintf(stderr, "Unexpected end of QOI data\n");
+  return -1;
+}
+
+local i32 qoiRead(StripReader* reader, u8* pixels, i32 rows) {
+  if (reader->data != NULL) {
+    return qoiDecode(reader, pixels, rows);
+  }
+
+  FILE* file = reader->file;
+  u8* px     = reader->px;
+  usize count = CAST(usize, rows) * reader->width;
+
+  for (usize i = 0; i < count; i++) {
+    if (reader->run > 0) {
+      reader->run--;
+    } else {
+      i32 b1 = getc(file);
+      if (b1 == EOF) goto eof;
+
+      if (b1 == QOI_OP_RGB) {
+        u8 rgb[3];
+        if (fread(rgb, 1, 3, file) != 3) goto eof;
+        px[0] = rgb[0];
+        px[1] = rgb[1];
+        px[2] = rgb[2];
+      } else if (b1 == QOI_OP_RGBA) {
+        if (fread(px, 1, 4, file) != 4) goto eof;
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        memcpy(px, reader->index[b1], 4);
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px[0] += ((b1 >> 4) & 0x03) - 2;
+        px[1] += ((b1 >> 2) & 0x03) - 2;
+        px[2] += ( b1       & 0x03) - 2;
+      } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        i32 b2 = getc(file);
+        if (b2 == EOF) goto eof;
+        i32 vg = (b1 & 0x3f) - 32;
+        px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+        px[1] += vg;
+        px[2] += vg - 8 +  (b2       & 0x0f);
+      } else {
+        reader->run = (b1 & 0x3f);
+      }
+
+      i32 hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+      memcpy(reader->index[hash], px, 4);
+    }
+
+    memcpy(pixels + i * 4, px, 4);
+  }
+
+  return rows;
+
+eof:
+  fprintf(stderr, "Unexpected end of QOI data\n");
+  return -1;
+}
+
+/// MAPPED ///////////////////////////////////////////////////////////////////
+
+#ifdef STRIP_MMAP
+
+bool stripMap(StripReader* reader, MappedImage* image) {
+  memset(image, 0, sizeof(MappedImage));
+  if (reader->file == stdin || reader->row > 0) {
+    return false;
+  }
+
+  struct stat st;
+  i32 fd = fileno(reader->file);
+  long offset = ftell(reader->file);
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset < 0 || st.st_size <= offset) {
+    return false;
+  }
+
+  usize size = st.st_size - offset;
+  if (reader->format == STRIP_PNM && size / pnmLineSize(reader) < CAST(usize, reader->height)) {
+    return false;
+  }
+
+  image->size    = st.st_size;
+  image->mapping = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (image->mapping == MAP_FAILED) {
+    image->mapping = NULL;
+    return false;
+  }
+  // Pixels are read from the top down, the kernel reads ahead
+  madvise(image->mapping, image->size, MADV_SEQUENTIAL);
+
+  const u8* data = CAST(const u8*, image->mapping) + offset;
+  if (reader->format == STRIP_PNM && reader->maxval == 255) {
+    image->bitmap = bitmapViewChannels(data, reader->width, reader->height,
+        pnmLineSize(reader), reader->channels);
+    return true;
+  }
+
+  // Anything else would have to be converted into the copy of the whole
+  // image, it is decoded strip by strip straight from the mapping instead
+  reader->data   = data;
+  reader->size   = size;
+  reader->cursor = 0;
+  image->reader  = reader;
+  image->offset  = offset;
+  return true;
+}
+
+void stripUnmap(MappedImage* image) {
+  StripReader* reader = image->reader;
+  if (reader != NULL) {
+    // File continues where the mapped data was left
+    fseek(reader->file, image->offset + CAST(long, reader->cursor), SEEK_SET);
+    reader->data = NULL;
+  }
+  if (image->mapping != NULL) {
+    munmap(image->mapping, image->size);
+  }
+  memset(image, 0, sizeof(MappedImage));
+}
+
+#else // STRIP_MMAP
+
+bool stripMap(StripReader* UNUSED(reader), MappedImage* image) {
+  memset(image, 0, sizeof(MappedImage));
+  return false;
+}
+
+void stripUnmap(MappedImage* image) {
+  memset(image, 0, sizeof(MappedImage));
+}
+
+#endif // STRIP_MMAP
+
+/// READER ///////////////////////////////////////////////////////////////////
+
+StripReader* stripOpen(const char* path) {
+  FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  StripReader* reader = CAST(StripReader*, calloc(1, sizeof(StripReader)));
+  reader->file = file;
+
+  u8 magic[4] = { 0 };
+  bool ok = false;
+
+  if (fread(magic, 1, 2, file) == 2) {
+    if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+      ok = pnmOpen(reader, magic[1]);
+    } else if (magic[0] == 'q' && magic[1] == 'o'
+        && fread(magic + 2, 1, 2, file) == 2 && magic[2] == 'i' && magic[3] == 'f') {
+      ok = qoiOpen(reader);
+    } else {
+      fprintf(stderr, "Unsupported format of %s, expected P5/P6 Netpbm or QOI\n", path);
+    }
+  }
+
+  if (ok && (reader->width <= 0 || reader->height <= 0)) {
+    fprintf(stderr, "Invalid image size %dx%d\n", reader->width, reader->height);
+    ok = false;
+  }
+
+  if (!ok) {
+    stripClose(reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+void stripClose(StripReader* reader) {
+  if (reader == NULL) {
+    return;
+  }
+  if (reader->file != stdin) {
+    fclose(reader->file);
+  }
+  free(reader->line);
+  free(reader);
+}
+
+i32 stripWidth(StripReader* reader) {
+  return reader->width;
+}
+
+i32 stripHeight(StripReader* reader) {
+  return reader->height;
+}
+
+i32 stripRead(StripReader* reader, u8* pixels, i32 rows) {
+  rows = min_value(rows, reader->height - reader->row);
+  if (rows <= 0) {
+    return 0;
+  }
+
+  i32 read = reader->format == STRIP_QOI
+    ? qoiRead(reader, pixels, rows)
+    : pnmRead(reader, pixels, rows);
+
+  if (read > 0) {
+    reader->row += read;
+  }
+  return read;
+}
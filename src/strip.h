@@ -0,0 +1,53 @@
+#ifndef STRIP_H
+#define STRIP_H
+
+#include "types.h"
+#include "imagine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// StripReader decodes the image row by row without ever holding more than
+// one row of the source file in memory. Supported formats are binary
+// Netpbm (P5 and P6, 8 or 16 bit) and QOI.
+FWD_STRUCT(StripReader);
+
+// stripOpen opens the image at path, "-" reads the image from stdin.
+// Returns NULL and prints the reason if the file can not be decoded.
+StripReader* stripOpen(const char* path);
+void stripClose(StripReader* reader);
+
+i32 stripWidth(StripReader* reader);
+i32 stripHeight(StripReader* reader);
+
+// stripRead decodes next rows of the image into RGBA pixels, pixels must
+// have room for rows * width * 4 bytes. Returns number of rows decoded which
+// is less than requested only at the end of the image or -1 on error.
+i32 stripRead(StripReader* reader, u8* pixels, i32 rows);
+
+// MappedImage is the file of the reader mapped into memory, so the image is
+// sampled without reading it through the stdio: 8-bit Netpbm in place as the
+// RGB or gray pixels of the bitmap, everything else is decoded from the
+// mapping by stripRead strip by strip and the bitmap is left empty.
+typedef struct {
+  Bitmap bitmap;
+  void* mapping;
+  usize size;
+  // Reader that decodes from the mapping and where its data starts
+  StripReader* reader;
+  long offset;
+} MappedImage;
+
+// stripMap maps the image of the reader that has not been read yet. Returns
+// false if the input can not be mapped: it is not a regular file, the data
+// is truncated or the platform has no mmap, the reader is left untouched to
+// be read in strips. The reader goes back to the file once unmapped.
+bool stripMap(StripReader* reader, MappedImage* image);
+void stripUnmap(MappedImage* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STRIP_H
@@ -0,0 +1,317 @@
+#include "sweep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "trace.h"
+
+// Rows or columns of the tables handed to a worker at once
+#define SWEEP_CHUNK 64
+
+////////////////////////////////////////////////////////////////////////////////
+/// SUMMED-AREA TABLES
+////////////////////////////////////////////////////////////////////////////////
+
+// ImageTables are the summed-area tables of the red, green and blue
+// channels, (width + 1) x (height + 1) each with the zero first row and
+// column.
+typedef struct {
+  Bitmap bitmap;
+  i32 stride;
+  u32* channels[3];
+} ImageTables;
+
+local void prefixRows(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  ImageTables* tables = CAST(ImageTables*, ctx);
+  i32 first = index * SWEEP_CHUNK;
+  i32 last  = min_value(first + SWEEP_CHUNK, tables->bitmap.height);
+
+  for (i32 y = first; y < last; y++) {
+    const u8* pixel = bitmapPixel(tables->bitmap, 0, y);
+    usize row = CAST(usize, y + 1) * tables->stride;
+
+    u32 sums[3] = { 0 };
+    for (i32 c = 0; c < 3; c++) {
+      tables->channels[c][row] = 0;
+    }
+    for (i32 x = 0; x < tables->bitmap.width; x++, pixel += tables->bitmap.channels) {
+      for (i32 c = 0; c < 3; c++) {
+        sums[c] += pixel[bitmapChannel(tables->bitmap, c)];
+        tables->channels[c][row + x + 1] = sums[c];
+      }
+    }
+  }
+}
+
+local void accumulateColumns(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  ImageTables* tables = CAST(ImageTables*, ctx);
+  i32 first = index * SWEEP_CHUNK + 1;
+  i32 last  = min_value(first + SWEEP_CHUNK, tables->stride);
+
+  for (i32 c = 0; c < 3; c++) {
+    u32* table = tables->channels[c];
+    for (i32 y = 2; y <= tables->bitmap.height; y++) {
+      u32* row = table + CAST(usize, y) * tables->stride;
+      const u32* above = row - tables->stride;
+      for (i32 x = first; x < last; x++) {
+        row[x] += above[x];
+      }
+    }
+  }
+}
+
+local void imageTablesBuild(ImageTables* tables, Bitmap bitmap, Workers* workers) {
+  tables->bitmap = bitmap;
+  tables->stride = bitmap.width + 1;
+
+  usize size = CAST(usize, bitmap.height + 1) * tables->stride;
+  for (i32 c = 0; c < 3; c++) {
+    tables->channels[c] = CAST(u32*, malloc(size * sizeof(u32)));
+    memset(tables->channels[c], 0, tables->stride * sizeof(u32));
+  }
+
+  TRACE_BEGIN("sweep_tables");
+  workersRun(workers, (bitmap.height + SWEEP_CHUNK - 1) / SWEEP_CHUNK, prefixRows, tables);
+  workersRun(workers, (bitmap.width + SWEEP_CHUNK - 1) / SWEEP_CHUNK, accumulateColumns, tables);
+  TRACE_END();
+}
+
+local void imageTablesFree(ImageTables* tables) {
+  for (i32 c = 0; c < 3; c++) {
+    free(tables->channels[c]);
+  }
+}
+
+// tablesAverage returns the same color as averageColor: pixels of the cell
+// inside of the image summed up and divided by the full area of the cell
+local Rgba tablesAverage(const ImageTables* tables, Rect cell) {
+  i32 x0 = cell.x;
+  i32 y0 = cell.y;
+  i32 x1 = min_value(CAST(i32, cell.x + cell.width), tables->bitmap.width);
+  i32 y1 = min_value(CAST(i32, cell.y + cell.height), tables->bitmap.height);
+  u32 count = cell.width * cell.height;
+
+  u32 sums[3];
+  for (i32 c = 0; c < 3; c++) {
+    const u32* top    = tables->channels[c] + CAST(usize, y0) * tables->stride;
+    const u32* bottom = tables->channels[c] + CAST(usize, y1) * tables->stride;
+    sums[c] = SAT_BOX(top, bottom, x0, x1, );
+  }
+
+  Rgba result = {
+    .r = CAST(u8, sums[0] / count),
+    .g = CAST(u8, sums[1] / count),
+    .b = CAST(u8, sums[2] / count),
+    .a = 255,
+  };
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SHEET
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const ImageTables* tables;
+  SweepSheet* sheet;
+} SweepJob;
+
+local void sweepTile(void* ctx, i32 index, Arena* UNUSED(scratch)) {
+  SweepJob* job = CAST(SweepJob*, ctx);
+  SweepTile* tile = job->sheet->tiles + index;
+  RenderParams params = tile->params;
+
+  i32 width  = job->tables->bitmap.width;
+  i32 height = job->tables->bitmap.height;
+  i32 step   = params.step;
+  i32 rows   = (height + step - 1) / step;
+
+  displayListBegin(&tile->list, step, rows);
+  for (i32 row = 0; row < rows; row++) {
+    i32 y = row * step;
+    i32 x = cellOffset(params, y);
+    for (; x < width; x += step) {
+      Rect cell = {
+        .x      = x,
+        .y      = y,
+        .width  = step,
+        .height = step,
+      };
+      displayListAddCell(&tile->list, cell, tablesAverage(job->tables, cell), params);
+    }
+    displayListEndRow(&tile->list);
+  }
+}
+
+bool sweepSheetBuild(SweepSheet* sheet, Bitmap bitmap, RenderParams base,
+    const SweepParams* sweep, Workers* workers) {
+  *sheet = (SweepSheet){ 0 };
+
+  for (i32 i = 0; i < sweep->step_count; i++) {
+    if (sweep->steps[i] < 1 || sweep->steps[i] > SAT_MAX_STEP) {
+      fprintf(stderr, "Steps of the sweep must be between 1 and %d\n", SAT_MAX_STEP);
+      return false;
+    }
+  }
+
+  i32 count = sweep->step_count * sweep->radius_count * sweep->figure_count
+    * sweep->shift_count * sweep->bw_count;
+  if (count == 0) {
+    fprintf(stderr, "Sweep has no combinations\n");
+    return false;
+  }
+
+  sheet->tiles        = CAST(SweepTile*, calloc(count, sizeof(SweepTile)));
+  sheet->count        = count;
+  sheet->image_width  = bitmap.width;
+  sheet->image_height = bitmap.height;
+
+  i32 tile = 0;
+  for (i32 f = 0; f < sweep->figure_count; f++) {
+    for (i32 s = 0; s < sweep->step_count; s++) {
+      for (i32 r = 0; r < sweep->radius_count; r++) {
+        for (i32 shift = 0; shift < sweep->shift_count; shift++) {
+          for (i32 bw = 0; bw < sweep->bw_count; bw++) {
+            RenderParams params = base;
+            params.figure = sweep->figures[f];
+            params.step   = sweep->steps[s];
+            params.radius = sweep->radii[r] * sweep->steps[s];
+            params.shift  = sweep->shifts[shift];
+            params.bw     = sweep->bws[bw];
+            sheet->tiles[tile++].params = params;
+
+            // Cells stick out of the image by up to a step
+            sheet->reach = max_value(sheet->reach, params.step + params.radius);
+          }
+        }
+      }
+    }
+  }
+
+  // Square-ish grid with the caption under every image
+  sheet->columns = CAST(i32, ceilf(sqrtf(count)));
+  sheet->rows    = (count + sheet->columns - 1) / sheet->columns;
+  sheet->caption = max_value(bitmap.width / 16.0f, 12.0f);
+
+  f32 pitch_x = bitmap.width + 2 * sheet->reach;
+  f32 pitch_y = bitmap.height + 2 * sheet->reach + sheet->caption;
+  sheet->width  = sheet->columns * pitch_x;
+  sheet->height = sheet->rows * pitch_y;
+  for (i32 i = 0; i < count; i++) {
+    sheet->tiles[i].origin = (Vec2){
+      .x = sheet->reach + (i % sheet->columns) * pitch_x,
+      .y = sheet->reach + (i / sheet->columns) * pitch_y,
+    };
+  }
+
+  ImageTables tables;
+  imageTablesBuild(&tables, bitmap, workers);
+
+  SweepJob job = {
+    .tables = &tables,
+    .sheet  = sheet,
+  };
+  TRACE_BEGIN("sweep_tiles");
+  workersRun(workers, count, sweepTile, &job);
+  TRACE_END();
+
+  imageTablesFree(&tables);
+  return true;
+}
+
+void sweepSheetFree(SweepSheet* sheet) {
+  for (i32 i = 0; i < sheet->count; i++) {
+    displayListFree(&sheet->tiles[i].list);
+  }
+  free(sheet->tiles);
+  *sheet = (SweepSheet){ 0 };
+}
+
+void sweepLabel(char* buffer, usize size, RenderParams params) {
+  snprintf(buffer, size, "%s, step %d, radius %.1f%s%s",
+      figure_names[params.figure], params.step, params.radius,
+      params.shift ? ", shift" : "", params.bw ? ", bw" : "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// RENDERING
+////////////////////////////////////////////////////////////////////////////////
+
+// TileRenderer moves the figures of the tile to its place on the sheet
+typedef struct {
+  Renderer render;
+  Vec2 origin;
+} TileRenderer;
+
+local Vec2 tileMove(const TileRenderer* tile, Vec2 point) {
+  return (Vec2){ point.x + tile->origin.x, point.y + tile->origin.y };
+}
+
+local void tileDrawCircle(void* ctx, Vec2 center, f32 radius, Rgba color) {
+  TileRenderer* tile = CAST(TileRenderer*, ctx);
+  tile->render.draw_circle(tile->render.ctx, tileMove(tile, center), radius, color);
+}
+
+local void tileDrawTriangle(void* ctx, Vec2 v1, Vec2 v2, Vec2 v3, Rgba color) {
+  TileRenderer* tile = CAST(TileRenderer*, ctx);
+  tile->render.draw_triangle(tile->render.ctx,
+      tileMove(tile, v1), tileMove(tile, v2), tileMove(tile, v3), color);
+}
+
+// Only the figures of the display list come here, so the points fit
+local i32 tileMovePoints(const TileRenderer* tile, const Vec2* points, i32 count, Vec2* moved) {
+  count = min_value(count, FIGURE_MAX_POINTS);
+  for (i32 i = 0; i < count; i++) {
+    moved[i] = tileMove(tile, points[i]);
+  }
+  return count;
+}
+
+local void tileDrawTriangleFan(void* ctx, const Vec2* points, i32 pointCount, Rgba color) {
+  TileRenderer* tile = CAST(TileRenderer*, ctx);
+  Vec2 moved[FIGURE_MAX_POINTS];
+  i32 count = tileMovePoints(tile, points, pointCount, moved);
+  tile->render.draw_triangle_fan(tile->render.ctx, moved, count, color);
+}
+
+local void tileDrawTriangleStrip(void* ctx, const Vec2* points, i32 pointCount, Rgba color) {
+  TileRenderer* tile = CAST(TileRenderer*, ctx);
+  Vec2 moved[FIGURE_MAX_POINTS];
+  i32 count = tileMovePoints(tile, points, pointCount, moved);
+  tile->render.draw_triangle_strip(tile->render.ctx, moved, count, color);
+}
+
+void renderSweepSheet(Renderer render, const SweepSheet* sheet) {
+  for (i32 i = 0; i < sheet->count; i++) {
+    TileRenderer tile = {
+      .render = render,
+      .origin = sheet->tiles[i].origin,
+    };
+    Renderer moved = {
+      .draw_circle         = tileDrawCircle,
+      .draw_triangle       = tileDrawTriangle,
+      .draw_triangle_fan   = tileDrawTriangleFan,
+      .draw_triangle_strip = tileDrawTriangleStrip,
+      .ctx                 = &tile,
+    };
+    displayListRender(&sheet->tiles[i].list, moved, 0, sheet->tiles[i].list.count);
+  }
+}
+
+void svgSweepSheet(FILE* svg, const SweepSheet* sheet, const Palette* palette) {
+  char label[128];
+
+  for (i32 i = 0; i < sheet->count; i++) {
+    const SweepTile* tile = sheet->tiles + i;
+    fprintf(svg, "<g transform=\"translate(%f %f)\">\n", tile->origin.x, tile->origin.y);
+    svgDisplayList(svg, &tile->list, palette);
+    fprintf(svg, "</g>\n");
+
+    sweepLabel(label, sizeof(label), tile->params);
+    fprintf(svg, "<text x=\"%f\" y=\"%f\" font-family=\"sans-serif\" font-size=\"%f\">%s</text>\n",
+        tile->origin.x, tile->origin.y + sheet->image_height + sheet->reach + sheet->caption * 0.75f,
+        sheet->caption * 0.6f, label);
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "imagine.h"
+#include "halftone.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest number of the values of every swept parameter
+#define SWEEP_MAX_VALUES 16
+
+// SweepParams lists the values of every parameter, the sheet has a tile for
+// every combination of them.
+typedef struct {
+  i32 steps[SWEEP_MAX_VALUES];
+  i32 step_count;
+  // Radius as the part of the step
+  f32 radii[SWEEP_MAX_VALUES];
+  i32 radius_count;
+  Figure figures[_FIGURE_MAX];
+  i32 figure_count;
+  bool shifts[2];
+  i32 shift_count;
+  bool bws[2];
+  i32 bw_count;
+} SweepParams;
+
+typedef struct {
+  RenderParams params;
+  DisplayList list;
+  // Top left corner of the image of the tile on the sheet
+  Vec2 origin;
+} SweepTile;
+
+// SweepSheet is the contact sheet of the combinations laid out in a grid,
+// coordinates of the sheet are the pixels of the image.
+typedef struct {
+  SweepTile* tiles;
+  i32 count;
+  i32 columns;
+  i32 rows;
+  i32 image_width;
+  i32 image_height;
+  // Space the figures of the tile may take around the image and the height
+  // of the caption under it
+  f32 reach;
+  f32 caption;
+  f32 width;
+  f32 height;
+} SweepSheet;
+
+// sweepSheetBuild samples every combination of the sweep into its tile. The
+// summed-area tables of the image are built once and shared, so every cell
+// of every combination is averaged in O(1). Combinations are spread over the
+// workers. Other fields of the base params are kept as is.
+bool sweepSheetBuild(SweepSheet* sheet, Bitmap bitmap, RenderParams base,
+    const SweepParams* sweep, Workers* workers);
+
+void sweepSheetFree(SweepSheet* sheet);
+
+// renderSweepSheet renders the figures of every tile in its place.
+void renderSweepSheet(Renderer render, const SweepSheet* sheet);
+
+// svgSweepSheet writes every tile as a group with the caption of its
+// parameters.
+void svgSweepSheet(FILE* svg, const SweepSheet* sheet, const Palette* palette);
+
+// sweepLabel writes the parameters of the tile to the buffer.
+void sweepLabel(char* buffer, usize size, RenderParams params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SWEEP_H
@@ -0,0 +1,256 @@
+#include "trace.h"
+
+#ifdef TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_SIZE - 1)
+
+// TraceBuffer is a single producer ring of the events of one thread. Owner
+// writes the event and then publishes it by incrementing the head, readers
+// copy events and then check that the head has not lapped them.
+typedef struct TraceBuffer TraceBuffer;
+struct TraceBuffer {
+  TraceBuffer* next;
+  u32 tid;
+  char name[32];
+
+  // Total number of events ever written
+  u64 head;
+
+  // Open scopes, only touched by the owner
+  u32 depth;
+  const char* names[TRACE_MAX_DEPTH];
+  u64 starts[TRACE_MAX_DEPTH];
+
+  TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+// List of the buffers of all threads that ever traced anything. Buffers are
+// never freed so events of the finished threads still make it to the dump.
+local TraceBuffer* buffers = NULL;
+local u32 next_tid = 0;
+local u64 epoch = 0;
+
+local _Thread_local TraceBuffer* current = NULL;
+
+// Frames are traced by a single thread
+local u64 frame_times[TRACE_FRAME_HISTORY];
+local u64 frame_count = 0;
+local u64 frame_start = 0;
+local u64 frame_end   = 0;
+
+u64 traceNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return CAST(u64, ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+local TraceBuffer* traceBuffer(void) {
+  if (current != NULL) {
+    return current;
+  }
+
+  TraceBuffer* buffer = CAST(TraceBuffer*, calloc(1, sizeof(TraceBuffer)));
+  if (buffer == NULL) {
+    return NULL;
+  }
+  buffer->tid = __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+  snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->tid);
+
+  u64 zero = 0;
+  __atomic_compare_exchange_n(&epoch, &zero, traceNow(), 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+  TraceBuffer* head = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+  do {
+    buffer->next = head;
+  } while (!__atomic_compare_exchange_n(&buffers, &head, buffer, 1,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  current = buffer;
+  return buffer;
+}
+
+void traceBegin(const char* name) {
+  TraceBuffer* buffer = traceBuffer();
+  if (buffer == NULL) return;
+
+  // Scopes nested too deep are not recorded but still have to be balanced
+  if (buffer->depth < TRACE_MAX_DEPTH) {
+    buffer->names[buffer->depth]  = name;
+    buffer->starts[buffer->depth] = traceNow();
+  }
+  buffer->depth++;
+}
+
+void traceEnd(void) {
+  TraceBuffer* buffer = current;
+  if (buffer == NULL || buffer->depth == 0) return;
+
+  buffer->depth--;
+  if (buffer->depth >= TRACE_MAX_DEPTH) return;
+
+  u64 head = buffer->head;
+  TraceEvent* event = buffer->events + (head & TRACE_BUFFER_MASK);
+  __atomic_store_n(&event->name, buffer->names[buffer->depth], __ATOMIC_RELAXED);
+  __atomic_store_n(&event->start, buffer->starts[buffer->depth], __ATOMIC_RELAXED);
+  __atomic_store_n(&event->end, traceNow(), __ATOMIC_RELAXED);
+  __atomic_store_n(&event->depth, buffer->depth, __ATOMIC_RELAXED);
+  __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void traceThreadName(const char* name) {
+  TraceBuffer* buffer = traceBuffer();
+  if (buffer == NULL) return;
+  snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+void traceFrameBegin(void) {
+  traceBegin("frame");
+}
+
+void traceFrameEnd(void) {
+  TraceBuffer* buffer = current;
+  if (buffer == NULL || buffer->depth != 1) return;
+
+  u64 start = buffer->starts[0];
+  traceEnd();
+  u64 end = buffer->events[(buffer->head - 1) & TRACE_BUFFER_MASK].end;
+
+  frame_times[frame_count % TRACE_FRAME_HISTORY] = end - start;
+  frame_count++;
+  frame_start = start;
+  frame_end   = end;
+}
+
+i32 traceFrameTimes(u64* times, i32 capacity) {
+  u64 count = min_value(frame_count, min_value(CAST(u64, capacity), TRACE_FRAME_HISTORY));
+  for (u64 i = 0; i < count; i++) {
+    times[i] = frame_times[(frame_count - count + i) % TRACE_FRAME_HISTORY];
+  }
+  return CAST(i32, count);
+}
+
+// traceRead copies event at index, returns false if the event has already
+// been overwritten by the owner of the buffer. The slot of index + SIZE may
+// be in the middle of being written, so only SIZE - 1 events are readable.
+local bool traceRead(TraceBuffer* buffer, u64 index, TraceEvent* event) {
+  TraceEvent* source = buffer->events + (index & TRACE_BUFFER_MASK);
+  event->name  = __atomic_load_n(&source->name, __ATOMIC_RELAXED);
+  event->start = __atomic_load_n(&source->start, __ATOMIC_RELAXED);
+  event->end   = __atomic_load_n(&source->end, __ATOMIC_RELAXED);
+  event->depth = __atomic_load_n(&source->depth, __ATOMIC_RELAXED);
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  u64 head = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+  return head - index < TRACE_BUFFER_SIZE;
+}
+
+local i32 compareStages(const void* lhs, const void* rhs) {
+  const TraceStage* a = CAST(const TraceStage*, lhs);
+  const TraceStage* b = CAST(const TraceStage*, rhs);
+  return (a->start > b->start) - (a->start < b->start);
+}
+
+i32 traceStages(TraceStage* stages, i32 capacity) {
+  if (frame_count == 0) {
+    return 0;
+  }
+
+  i32 count = 0;
+  TraceBuffer* buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+  for (; buffer != NULL; buffer = buffer->next) {
+    u64 head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+
+    // Events are ordered by their end, walk back until the frame start
+    for (u64 index = head; index > 0; index--) {
+      TraceEvent event;
+      if (!traceRead(buffer, index - 1, &event)) break;
+      if (event.end < frame_start) break;
+      if (event.start < frame_start || event.end > frame_end) continue;
+      if (strcmp(event.name, "frame") == 0) continue;
+
+      i32 i = 0;
+      while (i < count && strcmp(stages[i].name, event.name) != 0) i++;
+      if (i == count) {
+        if (count == capacity) continue;
+        stages[count++] = (TraceStage){
+          .name  = event.name,
+          .depth = event.depth,
+          .start = event.start,
+        };
+      }
+
+      stages[i].calls++;
+      stages[i].total += event.end - event.start;
+      stages[i].depth  = min_value(stages[i].depth, event.depth);
+      stages[i].start  = min_value(stages[i].start, event.start);
+    }
+  }
+
+  qsort(stages, count, sizeof(TraceStage), compareStages);
+  return count;
+}
+
+// traceString writes the string as the quoted JSON string
+local void traceString(FILE* file, const char* string) {
+  putc('"', file);
+  for (const u8* c = CAST(const u8*, string); *c != 0; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(file, "\\%c", *c);
+    } else if (*c < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    } else {
+      putc(*c, file);
+    }
+  }
+  putc('"', file);
+}
+
+bool traceDump(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  bool first = true;
+  TraceBuffer* buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+  for (; buffer != NULL; buffer = buffer->next) {
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+        "\"args\":{\"name\":", first ? "" : ",\n", buffer->tid);
+    traceString(file, buffer->name);
+    fprintf(file, "}}");
+    first = false;
+
+    u64 head  = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    u64 index = head >= TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE + 1 : 0;
+    for (; index < head; index++) {
+      TraceEvent event;
+      if (!traceRead(buffer, index, &event)) continue;
+
+      fprintf(file, ",\n{\"name\":");
+      traceString(file, event.name);
+      fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+          buffer->tid,
+          (event.start - epoch) / 1000.0, (event.end - event.start) / 1000.0);
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0 || !ok) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+#endif // TRACE
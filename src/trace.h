@@ -0,0 +1,115 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scoped timers of the hot paths. Every thread records finished scopes into
+// its own ring buffer, so recording never takes a lock and never allocates
+// after the first scope of the thread. Old events are overwritten.
+//
+// Tracing is compiled in only when TRACE is defined, otherwise the TRACE_*
+// macros expand to nothing.
+//
+//   TRACE_BEGIN("sample");
+//   ...
+//   TRACE_END();
+
+#ifdef TRACE
+
+// Number of events kept by every thread, must be a power of two
+#define TRACE_BUFFER_SIZE 16384
+// Maximum nesting of the scopes
+#define TRACE_MAX_DEPTH 32
+// Number of frame durations kept for the histogram
+#define TRACE_FRAME_HISTORY 256
+
+typedef struct {
+  // NOTE: must be a string literal or otherwise outlive the trace
+  const char* name;
+  u64 start;
+  u64 end;
+  u32 depth;
+} TraceEvent;
+
+// TraceStage is the time spent in all scopes with the same name
+typedef struct {
+  const char* name;
+  u32 depth;
+  u32 calls;
+  // Start of the first scope
+  u64 start;
+  u64 total;
+} TraceStage;
+
+// traceNow returns monotonic time in nanoseconds.
+u64 traceNow(void);
+
+void traceBegin(const char* name);
+void traceEnd(void);
+
+// traceThreadName names the calling thread in the exported trace.
+void traceThreadName(const char* name);
+
+// traceFrameBegin and traceFrameEnd enclose one frame of the window. Frame
+// is recorded as a scope and its duration goes to the histogram.
+void traceFrameBegin(void);
+void traceFrameEnd(void);
+
+// traceFrameTimes copies durations of the last frames in nanoseconds, oldest
+// first. Returns number of durations copied.
+i32 traceFrameTimes(u64* times, i32 capacity);
+
+// traceStages sums scopes of all threads recorded during the last finished
+// frame by name in order of their first appearance. Returns number of stages.
+i32 traceStages(TraceStage* stages, i32 capacity);
+
+// traceDump writes events of all threads to path as Chrome trace_event JSON
+// that can be opened in Perfetto or chrome://tracing.
+bool traceDump(const char* path);
+
+#define TRACE_BEGIN(name)   traceBegin(name)
+#define TRACE_END()         traceEnd()
+#define TRACE_THREAD(name)  traceThreadName(name)
+#define TRACE_FRAME_BEGIN() traceFrameBegin()
+#define TRACE_FRAME_END()   traceFrameEnd()
+
+#else
+
+#define TRACE_BEGIN(name)   ((void)0)
+#define TRACE_END()         ((void)0)
+#define TRACE_THREAD(name)  ((void)0)
+#define TRACE_FRAME_BEGIN() ((void)0)
+#define TRACE_FRAME_END()   ((void)0)
+
+#endif // TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
@@ -111,6 +111,28 @@ typedef double f64;
     #define cast_ptr(...)
 #endif
 
+#ifdef ARENA_STATS
+// Statistics of the dynamic array reallocations, collected under the same
+// switch as the arena statistics.
+typedef struct {
+  u64 reallocs;
+  // Upper bound of the bytes realloc had to move: size of the old block.
+  u64 bytes_copied;
+} DynamicArrayStats;
+
+// NOTE: defined in arena.c
+extern DynamicArrayStats da_stats;
+
+// Arrays grow on the worker threads too, the counters are relaxed atomics.
+#define da_stat_realloc(da, oldcap) do {                                  \
+  __atomic_add_fetch(&da_stats.reallocs, 1, __ATOMIC_RELAXED);            \
+  __atomic_add_fetch(&da_stats.bytes_copied,                              \
+      (u64)(oldcap) * sizeof(*(da)->arr), __ATOMIC_RELAXED);              \
+} while (0)
+#else
+#define da_stat_realloc(da, oldcap) ((void)0)
+#endif // ARENA_STATS
+
 #define da_define(name, T) typedef struct { \
   i32 len;                                  \
   i32 cap;                                  \
@@ -126,6 +148,7 @@ typedef double f64;
 // da_resize changes length of the dynamic array
 #define da_resize(da, newlen) do {                                                      \
   if ((da)->cap < (newlen)) {                                                           \
+    da_stat_realloc(da, (da)->cap);                                                     \
     (da)->cap = (newlen);                                                               \
     (da)->arr = cast_ptr((da)->arr)realloc((da)->arr, (da)->cap * sizeof(*(da)->arr));  \
   }                                                                                     \
@@ -136,6 +159,7 @@ typedef double f64;
 // NOTE: if new capacity is less then old capacity nothing will happen
 #define da_reserve(da, newcap) do {                                                     \
   if ((da)->cap < (newcap)) {                                                           \
+    da_stat_realloc(da, (da)->cap);                                                     \
     (da)->cap = (newcap);                                                               \
     (da)->arr = cast_ptr((da)->arr)realloc((da)->arr, (da)->cap * sizeof(*(da)->arr));  \
   }                                                                                     \
@@ -144,6 +168,7 @@ typedef double f64;
 // da_append ppends value to the dynamic array
 #define da_append(da, val) do {                                                         \
   if ((da)->len >= (da)->cap) {                                                         \
+    da_stat_realloc(da, (da)->cap);                                                     \
     (da)->cap = (da)->cap == 0 ? 256 : (da)->cap * 2;                                   \
     (da)->arr = cast_ptr((da)->arr)realloc((da)->arr, (da)->cap * sizeof(*(da)->arr));  \
   }                                                                                     \
@@ -0,0 +1,580 @@
+#include "video.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "raster.h"
+#include "trace.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Y4M
+////////////////////////////////////////////////////////////////////////////////
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_MAX_LINE 1024
+
+// y4mReadLine reads the line without the new line character, returns
+// length of the line or -1 at the end of the file.
+local i32 y4mReadLine(FILE* file, char* line, i32 size) {
+  i32 length = 0;
+  for (;;) {
+    i32 c = fgetc(file);
+    if (c == EOF) {
+      return length == 0 ? -1 : length;
+    }
+    if (c == EOL) {
+      break;
+    }
+    if (length < size - 1) {
+      line[length++] = CAST(char, c);
+    }
+  }
+  line[length] = '\0';
+  return length;
+}
+
+local usize y4mFrameSize(Y4mHeader* header) {
+  switch (header->chroma) {
+    case Y4M_420:
+      header->chroma_width  = (header->width + 1) / 2;
+      header->chroma_height = (header->height + 1) / 2;
+      break;
+    case Y4M_422:
+      header->chroma_width  = (header->width + 1) / 2;
+      header->chroma_height = header->height;
+      break;
+    case Y4M_444:
+      header->chroma_width  = header->width;
+      header->chroma_height = header->height;
+      break;
+    case Y4M_MONO:
+    default:
+      header->chroma_width  = 0;
+      header->chroma_height = 0;
+      break;
+  }
+
+  return CAST(usize, header->width) * header->height
+    + 2 * CAST(usize, header->chroma_width) * header->chroma_height;
+}
+
+bool y4mReadHeader(FILE* file, Y4mHeader* header) {
+  char line[Y4M_MAX_LINE];
+  if (y4mReadLine(file, line, sizeof(line)) < 0
+      || strncmp(line, Y4M_MAGIC " ", sizeof(Y4M_MAGIC)) != 0) {
+    fprintf(stderr, "Input is not a y4m stream\n");
+    return false;
+  }
+
+  *header = (Y4mHeader){
+    .fps_num = 25,
+    .fps_den = 1,
+    .chroma  = Y4M_420,
+  };
+
+  char* save = NULL;
+  for (char* tag = strtok_r(line + sizeof(Y4M_MAGIC), " ", &save);
+      tag != NULL; tag = strtok_r(NULL, " ", &save)) {
+    const char* value = tag + 1;
+    switch (tag[0]) {
+      case 'W':
+        header->width = atoi(value);
+        break;
+      case 'H':
+        header->height = atoi(value);
+        break;
+      case 'F':
+        if (sscanf(value, "%d:%d", &header->fps_num, &header->fps_den) != 2) {
+          fprintf(stderr, "Invalid y4m frame rate: %s\n", value);
+          return false;
+        }
+        break;
+      case 'C':
+        // Siting of the chroma samples is ignored
+        if (strcmp(value, "420") == 0 || strcmp(value, "420jpeg") == 0
+            || strcmp(value, "420paldv") == 0 || strcmp(value, "420mpeg2") == 0) {
+          header->chroma = Y4M_420;
+        } else if (strcmp(value, "422") == 0) {
+          header->chroma = Y4M_422;
+        } else if (strcmp(value, "444") == 0) {
+          header->chroma = Y4M_444;
+        } else if (strcmp(value, "mono") == 0) {
+          header->chroma = Y4M_MONO;
+        } else {
+          fprintf(stderr, "Unsupported y4m colorspace: %s\n", value);
+          return false;
+        }
+        break;
+      case 'X':
+        if (strcmp(value, "COLORRANGE=FULL") == 0) {
+          header->full_range = true;
+        }
+        break;
+      default:
+        // Interlacing and aspect ratio do not matter for the halftone
+        break;
+    }
+  }
+
+  if (header->width <= 0 || header->height <= 0 || header->fps_num <= 0 || header->fps_den <= 0) {
+    fprintf(stderr, "Invalid y4m header\n");
+    return false;
+  }
+
+  header->frame_size = y4mFrameSize(header);
+  return true;
+}
+
+i32 y4mReadFrame(FILE* file, const Y4mHeader* header, u8* frame) {
+  char line[Y4M_MAX_LINE];
+  if (y4mReadLine(file, line, sizeof(line)) < 0) {
+    return 0;
+  }
+  if (strncmp(line, "FRAME", 5) != 0) {
+    fprintf(stderr, "Invalid y4m frame header\n");
+    return -1;
+  }
+
+  if (fread(frame, 1, header->frame_size, file) != header->frame_size) {
+    fprintf(stderr, "Truncated y4m frame\n");
+    return -1;
+  }
+  return 1;
+}
+
+Y4mHeader y4mHeader420(i32 width, i32 height, i32 fps_num, i32 fps_den) {
+  Y4mHeader header = {
+    .width   = width,
+    .height  = height,
+    .fps_num = fps_num,
+    .fps_den = fps_den,
+    .chroma  = Y4M_420,
+  };
+  header.frame_size = y4mFrameSize(&header);
+  return header;
+}
+
+void y4mWriteHeader(FILE* file, const Y4mHeader* header) {
+  fprintf(file, Y4M_MAGIC " W%d H%d F%d:%d Ip A1:1 C420jpeg\n",
+      header->width, header->height, header->fps_num, header->fps_den);
+}
+
+bool y4mWriteFrame(FILE* file, const Y4mHeader* header, const u8* pixels, u8* planes) {
+  i32 width  = header->width;
+  i32 height = header->height;
+  i32 cw     = header->chroma_width;
+  i32 ch     = header->chroma_height;
+
+  u8* luma = planes;
+  u8* cb   = luma + CAST(usize, width) * height;
+  u8* cr   = cb + CAST(usize, cw) * ch;
+
+  // Integer approximation of the limited range BT.601
+  for (i32 y = 0; y < height; y++) {
+    const u8* pixel = pixels + CAST(usize, y) * width * 4;
+    u8* out = luma + CAST(usize, y) * width;
+    for (i32 x = 0; x < width; x++, pixel += 4) {
+      out[x] = CAST(u8, ((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128) >> 8) + 16);
+    }
+  }
+
+  // Chroma is the average of the 2x2 block
+  for (i32 y = 0; y < ch; y++) {
+    i32 y0 = 2 * y;
+    i32 y1 = min_value(y0 + 1, height - 1);
+    for (i32 x = 0; x < cw; x++) {
+      i32 x0 = 2 * x;
+      i32 x1 = min_value(x0 + 1, width - 1);
+
+      const u8* p00 = pixels + (CAST(usize, y0) * width + x0) * 4;
+      const u8* p01 = pixels + (CAST(usize, y0) * width + x1) * 4;
+      const u8* p10 = pixels + (CAST(usize, y1) * width + x0) * 4;
+      const u8* p11 = pixels + (CAST(usize, y1) * width + x1) * 4;
+
+      i32 r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) / 4;
+      i32 g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) / 4;
+      i32 b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) / 4;
+
+      cb[y * cw + x] = CAST(u8, ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      cr[y * cw + x] = CAST(u8, ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+  }
+
+  fprintf(file, "FRAME\n");
+  return fwrite(planes, 1, header->frame_size, file) == header->frame_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SAMPLING
+////////////////////////////////////////////////////////////////////////////////
+
+local u8 clampColor(f32 value) {
+  return CAST(u8, min_value(max_value(value, 0.0f), 255.0f) + 0.5f);
+}
+
+// planeAverage returns average of the samples of the plane inside of the
+// rectangle, rectangle is clipped by the caller.
+local f32 planeAverage(const u8* plane, i32 stride, i32 x0, i32 y0, i32 x1, i32 y1) {
+  u64 sum = 0;
+  for (i32 y = y0; y < y1; y++) {
+    const u8* sample = plane + CAST(usize, y) * stride;
+    for (i32 x = x0; x < x1; x++) {
+      sum += sample[x];
+    }
+  }
+  return CAST(f32, sum) / ((x1 - x0) * (y1 - y0));
+}
+
+// sampleCell averages the planes of the cell and converts the average to
+// RGB. Conversion is linear, so it is the same as averaging converted pixels
+// without converting the whole frame.
+local Rgba sampleCell(const Y4mHeader* header, const u8* frame, Rect cell) {
+  i32 width  = header->width;
+  i32 height = header->height;
+
+  i32 x0 = cell.x;
+  i32 y0 = cell.y;
+  i32 x1 = min_value(CAST(i32, cell.x + cell.width), width);
+  i32 y1 = min_value(CAST(i32, cell.y + cell.height), height);
+
+  f32 luma = planeAverage(frame, width, x0, y0, x1, y1);
+  f32 cb   = 128.0f;
+  f32 cr   = 128.0f;
+
+  if (header->chroma != Y4M_MONO) {
+    i32 cw = header->chroma_width;
+    i32 ch = header->chroma_height;
+    i32 sx = cw < width ? 1 : 0;
+    i32 sy = ch < height ? 1 : 0;
+
+    const u8* cb_plane = frame + CAST(usize, width) * height;
+    const u8* cr_plane = cb_plane + CAST(usize, cw) * ch;
+
+    i32 cx0 = x0 >> sx;
+    i32 cy0 = y0 >> sy;
+    i32 cx1 = min_value((x1 + sx) >> sx, cw);
+    i32 cy1 = min_value((y1 + sy) >> sy, ch);
+
+    cb = planeAverage(cb_plane, cw, cx0, cy0, cx1, cy1);
+    cr = planeAverage(cr_plane, cw, cx0, cy0, cx1, cy1);
+  }
+
+  f32 y = luma;
+  f32 u = cb - 128.0f;
+  f32 v = cr - 128.0f;
+  if (!header->full_range) {
+    y = (luma - 16.0f) * (255.0f / 219.0f);
+    u = u * (255.0f / 224.0f);
+    v = v * (255.0f / 224.0f);
+  }
+
+  Rgba color = {
+    .r = clampColor(y + 1.402f * v),
+    .g = clampColor(y - 0.344136f * u - 0.714136f * v),
+    .b = clampColor(y + 1.772f * u),
+    .a = 255,
+  };
+  return color;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// STREAM
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  u8* planes;
+  // Average colors of the cells in the layout of renderImage
+  Rgba* cells;
+  u8* pixels;
+  // Frame that ends the stream, it carries no picture
+  bool end;
+} StreamFrame;
+
+// FrameQueue is a bounded queue of the frames between two stages.
+typedef struct {
+  StreamFrame* frames[STREAM_QUEUE_SIZE];
+  i32 head;
+  i32 count;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+  pthread_cond_t space;
+} FrameQueue;
+
+typedef struct {
+  FILE* input;
+  FILE* output;
+  StreamFormat format;
+  RenderParams params;
+  Workers* workers;
+
+  Y4mHeader header;
+  Y4mHeader out;
+  i32 columns;
+  i32 rows;
+  Raster* raster;
+
+  StreamFrame frames[STREAM_QUEUE_SIZE];
+  // Frames travel free -> read -> sampled -> drawn -> free
+  FrameQueue free;
+  FrameQueue read;
+  FrameQueue sampled;
+  FrameQueue drawn;
+
+  atomic_bool failed;
+} Stream;
+
+local void queueInit(FrameQueue* queue) {
+  *queue = (FrameQueue){ 0 };
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->ready, NULL);
+  pthread_cond_init(&queue->space, NULL);
+}
+
+local void queueDestroy(FrameQueue* queue) {
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_cond_destroy(&queue->ready);
+  pthread_cond_destroy(&queue->space);
+}
+
+local void queuePush(FrameQueue* queue, StreamFrame* frame) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == STREAM_QUEUE_SIZE) {
+    pthread_cond_wait(&queue->space, &queue->mutex);
+  }
+  queue->frames[(queue->head + queue->count) % STREAM_QUEUE_SIZE] = frame;
+  queue->count++;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+local StreamFrame* queuePop(FrameQueue* queue) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == 0) {
+    pthread_cond_wait(&queue->ready, &queue->mutex);
+  }
+  StreamFrame* frame = queue->frames[queue->head];
+  queue->head = (queue->head + 1) % STREAM_QUEUE_SIZE;
+  queue->count--;
+  pthread_cond_signal(&queue->space);
+  pthread_mutex_unlock(&queue->mutex);
+  return frame;
+}
+
+local Rect streamCell(const Stream* stream, i32 row, i32 column) {
+  i32 step = stream->params.step;
+  i32 y    = row * step;
+  i32 x0   = cellOffset(stream->params, y);
+  Rect cell = {
+    .x      = x0 + column * step,
+    .y      = y,
+    .width  = step,
+    .height = step,
+  };
+  return cell;
+}
+
+local void* streamRead(void* arg) {
+  Stream* stream = CAST(Stream*, arg);
+  TRACE_THREAD("read");
+
+  for (;;) {
+    StreamFrame* frame = queuePop(&stream->free);
+
+    i32 status = 0;
+    if (!atomic_load(&stream->failed)) {
+      TRACE_BEGIN("y4m_read");
+      status = y4mReadFrame(stream->input, &stream->header, frame->planes);
+      TRACE_END();
+    }
+    if (status < 0) {
+      atomic_store(&stream->failed, true);
+    }
+
+    // Frame may come back to the free queue as soon as it is pushed
+    bool end = status <= 0;
+    frame->end = end;
+    queuePush(&stream->read, frame);
+    if (end) break;
+  }
+  return NULL;
+}
+
+local void* streamSample(void* arg) {
+  Stream* stream = CAST(Stream*, arg);
+  TRACE_THREAD("sample");
+
+  for (;;) {
+    StreamFrame* frame = queuePop(&stream->read);
+    if (!frame->end) {
+      TRACE_BEGIN("sample");
+      for (i32 row = 0; row < stream->rows; row++) {
+        for (i32 column = 0; column < stream->columns; column++) {
+          Rect cell = streamCell(stream, row, column);
+          frame->cells[row * stream->columns + column] = cell.x < stream->header.width
+            ? sampleCell(&stream->header, frame->planes, cell)
+            : (Rgba){ 0 };
+        }
+      }
+      TRACE_END();
+    }
+
+    bool end = frame->end;
+    queuePush(&stream->sampled, frame);
+    if (end) break;
+  }
+  return NULL;
+}
+
+local void* streamDraw(void* arg) {
+  Stream* stream = CAST(Stream*, arg);
+  TRACE_THREAD("draw");
+
+  Renderer render = rasterRenderer(stream->raster);
+  i32 width  = stream->header.width;
+  i32 height = stream->header.height;
+
+  for (;;) {
+    StreamFrame* frame = queuePop(&stream->sampled);
+    if (!frame->end) {
+      TRACE_BEGIN("draw");
+      rasterClear(stream->raster);
+      for (i32 i = 0; i < stream->columns * stream->rows; i++) {
+        if (frame->cells[i].a != 0) {
+          renderCell(render, streamCell(stream, i / stream->columns, i % stream->columns),
+              frame->cells[i], stream->params);
+        }
+      }
+      for (i32 y = 0; y < height; y += RASTER_TILE_SIZE) {
+        rasterRenderBand(stream->raster, stream->workers, y,
+            frame->pixels + CAST(usize, y) * width * 4, width * 4);
+      }
+      TRACE_END();
+    }
+
+    bool end = frame->end;
+    queuePush(&stream->drawn, frame);
+    if (end) break;
+  }
+  return NULL;
+}
+
+// streamWrite runs on the calling thread. After an error it keeps draining
+// the frames so the other stages can finish.
+local void streamWrite(Stream* stream) {
+  u8* planes = NULL;
+  if (stream->format == STREAM_Y4M) {
+    planes = CAST(u8*, malloc(stream->out.frame_size));
+    if (planes == NULL) {
+      fprintf(stderr, "Out of memory for the planes of the frame\n");
+      atomic_store(&stream->failed, true);
+    } else {
+      y4mWriteHeader(stream->output, &stream->out);
+    }
+  }
+
+  usize rgba_size = CAST(usize, stream->header.width) * stream->header.height * 4;
+  for (;;) {
+    StreamFrame* frame = queuePop(&stream->drawn);
+    if (frame->end) break;
+
+    if (!atomic_load(&stream->failed)) {
+      TRACE_BEGIN("write");
+      bool ok = stream->format == STREAM_Y4M
+        ? y4mWriteFrame(stream->output, &stream->out, frame->pixels, planes)
+        : fwrite(frame->pixels, 1, rgba_size, stream->output) == rgba_size;
+      TRACE_END();
+      if (!ok) {
+        fprintf(stderr, "Failed to write the frame\n");
+        atomic_store(&stream->failed, true);
+      }
+    }
+
+    queuePush(&stream->free, frame);
+  }
+
+  free(planes);
+}
+
+local void streamFreeFrames(Stream* stream) {
+  for (i32 i = 0; i < STREAM_QUEUE_SIZE; i++) {
+    free(stream->frames[i].planes);
+    free(stream->frames[i].cells);
+    free(stream->frames[i].pixels);
+  }
+}
+
+bool streamVideo(FILE* input, FILE* output, StreamFormat format,
+    RenderParams params, Workers* workers) {
+  Stream stream = {
+    .input   = input,
+    .output  = output,
+    .format  = format,
+    .params  = params,
+    .workers = workers,
+  };
+  if (!y4mReadHeader(input, &stream.header)) {
+    return false;
+  }
+
+  i32 width  = stream.header.width;
+  i32 height = stream.header.height;
+  i32 step   = params.step;
+
+  stream.out     = y4mHeader420(width, height, stream.header.fps_num, stream.header.fps_den);
+  stream.columns = (width + step - 1) / step;
+  stream.rows    = (height + step - 1) / step;
+  stream.raster  = rasterCreate(width, height, 1.0f, (Rgba){ 255, 255, 255, 255 });
+  if (stream.raster == NULL) {
+    return false;
+  }
+
+  usize cells = CAST(usize, stream.columns) * stream.rows;
+  bool allocated = true;
+  for (i32 i = 0; i < STREAM_QUEUE_SIZE; i++) {
+    StreamFrame* frame = &stream.frames[i];
+    frame->planes = CAST(u8*, malloc(stream.header.frame_size));
+    frame->cells  = CAST(Rgba*, malloc(cells * sizeof(Rgba)));
+    frame->pixels = CAST(u8*, malloc(CAST(usize, width) * height * 4));
+    if (frame->planes == NULL || frame->cells == NULL || frame->pixels == NULL) {
+      allocated = false;
+    }
+  }
+  if (!allocated) {
+    fprintf(stderr, "Out of memory for %d frames of %dx%d\n", STREAM_QUEUE_SIZE, width, height);
+    streamFreeFrames(&stream);
+    rasterDestroy(stream.raster);
+    return false;
+  }
+
+  queueInit(&stream.free);
+  queueInit(&stream.read);
+  queueInit(&stream.sampled);
+  queueInit(&stream.drawn);
+  for (i32 i = 0; i < STREAM_QUEUE_SIZE; i++) {
+    queuePush(&stream.free, &stream.frames[i]);
+  }
+
+  pthread_t read, sample, draw;
+  pthread_create(&read, NULL, streamRead, &stream);
+  pthread_create(&sample, NULL, streamSample, &stream);
+  pthread_create(&draw, NULL, streamDraw, &stream);
+
+  streamWrite(&stream);
+
+  pthread_join(read, NULL);
+  pthread_join(sample, NULL);
+  pthread_join(draw, NULL);
+
+  streamFreeFrames(&stream);
+  queueDestroy(&stream.free);
+  queueDestroy(&stream.read);
+  queueDestroy(&stream.sampled);
+  queueDestroy(&stream.drawn);
+  rasterDestroy(stream.raster);
+
+  fflush(output);
+  return !atomic_load(&stream.failed) && !ferror(output);
+}
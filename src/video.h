@@ -0,0 +1,106 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "halftone.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// Y4M
+////////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  Y4M_420  = 0,
+  Y4M_422  = 1,
+  Y4M_444  = 2,
+  Y4M_MONO = 3,
+} Y4mChroma;
+
+// Y4mHeader describes the frames of the YUV4MPEG2 stream. Planes of the
+// frame follow each other: luma, then blue and red difference.
+typedef struct {
+  i32 width;
+  i32 height;
+  i32 fps_num;
+  i32 fps_den;
+  Y4mChroma chroma;
+  // XCOLORRANGE=FULL, otherwise luma is in [16, 235]
+  bool full_range;
+
+  // Size of the chroma planes, zero for the monochrome streams
+  i32 chroma_width;
+  i32 chroma_height;
+  usize frame_size;
+} Y4mHeader;
+
+// y4mReadHeader parses the stream header, only 8 bit progressive streams
+// are supported.
+bool y4mReadHeader(FILE* file, Y4mHeader* header);
+
+// y4mReadFrame reads planes of the next frame, frame must have room for
+// frame_size bytes. Returns 1 on success, 0 at the end of the stream and -1
+// on error.
+i32 y4mReadFrame(FILE* file, const Y4mHeader* header, u8* frame);
+
+// y4mHeader420 returns header of the 4:2:0 limited range stream.
+Y4mHeader y4mHeader420(i32 width, i32 height, i32 fps_num, i32 fps_den);
+
+void y4mWriteHeader(FILE* file, const Y4mHeader* header);
+
+// y4mWriteFrame converts RGBA pixels to BT.601 and writes them as the next
+// frame, planes must have room for frame_size bytes. Only 4:2:0 streams
+// are written.
+bool y4mWriteFrame(FILE* file, const Y4mHeader* header, const u8* pixels, u8* planes);
+
+////////////////////////////////////////////////////////////////////////////////
+/// STREAM
+////////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  STREAM_Y4M  = 0,
+  STREAM_RGBA = 1,
+} StreamFormat;
+
+// Number of the frames in flight between the stages of the stream
+#define STREAM_QUEUE_SIZE 4
+
+// streamVideo halftones every frame of the y4m input and writes the frames
+// to the output. Reading, sampling of the cells, rasterization and writing
+// run on their own threads connected by bounded queues, so a slow stage
+// stalls the ones before it instead of piling frames up. Rasterization
+// spreads bands of the frame over the workers.
+bool streamVideo(FILE* input, FILE* output, StreamFormat format,
+    RenderParams params, Workers* workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIDEO_H
@@ -0,0 +1,133 @@
+#include "watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+// Room for at least a few dozens of events with the longest names
+#define WATCH_BUFFER (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+da_define(WatchNames, char*);
+
+struct Watch {
+  i32 fd;
+  // Files that were in the directory before the watch started
+  WatchNames existing;
+  i32 next;
+  // Events read from the descriptor but not returned yet
+  _Alignas(struct inotify_event) char buffer[WATCH_BUFFER];
+  i32 length;
+  i32 offset;
+};
+
+Watch* watchOpen(const char* path) {
+  Watch* watch = CAST(Watch*, calloc(1, sizeof(Watch)));
+
+  // Files are reported once they are closed after writing, or once they are
+  // renamed into the directory complete
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch->fd < 0 || inotify_add_watch(watch->fd, path, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    fprintf(stderr, "Failed to watch %s: %s\n", path, strerror(errno));
+    watchClose(watch);
+    return NULL;
+  }
+
+  // Listed after the watch is added, so the files written in between are
+  // reported at least once
+  DIR* dir = opendir(path);
+  if (dir == NULL) {
+    fprintf(stderr, "Failed to list %s: %s\n", path, strerror(errno));
+    watchClose(watch);
+    return NULL;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) {
+      da_append(&watch->existing, strdup(entry->d_name));
+    }
+  }
+  closedir(dir);
+
+  return watch;
+}
+
+void watchClose(Watch* watch) {
+  if (watch == NULL) {
+    return;
+  }
+  if (watch->fd >= 0) {
+    close(watch->fd);
+  }
+  for (i32 i = 0; i < watch->existing.len; i++) {
+    free(watch->existing.arr[i]);
+  }
+  da_free(&watch->existing);
+  free(watch);
+}
+
+const char* watchNext(Watch* watch, bool wait) {
+  if (watch->next < watch->existing.len) {
+    return watch->existing.arr[watch->next++];
+  }
+
+  for (;;) {
+    while (watch->offset < watch->length) {
+      const struct inotify_event* event =
+        CAST(const struct inotify_event*, watch->buffer + watch->offset);
+      watch->offset += sizeof(struct inotify_event) + event->len;
+      if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+        return event->name;
+      }
+    }
+
+    ssize_t length = read(watch->fd, watch->buffer, sizeof(watch->buffer));
+    if (length < 0 && errno == EAGAIN && wait) {
+      struct pollfd pfd = { .fd = watch->fd, .events = POLLIN };
+      if (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+          fprintf(stderr, "Failed to wait for the files: %s\n", strerror(errno));
+        }
+        return NULL;
+      }
+      continue;
+    }
+    if (length <= 0) {
+      if (length < 0 && errno != EAGAIN && errno != EINTR) {
+        fprintf(stderr, "Failed to read the events: %s\n", strerror(errno));
+      }
+      return NULL;
+    }
+
+    watch->length = length;
+    watch->offset = 0;
+  }
+}
+
+#else // __linux__
+
+struct Watch {
+  i32 unused;
+};
+
+Watch* watchOpen(const char* path) {
+  fprintf(stderr, "Failed to watch %s: supported on Linux only\n", path);
+  return NULL;
+}
+
+void watchClose(Watch* UNUSED(watch)) {
+}
+
+const char* watchNext(Watch* UNUSED(watch), bool UNUSED(wait)) {
+  return NULL;
+}
+
+#endif // __linux__
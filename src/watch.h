@@ -0,0 +1,50 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Watch reports the files that are written to the directory or moved into
+// it. Only Linux is supported, elsewhere watchOpen fails.
+FWD_STRUCT(Watch);
+
+// watchOpen starts watching the directory, files that are already there are
+// reported first. Returns NULL and prints the reason on failure.
+Watch* watchOpen(const char* path);
+void watchClose(Watch* watch);
+
+// watchNext returns name of the next file, valid until the next call. With
+// wait it blocks until a file arrives, otherwise it returns NULL right away
+// if there is none. NULL after waiting means the wait was interrupted by a
+// signal or failed.
+const char* watchNext(Watch* watch, bool wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WATCH_H
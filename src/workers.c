@@ -0,0 +1,223 @@
+#include "workers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+// Per thread state is padded to the cache line so the hot fields of the
+// neighbouring workers do not share it.
+typedef struct {
+  _Alignas(64) Arena arena;
+  Workers* workers;
+  pthread_t thread;
+} Worker;
+
+struct Workers {
+  RegionPool pool;
+
+  i32 count;
+  Worker* workers;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+
+  // Current loop, guarded by the mutex except for the next index
+  WorkFn* fn;
+  void* ctx;
+  i32 total;
+  atomic_int next;
+  // Incremented for every loop, workers wait for it to change
+  u64 generation;
+  // Number of threads that have not finished current loop yet
+  i32 active;
+  bool quit;
+};
+
+local _Thread_local Arena* current_arena = NULL;
+local _Thread_local i32 current_index = -1;
+
+// runLoop executes indices of the current loop until none are left. Thread
+// state is restored afterwards, the thread may be the worker of another pool.
+local void runLoop(Workers* workers, Worker* worker) {
+  Arena* arena  = current_arena;
+  i32 index     = current_index;
+  current_arena = &worker->arena;
+  current_index = worker - workers->workers;
+
+  WorkFn* fn = workers->fn;
+  void* ctx  = workers->ctx;
+  i32 total  = workers->total;
+
+  TRACE_BEGIN("workers");
+  for (;;) {
+    i32 next = atomic_fetch_add_explicit(&workers->next, 1, memory_order_relaxed);
+    if (next >= total) break;
+    fn(ctx, next, &worker->arena);
+  }
+  TRACE_END();
+
+  current_arena = arena;
+  current_index = index;
+}
+
+local void* workerMain(void* arg) {
+  Worker* worker   = CAST(Worker*, arg);
+  Workers* workers = worker->workers;
+  u64 seen         = 0;
+
+  TRACE_THREAD("worker");
+
+  pthread_mutex_lock(&workers->mutex);
+  for (;;) {
+    while (!workers->quit && workers->generation == seen) {
+      pthread_cond_wait(&workers->wake, &workers->mutex);
+    }
+    if (workers->quit) break;
+    seen = workers->generation;
+    pthread_mutex_unlock(&workers->mutex);
+
+    runLoop(workers, worker);
+
+    pthread_mutex_lock(&workers->mutex);
+    if (--workers->active == 0) {
+      pthread_cond_signal(&workers->done);
+    }
+  }
+  pthread_mutex_unlock(&workers->mutex);
+
+  return NULL;
+}
+
+Workers* workersCreate(i32 count) {
+  if (count < 1) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    count = cpus < 1 ? 1 : CAST(i32, cpus);
+  }
+
+  Workers* workers = CAST(Workers*, calloc(1, sizeof(Workers)));
+  workers->count   = count;
+  workers->workers = CAST(Worker*, aligned_alloc(_Alignof(Worker), sizeof(Worker) * count));
+  memset(workers->workers, 0, sizeof(Worker) * count);
+
+  pthread_mutex_init(&workers->mutex, NULL);
+  pthread_cond_init(&workers->wake, NULL);
+  pthread_cond_init(&workers->done, NULL);
+  atomic_init(&workers->next, 0);
+
+  for (i32 i = 0; i < count; i++) {
+    Worker* worker     = workers->workers + i;
+    worker->workers    = workers;
+    worker->arena.pool = &workers->pool;
+  }
+
+  // Worker with index 0 is the thread calling workersRun. Pool shrinks to
+  // the threads that could be started, down to the caller alone.
+  for (i32 i = 1; i < count; i++) {
+    i32 error = pthread_create(&workers->workers[i].thread, NULL, workerMain, workers->workers + i);
+    if (error != 0) {
+      fprintf(stderr, "Failed to start worker %d of %d: %s\n", i, count, strerror(error));
+      workers->count = i;
+      break;
+    }
+  }
+
+  return workers;
+}
+
+void workersDestroy(Workers* workers) {
+  if (workers == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&workers->mutex);
+  workers->quit = true;
+  pthread_cond_broadcast(&workers->wake);
+  pthread_mutex_unlock(&workers->mutex);
+
+  for (i32 i = 1; i < workers->count; i++) {
+    pthread_join(workers->workers[i].thread, NULL);
+  }
+
+  for (i32 i = 0; i < workers->count; i++) {
+    arena_free(&workers->workers[i].arena);
+  }
+  region_pool_free(&workers->pool);
+
+  pthread_cond_destroy(&workers->done);
+  pthread_cond_destroy(&workers->wake);
+  pthread_mutex_destroy(&workers->mutex);
+
+  free(workers->workers);
+  free(workers);
+}
+
+i32 workersCount(Workers* workers) {
+  return workers->count;
+}
+
+void workersRun(Workers* workers, i32 count, WorkFn* fn, void* ctx) {
+  if (count <= 0) {
+    return;
+  }
+
+  // Not worth waking anybody up
+  if (count == 1 || workers->count == 1) {
+    Arena* arena  = current_arena;
+    i32 index     = current_index;
+    current_arena = &workers->workers[0].arena;
+    current_index = 0;
+    for (i32 i = 0; i < count; i++) {
+      fn(ctx, i, current_arena);
+    }
+    current_arena = arena;
+    current_index = index;
+    return;
+  }
+
+  pthread_mutex_lock(&workers->mutex);
+  workers->fn     = fn;
+  workers->ctx    = ctx;
+  workers->total  = count;
+  workers->active = workers->count - 1;
+  atomic_store_explicit(&workers->next, 0, memory_order_relaxed);
+  workers->generation++;
+  pthread_cond_broadcast(&workers->wake);
+  pthread_mutex_unlock(&workers->mutex);
+
+  runLoop(workers, workers->workers);
+
+  pthread_mutex_lock(&workers->mutex);
+  while (workers->active > 0) {
+    pthread_cond_wait(&workers->done, &workers->mutex);
+  }
+  pthread_mutex_unlock(&workers->mutex);
+}
+
+void workersReset(Workers* workers) {
+  for (i32 i = 0; i < workers->count; i++) {
+    arena_release(&workers->workers[i].arena, &workers->pool);
+  }
+}
+
+Arena* workerArena(void) {
+  return current_arena;
+}
+
+i32 workerIndex(void) {
+  return current_index;
+}
+
+#ifdef ARENA_STATS
+ArenaStats workersStats(Workers* workers) {
+  ArenaStats stats = { 0 };
+  for (i32 i = 0; i < workers->count; i++) {
+    arena_stats_merge(&stats, arena_stats(&workers->workers[i].arena));
+  }
+  return stats;
+}
+#endif // ARENA_STATS
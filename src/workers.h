@@ -0,0 +1,75 @@
+// Copyright 2024, Geogii Chernukhin <nk2ge5k@gmail.com>
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "types.h"
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Workers is a fixed pool of threads that execute parallel loops. Every
+// thread, including the one that calls workersRun, owns a scratch arena that
+// takes its regions from the pool shared by all of the workers.
+FWD_STRUCT(Workers);
+
+// WorkFn is called once for every index of the loop. Scratch is the arena of
+// the thread the function runs on, it is never shared with other threads.
+typedef void WorkFn(void* ctx, i32 index, Arena* scratch);
+
+// workersCreate starts count - 1 threads, the caller of workersRun is the
+// last one. If count is less than one number of online CPUs is used.
+Workers* workersCreate(i32 count);
+void workersDestroy(Workers* workers);
+
+// workersCount returns number of threads executing the loop.
+i32 workersCount(Workers* workers);
+
+// workersRun calls fn for every index in [0, count) spreading calls between
+// the threads and returns when all of them are done.
+// NOTE: must not be called from inside of the WorkFn of the same pool.
+void workersRun(Workers* workers, i32 count, WorkFn* fn, void* ctx);
+
+// workersReset returns regions of all scratch arenas to the shared pool.
+// Meant to be called at job boundaries, when no loop is running.
+void workersReset(Workers* workers);
+
+// workerArena returns scratch arena of the current worker thread or NULL if
+// the caller is not executing a WorkFn.
+Arena* workerArena(void);
+
+// workerIndex returns index of the current worker thread in [0, count) or -1
+// if the caller is not executing a WorkFn.
+i32 workerIndex(void);
+
+#ifdef ARENA_STATS
+// workersStats returns statistics of all scratch arenas combined.
+ArenaStats workersStats(Workers* workers);
+#endif // ARENA_STATS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WORKERS_H